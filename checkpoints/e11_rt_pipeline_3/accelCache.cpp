@@ -0,0 +1,178 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+#include "accelCache.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#include "bufferUtils.h"
+#include "mappedFile.h"
+
+namespace {
+
+const char   k_accelCacheMagic[8] = "VKMPTAC";
+const size_t k_blobAlignment      = 16;
+
+uint64_t getPrimitiveCount(const AccelManager::BlasInput& input)
+{
+  uint64_t count = 0;
+  for(const VkAccelerationStructureBuildRangeInfoKHR& range : input.asBuildOffsetInfo)
+  {
+    count += range.primitiveCount;
+  }
+  return count;
+}
+
+}  // namespace
+
+uint64_t hashBytes(std::span<const uint8_t> data, uint64_t hash)
+{
+  // Mix in 8 bytes at a time, then the rest, so that hashing large scenes
+  // stays cheap compared to building their BLASes.
+  size_t i = 0;
+  for(; i + sizeof(uint64_t) <= data.size(); i += sizeof(uint64_t))
+  {
+    uint64_t word;
+    memcpy(&word, data.data() + i, sizeof(word));
+    hash = (hash ^ word) * 0x9E3779B97F4A7C15ull;
+    hash ^= hash >> 29;
+  }
+  for(; i < data.size(); i++)
+  {
+    hash = (hash ^ data[i]) * 0x9E3779B97F4A7C15ull;
+  }
+  // Final mix (from MurmurHash3's fmix64), so that every bit depends on all inputs:
+  hash ^= hash >> 33;
+  hash *= 0xFF51AFD7ED558CCDull;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+AccelCacheKey makeAccelCacheKey(VkPhysicalDevice physicalDevice, VkBuildAccelerationStructureFlagsKHR buildFlags, uint64_t geometryHash)
+{
+  VkPhysicalDeviceIDProperties idProperties{.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES};
+  VkPhysicalDeviceProperties2  properties{.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2, .pNext = &idProperties};
+  vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+
+  AccelCacheKey key{};
+  memcpy(key.deviceUUID, idProperties.deviceUUID, VK_UUID_SIZE);
+  key.vendorID      = properties.properties.vendorID;
+  key.deviceID      = properties.properties.deviceID;
+  key.driverVersion = properties.properties.driverVersion;
+  key.buildFlags    = buildFlags;
+  key.geometryHash  = geometryHash;
+  return key;
+}
+
+std::string getAccelCachePath(const std::string& scenePath)
+{
+  return scenePath + ".vkmptaccel";
+}
+
+bool readAccelCache(VkDevice                                 device,
+                    const std::string&                       cachePath,
+                    const AccelCacheKey&                     key,
+                    std::span<const AccelManager::BlasInput> inputs,
+                    AccelManager&                            accelManager)
+{
+  MappedFile mapping;
+  if(!mapping.open(cachePath) || mapping.size() < sizeof(AccelCacheHeader))
+  {
+    return false;
+  }
+
+  AccelCacheHeader header;
+  memcpy(&header, mapping.data(), sizeof(header));
+  if(memcmp(header.magic, k_accelCacheMagic, sizeof(header.magic)) != 0  //
+     || header.version != ACCEL_CACHE_VERSION || header.headerSize != sizeof(AccelCacheHeader)
+     || memcmp(&header.key, &key, sizeof(AccelCacheKey)) != 0 || header.numBlas != inputs.size()
+     || sizeof(AccelCacheHeader) + header.numBlas * sizeof(AccelCacheEntry) > mapping.size())
+  {
+    return false;
+  }
+
+  std::vector<AccelCacheEntry> entries(header.numBlas);
+  memcpy(entries.data(), mapping.data() + sizeof(AccelCacheHeader), entries.size() * sizeof(AccelCacheEntry));
+  std::vector<std::span<const uint8_t>> blobs(entries.size());
+  for(size_t blasIdx = 0; blasIdx < entries.size(); blasIdx++)
+  {
+    const AccelCacheEntry& entry = entries[blasIdx];
+    if(entry.offset > mapping.size() || entry.size > mapping.size() - entry.offset  //
+       || entry.size < 2 * VK_UUID_SIZE || entry.primitiveCount != getPrimitiveCount(inputs[blasIdx]))
+    {
+      return false;
+    }
+    blobs[blasIdx] = {mapping.data() + entry.offset, entry.size};
+
+    // The key should catch driver changes, but the driver has the last word:
+    VkAccelerationStructureVersionInfoKHR versionInfo{.sType        = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_VERSION_INFO_KHR,
+                                                      .pVersionData = blobs[blasIdx].data()};
+    VkAccelerationStructureCompatibilityKHR compatibility = VK_ACCELERATION_STRUCTURE_COMPATIBILITY_INCOMPATIBLE_KHR;
+    vkGetDeviceAccelerationStructureCompatibilityKHR(device, &versionInfo, &compatibility);
+    if(compatibility != VK_ACCELERATION_STRUCTURE_COMPATIBILITY_COMPATIBLE_KHR)
+    {
+      return false;
+    }
+  }
+  return accelManager.deserializeBlas(inputs, blobs);
+}
+
+bool writeAccelCache(const std::string&                       cachePath,
+                     const AccelCacheKey&                     key,
+                     std::span<const AccelManager::BlasInput> inputs,
+                     AccelManager&                            accelManager)
+{
+  std::vector<std::vector<uint8_t>> blobs;
+  if(!accelManager.serializeBlas(blobs) || blobs.size() != inputs.size())
+  {
+    return false;
+  }
+
+  AccelCacheHeader header{};
+  memcpy(header.magic, k_accelCacheMagic, sizeof(header.magic));
+  header.version    = ACCEL_CACHE_VERSION;
+  header.headerSize = sizeof(AccelCacheHeader);
+  header.key        = key;
+  header.numBlas    = blobs.size();
+  std::vector<AccelCacheEntry> entries(blobs.size());
+  uint64_t                     offset = alignUp(sizeof(AccelCacheHeader) + entries.size() * sizeof(AccelCacheEntry), k_blobAlignment);
+  for(size_t blasIdx = 0; blasIdx < blobs.size(); blasIdx++)
+  {
+    entries[blasIdx] = {.offset = offset, .size = blobs[blasIdx].size(), .primitiveCount = getPrimitiveCount(inputs[blasIdx])};
+    offset           = alignUp(offset + blobs[blasIdx].size(), k_blobAlignment);
+  }
+
+  // Write to a temporary file first, so that an interrupted run never leaves
+  // a truncated cache behind:
+  const std::string tempPath = cachePath + ".tmp";
+  {
+    std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+    if(!file)
+    {
+      return false;
+    }
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(entries.data()), static_cast<std::streamsize>(entries.size() * sizeof(AccelCacheEntry)));
+    for(size_t blasIdx = 0; blasIdx < blobs.size(); blasIdx++)
+    {
+      static const char zeros[k_blobAlignment] = {};
+      file.write(zeros, static_cast<std::streamsize>(entries[blasIdx].offset - static_cast<uint64_t>(file.tellp())));
+      file.write(reinterpret_cast<const char*>(blobs[blasIdx].data()), static_cast<std::streamsize>(blobs[blasIdx].size()));
+    }
+    if(!file)
+    {
+      return false;
+    }
+  }
+
+  std::error_code ec;
+  std::filesystem::rename(tempPath, cachePath, ec);
+  if(ec)
+  {
+    std::filesystem::remove(tempPath, ec);
+    return false;
+  }
+  return true;
+}
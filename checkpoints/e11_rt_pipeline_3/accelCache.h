@@ -0,0 +1,88 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+// An on-disk cache of a scene's BLASes. Building BLASes for large static
+// scenes can take seconds of GPU time before the first sample; the first run
+// serializes them (vkCmdCopyAccelerationStructureToMemoryKHR) into a file next
+// to the scene, and later runs deserialize them
+// (vkCmdCopyMemoryToAccelerationStructureKHR) instead of building them.
+//
+// Serialized acceleration structures only work on compatible devices and
+// drivers, so the cache is keyed by the device's UUID, vendor, ID and driver
+// version, the build flags, and a hash of the geometry; each BLAS is also
+// checked with vkGetDeviceAccelerationStructureCompatibilityKHR before use.
+// A cache written by another device, driver or scene is rebuilt and replaced.
+//
+// The TLAS isn't cached: a serialized TLAS refers to BLASes by address, which
+// changes between runs, and building it is cheap compared to the BLASes.
+//
+// File layout (little-endian):
+//   AccelCacheHeader
+//   AccelCacheEntry entries[numBlas]
+//   serialized BLASes, at the offsets given by their entries
+#ifndef VK_MINI_PATH_TRACER_ACCEL_CACHE_H
+#define VK_MINI_PATH_TRACER_ACCEL_CACHE_H
+
+#include <cstdint>
+#include <span>
+#include <string>
+
+#include "accelManager.h"
+
+// Increment this whenever the layout of the cache file changes.
+static const uint32_t ACCEL_CACHE_VERSION = 1;
+
+// What the cached BLASes depend on.
+struct AccelCacheKey
+{
+  uint8_t  deviceUUID[VK_UUID_SIZE];  // VkPhysicalDeviceIDProperties::deviceUUID
+  uint32_t vendorID;
+  uint32_t deviceID;
+  uint32_t driverVersion;
+  uint32_t buildFlags;    // VkBuildAccelerationStructureFlagsKHR the BLASes were built with
+  uint64_t geometryHash;  // See hashBytes()
+};
+
+struct AccelCacheHeader
+{
+  char          magic[8];    // "VKMPTAC" followed by a null terminator
+  uint32_t      version;     // ACCEL_CACHE_VERSION
+  uint32_t      headerSize;  // sizeof(AccelCacheHeader)
+  AccelCacheKey key;
+  uint64_t      numBlas;
+};
+
+struct AccelCacheEntry
+{
+  uint64_t offset;          // Byte offset of the serialized BLAS from the start of the file
+  uint64_t size;            // Size of the serialized BLAS
+  uint64_t primitiveCount;  // Triangles in the BLAS, to catch caches of different geometry
+};
+
+// A fast, non-cryptographic 64-bit hash of `data`, continuing from `hash`.
+uint64_t hashBytes(std::span<const uint8_t> data, uint64_t hash = 0);
+
+// Returns the key for BLASes built on `physicalDevice` with `buildFlags` from
+// geometry with the given hash.
+AccelCacheKey makeAccelCacheKey(VkPhysicalDevice physicalDevice, VkBuildAccelerationStructureFlagsKHR buildFlags, uint64_t geometryHash);
+
+// Returns the path of the cache file used for the given scene file.
+std::string getAccelCachePath(const std::string& scenePath);
+
+// Loads the BLASes for `inputs` from `cachePath` into `accelManager`. Returns
+// false if the cache doesn't exist, has a different key or version, doesn't
+// match `inputs`, or isn't compatible with `device`.
+bool readAccelCache(VkDevice                                 device,
+                    const std::string&                       cachePath,
+                    const AccelCacheKey&                     key,
+                    std::span<const AccelManager::BlasInput> inputs,
+                    AccelManager&                            accelManager);
+
+// Serializes the BLASes of `accelManager`, built from `inputs`, to
+// `cachePath`. Returns false if the file could not be written.
+bool writeAccelCache(const std::string&                       cachePath,
+                     const AccelCacheKey&                     key,
+                     std::span<const AccelManager::BlasInput> inputs,
+                     AccelManager&                            accelManager);
+
+#endif  // #ifndef VK_MINI_PATH_TRACER_ACCEL_CACHE_H
@@ -0,0 +1,1233 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+#include "accelManager.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <mutex>
+#include <numeric>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+
+#include <nvh/nvprint.hpp>
+#include <nvvk/error_vk.hpp>
+
+#include "bufferUtils.h"
+#include "measurement.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Serialized acceleration structures must start at multiples of 256 bytes.
+const VkDeviceSize k_serializedAlignment = 256;
+
+// Makes acceleration structure writes (from builds and copies) visible to
+// later builds, copies, and queries on the queue. Since builds share one
+// scratch buffer, this also keeps each build from overwriting the scratch
+// memory of the previous one.
+void accelBarrier(VkCommandBuffer cmdBuffer)
+{
+  VkMemoryBarrier barrier{.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                          .srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR,
+                          .dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR};
+  vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+                       VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+// Returns the world-space box of instance `instanceIdx`: its object-space
+// box transformed by its transform, or if there are no `instanceBounds`, the
+// point at its origin.
+VkAabbPositionsKHR instanceWorldBounds(std::span<const VkAccelerationStructureInstanceKHR> instances,
+                                       std::span<const VkAabbPositionsKHR>                 instanceBounds,
+                                       uint32_t                                            instanceIdx)
+{
+  const VkTransformMatrixKHR& transform = instances[instanceIdx].transform;
+  const VkAabbPositionsKHR    origin{};
+  const VkAabbPositionsKHR&   bounds       = instanceBounds.empty() ? origin : instanceBounds[instanceIdx];
+  const float                 objectMin[3] = {bounds.minX, bounds.minY, bounds.minZ};
+  const float                 objectMax[3] = {bounds.maxX, bounds.maxY, bounds.maxZ};
+  float                       worldMin[3], worldMax[3];
+  for(int row = 0; row < 3; row++)
+  {
+    worldMin[row] = worldMax[row] = transform.matrix[row][3];
+    for(int c = 0; c < 3; c++)
+    {
+      const float a = transform.matrix[row][c] * objectMin[c];
+      const float b = transform.matrix[row][c] * objectMax[c];
+      worldMin[row] += std::min(a, b);
+      worldMax[row] += std::max(a, b);
+    }
+  }
+  return {worldMin[0], worldMin[1], worldMin[2], worldMax[0], worldMax[1], worldMax[2]};
+}
+
+}  // namespace
+
+void AccelManager::init(VkDevice device, VkPhysicalDevice physicalDevice, VkQueue queue, uint32_t queueFamilyIndex, nvvk::ResourceAllocator& allocator)
+{
+  m_device    = device;
+  m_queue     = queue;
+  m_allocator = &allocator;
+
+  VkPhysicalDeviceAccelerationStructurePropertiesKHR asProperties{.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_PROPERTIES_KHR};
+  VkPhysicalDeviceProperties2 properties{.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2, .pNext = &asProperties};
+  vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+  m_scratchAlignment = std::max<VkDeviceSize>(1, asProperties.minAccelerationStructureScratchOffsetAlignment);
+
+  VkCommandPoolCreateInfo cmdPoolInfo{.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+                                      .flags            = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+                                      .queueFamilyIndex = queueFamilyIndex};
+  NVVK_CHECK(vkCreateCommandPool(device, &cmdPoolInfo, nullptr, &m_cmdPool));
+}
+
+void AccelManager::deinit()
+{
+  if(m_device == VK_NULL_HANDLE)
+  {
+    return;
+  }
+  for(nvvk::AccelKHR& blas : m_blas)
+  {
+    m_allocator->destroy(blas);
+  }
+  m_blas.clear();
+  m_blasAddresses.clear();
+  m_allocator->destroy(m_tlas);
+  m_allocator->destroy(m_blasScratchBuffer);
+  m_allocator->destroy(m_tlasScratchBuffer);
+  m_allocator->destroy(m_instanceBuffer);
+  m_instanceBufferSize = 0;
+  m_instancesOnDevice  = false;
+  vkDestroyCommandPool(m_device, m_cmdPool, nullptr);
+  m_device = VK_NULL_HANDLE;
+}
+
+AccelManager::AccelManager(AccelManager&& other) noexcept
+{
+  swap(other);
+}
+
+AccelManager& AccelManager::operator=(AccelManager&& other) noexcept
+{
+  if(this != &other)
+  {
+    deinit();
+    swap(other);
+  }
+  return *this;
+}
+
+void AccelManager::swap(AccelManager& other) noexcept
+{
+  std::swap(m_device, other.m_device);
+  std::swap(m_queue, other.m_queue);
+  std::swap(m_cmdPool, other.m_cmdPool);
+  std::swap(m_allocator, other.m_allocator);
+  std::swap(m_scratchAlignment, other.m_scratchAlignment);
+  std::swap(m_blas, other.m_blas);
+  std::swap(m_blasAddresses, other.m_blasAddresses);
+  std::swap(m_tlas, other.m_tlas);
+  std::swap(m_instanceBuffer, other.m_instanceBuffer);
+  std::swap(m_instanceBufferSize, other.m_instanceBufferSize);
+  std::swap(m_instancesOnDevice, other.m_instancesOnDevice);
+  std::swap(m_blasFlags, other.m_blasFlags);
+  std::swap(m_blasScratchBuffer, other.m_blasScratchBuffer);
+  std::swap(m_blasScratchAddress, other.m_blasScratchAddress);
+  std::swap(m_tlasFlags, other.m_tlasFlags);
+  std::swap(m_tlasScratchBuffer, other.m_tlasScratchBuffer);
+  std::swap(m_tlasScratchAddress, other.m_tlasScratchAddress);
+  std::swap(m_tlasBuildBounds, other.m_tlasBuildBounds);
+  std::swap(m_tlasBuildExtent, other.m_tlasBuildExtent);
+  std::swap(m_blasStats, other.m_blasStats);
+  std::swap(m_tlasStats, other.m_tlasStats);
+  std::swap(m_blasScratchBufferSize, other.m_blasScratchBufferSize);
+  std::swap(m_blasUpdateScratchSize, other.m_blasUpdateScratchSize);
+  std::swap(m_blasBatchBudget, other.m_blasBatchBudget);
+  std::swap(m_blasPeakBytes, other.m_blasPeakBytes);
+  std::swap(m_blasBatchCount, other.m_blasBatchCount);
+  std::swap(m_blasCompacted, other.m_blasCompacted);
+  std::swap(m_blasFromCache, other.m_blasFromCache);
+  std::swap(m_blasOnHost, other.m_blasOnHost);
+  std::swap(m_blasHostThreads, other.m_blasHostThreads);
+  std::swap(m_blasHostConcurrency, other.m_blasHostConcurrency);
+  std::swap(m_blasBuildMs, other.m_blasBuildMs);
+  std::swap(m_blasCompactionMs, other.m_blasCompactionMs);
+  std::swap(m_blasRefitMs, other.m_blasRefitMs);
+  std::swap(m_tlasBuildMs, other.m_tlasBuildMs);
+  std::swap(m_tlasUpdateMs, other.m_tlasUpdateMs);
+  std::swap(m_tlasUpdateScratchSize, other.m_tlasUpdateScratchSize);
+  std::swap(m_tlasDegradation, other.m_tlasDegradation);
+  std::swap(m_tlasBuildCount, other.m_tlasBuildCount);
+  std::swap(m_tlasUpdateCount, other.m_tlasUpdateCount);
+}
+
+VkCommandBuffer AccelManager::beginCommands()
+{
+  VkCommandBufferAllocateInfo cmdAllocInfo{.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+                                           .commandPool        = m_cmdPool,
+                                           .level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+                                           .commandBufferCount = 1};
+  VkCommandBuffer             cmdBuffer;
+  NVVK_CHECK(vkAllocateCommandBuffers(m_device, &cmdAllocInfo, &cmdBuffer));
+  VkCommandBufferBeginInfo beginInfo{.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+                                     .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT};
+  NVVK_CHECK(vkBeginCommandBuffer(cmdBuffer, &beginInfo));
+  return cmdBuffer;
+}
+
+void AccelManager::submit(VkCommandBuffer cmdBuffer)
+{
+  NVVK_CHECK(vkEndCommandBuffer(cmdBuffer));
+  VkSubmitInfo submitInfo{.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO, .commandBufferCount = 1, .pCommandBuffers = &cmdBuffer};
+  NVVK_CHECK(vkQueueSubmit(m_queue, 1, &submitInfo, VK_NULL_HANDLE));
+  NVVK_CHECK(vkQueueWaitIdle(m_queue));
+  vkFreeCommandBuffers(m_device, m_cmdPool, 1, &cmdBuffer);
+}
+
+VkDeviceAddress AccelManager::createScratch(VkDeviceSize size, nvvk::Buffer& buffer)
+{
+  buffer = m_allocator->createBuffer(size + m_scratchAlignment - 1,
+                                     VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT);
+  return alignUp(bufferAddress(buffer), m_scratchAlignment);
+}
+
+nvvk::AccelKHR AccelManager::createAccel(VkAccelerationStructureTypeKHR type, VkDeviceSize size, VkMemoryPropertyFlags memProperties)
+{
+  VkAccelerationStructureCreateInfoKHR createInfo{.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR,
+                                                  .size  = size,
+                                                  .type  = type};
+  return m_allocator->createAcceleration(createInfo, memProperties);
+}
+
+VkDeviceAddress AccelManager::bufferAddress(const nvvk::Buffer& buffer) const
+{
+  return getBufferDeviceAddress(m_device, buffer.buffer);
+}
+
+VkDeviceAddress AccelManager::accelAddress(VkAccelerationStructureKHR accel) const
+{
+  VkAccelerationStructureDeviceAddressInfoKHR addressInfo{.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR,
+                                                          .accelerationStructure = accel};
+  return vkGetAccelerationStructureDeviceAddressKHR(m_device, &addressInfo);
+}
+
+void AccelManager::buildBlas(std::span<const BlasInput> inputs, VkBuildAccelerationStructureFlagsKHR flags, VkDeviceSize batchBudget)
+{
+  const uint32_t numBlas = static_cast<uint32_t>(inputs.size());
+  if(flags & VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR)
+  {
+    // refitBlas() may rebuild BLASes in place, which needs their full size.
+    flags &= ~VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR;
+  }
+  m_blasFlags       = flags;
+  m_blasFromCache   = false;
+  m_blasCompacted   = (flags & VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR) != 0;
+  m_blasBatchBudget = batchBudget;
+  for(nvvk::AccelKHR& blas : m_blas)
+  {
+    m_allocator->destroy(blas);
+  }
+  m_blasStats.assign(numBlas, AccelStats{});
+  m_blasUpdateScratchSize = 0;
+  m_blas.resize(numBlas);
+  m_blasAddresses.resize(numBlas);
+
+  // Ask the driver how large each BLAS and its scratch memory will be. We
+  // create each BLAS when its batch starts.
+  std::vector<VkAccelerationStructureBuildGeometryInfoKHR> buildInfos(numBlas);
+  for(uint32_t blasIdx = 0; blasIdx < numBlas; blasIdx++)
+  {
+    const BlasInput& input = inputs[blasIdx];
+    buildInfos[blasIdx]    = {.sType         = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR,
+                              .type          = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR,
+                              .flags         = flags,
+                              .mode          = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR,
+                              .geometryCount = static_cast<uint32_t>(input.asGeometry.size()),
+                              .pGeometries   = input.asGeometry.data()};
+    std::vector<uint32_t> maxPrimitiveCounts;
+    for(const VkAccelerationStructureBuildRangeInfoKHR& range : input.asBuildOffsetInfo)
+    {
+      maxPrimitiveCounts.push_back(range.primitiveCount);
+      m_blasStats[blasIdx].primitiveCount += range.primitiveCount;
+    }
+    VkAccelerationStructureBuildSizesInfoKHR sizeInfo{.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR};
+    vkGetAccelerationStructureBuildSizesKHR(m_device, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &buildInfos[blasIdx],
+                                            maxPrimitiveCounts.data(), &sizeInfo);
+    m_blasStats[blasIdx].builtSize   = sizeInfo.accelerationStructureSize;
+    m_blasStats[blasIdx].finalSize   = sizeInfo.accelerationStructureSize;
+    m_blasStats[blasIdx].scratchSize = sizeInfo.buildScratchSize;
+    m_blasUpdateScratchSize          = std::max(m_blasUpdateScratchSize, sizeInfo.updateScratchSize);
+  }
+
+  // Builds run one after another, so they can all share a scratch buffer as
+  // large as the largest one needs, across all batches. BLASes that can be
+  // updated keep it for refitBlas().
+  m_blasScratchBufferSize = 0;
+  for(const AccelStats& stats : m_blasStats)
+  {
+    m_blasScratchBufferSize = std::max(m_blasScratchBufferSize, stats.scratchSize);
+  }
+  if(flags & VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR)
+  {
+    m_blasScratchBufferSize = std::max(m_blasScratchBufferSize, m_blasUpdateScratchSize);
+  }
+  m_allocator->destroy(m_blasScratchBuffer);
+  m_blasScratchAddress                 = createScratch(m_blasScratchBufferSize, m_blasScratchBuffer);
+  const VkDeviceAddress scratchAddress = m_blasScratchAddress;
+
+  VkQueryPool queryPool = VK_NULL_HANDLE;
+  if(m_blasCompacted && numBlas > 0)
+  {
+    VkQueryPoolCreateInfo queryPoolInfo{.sType      = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+                                        .queryType  = VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR,
+                                        .queryCount = numBlas};
+    NVVK_CHECK(vkCreateQueryPool(m_device, &queryPoolInfo, nullptr, &queryPool));
+  }
+
+  m_blasBuildMs              = 0.0;
+  m_blasCompactionMs         = 0.0;
+  m_blasBatchCount           = 0;
+  m_blasPeakBytes            = 0;
+  VkDeviceSize residentBytes = m_blasScratchBufferSize;  // Scratch and BLASes of earlier batches
+  for(uint32_t batchStart = 0; batchStart < numBlas;)
+  {
+    // Add BLASes to the batch until the next one would go over the budget.
+    uint32_t     batchEnd   = batchStart;
+    VkDeviceSize batchBytes = 0;
+    do
+    {
+      batchBytes += m_blasStats[batchEnd].builtSize;
+      batchEnd++;
+    } while(batchEnd < numBlas && (batchBudget == 0 || batchBytes + m_blasStats[batchEnd].builtSize <= batchBudget));
+    const uint32_t batchSize = batchEnd - batchStart;
+    m_blasBatchCount++;
+
+    // Record the batch's builds, each followed by a query for its compacted size.
+    const Clock::time_point buildStart = Clock::now();
+    VkCommandBuffer         cmdBuffer  = beginCommands();
+    if(queryPool != VK_NULL_HANDLE)
+    {
+      vkCmdResetQueryPool(cmdBuffer, queryPool, batchStart, batchSize);
+    }
+    for(uint32_t blasIdx = batchStart; blasIdx < batchEnd; blasIdx++)
+    {
+      m_blas[blasIdx] = createAccel(VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR, m_blasStats[blasIdx].builtSize);
+      buildInfos[blasIdx].dstAccelerationStructure              = m_blas[blasIdx].accel;
+      buildInfos[blasIdx].scratchData.deviceAddress              = scratchAddress;
+      const VkAccelerationStructureBuildRangeInfoKHR* rangeInfos = inputs[blasIdx].asBuildOffsetInfo.data();
+      vkCmdBuildAccelerationStructuresKHR(cmdBuffer, 1, &buildInfos[blasIdx], &rangeInfos);
+      accelBarrier(cmdBuffer);
+      if(queryPool != VK_NULL_HANDLE)
+      {
+        vkCmdWriteAccelerationStructuresPropertiesKHR(cmdBuffer, 1, &m_blas[blasIdx].accel,
+                                                      VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR, queryPool, blasIdx);
+      }
+    }
+    submit(cmdBuffer);
+    m_blasBuildMs += millisecondsSince(buildStart);
+
+    // Copy each BLAS into a new one of its compacted size, then free the
+    // originals, so that the next batch can use their memory.
+    VkDeviceSize compactedBytes = 0;
+    if(queryPool != VK_NULL_HANDLE)
+    {
+      const Clock::time_point   compactionStart = Clock::now();
+      std::vector<VkDeviceSize> compactedSizes(batchSize);
+      NVVK_CHECK(vkGetQueryPoolResults(m_device, queryPool, batchStart, batchSize, batchSize * sizeof(VkDeviceSize),
+                                       compactedSizes.data(), sizeof(VkDeviceSize), VK_QUERY_RESULT_WAIT_BIT | VK_QUERY_RESULT_64_BIT));
+      std::vector<nvvk::AccelKHR> compacted(batchSize);
+      cmdBuffer = beginCommands();
+      for(uint32_t i = 0; i < batchSize; i++)
+      {
+        const uint32_t blasIdx         = batchStart + i;
+        m_blasStats[blasIdx].finalSize = compactedSizes[i];
+        compactedBytes += compactedSizes[i];
+        compacted[i] = createAccel(VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR, compactedSizes[i]);
+        VkCopyAccelerationStructureInfoKHR copyInfo{.sType = VK_STRUCTURE_TYPE_COPY_ACCELERATION_STRUCTURE_INFO_KHR,
+                                                    .src   = m_blas[blasIdx].accel,
+                                                    .dst   = compacted[i].accel,
+                                                    .mode  = VK_COPY_ACCELERATION_STRUCTURE_MODE_COMPACT_KHR};
+        vkCmdCopyAccelerationStructureKHR(cmdBuffer, &copyInfo);
+      }
+      accelBarrier(cmdBuffer);
+      submit(cmdBuffer);
+      for(uint32_t i = 0; i < batchSize; i++)
+      {
+        m_allocator->destroy(m_blas[batchStart + i]);
+        m_blas[batchStart + i] = compacted[i];
+      }
+      m_blasCompactionMs += millisecondsSince(compactionStart);
+    }
+
+    // While compacting, the batch's BLASes exist in both sizes at once.
+    m_blasPeakBytes = std::max(m_blasPeakBytes, residentBytes + batchBytes + compactedBytes);
+    residentBytes += (queryPool != VK_NULL_HANDLE) ? compactedBytes : batchBytes;
+    batchStart = batchEnd;
+  }
+
+  if(queryPool != VK_NULL_HANDLE)
+  {
+    vkDestroyQueryPool(m_device, queryPool, nullptr);
+  }
+  if((flags & VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR) == 0)
+  {
+    m_allocator->destroy(m_blasScratchBuffer);
+  }
+
+  for(uint32_t blasIdx = 0; blasIdx < numBlas; blasIdx++)
+  {
+    m_blasAddresses[blasIdx] = accelAddress(m_blas[blasIdx].accel);
+  }
+  m_blasOnHost = false;
+}
+
+void AccelManager::buildBlasOnHost(std::span<const BlasInput>           inputs,
+                                   VkBuildAccelerationStructureFlagsKHR flags,
+                                   ThreadPool&                          pool,
+                                   uint32_t                             maxThreads)
+{
+  const uint32_t numBlas = static_cast<uint32_t>(inputs.size());
+  // The BLASes are copied into device memory anyway, so updating them in
+  // place isn't supported here.
+  flags &= ~VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR;
+  m_blasFlags       = flags;
+  m_blasFromCache   = false;
+  m_blasOnHost      = true;
+  m_blasCompacted   = (flags & VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR) != 0;
+  m_blasBatchBudget = 0;
+  m_blasBatchCount  = 1;
+  for(nvvk::AccelKHR& blas : m_blas)
+  {
+    m_allocator->destroy(blas);
+  }
+  m_allocator->destroy(m_blasScratchBuffer);
+  m_blasStats.assign(numBlas, AccelStats{});
+  m_blasUpdateScratchSize = 0;
+  m_blas.resize(numBlas);
+  m_blasAddresses.resize(numBlas);
+
+  // Host builds write into acceleration structures in host-visible memory,
+  // and use scratch memory on the heap. All builds run at once, so each needs
+  // its own range of scratch memory.
+  std::vector<VkAccelerationStructureBuildGeometryInfoKHR> buildInfos(numBlas);
+  std::vector<nvvk::AccelKHR>                              hostBlas(numBlas);
+  std::vector<VkDeviceSize>                                scratchOffsets(numBlas);
+  m_blasScratchBufferSize = 0;
+  for(uint32_t blasIdx = 0; blasIdx < numBlas; blasIdx++)
+  {
+    const BlasInput& input = inputs[blasIdx];
+    buildInfos[blasIdx]    = {.sType         = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR,
+                              .type          = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR,
+                              .flags         = flags,
+                              .mode          = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR,
+                              .geometryCount = static_cast<uint32_t>(input.asGeometry.size()),
+                              .pGeometries   = input.asGeometry.data()};
+    std::vector<uint32_t> maxPrimitiveCounts;
+    for(const VkAccelerationStructureBuildRangeInfoKHR& range : input.asBuildOffsetInfo)
+    {
+      maxPrimitiveCounts.push_back(range.primitiveCount);
+      m_blasStats[blasIdx].primitiveCount += range.primitiveCount;
+    }
+    VkAccelerationStructureBuildSizesInfoKHR sizeInfo{.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR};
+    vkGetAccelerationStructureBuildSizesKHR(m_device, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_HOST_KHR, &buildInfos[blasIdx],
+                                            maxPrimitiveCounts.data(), &sizeInfo);
+    m_blasStats[blasIdx].builtSize   = sizeInfo.accelerationStructureSize;
+    m_blasStats[blasIdx].finalSize   = sizeInfo.accelerationStructureSize;
+    m_blasStats[blasIdx].scratchSize = sizeInfo.buildScratchSize;
+    hostBlas[blasIdx] = createAccel(VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR, sizeInfo.accelerationStructureSize,
+                                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    buildInfos[blasIdx].dstAccelerationStructure = hostBlas[blasIdx].accel;
+    scratchOffsets[blasIdx]                      = m_blasScratchBufferSize;
+    m_blasScratchBufferSize += alignUp(sizeInfo.buildScratchSize, m_scratchAlignment);
+  }
+  std::vector<uint8_t> scratch(m_blasScratchBufferSize + m_scratchAlignment);
+  const uintptr_t      scratchBase = alignUp(reinterpret_cast<uintptr_t>(scratch.data()), m_scratchAlignment);
+  std::vector<const VkAccelerationStructureBuildRangeInfoKHR*> rangeInfos(numBlas);
+  for(uint32_t blasIdx = 0; blasIdx < numBlas; blasIdx++)
+  {
+    buildInfos[blasIdx].scratchData.hostAddress = reinterpret_cast<void*>(scratchBase + scratchOffsets[blasIdx]);
+    rangeInfos[blasIdx]                         = inputs[blasIdx].asBuildOffsetInfo.data();
+  }
+
+  // Start the builds as a deferred operation: vkBuildAccelerationStructuresKHR
+  // returns right away, and the work happens in threads that join the
+  // operation. Each join returns VK_SUCCESS once the whole operation is done,
+  // VK_THREAD_DONE_KHR once there's no more work for this thread, or
+  // VK_THREAD_IDLE_KHR if there's no work for it right now but may be later.
+  const Clock::time_point buildStart = Clock::now();
+  VkDeferredOperationKHR  deferredOp = VK_NULL_HANDLE;
+  NVVK_CHECK(vkCreateDeferredOperationKHR(m_device, nullptr, &deferredOp));
+  VkResult result = vkBuildAccelerationStructuresKHR(m_device, deferredOp, numBlas, buildInfos.data(), rangeInfos.data());
+  if(result == VK_OPERATION_DEFERRED_KHR)
+  {
+    // parallelFor() can run several indices on one thread, or start an index
+    // after the operation finished, so count the threads that really joined.
+    m_blasHostConcurrency = vkGetDeferredOperationMaxConcurrencyKHR(m_device, deferredOp);
+    std::mutex                   joinedMutex;
+    std::vector<std::thread::id> joinedThreads;
+    pool.parallelFor(std::max(1u, std::min(maxThreads, m_blasHostConcurrency)), [&](size_t) {
+      if(vkGetDeferredOperationResultKHR(m_device, deferredOp) != VK_NOT_READY)
+      {
+        return;
+      }
+      {
+        std::lock_guard<std::mutex> lock(joinedMutex);
+        if(std::ranges::find(joinedThreads, std::this_thread::get_id()) == joinedThreads.end())
+        {
+          joinedThreads.push_back(std::this_thread::get_id());
+        }
+      }
+      VkResult joinResult;
+      do
+      {
+        joinResult = vkDeferredOperationJoinKHR(m_device, deferredOp);
+        if(joinResult == VK_THREAD_IDLE_KHR)
+        {
+          std::this_thread::yield();
+        }
+      } while(joinResult == VK_THREAD_IDLE_KHR);
+    });
+    // Every joined thread has returned, so the operation is complete.
+    result            = vkGetDeferredOperationResultKHR(m_device, deferredOp);
+    m_blasHostThreads = static_cast<uint32_t>(joinedThreads.size());
+  }
+  else
+  {
+    // The driver ran the builds on this thread (VK_OPERATION_NOT_DEFERRED_KHR) or failed.
+    m_blasHostConcurrency = 1;
+    m_blasHostThreads     = 1;
+    if(result == VK_OPERATION_NOT_DEFERRED_KHR)
+    {
+      result = VK_SUCCESS;
+    }
+  }
+  vkDestroyDeferredOperationKHR(m_device, deferredOp, nullptr);
+  NVVK_CHECK(result);
+  m_blasBuildMs   = millisecondsSince(buildStart);
+  m_blasPeakBytes = 0;
+  for(const AccelStats& stats : m_blasStats)
+  {
+    m_blasPeakBytes += stats.builtSize;
+  }
+
+  // Tracing reads BLASes much faster from device-local memory, so copy them
+  // there. If compacting, the host can tell us the compacted sizes directly.
+  const Clock::time_point copyStart = Clock::now();
+  if(m_blasCompacted && numBlas > 0)
+  {
+    std::vector<VkAccelerationStructureKHR> accels(numBlas);
+    std::vector<VkDeviceSize>               compactedSizes(numBlas);
+    for(uint32_t blasIdx = 0; blasIdx < numBlas; blasIdx++)
+    {
+      accels[blasIdx] = hostBlas[blasIdx].accel;
+    }
+    NVVK_CHECK(vkWriteAccelerationStructuresPropertiesKHR(m_device, numBlas, accels.data(),
+                                                          VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR,
+                                                          numBlas * sizeof(VkDeviceSize), compactedSizes.data(), sizeof(VkDeviceSize)));
+    for(uint32_t blasIdx = 0; blasIdx < numBlas; blasIdx++)
+    {
+      m_blasStats[blasIdx].finalSize = compactedSizes[blasIdx];
+    }
+  }
+  VkCommandBuffer cmdBuffer = beginCommands();
+  for(uint32_t blasIdx = 0; blasIdx < numBlas; blasIdx++)
+  {
+    m_blas[blasIdx] = createAccel(VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR, m_blasStats[blasIdx].finalSize);
+    VkCopyAccelerationStructureInfoKHR copyInfo{.sType = VK_STRUCTURE_TYPE_COPY_ACCELERATION_STRUCTURE_INFO_KHR,
+                                                .src   = hostBlas[blasIdx].accel,
+                                                .dst   = m_blas[blasIdx].accel,
+                                                .mode  = m_blasCompacted ? VK_COPY_ACCELERATION_STRUCTURE_MODE_COMPACT_KHR :
+                                                                           VK_COPY_ACCELERATION_STRUCTURE_MODE_CLONE_KHR};
+    vkCmdCopyAccelerationStructureKHR(cmdBuffer, &copyInfo);
+  }
+  accelBarrier(cmdBuffer);
+  submit(cmdBuffer);
+  for(nvvk::AccelKHR& blas : hostBlas)
+  {
+    m_allocator->destroy(blas);
+  }
+  m_blasCompactionMs = millisecondsSince(copyStart);
+
+  for(uint32_t blasIdx = 0; blasIdx < numBlas; blasIdx++)
+  {
+    m_blasAddresses[blasIdx] = accelAddress(m_blas[blasIdx].accel);
+  }
+}
+
+void AccelManager::refitBlas(std::span<const uint32_t> blasIndices, std::span<const BlasInput> inputs, bool rebuild)
+{
+  assert(blasIndices.size() == inputs.size());
+  assert(m_blasFlags & VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR);
+  const Clock::time_point start     = Clock::now();
+  VkCommandBuffer         cmdBuffer = beginCommands();
+  for(size_t i = 0; i < blasIndices.size(); i++)
+  {
+    const uint32_t   blasIdx = blasIndices[i];
+    const BlasInput& input   = inputs[i];
+    // A refit reads the BLAS's old tree and writes the new one in place. A
+    // rebuild writes a new tree into the same memory, which fits since the
+    // BLAS wasn't compacted and has as many primitives as before.
+    VkAccelerationStructureBuildGeometryInfoKHR buildInfo{
+        .sType                    = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR,
+        .type                     = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR,
+        .flags                    = m_blasFlags,
+        .mode                     = rebuild ? VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR : VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR,
+        .srcAccelerationStructure = rebuild ? VK_NULL_HANDLE : m_blas[blasIdx].accel,
+        .dstAccelerationStructure = m_blas[blasIdx].accel,
+        .geometryCount            = static_cast<uint32_t>(input.asGeometry.size()),
+        .pGeometries              = input.asGeometry.data(),
+        .scratchData              = {.deviceAddress = m_blasScratchAddress}};
+    const VkAccelerationStructureBuildRangeInfoKHR* rangeInfos = input.asBuildOffsetInfo.data();
+    vkCmdBuildAccelerationStructuresKHR(cmdBuffer, 1, &buildInfo, &rangeInfos);
+    accelBarrier(cmdBuffer);
+  }
+  submit(cmdBuffer);
+  m_blasRefitMs = millisecondsSince(start);
+}
+
+bool AccelManager::serializeBlas(std::vector<std::vector<uint8_t>>& blobs)
+{
+  const uint32_t numBlas = static_cast<uint32_t>(m_blas.size());
+  blobs.assign(numBlas, {});
+  if(numBlas == 0)
+  {
+    return true;
+  }
+
+  // Ask how large each serialized BLAS will be.
+  VkQueryPool           queryPool;
+  VkQueryPoolCreateInfo queryPoolInfo{.sType      = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+                                      .queryType  = VK_QUERY_TYPE_ACCELERATION_STRUCTURE_SERIALIZATION_SIZE_KHR,
+                                      .queryCount = numBlas};
+  NVVK_CHECK(vkCreateQueryPool(m_device, &queryPoolInfo, nullptr, &queryPool));
+  std::vector<VkAccelerationStructureKHR> accels(numBlas);
+  for(uint32_t blasIdx = 0; blasIdx < numBlas; blasIdx++)
+  {
+    accels[blasIdx] = m_blas[blasIdx].accel;
+  }
+  VkCommandBuffer cmdBuffer = beginCommands();
+  vkCmdResetQueryPool(cmdBuffer, queryPool, 0, numBlas);
+  vkCmdWriteAccelerationStructuresPropertiesKHR(cmdBuffer, numBlas, accels.data(),
+                                                VK_QUERY_TYPE_ACCELERATION_STRUCTURE_SERIALIZATION_SIZE_KHR, queryPool, 0);
+  submit(cmdBuffer);
+  std::vector<VkDeviceSize> sizes(numBlas);
+  const VkResult            result = vkGetQueryPoolResults(m_device, queryPool, 0, numBlas, numBlas * sizeof(VkDeviceSize), sizes.data(),
+                                                           sizeof(VkDeviceSize), VK_QUERY_RESULT_WAIT_BIT | VK_QUERY_RESULT_64_BIT);
+  vkDestroyQueryPool(m_device, queryPool, nullptr);
+  if(result != VK_SUCCESS)
+  {
+    return false;
+  }
+
+  // Serialize them all into one host-visible buffer, then copy them out.
+  std::vector<VkDeviceSize> offsets(numBlas);
+  VkDeviceSize              totalSize = 0;
+  for(uint32_t blasIdx = 0; blasIdx < numBlas; blasIdx++)
+  {
+    offsets[blasIdx] = totalSize;
+    totalSize += alignUp(sizes[blasIdx], k_serializedAlignment);
+  }
+
+  // The addresses of serialized acceleration structures must be multiples of
+  // 256 bytes, but buffers may start anywhere, so we allocate enough to start
+  // at the next multiple, like createScratch() does.
+  nvvk::Buffer          buffer      = m_allocator->createBuffer(totalSize + k_serializedAlignment - 1,
+                                                                VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                                                                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+                                                                    | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+                                                                    | VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+  const VkDeviceAddress bufferStart = bufferAddress(buffer);
+  const VkDeviceAddress address     = alignUp(bufferStart, k_serializedAlignment);
+  cmdBuffer                         = beginCommands();
+  for(uint32_t blasIdx = 0; blasIdx < numBlas; blasIdx++)
+  {
+    VkCopyAccelerationStructureToMemoryInfoKHR copyInfo{.sType = VK_STRUCTURE_TYPE_COPY_ACCELERATION_STRUCTURE_TO_MEMORY_INFO_KHR,
+                                                        .src   = accels[blasIdx],
+                                                        .dst   = {.deviceAddress = address + offsets[blasIdx]},
+                                                        .mode  = VK_COPY_ACCELERATION_STRUCTURE_MODE_SERIALIZE_KHR};
+    vkCmdCopyAccelerationStructureToMemoryKHR(cmdBuffer, &copyInfo);
+  }
+  VkMemoryBarrier barrier{.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                          .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+                          .dstAccessMask = VK_ACCESS_HOST_READ_BIT};
+  vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, VK_PIPELINE_STAGE_HOST_BIT, 0, 1,
+                       &barrier, 0, nullptr, 0, nullptr);
+  submit(cmdBuffer);
+  const uint8_t* mapped = static_cast<const uint8_t*>(m_allocator->map(buffer)) + (address - bufferStart);
+  for(uint32_t blasIdx = 0; blasIdx < numBlas; blasIdx++)
+  {
+    blobs[blasIdx].assign(mapped + offsets[blasIdx], mapped + offsets[blasIdx] + sizes[blasIdx]);
+  }
+  m_allocator->unmap(buffer);
+  m_allocator->destroy(buffer);
+  return true;
+}
+
+bool AccelManager::deserializeBlas(std::span<const BlasInput> inputs, std::span<const std::span<const uint8_t>> blobs)
+{
+  const uint32_t numBlas = static_cast<uint32_t>(blobs.size());
+  if(inputs.size() != blobs.size())
+  {
+    return false;
+  }
+
+  // Each serialized BLAS starts with a header that says how large the
+  // deserialized BLAS will be.
+  const size_t              accelSizeOffset = 2 * VK_UUID_SIZE + sizeof(uint64_t);
+  std::vector<VkDeviceSize> accelSizes(numBlas), offsets(numBlas);
+  VkDeviceSize              totalSize = 0;
+  for(uint32_t blasIdx = 0; blasIdx < numBlas; blasIdx++)
+  {
+    if(blobs[blasIdx].size() < accelSizeOffset + sizeof(uint64_t))
+    {
+      return false;
+    }
+    memcpy(&accelSizes[blasIdx], blobs[blasIdx].data() + accelSizeOffset, sizeof(uint64_t));
+    offsets[blasIdx] = totalSize;
+    totalSize += alignUp(blobs[blasIdx].size(), k_serializedAlignment);
+  }
+
+  const Clock::time_point start = Clock::now();
+  for(nvvk::AccelKHR& blas : m_blas)
+  {
+    m_allocator->destroy(blas);
+  }
+  m_blas.resize(numBlas);
+  m_blasAddresses.resize(numBlas);
+  m_blasStats.assign(numBlas, AccelStats{});
+  // Align the start of the blobs to 256 bytes, like serializeBlas() does.
+  nvvk::Buffer          buffer      = m_allocator->createBuffer(totalSize + k_serializedAlignment - 1,
+                                                                VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                                                                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+                                                                    | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  const VkDeviceAddress bufferStart = bufferAddress(buffer);
+  const VkDeviceAddress address     = alignUp(bufferStart, k_serializedAlignment);
+  uint8_t*              mapped      = static_cast<uint8_t*>(m_allocator->map(buffer)) + (address - bufferStart);
+  for(uint32_t blasIdx = 0; blasIdx < numBlas; blasIdx++)
+  {
+    memcpy(mapped + offsets[blasIdx], blobs[blasIdx].data(), blobs[blasIdx].size());
+  }
+  m_allocator->unmap(buffer);
+
+  VkCommandBuffer cmdBuffer = beginCommands();
+  for(uint32_t blasIdx = 0; blasIdx < numBlas; blasIdx++)
+  {
+    m_blas[blasIdx] = createAccel(VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR, accelSizes[blasIdx]);
+    VkCopyMemoryToAccelerationStructureInfoKHR copyInfo{.sType = VK_STRUCTURE_TYPE_COPY_MEMORY_TO_ACCELERATION_STRUCTURE_INFO_KHR,
+                                                        .src   = {.deviceAddress = address + offsets[blasIdx]},
+                                                        .dst   = m_blas[blasIdx].accel,
+                                                        .mode  = VK_COPY_ACCELERATION_STRUCTURE_MODE_DESERIALIZE_KHR};
+    vkCmdCopyMemoryToAccelerationStructureKHR(cmdBuffer, &copyInfo);
+    for(const VkAccelerationStructureBuildRangeInfoKHR& range : inputs[blasIdx].asBuildOffsetInfo)
+    {
+      m_blasStats[blasIdx].primitiveCount += range.primitiveCount;
+    }
+    m_blasStats[blasIdx].builtSize = accelSizes[blasIdx];
+    m_blasStats[blasIdx].finalSize = accelSizes[blasIdx];
+  }
+  accelBarrier(cmdBuffer);
+  submit(cmdBuffer);
+  m_allocator->destroy(buffer);
+
+  for(uint32_t blasIdx = 0; blasIdx < numBlas; blasIdx++)
+  {
+    m_blasAddresses[blasIdx] = accelAddress(m_blas[blasIdx].accel);
+  }
+  m_blasFlags        = 0;
+  m_blasCompacted    = false;
+  m_blasFromCache    = true;
+  m_blasOnHost       = false;
+  m_blasBuildMs      = millisecondsSince(start);
+  m_blasCompactionMs = 0.0;
+  return true;
+}
+
+void AccelManager::writeInstances(std::span<const VkAccelerationStructureInstanceKHR> instances)
+{
+  // The buffer only grows, so that updates can rewrite it in place.
+  const VkDeviceSize bytes = std::max<VkDeviceSize>(instances.size_bytes(), sizeof(VkAccelerationStructureInstanceKHR));
+  if(m_instanceBufferSize < bytes || m_instancesOnDevice)
+  {
+    m_allocator->destroy(m_instanceBuffer);
+    m_instanceBuffer     = m_allocator->createBuffer(bytes,
+                                                     VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT
+                                                         | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR,
+                                                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    m_instanceBufferSize = bytes;
+    m_instancesOnDevice  = false;
+  }
+  // Builds and updates wait for the GPU, so it can't be reading the buffer now.
+  memcpy(m_allocator->map(m_instanceBuffer), instances.data(), instances.size_bytes());
+  m_allocator->unmap(m_instanceBuffer);
+}
+
+void AccelManager::recordTlasBuild(VkCommandBuffer cmdBuffer, uint32_t numInstances)
+{
+  VkAccelerationStructureGeometryKHR          geometry  = tlasGeometry();
+  VkAccelerationStructureBuildGeometryInfoKHR buildInfo{.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR,
+                                                        .type  = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR,
+                                                        .flags = m_tlasFlags,
+                                                        .mode  = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR,
+                                                        .geometryCount = 1,
+                                                        .pGeometries   = &geometry};
+  VkAccelerationStructureBuildSizesInfoKHR sizeInfo{.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR};
+  vkGetAccelerationStructureBuildSizesKHR(m_device, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &buildInfo, &numInstances, &sizeInfo);
+  m_tlasStats = {.primitiveCount = numInstances,
+                 .builtSize      = sizeInfo.accelerationStructureSize,
+                 .finalSize      = sizeInfo.accelerationStructureSize,
+                 .scratchSize    = sizeInfo.buildScratchSize};
+  m_tlasUpdateScratchSize = sizeInfo.updateScratchSize;
+
+  m_allocator->destroy(m_tlas);
+  m_tlas                             = createAccel(VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR, sizeInfo.accelerationStructureSize);
+  buildInfo.dstAccelerationStructure = m_tlas.accel;
+  // A TLAS that can be updated keeps its scratch buffer for the updates.
+  m_allocator->destroy(m_tlasScratchBuffer);
+  m_tlasScratchAddress = createScratch(std::max(sizeInfo.buildScratchSize, sizeInfo.updateScratchSize), m_tlasScratchBuffer);
+  buildInfo.scratchData.deviceAddress = m_tlasScratchAddress;
+
+  VkAccelerationStructureBuildRangeInfoKHR        range{.primitiveCount = numInstances};
+  const VkAccelerationStructureBuildRangeInfoKHR* rangeInfo = &range;
+  vkCmdBuildAccelerationStructuresKHR(cmdBuffer, 1, &buildInfo, &rangeInfo);
+}
+
+void AccelManager::buildTlas(std::span<const VkAccelerationStructureInstanceKHR> instances,
+                             VkBuildAccelerationStructureFlagsKHR                flags,
+                             std::span<const VkAabbPositionsKHR>                 instanceBounds)
+{
+  const Clock::time_point buildStart   = Clock::now();
+  const uint32_t          numInstances = static_cast<uint32_t>(instances.size());
+  m_tlasFlags                          = flags;
+  writeInstances(instances);
+
+  VkCommandBuffer cmdBuffer = beginCommands();
+  recordTlasBuild(cmdBuffer, numInstances);
+  submit(cmdBuffer);
+  if((flags & VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR) == 0)
+  {
+    m_allocator->destroy(m_tlasScratchBuffer);
+  }
+
+  // Remember where instances were, to estimate how much later updates degrade the TLAS.
+  assert(instanceBounds.empty() || instanceBounds.size() == instances.size());
+  m_tlasBuildBounds.resize(numInstances);
+  float boundsMin[3] = {FLT_MAX, FLT_MAX, FLT_MAX}, boundsMax[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+  for(uint32_t instanceIdx = 0; instanceIdx < numInstances; instanceIdx++)
+  {
+    const VkAabbPositionsKHR bounds = instanceWorldBounds(instances, instanceBounds, instanceIdx);
+    m_tlasBuildBounds[instanceIdx]  = bounds;
+    boundsMin[0]                    = std::min(boundsMin[0], bounds.minX);
+    boundsMin[1]                    = std::min(boundsMin[1], bounds.minY);
+    boundsMin[2]                    = std::min(boundsMin[2], bounds.minZ);
+    boundsMax[0]                    = std::max(boundsMax[0], bounds.maxX);
+    boundsMax[1]                    = std::max(boundsMax[1], bounds.maxY);
+    boundsMax[2]                    = std::max(boundsMax[2], bounds.maxZ);
+  }
+  m_tlasBuildExtent =
+      (numInstances > 0) ? std::hypot(boundsMax[0] - boundsMin[0], boundsMax[1] - boundsMin[1], boundsMax[2] - boundsMin[2]) : 0.0f;
+  m_tlasDegradation = 0.0f;
+  m_tlasBuildMs     = millisecondsSince(buildStart);
+  m_tlasBuildCount++;
+}
+
+void AccelManager::buildTlasOnDevice(uint32_t                                                      numInstances,
+                                     VkBuildAccelerationStructureFlagsKHR                          flags,
+                                     const std::function<void(VkCommandBuffer, VkDeviceAddress)>& recordInstanceWrites)
+{
+  const Clock::time_point buildStart = Clock::now();
+  m_tlasFlags                        = flags & ~VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR;
+
+  // The GPU writes the instances, so they can live in device-local memory.
+  const VkDeviceSize bytes = std::max<VkDeviceSize>(VkDeviceSize(numInstances) * sizeof(VkAccelerationStructureInstanceKHR),
+                                                    sizeof(VkAccelerationStructureInstanceKHR));
+  if(m_instanceBufferSize < bytes || !m_instancesOnDevice)
+  {
+    m_allocator->destroy(m_instanceBuffer);
+    m_instanceBuffer     = m_allocator->createBuffer(bytes,
+                                                     VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                                                         | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR,
+                                                     VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    m_instanceBufferSize = bytes;
+    m_instancesOnDevice  = true;
+  }
+
+  VkCommandBuffer cmdBuffer = beginCommands();
+  recordInstanceWrites(cmdBuffer, bufferAddress(m_instanceBuffer));
+  // The build reads the instances as shader reads.
+  VkMemoryBarrier barrier{.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                          .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+                          .dstAccessMask = VK_ACCESS_SHADER_READ_BIT};
+  vkCmdPipelineBarrier(cmdBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+                       0, 1, &barrier, 0, nullptr, 0, nullptr);
+  recordTlasBuild(cmdBuffer, numInstances);
+  submit(cmdBuffer);
+  m_allocator->destroy(m_tlasScratchBuffer);
+
+  // Without the instances on the host, updateTlas() can only rebuild.
+  m_tlasBuildBounds.clear();
+  m_tlasBuildExtent = 0.0f;
+  m_tlasDegradation = 0.0f;
+  m_tlasBuildMs     = millisecondsSince(buildStart);
+  m_tlasBuildCount++;
+}
+
+bool AccelManager::updateTlas(std::span<const VkAccelerationStructureInstanceKHR> instances,
+                              std::span<const VkAabbPositionsKHR>                 instanceBounds,
+                              float                                               rebuildThreshold)
+{
+  const uint32_t numInstances = static_cast<uint32_t>(instances.size());
+  if((m_tlasFlags & VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR) == 0 || numInstances != m_tlasStats.primitiveCount)
+  {
+    buildTlas(instances, m_tlasFlags, instanceBounds);
+    return false;
+  }
+
+  const Clock::time_point updateStart = Clock::now();
+  // An update keeps the TLAS's tree and only grows its boxes to fit, so the
+  // tree gets worse the further instances' boxes move from where they were
+  // when it was built. We estimate this as the average distance the corners
+  // of the boxes moved, relative to the size of the box around all instances
+  // at the last build.
+  double movedDistance = 0.0;
+  for(uint32_t instanceIdx = 0; instanceIdx < numInstances; instanceIdx++)
+  {
+    const VkAabbPositionsKHR  bounds = instanceWorldBounds(instances, instanceBounds, instanceIdx);
+    const VkAabbPositionsKHR& built  = m_tlasBuildBounds[instanceIdx];
+    movedDistance += std::max(std::hypot(bounds.minX - built.minX, bounds.minY - built.minY, bounds.minZ - built.minZ),
+                              std::hypot(bounds.maxX - built.maxX, bounds.maxY - built.maxY, bounds.maxZ - built.maxZ));
+  }
+  m_tlasDegradation = static_cast<float>(movedDistance / std::max<double>(numInstances, 1))
+                      / std::max(m_tlasBuildExtent, FLT_MIN);
+  if(m_tlasDegradation > rebuildThreshold)
+  {
+    buildTlas(instances, m_tlasFlags, instanceBounds);
+    return false;
+  }
+
+  writeInstances(instances);
+  VkAccelerationStructureGeometryKHR          geometry = tlasGeometry();
+  VkAccelerationStructureBuildGeometryInfoKHR buildInfo{.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR,
+                                                        .type  = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR,
+                                                        .flags = m_tlasFlags,
+                                                        .mode  = VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR,
+                                                        .srcAccelerationStructure = m_tlas.accel,  // Updates in place
+                                                        .dstAccelerationStructure = m_tlas.accel,
+                                                        .geometryCount            = 1,
+                                                        .pGeometries              = &geometry,
+                                                        .scratchData = {.deviceAddress = m_tlasScratchAddress}};
+  VkAccelerationStructureBuildRangeInfoKHR        range{.primitiveCount = numInstances};
+  const VkAccelerationStructureBuildRangeInfoKHR* rangeInfo = &range;
+  VkCommandBuffer                                 cmdBuffer = beginCommands();
+  vkCmdBuildAccelerationStructuresKHR(cmdBuffer, 1, &buildInfo, &rangeInfo);
+  submit(cmdBuffer);
+  m_tlasUpdateMs = millisecondsSince(updateStart);
+  m_tlasUpdateCount++;
+  return true;
+}
+
+VkAccelerationStructureGeometryKHR AccelManager::tlasGeometry() const
+{
+  return {.sType        = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR,
+          .geometryType = VK_GEOMETRY_TYPE_INSTANCES_KHR,
+          .geometry     = {.instances = {.sType           = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR,
+                                         .arrayOfPointers = VK_FALSE,
+                                         .data            = {.deviceAddress = bufferAddress(m_instanceBuffer)}}}};
+}
+
+void AccelManager::logBlasBuildReport(const AccelStats& totals) const
+{
+  if(m_blasOnHost)
+  {
+    LOGI("    Built on the host by %u thread(s) (the driver could use %u) in %.3f ms, with %.3f MB of host scratch memory.\n",
+         m_blasHostThreads, m_blasHostConcurrency, m_blasBuildMs, toMB(m_blasScratchBufferSize));
+    LOGI("    %s into device memory took %.3f ms; %.3f MB of host-visible memory was used while building.\n",
+         m_blasCompacted ? "Compacting" : "Copying", m_blasCompactionMs, toMB(m_blasPeakBytes));
+    return;
+  }
+  LOGI("    Scratch buffer: %.3f MB, shared by all builds (%.3f MB if each build had its own).\n",
+       toMB(m_blasScratchBufferSize), toMB(totals.scratchSize));
+  if(m_blasBatchBudget > 0)
+  {
+    LOGI("    Built in %u batch(es) of at most %.3f MB each; peak memory use was %.3f MB.\n", m_blasBatchCount,
+         toMB(m_blasBatchBudget), toMB(m_blasPeakBytes));
+  }
+  else
+  {
+    LOGI("    Built in one batch; peak memory use was %.3f MB.\n", toMB(m_blasPeakBytes));
+  }
+  if(m_blasCompacted)
+  {
+    const VkDeviceSize saved = totals.builtSize - totals.finalSize;
+    LOGI("    Compaction saved %.3f MB (%.1f%%), and added %.3f ms to the %.3f ms build (%.1f%%).\n", toMB(saved),
+         (totals.builtSize > 0) ? 100.0 * static_cast<double>(saved) / static_cast<double>(totals.builtSize) : 0.0,
+         m_blasCompactionMs, m_blasBuildMs, (m_blasBuildMs > 0.0) ? 100.0 * m_blasCompactionMs / m_blasBuildMs : 0.0);
+  }
+  else
+  {
+    LOGI("    Built in %.3f ms without compaction.\n", m_blasBuildMs);
+  }
+}
+
+void AccelManager::logReport() const
+{
+  AccelStats totals;
+  for(const AccelStats& stats : m_blasStats)
+  {
+    totals.primitiveCount += stats.primitiveCount;
+    totals.builtSize += stats.builtSize;
+    totals.finalSize += stats.finalSize;
+    totals.scratchSize += stats.scratchSize;
+  }
+  LOGI("Acceleration structures:\n");
+  LOGI("  %zu BLAS(es) with %llu triangles: %.3f MB as built, %.3f MB in use.\n", m_blasStats.size(),
+       static_cast<unsigned long long>(totals.primitiveCount), toMB(totals.builtSize), toMB(totals.finalSize));
+  if(m_blasFromCache)
+  {
+    LOGI("    Loaded from the cache in %.3f ms, without building.\n", m_blasBuildMs);
+  }
+  else
+  {
+    logBlasBuildReport(totals);
+  }
+
+  // List the largest BLASes, which are the ones worth optimizing:
+  const size_t          numListed = std::min<size_t>(m_blasStats.size(), 8);
+  std::vector<uint32_t> order(m_blasStats.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::partial_sort(order.begin(), order.begin() + numListed, order.end(),
+                    [this](uint32_t a, uint32_t b) { return m_blasStats[a].builtSize > m_blasStats[b].builtSize; });
+  LOGI("    %-8s %12s %12s %12s %12s\n", "BLAS", "Triangles", "Built (KB)", "Final (KB)", "Scratch (KB)");
+  for(size_t i = 0; i < numListed; i++)
+  {
+    const AccelStats& stats = m_blasStats[order[i]];
+    LOGI("    %-8u %12llu %12.1f %12.1f %12.1f\n", order[i], static_cast<unsigned long long>(stats.primitiveCount),
+         static_cast<double>(stats.builtSize) / 1024.0, static_cast<double>(stats.finalSize) / 1024.0,
+         static_cast<double>(stats.scratchSize) / 1024.0);
+  }
+  if(numListed < m_blasStats.size())
+  {
+    LOGI("    (%zu smaller BLASes not listed)\n", m_blasStats.size() - numListed);
+  }
+
+  // The TLAS grows with the number of instances, so report its cost per instance:
+  const uint64_t numInstances = std::max<uint64_t>(1, m_tlasStats.primitiveCount);
+  LOGI("  TLAS with %llu instances: %.3f MB (%.1f bytes per instance), %.3f MB of scratch, %.3f MB of instance data; built in %.3f ms.\n",
+       static_cast<unsigned long long>(m_tlasStats.primitiveCount), toMB(m_tlasStats.finalSize),
+       static_cast<double>(m_tlasStats.finalSize) / static_cast<double>(numInstances), toMB(m_tlasStats.scratchSize),
+       toMB(m_tlasStats.primitiveCount * sizeof(VkAccelerationStructureInstanceKHR)), m_tlasBuildMs);
+  if(m_tlasFlags & VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR)
+  {
+    LOGI("    Updatable: keeps %.3f MB of scratch; %u update(s) (last took %.3f ms) and %u build(s).\n",
+         toMB(std::max(m_tlasStats.scratchSize, m_tlasUpdateScratchSize)), m_tlasUpdateCount, m_tlasUpdateMs, m_tlasBuildCount);
+  }
+  LOGI("  Total: %.3f MB of acceleration structures.\n", toMB(totals.finalSize + m_tlasStats.finalSize));
+}
+
+void runBlasBudgetBenchmark(VkDevice                 device,
+                            VkPhysicalDevice         physicalDevice,
+                            VkQueue                  queue,
+                            uint32_t                 queueFamilyIndex,
+                            nvvk::ResourceAllocator& allocator,
+                            uint32_t                 numMeshes)
+{
+  // Each mesh is a bumpy grid of a random resolution, so that BLAS sizes vary
+  // over two orders of magnitude like the meshes of a real scene. All meshes
+  // share one buffer of vertices followed by indices.
+  struct SyntheticMesh
+  {
+    uint32_t firstVertex, vertexCount, firstIndex, indexCount;
+  };
+  std::minstd_rand                        randomEngine(1);
+  std::uniform_int_distribution<uint32_t> resolutionDist(2, 64);
+  std::uniform_real_distribution<float>   heightDist(-0.1f, 0.1f);
+  std::vector<SyntheticMesh>              meshes(numMeshes);
+  std::vector<float>                      vertices;
+  std::vector<uint32_t>                   indices;
+  for(SyntheticMesh& mesh : meshes)
+  {
+    const uint32_t resolution = resolutionDist(randomEngine);  // Quads per side
+    mesh                      = {.firstVertex = static_cast<uint32_t>(vertices.size() / 3),
+                                 .vertexCount = (resolution + 1) * (resolution + 1),
+                                 .firstIndex  = static_cast<uint32_t>(indices.size()),
+                                 .indexCount  = resolution * resolution * 6};
+    for(uint32_t y = 0; y <= resolution; y++)
+    {
+      for(uint32_t x = 0; x <= resolution; x++)
+      {
+        vertices.insert(vertices.end(), {float(x) / float(resolution), float(y) / float(resolution), heightDist(randomEngine)});
+      }
+    }
+    for(uint32_t y = 0; y < resolution; y++)
+    {
+      for(uint32_t x = 0; x < resolution; x++)
+      {
+        const uint32_t v = y * (resolution + 1) + x;  // Relative to the mesh's first vertex
+        indices.insert(indices.end(), {v, v + 1, v + resolution + 1, v + 1, v + resolution + 2, v + resolution + 1});
+      }
+    }
+  }
+  const VkDeviceSize vertexBytes = vertices.size() * sizeof(float);
+  const VkDeviceSize indexBytes  = indices.size() * sizeof(uint32_t);
+  nvvk::Buffer       geometryBuffer =
+      allocator.createBuffer(vertexBytes + indexBytes,
+                             VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR,
+                             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  uint8_t* mapped = static_cast<uint8_t*>(allocator.map(geometryBuffer));
+  memcpy(mapped, vertices.data(), vertexBytes);
+  memcpy(mapped + vertexBytes, indices.data(), indexBytes);
+  allocator.unmap(geometryBuffer);
+  const VkDeviceAddress geometryAddress = getBufferDeviceAddress(device, geometryBuffer.buffer);
+
+  std::vector<AccelManager::BlasInput> inputs(numMeshes);
+  for(uint32_t meshIdx = 0; meshIdx < numMeshes; meshIdx++)
+  {
+    const SyntheticMesh&                            mesh = meshes[meshIdx];
+    VkAccelerationStructureGeometryTrianglesDataKHR triangles{
+        .sType        = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR,
+        .vertexFormat = VK_FORMAT_R32G32B32_SFLOAT,
+        .vertexData   = {.deviceAddress = geometryAddress + VkDeviceSize(mesh.firstVertex) * 3 * sizeof(float)},
+        .vertexStride = 3 * sizeof(float),
+        .maxVertex    = mesh.vertexCount - 1,
+        .indexType    = VK_INDEX_TYPE_UINT32,
+        .indexData    = {.deviceAddress = geometryAddress + vertexBytes + VkDeviceSize(mesh.firstIndex) * sizeof(uint32_t)}};
+    inputs[meshIdx].asGeometry.push_back({.sType        = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR,
+                                          .geometryType = VK_GEOMETRY_TYPE_TRIANGLES_KHR,
+                                          .geometry     = {.triangles = triangles},
+                                          .flags        = VK_GEOMETRY_OPAQUE_BIT_KHR});
+    inputs[meshIdx].asBuildOffsetInfo.push_back({.primitiveCount = mesh.indexCount / 3});
+  }
+
+  LOGI("BLAS budget benchmark: %u synthetic meshes, %zu triangles\n", numMeshes, indices.size() / 3);
+  LOGI("  %-12s %8s %16s %14s %12s\n", "Budget (MB)", "Batches", "Peak memory (MB)", "Final (MB)", "Time (ms)");
+  // 0 means no budget, i.e. a single batch.
+  for(const uint32_t budgetMB : {0u, 256u, 64u, 16u, 4u, 1u})
+  {
+    AccelManager accelManager;
+    accelManager.init(device, physicalDevice, queue, queueFamilyIndex, allocator);
+    accelManager.buildBlas(inputs,
+                           VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR | VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR,
+                           VkDeviceSize(budgetMB) * 1024 * 1024);
+    VkDeviceSize finalBytes = 0;
+    for(const AccelManager::AccelStats& stats : accelManager.blasStats())
+    {
+      finalBytes += stats.finalSize;
+    }
+    const std::string budgetName = (budgetMB == 0) ? "none" : std::to_string(budgetMB);
+    LOGI("  %-12s %8u %16.3f %14.3f %12.3f\n", budgetName.c_str(), accelManager.blasBatchCount(),
+         toMB(accelManager.blasPeakBytes()), toMB(finalBytes), accelManager.blasTotalMs());
+    accelManager.deinit();
+  }
+  allocator.destroy(geometryBuffer);
+}
+
+void runTlasUpdateBenchmark(VkDevice                  device,
+                            VkPhysicalDevice          physicalDevice,
+                            VkQueue                   queue,
+                            uint32_t                  queueFamilyIndex,
+                            nvvk::ResourceAllocator&  allocator,
+                            VkDeviceAddress           blasAddress,
+                            const VkAabbPositionsKHR& blasBounds)
+{
+  const uint32_t numFrames = 16;
+  LOGI("TLAS update benchmark: average time per frame over %u animated frames\n", numFrames);
+  LOGI("  %-10s %14s %14s %10s %10s\n", "Instances", "Rebuild (ms)", "Refit (ms)", "Speedup", "Fallbacks");
+  for(const uint32_t numInstances : {441u, 10000u, 1000000u})
+  {
+    // Instances on a cubic grid, each spinning around its own vertical axis
+    // and bobbing up and down, like a turntable of many objects.
+    const uint32_t side = static_cast<uint32_t>(std::ceil(std::cbrt(double(numInstances))));
+    std::vector<VkAccelerationStructureInstanceKHR> instances(numInstances);
+    const std::vector<VkAabbPositionsKHR>           instanceBounds(numInstances, blasBounds);
+    const auto animate = [&](float time) {
+      for(uint32_t instanceIdx = 0; instanceIdx < numInstances; instanceIdx++)
+      {
+        const float x     = 2.0f * float(instanceIdx % side);
+        const float y     = 2.0f * float((instanceIdx / side) % side) + 0.1f * std::sin(time + float(instanceIdx));
+        const float z     = 2.0f * float(instanceIdx / (side * side));
+        const float angle = time + 0.1f * float(instanceIdx);
+        const float c = std::cos(angle), s = std::sin(angle);
+        instances[instanceIdx] = {.transform = {.matrix = {{c, 0.0f, s, x}, {0.0f, 1.0f, 0.0f, y}, {-s, 0.0f, c, z}}},
+                                  .mask      = 0xFF,
+                                  .flags     = VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR,
+                                  .accelerationStructureReference = blasAddress};
+      }
+    };
+
+    AccelManager rebuilt, refit;
+    rebuilt.init(device, physicalDevice, queue, queueFamilyIndex, allocator);
+    refit.init(device, physicalDevice, queue, queueFamilyIndex, allocator);
+    animate(0.0f);
+    rebuilt.buildTlas(instances, VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR);
+    refit.buildTlas(instances, VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR | VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR,
+                    instanceBounds);
+    double   rebuildMs = 0.0, refitMs = 0.0;
+    uint32_t numFallbacks = 0;
+    for(uint32_t frame = 1; frame <= numFrames; frame++)
+    {
+      animate(0.05f * float(frame));
+      rebuilt.buildTlas(instances, VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR);
+      rebuildMs += rebuilt.tlasBuildMs();
+      if(refit.updateTlas(instances, instanceBounds))
+      {
+        refitMs += refit.tlasUpdateMs();
+      }
+      else
+      {
+        refitMs += refit.tlasBuildMs();
+        numFallbacks++;
+      }
+    }
+    LOGI("  %-10u %14.3f %14.3f %9.2fx %10u\n", numInstances, rebuildMs / numFrames, refitMs / numFrames,
+         (refitMs > 0.0) ? rebuildMs / refitMs : 0.0, numFallbacks);
+    rebuilt.deinit();
+    refit.deinit();
+  }
+}
+
+void runHostBuildBenchmark(VkDevice                                 device,
+                           VkPhysicalDevice                         physicalDevice,
+                           VkQueue                                  queue,
+                           uint32_t                                 queueFamilyIndex,
+                           nvvk::ResourceAllocator&                 allocator,
+                           std::span<const AccelManager::BlasInput> deviceInputs,
+                           std::span<const AccelManager::BlasInput> hostInputs,
+                           ThreadPool&                              pool)
+{
+  const VkBuildAccelerationStructureFlagsKHR flags =
+      VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR | VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR;
+  AccelManager accelManager;
+  accelManager.init(device, physicalDevice, queue, queueFamilyIndex, allocator);
+  accelManager.buildBlas(deviceInputs, flags);
+  const double deviceMs = accelManager.blasTotalMs();
+  LOGI("Host BLAS build benchmark: %zu BLAS(es); building and compacting on the GPU takes %.3f ms\n", hostInputs.size(), deviceMs);
+  LOGI("  %-10s %8s %12s %14s %12s %10s\n", "Threads", "Joined", "Driver max", "Total (ms)", "Speedup", "vs. GPU");
+
+  // The pool's workers plus the calling thread can join the operation.
+  const uint32_t maxThreads  = pool.numThreads() + 1;
+  double         oneThreadMs = 0.0;
+  for(uint32_t numThreads = 1;; numThreads = std::min(numThreads * 2, maxThreads))
+  {
+    accelManager.buildBlasOnHost(hostInputs, flags, pool, numThreads);
+    const double totalMs = accelManager.blasTotalMs();
+    if(numThreads == 1)
+    {
+      oneThreadMs = totalMs;
+    }
+    LOGI("  %-10u %8u %12u %14.3f %11.2fx %9.2fx\n", numThreads, accelManager.blasHostThreads(),
+         accelManager.blasHostConcurrency(), totalMs, (totalMs > 0.0) ? oneThreadMs / totalMs : 0.0,
+         (totalMs > 0.0) ? deviceMs / totalMs : 0.0);
+    if(numThreads == maxThreads)
+    {
+      break;
+    }
+  }
+  accelManager.deinit();
+}
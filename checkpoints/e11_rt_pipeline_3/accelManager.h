@@ -0,0 +1,275 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+// Builds and owns the scene's acceleration structures, and records what they
+// cost. This does what nvvk::RaytracingBuilderKHR does (build BLASes, compact
+// them, then build a TLAS over instances of them), but keeps track of the
+// numbers the builder hides, so that we can size VRAM budgets:
+// - how large each BLAS was as built and after compaction,
+// - how large the scratch buffers were, and
+// - how long building, compacting (size queries and copies), and building
+//   the TLAS took.
+// logReport() prints a summary, including how much memory compaction saved
+// compared to how much time it added to the build.
+//
+// Scenes with thousands of meshes can need more memory for uncompacted BLASes
+// than the GPU has, even if the compacted BLASes would fit. buildBlas() can
+// therefore build BLASes in batches under a memory budget: each batch is
+// built and compacted before the next one starts, and all batches reuse the
+// same scratch buffer. Smaller budgets lower peak memory use, but cost more
+// time, since every batch waits for the GPU twice.
+//
+// On devices with the accelerationStructureHostCommands feature,
+// buildBlasOnHost() builds BLASes on the CPU instead
+// (vkBuildAccelerationStructuresKHR), as a deferred operation
+// (VK_KHR_deferred_host_operations) that several threads of a ThreadPool work
+// on together. This leaves the queue free for rendering, e.g. while the next
+// scene loads; the GPU only copies the finished BLASes into device memory.
+#ifndef VK_MINI_PATH_TRACER_ACCEL_MANAGER_H
+#define VK_MINI_PATH_TRACER_ACCEL_MANAGER_H
+
+#include <array>
+#include <functional>
+#include <span>
+#include <vector>
+
+#include <nvvk/resourceallocator_vk.hpp>
+
+#include "threadPool.h"
+
+class AccelManager
+{
+public:
+  // The geometries of one BLAS, and how many primitives to read from each.
+  struct BlasInput
+  {
+    std::vector<VkAccelerationStructureGeometryKHR>       asGeometry;
+    std::vector<VkAccelerationStructureBuildRangeInfoKHR> asBuildOffsetInfo;
+  };
+
+  // What one acceleration structure cost.
+  struct AccelStats
+  {
+    uint64_t     primitiveCount = 0;  // Triangles for a BLAS, instances for a TLAS
+    VkDeviceSize builtSize      = 0;  // Size of the acceleration structure as built
+    VkDeviceSize finalSize      = 0;  // Size after compaction; equal to builtSize if it wasn't compacted
+    VkDeviceSize scratchSize    = 0;  // Scratch memory its build needed
+  };
+
+  // AccelManager owns Vulkan objects, so it can't be copied. Moving hands
+  // them over and leaves the source without any; moving into an AccelManager
+  // first deinit()s it.
+  AccelManager() = default;
+  AccelManager(const AccelManager&)            = delete;
+  AccelManager& operator=(const AccelManager&) = delete;
+  AccelManager(AccelManager&& other) noexcept;
+  AccelManager& operator=(AccelManager&& other) noexcept;
+  void          swap(AccelManager& other) noexcept;
+
+  // Builds are submitted to `queue`, which must belong to `queueFamilyIndex`.
+  void init(VkDevice device, VkPhysicalDevice physicalDevice, VkQueue queue, uint32_t queueFamilyIndex, nvvk::ResourceAllocator& allocator);
+  void deinit();
+
+  // Builds one BLAS per input, and waits for the builds to finish. If
+  // `flags` contains VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR,
+  // this then compacts them.
+  // If `batchBudget` isn't 0, consecutive inputs are grouped into batches
+  // whose uncompacted BLASes take at most `batchBudget` bytes (or a single
+  // BLAS, if it is larger than that), and each batch is compacted before the
+  // next one is built.
+  // BLASes built with VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR
+  // are never compacted, so that refitBlas() can rebuild them in place.
+  void buildBlas(std::span<const BlasInput> inputs, VkBuildAccelerationStructureFlagsKHR flags, VkDeviceSize batchBudget = 0);
+  // Like buildBlas(), but builds on the CPU: the inputs' geometry must use
+  // host addresses, and the device must have enabled the
+  // accelerationStructureHostCommands feature. The builds run as one deferred
+  // operation, which up to `maxThreads` threads (workers of `pool` and the
+  // calling thread) join, limited by how many the driver can use. The BLASes
+  // are built in host-visible memory, then copied (compacted, if `flags` allow
+  // it) into device-local memory by the GPU.
+  void buildBlasOnHost(std::span<const BlasInput>           inputs,
+                       VkBuildAccelerationStructureFlagsKHR flags,
+                       ThreadPool&                          pool,
+                       uint32_t                             maxThreads);
+  // For deforming meshes: after their vertices changed, refits (or if
+  // `rebuild` is true, rebuilds) BLASes `blasIndices[i]` from `inputs[i]`.
+  // The inputs must have the same primitive counts as when the BLASes were
+  // built, and the BLASes must have been built with
+  // VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR. Refitting keeps
+  // each BLAS's tree, so it gets slower to trace the more triangles move
+  // relative to each other; rebuilding every few frames restores it. Since
+  // instance bounds come from BLASes, the TLAS needs an update afterwards.
+  // Waits for the GPU to finish.
+  void refitBlas(std::span<const uint32_t> blasIndices, std::span<const BlasInput> inputs, bool rebuild = false);
+  // For caching BLASes on disk: copies each BLAS into a
+  // device-specific serialized form (VK_COPY_ACCELERATION_STRUCTURE_MODE_SERIALIZE_KHR).
+  // Returns false if that failed.
+  bool serializeBlas(std::vector<std::vector<uint8_t>>& blobs);
+  // Replaces the BLASes with ones deserialized from `blobs`, instead of
+  // building them from `inputs` (which are only used for statistics). The
+  // caller must have checked that the blobs are compatible with this device
+  // (see accelCache.h). Returns false if the blobs are malformed.
+  bool deserializeBlas(std::span<const BlasInput> inputs, std::span<const std::span<const uint8_t>> blobs);
+  // Builds the TLAS over `instances`, and waits for the build to finish.
+  // `instanceBounds` are only needed for TLASes that updateTlas() updates.
+  void buildTlas(std::span<const VkAccelerationStructureInstanceKHR> instances,
+                 VkBuildAccelerationStructureFlagsKHR                flags,
+                 std::span<const VkAabbPositionsKHR>                 instanceBounds = {});
+  // Like buildTlas(), but for `numInstances` instances the GPU writes itself
+  // (see instanceGenerator.h): `recordInstanceWrites` records commands that
+  // write them to the device-local buffer at the address it gets, and the
+  // build follows in the same command buffer, so instances never pass through
+  // host memory. Since updateTlas() needs instances on the host, this ignores
+  // VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR.
+  void buildTlasOnDevice(uint32_t                                                      numInstances,
+                         VkBuildAccelerationStructureFlagsKHR                          flags,
+                         const std::function<void(VkCommandBuffer, VkDeviceAddress)>& recordInstanceWrites);
+  // For animation: rewrites the instance buffer in place and refits the TLAS
+  // to the new transforms, which is much faster than building it again. This
+  // needs a TLAS built with VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR
+  // over the same number of instances; otherwise, this rebuilds it.
+  // Refitting makes the TLAS slower to trace the more the instances' boxes
+  // change, so once they have moved by more than `rebuildThreshold` times the
+  // size of the scene on average since the last build, this rebuilds the TLAS
+  // instead. An instance's box is the object-space box `instanceBounds[i]`
+  // of its BLAS, transformed to world space, so rotating or scaling an
+  // instance counts as well as moving it; if `instanceBounds` is empty,
+  // instances count as points, which only translations move. The bounds
+  // should match the ones given to buildTlas(). Returns true if it refit the
+  // TLAS, and false if it rebuilt it. Waits for the GPU to finish.
+  bool updateTlas(std::span<const VkAccelerationStructureInstanceKHR> instances,
+                  std::span<const VkAabbPositionsKHR>                 instanceBounds,
+                  float                                               rebuildThreshold = 0.1f);
+
+  VkDeviceAddress            getBlasDeviceAddress(uint32_t blasIdx) const { return m_blasAddresses[blasIdx]; }
+  VkAccelerationStructureKHR getTlas() const { return m_tlas.accel; }
+
+  const std::vector<AccelStats>& blasStats() const { return m_blasStats; }
+  const AccelStats&              tlasStats() const { return m_tlasStats; }
+  // The most memory BLASes and their scratch buffer used at once while building.
+  VkDeviceSize blasPeakBytes() const { return m_blasPeakBytes; }
+  uint32_t     blasBatchCount() const { return m_blasBatchCount; }
+  // Time spent building and compacting BLASes, or deserializing them if
+  // blasFromCache() is true.
+  double blasTotalMs() const { return m_blasBuildMs + m_blasCompactionMs; }
+  // True if the BLASes came from deserializeBlas() instead of a build.
+  bool blasFromCache() const { return m_blasFromCache; }
+  // For buildBlasOnHost(): how many threads joined the last host build, and
+  // how many the driver said it could use (vkGetDeferredOperationMaxConcurrencyKHR()).
+  uint32_t blasHostThreads() const { return m_blasHostThreads; }
+  uint32_t blasHostConcurrency() const { return m_blasHostConcurrency; }
+  // Time the last TLAS build or update took, including writing instances.
+  double tlasBuildMs() const { return m_tlasBuildMs; }
+  double tlasUpdateMs() const { return m_tlasUpdateMs; }
+  // Time the last refitBlas() call took.
+  double blasRefitMs() const { return m_blasRefitMs; }
+
+  // Logs the memory and time the acceleration structures took.
+  void logReport() const;
+
+private:
+  // Command buffers for one-off work; submit() waits for the queue to go idle.
+  VkCommandBuffer beginCommands();
+  void            submit(VkCommandBuffer cmdBuffer);
+  // Creates a buffer of at least `size` bytes whose device address is a
+  // multiple of the scratch alignment, and returns that address.
+  VkDeviceAddress createScratch(VkDeviceSize size, nvvk::Buffer& buffer);
+  nvvk::AccelKHR  createAccel(VkAccelerationStructureTypeKHR type,
+                              VkDeviceSize                   size,
+                              VkMemoryPropertyFlags          memProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  VkDeviceAddress bufferAddress(const nvvk::Buffer& buffer) const;
+  VkDeviceAddress accelAddress(VkAccelerationStructureKHR accel) const;
+  void            logBlasBuildReport(const AccelStats& totals) const;
+  // Copies instances to m_instanceBuffer, growing it if needed.
+  void writeInstances(std::span<const VkAccelerationStructureInstanceKHR> instances);
+  // Creates the TLAS and its scratch buffer for `numInstances` instances in
+  // m_instanceBuffer, and records its build.
+  void                               recordTlasBuild(VkCommandBuffer cmdBuffer, uint32_t numInstances);
+  VkAccelerationStructureGeometryKHR tlasGeometry() const;
+
+  VkDevice                 m_device           = VK_NULL_HANDLE;
+  VkQueue                  m_queue            = VK_NULL_HANDLE;
+  VkCommandPool            m_cmdPool          = VK_NULL_HANDLE;
+  nvvk::ResourceAllocator* m_allocator        = nullptr;
+  VkDeviceSize             m_scratchAlignment = 1;
+
+  std::vector<nvvk::AccelKHR>  m_blas;
+  std::vector<VkDeviceAddress> m_blasAddresses;
+  nvvk::AccelKHR               m_tlas;
+  nvvk::Buffer                 m_instanceBuffer;
+  VkDeviceSize                 m_instanceBufferSize = 0;
+  bool                         m_instancesOnDevice  = false;  // If true, m_instanceBuffer is device-local and written by the GPU
+
+  // State for BLAS updates:
+  VkBuildAccelerationStructureFlagsKHR m_blasFlags          = 0;
+  nvvk::Buffer                         m_blasScratchBuffer;       // Only kept if the BLASes can be updated
+  VkDeviceAddress                      m_blasScratchAddress = 0;
+
+  // State for TLAS updates:
+  VkBuildAccelerationStructureFlagsKHR m_tlasFlags          = 0;
+  nvvk::Buffer                         m_tlasScratchBuffer;       // Only kept if the TLAS can be updated
+  VkDeviceAddress                      m_tlasScratchAddress = 0;
+  std::vector<VkAabbPositionsKHR>      m_tlasBuildBounds;         // World-space instance boxes at the last build
+  float                                m_tlasBuildExtent    = 0.0f;  // Diagonal of the box around m_tlasBuildBounds
+
+  // Statistics:
+  std::vector<AccelStats> m_blasStats;
+  AccelStats              m_tlasStats;
+  VkDeviceSize            m_blasScratchBufferSize = 0;  // Size of the scratch buffer shared by all BLAS builds
+  VkDeviceSize            m_blasUpdateScratchSize = 0;
+  VkDeviceSize            m_blasBatchBudget       = 0;
+  VkDeviceSize            m_blasPeakBytes         = 0;
+  uint32_t                m_blasBatchCount        = 0;
+  bool                    m_blasCompacted         = false;
+  bool                    m_blasFromCache         = false;  // If true, m_blasBuildMs is the time deserializing took
+  bool                    m_blasOnHost            = false;  // If true, m_blasCompactionMs includes copying to device memory
+  uint32_t                m_blasHostThreads       = 0;
+  uint32_t                m_blasHostConcurrency   = 0;      // vkGetDeferredOperationMaxConcurrencyKHR()
+  double                  m_blasBuildMs           = 0.0;
+  double                  m_blasCompactionMs      = 0.0;  // Size queries, copies, and freeing the originals
+  double                  m_blasRefitMs           = 0.0;
+  double                  m_tlasBuildMs           = 0.0;
+  double                  m_tlasUpdateMs          = 0.0;
+  VkDeviceSize            m_tlasUpdateScratchSize = 0;
+  float                   m_tlasDegradation       = 0.0f;  // See updateTlas()
+  uint32_t                m_tlasBuildCount        = 0;
+  uint32_t                m_tlasUpdateCount       = 0;
+};
+
+// --bench-blas-budget: builds BLASes for a synthetic scene of `numMeshes`
+// meshes of different sizes under several batch budgets, and logs peak
+// memory use against build time for each.
+// The arguments other than `numMeshes` are the same as for AccelManager::init().
+void runBlasBudgetBenchmark(VkDevice                 device,
+                            VkPhysicalDevice         physicalDevice,
+                            VkQueue                  queue,
+                            uint32_t                 queueFamilyIndex,
+                            nvvk::ResourceAllocator& allocator,
+                            uint32_t                 numMeshes);
+
+// --bench-tlas-update: builds TLASes of 441, 10k and 1M animated instances of
+// the BLAS at `blasAddress`, whose object-space box is `blasBounds`, and logs
+// how long updating them takes per frame compared to rebuilding them.
+// Arguments are otherwise as for runBlasBudgetBenchmark().
+void runTlasUpdateBenchmark(VkDevice                  device,
+                            VkPhysicalDevice          physicalDevice,
+                            VkQueue                   queue,
+                            uint32_t                  queueFamilyIndex,
+                            nvvk::ResourceAllocator&  allocator,
+                            VkDeviceAddress           blasAddress,
+                            const VkAabbPositionsKHR& blasBounds);
+
+// --bench-host-build: builds the BLASes of `hostInputs` on the CPU with 1, 2,
+// 4, ... threads of `pool`, and logs how the build time scales, compared to
+// building `deviceInputs` (the same geometry, read through device addresses)
+// on the GPU. Arguments are otherwise as for runBlasBudgetBenchmark().
+void runHostBuildBenchmark(VkDevice                                 device,
+                           VkPhysicalDevice                         physicalDevice,
+                           VkQueue                                  queue,
+                           uint32_t                                 queueFamilyIndex,
+                           nvvk::ResourceAllocator&                 allocator,
+                           std::span<const AccelManager::BlasInput> deviceInputs,
+                           std::span<const AccelManager::BlasInput> hostInputs,
+                           ThreadPool&                              pool);
+
+#endif  // #ifndef VK_MINI_PATH_TRACER_ACCEL_MANAGER_H
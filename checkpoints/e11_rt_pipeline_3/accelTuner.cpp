@@ -0,0 +1,131 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+#include "accelTuner.h"
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include <nvh/nvprint.hpp>
+
+#include "measurement.h"
+
+namespace {
+
+const VkBuildAccelerationStructureFlagsKHR k_fastTrace  = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR;
+const VkBuildAccelerationStructureFlagsKHR k_fastBuild  = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_BUILD_BIT_KHR;
+const VkBuildAccelerationStructureFlagsKHR k_lowMemory  = VK_BUILD_ACCELERATION_STRUCTURE_LOW_MEMORY_BIT_KHR;
+const VkBuildAccelerationStructureFlagsKHR k_compaction = VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR;
+
+const std::array<AccelFlagPreset, 6> k_presets = {{
+    {.name = "fast-trace", .blasFlags = k_fastTrace | k_compaction, .tlasFlags = k_fastTrace},
+    {.name = "fast-trace-uncompacted", .blasFlags = k_fastTrace, .tlasFlags = k_fastTrace},
+    {.name = "fast-build", .blasFlags = k_fastBuild | k_compaction, .tlasFlags = k_fastBuild},
+    {.name = "fast-build-uncompacted", .blasFlags = k_fastBuild, .tlasFlags = k_fastBuild},
+    {.name = "low-memory", .blasFlags = k_lowMemory | k_compaction, .tlasFlags = k_fastTrace},
+    {.name = "driver-default", .blasFlags = k_compaction, .tlasFlags = 0},
+}};
+
+// Traces are short, so the first one with a new TLAS can include one-time
+// costs such as paging in memory; the tuner keeps the fastest of this many.
+const uint32_t k_traceRepetitions = 2;
+
+// What one preset cost.
+struct PresetResult
+{
+  double       blasMs      = 0.0;  // Building and compacting
+  double       tlasMs      = 0.0;
+  double       msPerSpp    = 0.0;  // Tracing one sample per pixel
+  VkDeviceSize bytes       = 0;    // BLASes and TLAS after compaction
+  VkDeviceSize peakBytes   = 0;    // BLASes and scratch while building
+  double       timeToImage = 0.0;
+};
+
+}  // namespace
+
+std::span<const AccelFlagPreset> accelFlagPresets()
+{
+  return k_presets;
+}
+
+const AccelFlagPreset* findAccelFlagPreset(const std::string& name)
+{
+  const auto preset = std::ranges::find_if(k_presets, [&](const AccelFlagPreset& p) { return name == p.name; });
+  return (preset != k_presets.end()) ? &*preset : nullptr;
+}
+
+uint32_t tuneAccelFlags(VkDevice                                             device,
+                        VkPhysicalDevice                                     physicalDevice,
+                        VkQueue                                              queue,
+                        uint32_t                                             queueFamilyIndex,
+                        nvvk::ResourceAllocator&                             allocator,
+                        std::span<const AccelManager::BlasInput>             blases,
+                        std::span<const VkAccelerationStructureInstanceKHR> instances,
+                        std::span<const uint32_t>                            instanceBlases,
+                        const AccelTraceFunction&                            trace,
+                        uint32_t                                             tracedSpp,
+                        uint32_t                                             targetSpp,
+                        AccelManager&                                        best)
+{
+  LOGI("Acceleration structure flag tuning: %zu BLAS(es), %zu instance(s), tracing %u spp per preset for a %u spp image\n",
+       blases.size(), instances.size(), tracedSpp, targetSpp);
+  LOGI("  %-24s %12s %12s %10s %10s %12s %16s\n", "Preset", "BLAS (ms)", "TLAS (ms)", "MB", "Peak MB", "ms/spp", "To image (ms)");
+
+  std::vector<PresetResult>                       results(k_presets.size());
+  std::vector<VkAccelerationStructureInstanceKHR> presetInstances(instances.begin(), instances.end());
+  uint32_t                                        bestIdx = 0;
+  for(uint32_t presetIdx = 0; presetIdx < k_presets.size(); presetIdx++)
+  {
+    const AccelFlagPreset& preset = k_presets[presetIdx];
+    AccelManager           candidate;
+    candidate.init(device, physicalDevice, queue, queueFamilyIndex, allocator);
+    candidate.buildBlas(blases, preset.blasFlags);
+    for(size_t instanceIdx = 0; instanceIdx < presetInstances.size(); instanceIdx++)
+    {
+      presetInstances[instanceIdx].accelerationStructureReference = candidate.getBlasDeviceAddress(instanceBlases[instanceIdx]);
+    }
+    candidate.buildTlas(presetInstances, preset.tlasFlags);
+
+    double traceMs = std::numeric_limits<double>::max();
+    for(uint32_t repetition = 0; repetition < k_traceRepetitions; repetition++)
+    {
+      traceMs = std::min(traceMs, trace(candidate.getTlas()));
+    }
+
+    PresetResult& result = results[presetIdx];
+    result.blasMs        = candidate.blasTotalMs();
+    result.tlasMs        = candidate.tlasBuildMs();
+    result.msPerSpp      = traceMs / std::max(1u, tracedSpp);
+    result.peakBytes     = candidate.blasPeakBytes();
+    result.bytes         = candidate.tlasStats().finalSize;
+    for(const AccelManager::AccelStats& stats : candidate.blasStats())
+    {
+      result.bytes += stats.finalSize;
+    }
+    result.timeToImage = result.blasMs + result.tlasMs + result.msPerSpp * targetSpp;
+    LOGI("  %-24s %12.3f %12.3f %10.3f %10.3f %12.4f %16.3f\n", preset.name, result.blasMs, result.tlasMs,
+         toMB(result.bytes), toMB(result.peakBytes), result.msPerSpp, result.timeToImage);
+
+    // Keep only the best acceleration structures so far. Moving the candidate
+    // into `best` frees the previous best ones.
+    if(presetIdx == 0 || result.timeToImage < results[bestIdx].timeToImage)
+    {
+      best    = std::move(candidate);
+      bestIdx = presetIdx;
+    }
+    else
+    {
+      candidate.deinit();
+    }
+  }
+
+  const PresetResult& defaultResult = results[0];
+  const PresetResult& bestResult    = results[bestIdx];
+  LOGI("Recommended acceleration structure flags for %u spp: --accel-flags %s (%.3f ms to image, %.1f%% less than %s).\n",
+       targetSpp, k_presets[bestIdx].name, bestResult.timeToImage,
+       (defaultResult.timeToImage > 0.0) ? 100.0 * (1.0 - bestResult.timeToImage / defaultResult.timeToImage) : 0.0,
+       k_presets[0].name);
+  return bestIdx;
+}
@@ -0,0 +1,67 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+// Chooses acceleration structure build flags for a scene. Preferring fast
+// traces makes builds slower and structures larger; preferring fast builds
+// or low memory does the opposite, and compaction trades build time for
+// memory. Which is best depends on how many samples per pixel an image needs:
+// a preview of a few samples can spend more time building than tracing, while
+// a final image amortizes even a slow build.
+//
+// Each preset below is one such combination. tuneAccelFlags() builds the
+// scene's BLASes and TLAS with every preset, traces a fixed number of samples
+// with each, and estimates the time to an image of a given number of samples
+// per pixel as
+//   BLAS build + TLAS build + (trace time per sample) * samples.
+// The sample can then use the fastest preset, or the user can pass its name
+// with --accel-flags in later runs to skip tuning.
+#ifndef VK_MINI_PATH_TRACER_ACCEL_TUNER_H
+#define VK_MINI_PATH_TRACER_ACCEL_TUNER_H
+
+#include <functional>
+#include <span>
+#include <string>
+
+#include "accelManager.h"
+
+// Build flags for the BLASes and the TLAS, with a name for --accel-flags.
+struct AccelFlagPreset
+{
+  const char*                          name;
+  VkBuildAccelerationStructureFlagsKHR blasFlags;
+  VkBuildAccelerationStructureFlagsKHR tlasFlags;
+};
+
+// All presets; the first one is the sample's default.
+std::span<const AccelFlagPreset> accelFlagPresets();
+// Returns the preset called `name`, or nullptr if there is none.
+const AccelFlagPreset* findAccelFlagPreset(const std::string& name);
+
+// Points the renderer at `tlas`, traces the fixed number of samples per pixel
+// the tuner measures with, waits for the GPU, and returns how long that took
+// in milliseconds.
+using AccelTraceFunction = std::function<double(VkAccelerationStructureKHR tlas)>;
+
+// Builds `blases` and a TLAS over `instances` with each preset, traces
+// `tracedSpp` samples per pixel with each using `trace`, logs what each
+// preset cost, and recommends the one with the shortest time to an image of
+// `targetSpp` samples per pixel. `instanceBlases[i]` is the index in `blases`
+// of the BLAS instance i uses; the tuner replaces the instances' BLAS
+// addresses with its own.
+// Returns the index of the recommended preset, and moves the acceleration
+// structures built with it into `best`, which must not be initialized.
+// The arguments before `blases` are the same as for AccelManager::init().
+uint32_t tuneAccelFlags(VkDevice                                             device,
+                        VkPhysicalDevice                                     physicalDevice,
+                        VkQueue                                              queue,
+                        uint32_t                                             queueFamilyIndex,
+                        nvvk::ResourceAllocator&                             allocator,
+                        std::span<const AccelManager::BlasInput>             blases,
+                        std::span<const VkAccelerationStructureInstanceKHR> instances,
+                        std::span<const uint32_t>                            instanceBlases,
+                        const AccelTraceFunction&                            trace,
+                        uint32_t                                             tracedSpp,
+                        uint32_t                                             targetSpp,
+                        AccelManager&                                        best);
+
+#endif  // #ifndef VK_MINI_PATH_TRACER_ACCEL_TUNER_H
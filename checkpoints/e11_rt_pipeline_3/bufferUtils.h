@@ -0,0 +1,34 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+// Small helpers for laying out and addressing data in buffers and files.
+#ifndef VK_MINI_PATH_TRACER_BUFFER_UTILS_H
+#define VK_MINI_PATH_TRACER_BUFFER_UTILS_H
+
+#include <cstdint>
+#include <span>
+
+#include <nvvk/resourceallocator_vk.hpp>
+
+// Rounds `value` up to a multiple of `alignment`.
+inline uint64_t alignUp(uint64_t value, uint64_t alignment)
+{
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+// Returns the bytes of `data`, e.g. to upload them to a buffer.
+template <class T>
+std::span<const uint8_t> asBytes(std::span<const T> data)
+{
+  return {reinterpret_cast<const uint8_t*>(data.data()), data.size_bytes()};
+}
+
+// Returns the device address of `buffer`, which must have been created with
+// VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT.
+inline VkDeviceAddress getBufferDeviceAddress(VkDevice device, VkBuffer buffer)
+{
+  VkBufferDeviceAddressInfo addressInfo{.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO, .buffer = buffer};
+  return vkGetBufferDeviceAddress(device, &addressInfo);
+}
+
+#endif  // #ifndef VK_MINI_PATH_TRACER_BUFFER_UTILS_H
@@ -8,11 +8,73 @@
 #ifdef __cplusplus
 #include <cstdint>
 using uint = uint32_t;
+#else
+#extension GL_EXT_shader_explicit_arithmetic_types_int64 : require
 #endif  // #ifdef __cplusplus
 
 struct PushConstants
 {
   uint sample_batch;
+  // Camera and render settings from the scene description (see sceneDescription.h).
+  // Vectors are float arrays so that C++ and GLSL lay them out the same way.
+  float cameraOrigin[3];
+  float cameraRight[3];    // Unit vectors spanning the image plane
+  float cameraUp[3];
+  float cameraForward[3];  // Unit view direction
+  float fovVerticalSlope;  // Vertical slope of the topmost rays
+  uint  samplesPerBatch;   // Samples per pixel traced by each launch
+  uint  maxSegments;       // Maximum number of segments per path
+};
+
+// Where to find the mesh data of a BLAS. Each instance's custom index is the
+// index of its GeometryInfo in the buffer at BINDING_GEOMETRIES, so shaders
+// can reach any mesh through buffer device addresses without needing a
+// descriptor per mesh.
+struct GeometryInfo
+{
+  uint64_t vertexAddress;  // Device address of the mesh's first vertex (3 floats each)
+  uint64_t indexAddress;   // Device address of the mesh's first index (3 per triangle)
+  uint     indexBits;      // 16 (two indices packed per uint, low half first) or 32
+  uint     vertexStride;   // Bytes between vertices; a multiple of 4, at least 12
+  // With --quantized-shading, shaders read the quantized shading stream
+  // (see shadingStream.h) instead of `vertexAddress`, which is then 0.
+  uint64_t quantizedPositionAddress;  // 3 16-bit unorm values per vertex
+  uint64_t quantizedNormalAddress;    // 1 16-bit octahedral normal per triangle
+  float    positionMin[3];            // Position = positionMin + quantized position * positionScale
+  float    positionScale[3];
+  // If load-time reordering changed the order of the mesh's triangles, the
+  // device address of their original primitive IDs (see triangleReorder.h); 0 otherwise.
+  uint64_t primitiveRemapAddress;
+};
+
+// With --gpu-instances, instanceGen.comp.glsl writes the TLAS instances of
+// an instance grid directly into the TLAS's instance buffer (see
+// instanceGenerator.h). Each cell of the grid places one instance of every
+// mesh in the mesh table, all with the cell's random rotation, scale, offset
+// and material. These are the compute shader's push constants.
+struct InstanceGenParams
+{
+  uint64_t meshTableAddress;  // Device address of numMeshes GeneratedMesh structs
+  uint64_t instanceAddress;   // Where to write the VkAccelerationStructureInstanceKHR records, cell by cell
+  uint     gridSize[3];       // Cells along x, y and z
+  uint     numMeshes;
+  float    gridOrigin[3];  // Position of cell (0, 0, 0)
+  float    spacing;        // Distance between neighboring cells
+  float    center[3];      // Point of the meshes placed at each cell's position
+  float    maxRotation;    // Maximum random rotation around x and y, in radians
+  float    scale;
+  float    scaleVariation;  // Each cell's scale is scale * (1 + a random value in [-scaleVariation, scaleVariation])
+  float    jitter;          // Maximum random offset in x and y from the cell's position, relative to `spacing`
+  uint     seed;
+  float    materialCdf[9];  // Probability that a cell's material is at most i; materialCdf[8] is 1
+};
+
+// One mesh that instanceGen.comp.glsl places in every cell.
+struct GeneratedMesh
+{
+  uint64_t blasAddress;
+  float    offset[3];    // Translation to apply before the cell's transform (see meshDedup.h)
+  uint     customIndex;  // Index in the geometry table
 };
 
 #define WORKGROUP_WIDTH 16
@@ -20,7 +82,8 @@ struct PushConstants
 
 #define BINDING_IMAGEDATA 0
 #define BINDING_TLAS 1
-#define BINDING_VERTICES 2
-#define BINDING_INDICES 3
+#define BINDING_GEOMETRIES 2
+
+#define INSTANCE_GEN_WORKGROUP_SIZE 256
 
 #endif // #ifndef VK_MINI_PATH_TRACER_COMMON_H
\ No newline at end of file
@@ -0,0 +1,397 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+#include "cpuBvh.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <numeric>
+
+#include "measurement.h"
+#include "threadPool.h"
+
+namespace {
+
+// Number of candidate split positions along each axis, plus 1.
+const uint32_t k_numBins = 16;
+// The costs of visiting a node and of testing a primitive, relative to each
+// other; this is the ratio pbrt uses.
+const float k_traversalCost    = 0.125f;
+const float k_intersectionCost = 1.0f;
+// The SAH builder makes leaves with at most this many primitives...
+const uint32_t k_maxSahLeafPrimitives = 8;
+// ...and the median split builder splits nodes with more than this many.
+const uint32_t k_maxMedianLeafPrimitives = 4;
+// Nodes with at least this many primitives bin them on several threads, in
+// chunks of this size.
+const uint32_t k_parallelBinningPrimitives = 65536;
+const uint32_t k_binningChunkSize          = 16384;
+// Nodes with at least this many primitives build their subtrees in parallel.
+const uint32_t k_parallelSubtreePrimitives = 4096;
+// From this depth on, the SAH builder splits at the median instead, which
+// keeps the BVH within k_maxBvhDepth even for 2^32 primitives.
+const uint32_t k_maxSahDepth = k_maxBvhDepth - 32;
+
+glm::vec3 centroid(const Aabb& box)
+{
+  return 0.5f * (box.min + box.max);
+}
+
+int longestAxis(const glm::vec3& extent)
+{
+  return (extent.x > extent.y) ? ((extent.x > extent.z) ? 0 : 2) : ((extent.y > extent.z) ? 1 : 2);
+}
+
+// A range of Bvh::primitiveOrder that a node covers.
+struct PrimitiveRange
+{
+  uint32_t first;
+  uint32_t count;
+  Aabb     bounds;          // Of the primitives
+  Aabb     centroidBounds;  // Of the primitives' centroids
+};
+
+struct Bin
+{
+  Aabb     bounds;
+  Aabb     centroidBounds;
+  uint32_t count = 0;
+};
+using AxisBins = std::array<std::array<Bin, k_numBins>, 3>;
+
+class BvhBuilder
+{
+public:
+  BvhBuilder(std::span<const Aabb> primitiveBounds, BvhBuildMethod method, ThreadPool& threadPool, Bvh& bvh)
+      : m_primitiveBounds(primitiveBounds)
+      , m_method(method)
+      , m_threadPool(threadPool)
+      , m_bvh(bvh)
+  {
+  }
+
+  void build()
+  {
+    const uint32_t numPrimitives = static_cast<uint32_t>(m_primitiveBounds.size());
+    m_bvh.primitiveOrder.resize(numPrimitives);
+    std::iota(m_bvh.primitiveOrder.begin(), m_bvh.primitiveOrder.end(), 0u);
+    m_centroids.resize(numPrimitives);
+
+    // Compute the centroids and the root's bounds in chunks.
+    const size_t     numChunks = (size_t(numPrimitives) + k_binningChunkSize - 1) / k_binningChunkSize;
+    std::vector<Bin> chunkBounds(numChunks);
+    m_threadPool.parallelFor(numChunks, [&](size_t chunk) {
+      const uint32_t first = static_cast<uint32_t>(chunk * k_binningChunkSize);
+      const uint32_t end   = std::min(numPrimitives, first + k_binningChunkSize);
+      for(uint32_t i = first; i < end; i++)
+      {
+        m_centroids[i] = centroid(m_primitiveBounds[i]);
+        chunkBounds[chunk].bounds.grow(m_primitiveBounds[i]);
+        chunkBounds[chunk].centroidBounds.grow(m_centroids[i]);
+      }
+    });
+    PrimitiveRange root{.first = 0, .count = numPrimitives, .bounds = {}, .centroidBounds = {}};
+    for(const Bin& bounds : chunkBounds)
+    {
+      root.bounds.grow(bounds.bounds);
+      root.centroidBounds.grow(bounds.centroidBounds);
+    }
+
+    // A binary tree with leaves of at least 1 primitive has at most 2n - 1 nodes.
+    m_bvh.nodes.resize((numPrimitives == 0) ? 1 : 2 * size_t(numPrimitives) - 1);
+    m_nodeCount = 1;
+    buildNode(0, root, 0);
+    m_bvh.nodes.resize(m_nodeCount);
+  }
+
+private:
+  void buildNode(uint32_t nodeIdx, const PrimitiveRange& range, uint32_t depth)
+  {
+    BvhNode& node = m_bvh.nodes[nodeIdx];
+    node          = {.bounds = range.bounds, .firstChildOrPrimitive = range.first, .primitiveCount = range.count};
+
+    std::array<PrimitiveRange, 2> children;
+    if(m_method == BvhBuildMethod::eMedianSplit || depth >= k_maxSahDepth)
+    {
+      if(range.count <= k_maxMedianLeafPrimitives)
+      {
+        return;
+      }
+      splitAtMedian(range, children);
+    }
+    else
+    {
+      if(range.count <= 1)
+      {
+        return;
+      }
+      if(!splitWithSah(range, children))
+      {
+        if(range.count <= k_maxSahLeafPrimitives)
+        {
+          return;  // A leaf is cheaper than any split
+        }
+        // The centroids are too close together to bin, so split by count.
+        splitAtMedian(range, children);
+      }
+    }
+
+    const uint32_t firstChild = m_nodeCount.fetch_add(2);
+    node.firstChildOrPrimitive = firstChild;
+    node.primitiveCount        = 0;
+    if(range.count >= k_parallelSubtreePrimitives)
+    {
+      m_threadPool.parallelFor(2, [&](size_t child) { buildNode(firstChild + uint32_t(child), children[child], depth + 1); });
+    }
+    else
+    {
+      buildNode(firstChild, children[0], depth + 1);
+      buildNode(firstChild + 1, children[1], depth + 1);
+    }
+  }
+
+  // Finds the cheapest split of `range` at a bin boundary. If it's cheaper
+  // than a leaf, partitions the range's primitives accordingly and returns
+  // true. Leaves with more than k_maxSahLeafPrimitives primitives are never
+  // cheaper.
+  bool splitWithSah(const PrimitiveRange& range, std::array<PrimitiveRange, 2>& children)
+  {
+    const glm::vec3 extent = range.centroidBounds.max - range.centroidBounds.min;
+    glm::vec3       binScale;
+    for(int axis = 0; axis < 3; axis++)
+    {
+      binScale[axis] = (extent[axis] > 0.0f) ? float(k_numBins) / extent[axis] : 0.0f;
+    }
+    const AxisBins bins = binPrimitives(range, binScale);
+
+    // Sweep from the right to find the bounds of the primitives after each
+    // boundary, and then from the left to evaluate each split.
+    const float nodeArea  = std::max(range.bounds.surfaceArea(), std::numeric_limits<float>::min());
+    float       bestCost  = (range.count <= k_maxSahLeafPrimitives) ? k_intersectionCost * float(range.count) :
+                                                                      std::numeric_limits<float>::infinity();
+    int         bestAxis  = -1;
+    uint32_t    bestSplit = 0;
+    for(int axis = 0; axis < 3; axis++)
+    {
+      if(binScale[axis] == 0.0f)
+      {
+        continue;
+      }
+      std::array<float, k_numBins>    rightArea;
+      std::array<uint32_t, k_numBins> rightCount;
+      Bin                             right;
+      for(uint32_t split = k_numBins - 1; split > 0; split--)
+      {
+        right.bounds.grow(bins[axis][split].bounds);
+        right.count += bins[axis][split].count;
+        rightArea[split]  = right.bounds.surfaceArea();
+        rightCount[split] = right.count;
+      }
+      Bin left;
+      for(uint32_t split = 1; split < k_numBins; split++)
+      {
+        left.bounds.grow(bins[axis][split - 1].bounds);
+        left.count += bins[axis][split - 1].count;
+        if(left.count == 0 || rightCount[split] == 0)
+        {
+          continue;
+        }
+        const float cost = k_traversalCost
+                           + k_intersectionCost
+                                 * (left.bounds.surfaceArea() * float(left.count) + rightArea[split] * float(rightCount[split]))
+                                 / nodeArea;
+        if(cost < bestCost)
+        {
+          bestCost  = cost;
+          bestAxis  = axis;
+          bestSplit = split;
+        }
+      }
+    }
+    if(bestAxis < 0)
+    {
+      return false;
+    }
+
+    // Move the primitives left of the split to the front of the range.
+    const auto     begin = m_bvh.primitiveOrder.begin() + range.first;
+    const float    min   = range.centroidBounds.min[bestAxis];
+    const float    scale = binScale[bestAxis];
+    const auto     end   = std::partition(begin, begin + range.count, [&](uint32_t primitive) {
+      return binIndex(m_centroids[primitive][bestAxis], min, scale) < bestSplit;
+    });
+    const uint32_t leftCount = static_cast<uint32_t>(end - begin);
+    children[0]              = {.first = range.first, .count = leftCount, .bounds = {}, .centroidBounds = {}};
+    children[1]              = {.first          = range.first + leftCount,
+                                .count          = range.count - leftCount,
+                                .bounds         = {},
+                                .centroidBounds = {}};
+    for(uint32_t bin = 0; bin < k_numBins; bin++)
+    {
+      PrimitiveRange& child = children[(bin < bestSplit) ? 0 : 1];
+      child.bounds.grow(bins[bestAxis][bin].bounds);
+      child.centroidBounds.grow(bins[bestAxis][bin].centroidBounds);
+    }
+    return true;
+  }
+
+  // Splits `range` into two halves, the first one with the primitives whose
+  // centroids come first along the longest axis of the centroids' bounds.
+  void splitAtMedian(const PrimitiveRange& range, std::array<PrimitiveRange, 2>& children)
+  {
+    const int      axis  = longestAxis(range.centroidBounds.max - range.centroidBounds.min);
+    const auto     begin = m_bvh.primitiveOrder.begin() + range.first;
+    const uint32_t half  = range.count / 2;
+    std::nth_element(begin, begin + half, begin + range.count,
+                     [&](uint32_t a, uint32_t b) { return m_centroids[a][axis] < m_centroids[b][axis]; });
+    children[0] = {.first = range.first, .count = half, .bounds = {}, .centroidBounds = {}};
+    children[1] = {.first = range.first + half, .count = range.count - half, .bounds = {}, .centroidBounds = {}};
+    for(PrimitiveRange& child : children)
+    {
+      for(uint32_t i = child.first; i < child.first + child.count; i++)
+      {
+        child.bounds.grow(m_primitiveBounds[m_bvh.primitiveOrder[i]]);
+        child.centroidBounds.grow(m_centroids[m_bvh.primitiveOrder[i]]);
+      }
+    }
+  }
+
+  static uint32_t binIndex(float centroid, float min, float scale)
+  {
+    return std::min(static_cast<uint32_t>(std::max(0.0f, (centroid - min) * scale)), k_numBins - 1);
+  }
+
+  // Sorts the primitives of `range` into bins along each axis. Large ranges
+  // are binned in chunks on several threads, and the chunks' bins merged.
+  AxisBins binPrimitives(const PrimitiveRange& range, const glm::vec3& binScale) const
+  {
+    const auto binChunk = [&](uint32_t first, uint32_t end, AxisBins& bins) {
+      for(uint32_t i = first; i < end; i++)
+      {
+        const uint32_t primitive = m_bvh.primitiveOrder[i];
+        for(int axis = 0; axis < 3; axis++)
+        {
+          Bin& bin = bins[axis][binIndex(m_centroids[primitive][axis], range.centroidBounds.min[axis], binScale[axis])];
+          bin.bounds.grow(m_primitiveBounds[primitive]);
+          bin.centroidBounds.grow(m_centroids[primitive]);
+          bin.count++;
+        }
+      }
+    };
+
+    AxisBins bins;
+    if(range.count < k_parallelBinningPrimitives)
+    {
+      binChunk(range.first, range.first + range.count, bins);
+      return bins;
+    }
+    const size_t          numChunks = (range.count + k_binningChunkSize - 1) / k_binningChunkSize;
+    std::vector<AxisBins> chunkBins(numChunks);
+    m_threadPool.parallelFor(numChunks, [&](size_t chunk) {
+      const uint32_t first = range.first + static_cast<uint32_t>(chunk * k_binningChunkSize);
+      binChunk(first, std::min(range.first + range.count, first + k_binningChunkSize), chunkBins[chunk]);
+    });
+    for(const AxisBins& chunk : chunkBins)
+    {
+      for(int axis = 0; axis < 3; axis++)
+      {
+        for(uint32_t bin = 0; bin < k_numBins; bin++)
+        {
+          bins[axis][bin].bounds.grow(chunk[axis][bin].bounds);
+          bins[axis][bin].centroidBounds.grow(chunk[axis][bin].centroidBounds);
+          bins[axis][bin].count += chunk[axis][bin].count;
+        }
+      }
+    }
+    return bins;
+  }
+
+  std::span<const Aabb>  m_primitiveBounds;
+  BvhBuildMethod         m_method;
+  ThreadPool&            m_threadPool;
+  Bvh&                   m_bvh;
+  std::vector<glm::vec3> m_centroids;
+  std::atomic<uint32_t>  m_nodeCount = 0;
+};
+
+// Subtrees build in parallel, so nodes end up in the order threads allocated
+// them. This stores them in depth-first order instead, which keeps each
+// node's first child next to it in memory, and measures the tree on the way.
+void storeDepthFirst(Bvh& bvh, BvhBuildStats& stats)
+{
+  std::vector<BvhNode> ordered;
+  ordered.reserve(bvh.nodes.size());
+  ordered.push_back(bvh.nodes[0]);
+  const float rootArea = bvh.nodes[0].bounds.surfaceArea();
+
+  struct PendingNode
+  {
+    uint32_t oldIdx;
+    uint32_t newIdx;
+    uint32_t depth;
+  };
+  std::vector<PendingNode> pending = {{0, 0, 0}};
+  while(!pending.empty())
+  {
+    const PendingNode item = pending.back();
+    pending.pop_back();
+    const BvhNode& node        = bvh.nodes[item.oldIdx];
+    const float    probability = (rootArea > 0.0f) ? node.bounds.surfaceArea() / rootArea : 0.0f;
+    if(node.primitiveCount > 0 || bvh.nodes.size() == 1)
+    {
+      stats.sahCost += k_intersectionCost * float(node.primitiveCount) * probability;
+      stats.leafCount++;
+      stats.maxDepth = std::max(stats.maxDepth, item.depth);
+      continue;
+    }
+    stats.sahCost += k_traversalCost * probability;
+    const uint32_t firstChild = static_cast<uint32_t>(ordered.size());
+    ordered.push_back(bvh.nodes[node.firstChildOrPrimitive]);
+    ordered.push_back(bvh.nodes[node.firstChildOrPrimitive + 1]);
+    ordered[item.newIdx].firstChildOrPrimitive = firstChild;
+    pending.push_back({node.firstChildOrPrimitive + 1, firstChild + 1, item.depth + 1});
+    pending.push_back({node.firstChildOrPrimitive, firstChild, item.depth + 1});
+  }
+  bvh.nodes       = std::move(ordered);
+  stats.nodeCount = static_cast<uint32_t>(bvh.nodes.size());
+}
+
+}  // namespace
+
+void Aabb::grow(const glm::vec3& point)
+{
+  min = glm::min(min, point);
+  max = glm::max(max, point);
+}
+
+void Aabb::grow(const Aabb& other)
+{
+  min = glm::min(min, other.min);
+  max = glm::max(max, other.max);
+}
+
+float Aabb::surfaceArea() const
+{
+  if(min.x > max.x)
+  {
+    return 0.0f;
+  }
+  const glm::vec3 size = max - min;
+  return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+BvhBuildStats buildBvh(std::span<const Aabb> primitiveBounds, BvhBuildMethod method, ThreadPool& threadPool, Bvh& bvh)
+{
+  const auto startTime = std::chrono::steady_clock::now();
+  BvhBuilder(primitiveBounds, method, threadPool, bvh).build();
+  BvhBuildStats stats;
+  storeDepthFirst(bvh, stats);
+  stats.buildMs = millisecondsSince(startTime);
+  return stats;
+}
+
+const char* bvhBuildMethodName(BvhBuildMethod method)
+{
+  return (method == BvhBuildMethod::eBinnedSah) ? "binned SAH" : "median split";
+}
@@ -0,0 +1,79 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+// A binary bounding volume hierarchy for the CPU renderer (see cpuRenderer.h),
+// the CPU's counterpart to the BLASes and TLAS the GPU traces. Nodes sit in
+// one array in depth-first order, with the two children of each interior node
+// next to each other, and each leaf refers to a contiguous range of the
+// primitives, in the order of Bvh::primitiveOrder.
+//
+// The driver builds the GPU's acceleration structures, but the CPU has to
+// build its own. The default builder uses the surface area heuristic (SAH):
+// it estimates the cost of tracing a random ray through a node as the cost of
+// the nodes and primitives it contains, weighted by the probability that the
+// ray hits them, which is proportional to their surface area. Each node tries
+// splitting its primitives at the boundaries of 16 bins along each axis, and
+// keeps the cheapest split, or becomes a leaf if that is cheaper. Large
+// nodes bin their primitives on several threads, and subtrees build in
+// parallel. The simpler median split is kept for comparison.
+#ifndef VK_MINI_PATH_TRACER_CPU_BVH_H
+#define VK_MINI_PATH_TRACER_CPU_BVH_H
+
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+class ThreadPool;
+
+// The builders keep BVHs at most this deep, so traversals can use a
+// fixed-size stack.
+const uint32_t k_maxBvhDepth = 128;
+
+struct Aabb
+{
+  glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+  glm::vec3 max = glm::vec3(-std::numeric_limits<float>::max());
+
+  void  grow(const glm::vec3& point);
+  void  grow(const Aabb& other);
+  float surfaceArea() const;  // 0 for empty boxes
+};
+
+struct BvhNode
+{
+  Aabb     bounds;
+  uint32_t firstChildOrPrimitive;  // Index of the first child, or of the leaf's first primitive
+  uint32_t primitiveCount;         // 0 for interior nodes
+};
+
+struct Bvh
+{
+  std::vector<BvhNode>  nodes;           // nodes[0] is the root
+  std::vector<uint32_t> primitiveOrder;  // The primitives the leaves refer to
+};
+
+enum class BvhBuildMethod
+{
+  eBinnedSah,    // Binned surface area heuristic, built in parallel
+  eMedianSplit,  // Split at the median primitive along the longest axis
+};
+
+struct BvhBuildStats
+{
+  double   buildMs   = 0.0;
+  double   sahCost   = 0.0;  // Expected cost of a ray that hits the root, in primitive tests
+  uint32_t nodeCount = 0;
+  uint32_t leafCount = 0;
+  uint32_t maxDepth  = 0;  // Depth of the deepest leaf; the root is at depth 0
+};
+
+// Builds a BVH over primitives with the given bounds.
+BvhBuildStats buildBvh(std::span<const Aabb> primitiveBounds, BvhBuildMethod method, ThreadPool& threadPool, Bvh& bvh);
+
+// Returns the name of `method`, for logging.
+const char* bvhBuildMethodName(BvhBuildMethod method);
+
+#endif  // #ifndef VK_MINI_PATH_TRACER_CPU_BVH_H
@@ -0,0 +1,159 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+#include "cpuBvh8.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace {
+
+// Quantization steps span the node's bounds in at most this many steps, so
+// that rounding the maxima outwards never runs past 255.
+const float k_maxQuantizationSteps = 250.0f;
+
+float surfaceArea(const Aabb& box)
+{
+  const glm::vec3 size = box.max - box.min;
+  return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+class Bvh8Collapser
+{
+public:
+  Bvh8Collapser(const Bvh& bvh, Bvh8& bvh8)
+      : m_bvh(bvh)
+      , m_bvh8(bvh8)
+  {
+  }
+
+  // Makes the 8-wide node for the binary interior node `nodeIdx` and its
+  // descendants, and returns its index.
+  uint32_t collapseNode(uint32_t nodeIdx)
+  {
+    // Start with the node's two children, and replace the interior child
+    // with the largest surface area by its children until there are 8:
+    // the larger a child, the more rays test it, and the more they save by
+    // testing its children at once instead.
+    std::vector<uint32_t> children = {m_bvh.nodes[nodeIdx].firstChildOrPrimitive, m_bvh.nodes[nodeIdx].firstChildOrPrimitive + 1};
+    while(children.size() < k_bvh8Width)
+    {
+      size_t largest     = children.size();
+      float  largestArea = -1.0f;
+      for(size_t i = 0; i < children.size(); i++)
+      {
+        const BvhNode& child = m_bvh.nodes[children[i]];
+        if(child.primitiveCount == 0 && surfaceArea(child.bounds) > largestArea)
+        {
+          largest     = i;
+          largestArea = surfaceArea(child.bounds);
+        }
+      }
+      if(largest == children.size())
+      {
+        break;  // All children are leaves
+      }
+      const uint32_t firstGrandchild = m_bvh.nodes[children[largest]].firstChildOrPrimitive;
+      children[largest]              = firstGrandchild;
+      children.push_back(firstGrandchild + 1);
+    }
+
+    const uint32_t wideIdx = static_cast<uint32_t>(m_bvh8.nodes.size());
+    m_bvh8.nodes.emplace_back();
+    {
+      Bvh8Node& node = m_bvh8.nodes[wideIdx];
+      quantizeChildBounds(m_bvh.nodes[nodeIdx].bounds, children, node);
+      node.numChildren = static_cast<uint8_t>(children.size());
+    }
+    for(size_t i = 0; i < children.size(); i++)
+    {
+      const BvhNode& child = m_bvh.nodes[children[i]];
+      // Collapsing a child adds nodes, which can move this one.
+      const uint32_t childRef = (child.primitiveCount > 0) ? child.firstChildOrPrimitive : collapseNode(children[i]);
+      m_bvh8.nodes[wideIdx].children[i]        = childRef;
+      m_bvh8.nodes[wideIdx].primitiveCounts[i] = static_cast<uint8_t>(child.primitiveCount);
+    }
+    return wideIdx;
+  }
+
+  // Makes a root with a single leaf child, for BVHs that are one leaf.
+  void collapseLeafRoot()
+  {
+    const BvhNode& root = m_bvh.nodes[0];
+    Bvh8Node&      node = m_bvh8.nodes.emplace_back();
+    quantizeChildBounds(root.bounds, {0}, node);
+    node.children[0]        = root.firstChildOrPrimitive;
+    node.primitiveCounts[0] = static_cast<uint8_t>(root.primitiveCount);
+    node.numChildren        = 1;
+  }
+
+private:
+  // Sets the origin and scale of `node` to cover `bounds`, and the quantized
+  // bounds of the children to contain the binary nodes `children`.
+  void quantizeChildBounds(const Aabb& bounds, const std::vector<uint32_t>& children, Bvh8Node& node) const
+  {
+    for(uint32_t axis = 0; axis < 3; axis++)
+    {
+      // The smallest power of 2 that spans the bounds in k_maxQuantizationSteps
+      // steps. Multiplying a byte by a power of 2 is exact, so the rounding
+      // below only has to account for adding the origin.
+      const float extent = bounds.max[axis] - bounds.min[axis];
+      int         exponent;
+      std::frexp(extent / k_maxQuantizationSteps, &exponent);
+      node.origin[axis] = bounds.min[axis];
+      node.scale[axis]  = (extent > 0.0f) ? std::ldexp(1.0f, exponent) : std::ldexp(1.0f, -100);
+
+      for(uint32_t i = 0; i < k_bvh8Width; i++)
+      {
+        if(i >= children.size())
+        {
+          node.quantizedMin[axis][i] = 0;
+          node.quantizedMax[axis][i] = 0;
+          continue;
+        }
+        const Aabb& childBounds = m_bvh.nodes[children[i]].bounds;
+        const float stepsToMin  = (childBounds.min[axis] - node.origin[axis]) / node.scale[axis];
+        const float stepsToMax  = (childBounds.max[axis] - node.origin[axis]) / node.scale[axis];
+        uint32_t    qMin        = static_cast<uint32_t>(std::clamp(std::floor(stepsToMin), 0.0f, 255.0f));
+        uint32_t    qMax        = static_cast<uint32_t>(std::clamp(std::ceil(stepsToMax), 0.0f, 255.0f));
+        // Round outwards until the bounds, as the traversal computes them,
+        // contain the child's box.
+        while(qMin > 0 && node.dequantize(axis, uint8_t(qMin)) > childBounds.min[axis])
+        {
+          qMin--;
+        }
+        while(qMax < 255 && node.dequantize(axis, uint8_t(qMax)) < childBounds.max[axis])
+        {
+          qMax++;
+        }
+        assert(node.dequantize(axis, uint8_t(qMin)) <= childBounds.min[axis]);
+        assert(node.dequantize(axis, uint8_t(qMax)) >= childBounds.max[axis]);
+        node.quantizedMin[axis][i] = static_cast<uint8_t>(qMin);
+        node.quantizedMax[axis][i] = static_cast<uint8_t>(qMax);
+      }
+    }
+  }
+
+  const Bvh& m_bvh;
+  Bvh8&      m_bvh8;
+};
+
+}  // namespace
+
+void collapseBvh8(const Bvh& bvh, Bvh8& bvh8)
+{
+  bvh8.nodes.clear();
+  Bvh8Collapser collapser(bvh, bvh8);
+  if(bvh.primitiveOrder.empty())
+  {
+    bvh8.nodes.emplace_back();  // A root without children
+  }
+  else if(bvh.nodes[0].primitiveCount > 0)
+  {
+    collapser.collapseLeafRoot();
+  }
+  else
+  {
+    collapser.collapseNode(0);
+  }
+}
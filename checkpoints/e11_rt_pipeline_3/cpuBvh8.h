@@ -0,0 +1,55 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+// An 8-wide BVH for the CPU renderer, collapsed from the binary BVH (see
+// cpuBvh.h). A ray traversing the binary BVH loads a 32-byte node for every
+// box it tests, and tests one box at a time, which is slow for the
+// incoherent rays of diffuse bounces, which can't share this work in packets.
+// An 8-wide node instead holds the bounds of up to 8 children, which one ray
+// tests at once with Float8 operations (see cpuSimd.h), and needs about
+// 8 times fewer node loads.
+//
+// To fit 8 boxes into two cache lines, each node stores its children's
+// bounds as 8-bit offsets from the node's minimum corner, in steps of a
+// power of two per axis, rounded outwards: a child's box in the wide BVH
+// contains its box in the binary BVH. Bounds are stored as structure of
+// arrays, so that each axis's 8 minima or maxima are one 8-byte load.
+#ifndef VK_MINI_PATH_TRACER_CPU_BVH8_H
+#define VK_MINI_PATH_TRACER_CPU_BVH8_H
+
+#include <cstdint>
+#include <vector>
+
+#include "cpuBvh.h"
+
+const uint32_t k_bvh8Width = 8;
+
+struct alignas(64) Bvh8Node
+{
+  float   origin[3];  // The minimum corner of the node's bounds
+  float   scale[3];   // The size of one quantization step on each axis, a power of 2
+  uint8_t quantizedMin[3][k_bvh8Width];
+  uint8_t quantizedMax[3][k_bvh8Width];
+  // For interior children, the index of the child node; for leaves, the
+  // index of the first primitive.
+  uint32_t children[k_bvh8Width];
+  uint8_t  primitiveCounts[k_bvh8Width];  // 0 for interior children
+  uint8_t  numChildren;
+
+  // Returns the coordinate a quantized bound stands for on `axis`, computed
+  // in the same way as the traversal does.
+  float dequantize(uint32_t axis, uint8_t quantized) const { return origin[axis] + float(quantized) * scale[axis]; }
+};
+static_assert(sizeof(Bvh8Node) == 128);
+
+struct Bvh8
+{
+  std::vector<Bvh8Node> nodes;  // nodes[0] is the root
+};
+
+// Collapses `bvh` into an 8-wide BVH whose leaves refer to the same
+// primitives: each node takes in the children of its largest interior
+// children until it has 8, and leaves stay leaves.
+void collapseBvh8(const Bvh& bvh, Bvh8& bvh8);
+
+#endif  // #ifndef VK_MINI_PATH_TRACER_CPU_BVH8_H
@@ -0,0 +1,606 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+#include "cpuRenderer.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include <nvh/nvprint.hpp>
+
+#include "measurement.h"
+#include "threadPool.h"
+
+namespace {
+
+const float k_pi = 3.14159265f;
+
+// The paths of each block of 4x2 pixels are traced together, one packet of
+// rays per segment (see CpuScene::intersectPacket()).
+const uint32_t k_packetBlockWidth  = 4;
+const uint32_t k_packetBlockHeight = 2;
+static_assert(k_packetBlockWidth * k_packetBlockHeight == k_simdWidth);
+
+// When at most this many paths of a block are left, their rays are traced
+// one at a time (see tracePacket()).
+const int k_maxSingleRays = 4;
+
+// Threads render tiles of 16x16 pixels (see tileScheduler.h), made of whole
+// blocks of pixels.
+const uint32_t k_tileSize = 16;
+static_assert(k_tileSize % k_packetBlockWidth == 0 && k_tileSize % k_packetBlockHeight == 0);
+
+// Packets each job of the traversal benchmark traces.
+const size_t k_benchmarkPacketsPerJob = 64;
+
+// How the traversal benchmark traces rays.
+enum class BenchmarkTraversal
+{
+  eBinary,         // One ray at a time through the binary BVH
+  eBinaryPackets,  // Packets through the binary BVH
+  eBvh8,           // One ray at a time through the 8-wide BVH
+};
+
+// The ray payload (see shaderCommon.h).
+struct PassableInfo
+{
+  glm::vec3 color;         // The reflectivity of the surface.
+  glm::vec3 rayOrigin;     // The new ray origin in world-space.
+  glm::vec3 rayDirection;  // The new ray direction in world-space.
+  uint32_t  rngState;      // State of the random number generator.
+  bool      rayHitSky;     // True if the ray hit the sky.
+};
+
+// What closest-hit shaders know about a hit (see closestHitCommon.h).
+struct HitInfo
+{
+  glm::vec3 objectPosition;
+  glm::vec3 worldPosition;
+  glm::vec3 worldNormal;
+};
+
+glm::vec3 toVec3(const float v[3])
+{
+  return glm::vec3(v[0], v[1], v[2]);
+}
+
+// Steps the RNG and returns a floating-point value between 0 and 1 inclusive.
+float stepAndOutputRNGFloat(uint32_t& rngState)
+{
+  // Condensed version of pcg_output_rxs_m_xs_32_32, with simple conversion to floating-point [0,1].
+  rngState      = rngState * 747796405u + 1u;
+  uint32_t word = ((rngState >> ((rngState >> 28) + 4)) ^ rngState) * 277803737u;
+  word          = (word >> 22) ^ word;
+  return float(word) / 4294967295.0f;
+}
+
+// Uses the Box-Muller transform to return a normally distributed (centered
+// at 0, standard deviation 1) 2D point.
+glm::vec2 randomGaussian(uint32_t& rngState)
+{
+  // Almost uniform in (0, 1] - make sure the value is never 0:
+  const float u1    = std::max(1e-38f, stepAndOutputRNGFloat(rngState));
+  const float u2    = stepAndOutputRNGFloat(rngState);  // In [0, 1]
+  const float r     = std::sqrt(-2.0f * std::log(u1));
+  const float theta = 2.0f * k_pi * u2;  // Random in [0, 2pi]
+  return r * glm::vec2(std::cos(theta), std::sin(theta));
+}
+
+// GLSL's mod(), which rounds towards negative infinity, unlike std::fmod().
+float glslMod(float x, float y)
+{
+  return x - y * std::floor(x / y);
+}
+
+// Shifts a point on a surface along its normal far enough that rays starting
+// there don't hit the surface again; see offsetPositionAlongNormal() in
+// closestHitCommon.h for details.
+glm::vec3 offsetPositionAlongNormal(const glm::vec3& worldPosition, const glm::vec3& normal)
+{
+  // Convert the normal to an integer offset.
+  const float int_scale = 256.0f;
+  // Use a floating-point offset instead for points near (0,0,0), the origin.
+  const float origin     = 1.0f / 32.0f;
+  const float floatScale = 1.0f / 65536.0f;
+
+  glm::vec3 result;
+  for(int axis = 0; axis < 3; axis++)
+  {
+    if(std::abs(worldPosition[axis]) < origin)
+    {
+      result[axis] = worldPosition[axis] + floatScale * normal[axis];
+    }
+    else
+    {
+      // Offset the component using its binary representation, handling the sign bit.
+      const int32_t of_i = static_cast<int32_t>(int_scale * normal[axis]);
+      const int32_t bits = std::bit_cast<int32_t>(worldPosition[axis]) + ((worldPosition[axis] < 0) ? -of_i : of_i);
+      result[axis]       = std::bit_cast<float>(bits);
+    }
+  }
+  return result;
+}
+
+glm::vec3 diffuseReflection(const glm::vec3& normal, uint32_t& rngState)
+{
+  // A random point on a sphere of radius 1 centered at the normal:
+  const float     theta     = 2.0f * k_pi * stepAndOutputRNGFloat(rngState);  // Random in [0, 2pi]
+  const float     u         = 2.0f * stepAndOutputRNGFloat(rngState) - 1.0f;  // Random in [-1, 1]
+  const float     r         = std::sqrt(1.0f - u * u);
+  const glm::vec3 direction = normal + glm::vec3(r * std::cos(theta), r * std::sin(theta), u);
+
+  // Then normalize the ray direction:
+  return glm::normalize(direction);
+}
+
+// raytrace.rmiss.glsl: the color of the sky in a given direction.
+void shadeSky(const glm::vec3& rayDirection, PassableInfo& pld)
+{
+  // +y in world space is up, so:
+  const float rayDirY = rayDirection.y;
+  if(rayDirY > 0.0f)
+  {
+    pld.color = glm::mix(glm::vec3(1.0f), glm::vec3(0.25f, 0.5f, 1.0f), rayDirY);
+  }
+  else
+  {
+    pld.color = glm::vec3(0.03f);
+  }
+  pld.rayHitSky = true;
+}
+
+// getObjectHitInfo() in closestHitCommon.h.
+HitInfo getObjectHitInfo(const CpuScene& scene, const CpuHit& hit, const glm::vec3& rayDirection)
+{
+  const CpuInstance& instance  = scene.instances[scene.triangleInstances[hit.triangle]];
+  const CpuMesh&     mesh      = scene.meshes[instance.mesh];
+  const uint32_t     primitive = scene.trianglePrimitives[hit.triangle];
+  const CpuTriangle& triangle  = scene.triangles[hit.triangle];
+
+  // Interpolate the object-space vertices, which some materials depend on.
+  const glm::vec3 v0 = mesh.vertex(mesh.index(3 * primitive + 0));
+  const glm::vec3 v1 = mesh.vertex(mesh.index(3 * primitive + 1));
+  const glm::vec3 v2 = mesh.vertex(mesh.index(3 * primitive + 2));
+
+  HitInfo result;
+  result.objectPosition = v0 * (1.0f - hit.u - hit.v) + v1 * hit.u + v2 * hit.v;
+  // The scene's triangles are already in world space, so the normal of the
+  // world-space triangle is the object-space normal transformed by the
+  // inverse transpose of the instance's transform, up to its sign:
+  result.worldPosition = triangle.v0 + hit.u * triangle.edge1 + hit.v * triangle.edge2;
+  result.worldNormal   = glm::normalize(glm::cross(triangle.edge1, triangle.edge2));
+
+  // Flip the normal so it points against the ray direction:
+  result.worldNormal = glm::faceforward(result.worldNormal, rayDirection, result.worldNormal);
+  return result;
+}
+
+// The closest-hit shaders material0.rchit.glsl to material8.rchit.glsl.
+void shadeHit(const CpuScene& scene, const CpuHit& hit, const glm::vec3& rayDirection, PassableInfo& pld)
+{
+  const HitInfo  hitInfo  = getObjectHitInfo(scene, hit, rayDirection);
+  const uint32_t material = scene.instances[scene.triangleInstances[hit.triangle]].material;
+  switch(material)
+  {
+    default:
+    case 0:  // Diffuse
+      pld.color        = glm::vec3(0.7f);
+      pld.rayOrigin    = offsetPositionAlongNormal(hitInfo.worldPosition, hitInfo.worldNormal);
+      pld.rayDirection = diffuseReflection(hitInfo.worldNormal, pld.rngState);
+      break;
+    case 1:  // Mirror
+      pld.color        = glm::vec3(0.7f);
+      pld.rayOrigin    = offsetPositionAlongNormal(hitInfo.worldPosition, hitInfo.worldNormal);
+      pld.rayDirection = glm::reflect(rayDirection, hitInfo.worldNormal);
+      break;
+    case 2:  // Diffuse, colored by the normal
+      pld.color        = glm::vec3(0.5f) + 0.5f * hitInfo.worldNormal;
+      pld.rayOrigin    = offsetPositionAlongNormal(hitInfo.worldPosition, hitInfo.worldNormal);
+      pld.rayDirection = diffuseReflection(hitInfo.worldNormal, pld.rngState);
+      break;
+    case 3:  // Glossy: 20% mirror, 80% diffuse
+      pld.color     = glm::vec3(0.7f);
+      pld.rayOrigin = offsetPositionAlongNormal(hitInfo.worldPosition, hitInfo.worldNormal);
+      if(stepAndOutputRNGFloat(pld.rngState) < 0.2f)
+      {
+        pld.rayDirection = glm::reflect(rayDirection, hitInfo.worldNormal);
+      }
+      else
+      {
+        pld.rayDirection = diffuseReflection(hitInfo.worldNormal, pld.rngState);
+      }
+      break;
+    case 4:  // Half transparent
+      pld.color = glm::vec3(0.7f);
+      if(stepAndOutputRNGFloat(pld.rngState) < 0.5f)
+      {
+        pld.rayOrigin    = offsetPositionAlongNormal(hitInfo.worldPosition, hitInfo.worldNormal);
+        pld.rayDirection = diffuseReflection(hitInfo.worldNormal, pld.rngState);
+      }
+      else
+      {
+        pld.rayOrigin    = offsetPositionAlongNormal(hitInfo.worldPosition, -hitInfo.worldNormal);
+        pld.rayDirection = rayDirection;
+      }
+      break;
+    case 5:  // Diffuse stripes with gaps
+      if(glslMod(glm::dot(hitInfo.objectPosition, glm::vec3(1.0f, 1.0f, 1.0f)), 0.5f) >= 0.25f)
+      {
+        pld.color        = glm::vec3(0.7f);
+        pld.rayOrigin    = offsetPositionAlongNormal(hitInfo.worldPosition, hitInfo.worldNormal);
+        pld.rayDirection = diffuseReflection(hitInfo.worldNormal, pld.rngState);
+      }
+      else
+      {
+        pld.color        = glm::vec3(1.0f);
+        pld.rayOrigin    = offsetPositionAlongNormal(hitInfo.worldPosition, -hitInfo.worldNormal);
+        pld.rayDirection = rayDirection;
+      }
+      break;
+    case 6:  // Bumpy glossy
+    {
+      pld.color     = glm::vec3(0.7f);
+      pld.rayOrigin = offsetPositionAlongNormal(hitInfo.worldPosition, hitInfo.worldNormal);
+
+      // Perturb the normal:
+      const float     scaleFactor        = 80.0f;
+      const glm::vec3 perturbationAmount = 0.03f
+                                           * glm::vec3(std::sin(scaleFactor * hitInfo.worldPosition.x),  //
+                                                       std::sin(scaleFactor * hitInfo.worldPosition.y),  //
+                                                       std::sin(scaleFactor * hitInfo.worldPosition.z));
+      const glm::vec3 shadingNormal      = glm::normalize(hitInfo.worldNormal + perturbationAmount);
+      if(stepAndOutputRNGFloat(pld.rngState) < 0.4f)
+      {
+        pld.rayDirection = glm::reflect(rayDirection, shadingNormal);
+      }
+      else
+      {
+        pld.rayDirection = diffuseReflection(shadingNormal, pld.rngState);
+      }
+      // If the ray now points into the surface, reflect it across:
+      if(glm::dot(pld.rayDirection, hitInfo.worldNormal) <= 0.0f)
+      {
+        pld.rayDirection = glm::reflect(pld.rayDirection, hitInfo.worldNormal);
+      }
+      break;
+    }
+    case 7:  // Diffuse, colored by the original primitive ID
+    {
+      const CpuMesh& mesh        = scene.meshes[scene.instances[scene.triangleInstances[hit.triangle]].mesh];
+      const uint32_t primitive   = scene.trianglePrimitives[hit.triangle];
+      const float    primitiveID = float((mesh.sourcePrimitives != nullptr) ? mesh.sourcePrimitives[primitive] : primitive);
+      pld.color = glm::clamp(glm::vec3(primitiveID / 36.0f, primitiveID / 9.0f, primitiveID / 18.0f), glm::vec3(0.0f), glm::vec3(1.0f));
+      pld.rayOrigin    = offsetPositionAlongNormal(hitInfo.worldPosition, hitInfo.worldNormal);
+      pld.rayDirection = diffuseReflection(hitInfo.worldNormal, pld.rngState);
+      break;
+    }
+    case 8:  // Diffuse spherical shells with gaps
+      if(glslMod(glm::length(hitInfo.objectPosition), 0.2f) >= 0.05f)
+      {
+        pld.color        = glm::vec3(0.7f);
+        pld.rayOrigin    = offsetPositionAlongNormal(hitInfo.worldPosition, hitInfo.worldNormal);
+        pld.rayDirection = diffuseReflection(hitInfo.worldNormal, pld.rngState);
+      }
+      else
+      {
+        pld.color        = glm::vec3(1.0f);
+        pld.rayOrigin    = offsetPositionAlongNormal(hitInfo.worldPosition, -hitInfo.worldNormal);
+        pld.rayDirection = rayDirection;
+      }
+      break;
+  }
+  pld.rayHitSky = false;
+}
+
+// Traces the active rays of `packet` and returns a mask of the rays that hit
+// something. While many of the paths of a block are left, their rays go
+// through the binary BVH as a packet. After a few bounces, when few of the
+// paths are left and they went in different directions, each ray goes
+// through the 8-wide BVH on its own instead, which is faster for them.
+uint32_t tracePacket(const CpuScene& scene, const CpuRayPacket& packet, std::array<CpuHit, k_simdWidth>& hits)
+{
+  if(std::popcount(packet.activeMask) > k_maxSingleRays)
+  {
+    return scene.intersectPacket(packet, 10000.0f, hits);
+  }
+  uint32_t hitMask = 0;
+  for(uint32_t lanes = packet.activeMask; lanes != 0; lanes &= lanes - 1)
+  {
+    const int lane = std::countr_zero(lanes);
+    if(scene.intersectBvh8(packet.origins[lane], packet.directions[lane], 10000.0f, hits[lane]))
+    {
+      hitMask |= 1u << lane;
+    }
+  }
+  return hitMask;
+}
+
+// raytrace.rgen.glsl for the block of 4x2 pixels whose top left pixel is
+// (blockX, blockY).
+void renderPixelBlock(const CpuScene&      scene,
+                      const PushConstants& pushConstants,
+                      uint32_t             width,
+                      uint32_t             height,
+                      uint32_t             blockX,
+                      uint32_t             blockY,
+                      std::span<float>     image)
+{
+  const glm::vec3 cameraOrigin = toVec3(pushConstants.cameraOrigin);
+  const uint32_t  NUM_SAMPLES  = pushConstants.samplesPerBatch;
+
+  // Each lane of a packet traces the paths of one pixel of the block.
+  // Pixels past the edges of the image are never active.
+  std::array<uint32_t, k_simdWidth>     pixelX{};
+  std::array<uint32_t, k_simdWidth>     pixelY{};
+  std::array<PassableInfo, k_simdWidth> plds{};
+  uint32_t                              pixelMask = 0;
+  for(uint32_t lane = 0; lane < k_simdWidth; lane++)
+  {
+    pixelX[lane] = blockX + lane % k_packetBlockWidth;
+    pixelY[lane] = blockY + lane / k_packetBlockWidth;
+    if(pixelX[lane] < width && pixelY[lane] < height)
+    {
+      pixelMask |= 1u << lane;
+      // State of the random number generator with an initial seed, as in raytrace.rgen.glsl.
+      plds[lane].rngState = (pushConstants.sample_batch * height + pixelY[lane]) * width + pixelX[lane];
+    }
+  }
+
+  // The sum of the colors of all of the samples of each pixel.
+  std::array<glm::vec3, k_simdWidth> summedPixelColors;
+  summedPixelColors.fill(glm::vec3(0.0f));
+  for(uint32_t sampleIdx = 0; sampleIdx < NUM_SAMPLES; sampleIdx++)
+  {
+    CpuRayPacket packet;
+    packet.activeMask = pixelMask;
+    // The amount of light that made it to the end of the current ray of each pixel.
+    std::array<glm::vec3, k_simdWidth> accumulatedRayColors;
+    accumulatedRayColors.fill(glm::vec3(1.0f));
+    for(uint32_t lanes = pixelMask; lanes != 0; lanes &= lanes - 1)
+    {
+      const int lane = std::countr_zero(lanes);
+      // Use a Gaussian with standard deviation 0.375 centered at the center of the pixel:
+      const glm::vec2 randomPixelCenter = glm::vec2(float(pixelX[lane]), float(pixelY[lane])) + glm::vec2(0.5f)
+                                          + 0.375f * randomGaussian(plds[lane].rngState);
+      packet.origins[lane]    = cameraOrigin;
+      packet.directions[lane] = cameraRayDirection(pushConstants, randomPixelCenter, width, height);
+    }
+
+    // Limit the kernel to trace at most maxSegments segments.
+    for(uint32_t tracedSegments = 0; tracedSegments < pushConstants.maxSegments && packet.activeMask != 0; tracedSegments++)
+    {
+      std::array<CpuHit, k_simdWidth> hits;
+      const uint32_t                  hitMask = tracePacket(scene, packet, hits);
+      for(uint32_t lanes = packet.activeMask; lanes != 0; lanes &= lanes - 1)
+      {
+        const int     lane = std::countr_zero(lanes);
+        PassableInfo& pld  = plds[lane];
+        if((hitMask >> lane) & 1)
+        {
+          shadeHit(scene, hits[lane], packet.directions[lane], pld);
+        }
+        else
+        {
+          shadeSky(packet.directions[lane], pld);
+        }
+
+        // Compute the amount of light that returns to this sample from the ray
+        accumulatedRayColors[lane] *= pld.color;
+
+        if(pld.rayHitSky)
+        {
+          // Done tracing this ray; sum it with the pixel's other samples.
+          summedPixelColors[lane] += accumulatedRayColors[lane];
+          packet.activeMask &= ~(1u << lane);
+        }
+        else
+        {
+          // Start a new segment
+          packet.origins[lane]    = pld.rayOrigin;
+          packet.directions[lane] = pld.rayDirection;
+        }
+      }
+    }
+  }
+
+  // Blend with the averaged image:
+  for(uint32_t lanes = pixelMask; lanes != 0; lanes &= lanes - 1)
+  {
+    const int lane              = std::countr_zero(lanes);
+    float*    pixel             = &image[4 * (size_t(pixelY[lane]) * width + pixelX[lane])];
+    glm::vec3 averagePixelColor = summedPixelColors[lane] / float(NUM_SAMPLES);
+    if(pushConstants.sample_batch != 0)
+    {
+      const glm::vec3 previousAverageColor(pixel[0], pixel[1], pixel[2]);
+      averagePixelColor = (float(pushConstants.sample_batch) * previousAverageColor + averagePixelColor)
+                          / float(pushConstants.sample_batch + 1);
+    }
+    pixel[0] = averagePixelColor.x;
+    pixel[1] = averagePixelColor.y;
+    pixel[2] = averagePixelColor.z;
+    pixel[3] = 0.0f;
+  }
+}
+
+// Makes the rays the packet benchmark traces: for each block of 4x2 pixels,
+// the camera rays through the centers of its pixels, followed for `bounces`
+// bounces. Paths that reached the sky by then leave their lanes inactive,
+// and blocks without any active lanes are left out.
+std::vector<CpuRayPacket> makeBenchmarkPackets(const CpuScene&      scene,
+                                               const PushConstants& pushConstants,
+                                               uint32_t             width,
+                                               uint32_t             height,
+                                               uint32_t             bounces,
+                                               ThreadPool&          threadPool)
+{
+  const uint32_t            numBlocksX = (width + k_packetBlockWidth - 1) / k_packetBlockWidth;
+  const uint32_t            numBlocksY = (height + k_packetBlockHeight - 1) / k_packetBlockHeight;
+  std::vector<CpuRayPacket> packets(size_t(numBlocksX) * numBlocksY);
+  threadPool.parallelFor(numBlocksY, [&](size_t blockY) {
+    for(uint32_t blockX = 0; blockX < numBlocksX; blockX++)
+    {
+      CpuRayPacket& packet = packets[blockY * numBlocksX + blockX];
+      for(uint32_t lane = 0; lane < k_simdWidth; lane++)
+      {
+        const uint32_t x = blockX * k_packetBlockWidth + lane % k_packetBlockWidth;
+        const uint32_t y = static_cast<uint32_t>(blockY) * k_packetBlockHeight + lane / k_packetBlockWidth;
+        if(x < width && y < height)
+        {
+          packet.activeMask |= 1u << lane;
+          packet.origins[lane]    = toVec3(pushConstants.cameraOrigin);
+          packet.directions[lane] = cameraRayDirection(pushConstants, glm::vec2(float(x) + 0.5f, float(y) + 0.5f), width, height);
+        }
+      }
+
+      PassableInfo pld{};
+      pld.rngState = static_cast<uint32_t>(blockY * numBlocksX + blockX);
+      for(uint32_t bounce = 0; bounce < bounces; bounce++)
+      {
+        std::array<CpuHit, k_simdWidth> hits;
+        const uint32_t                  hitMask = scene.intersectPacket(packet, 10000.0f, hits);
+        packet.activeMask                       = hitMask;
+        for(uint32_t lanes = hitMask; lanes != 0; lanes &= lanes - 1)
+        {
+          const int lane = std::countr_zero(lanes);
+          shadeHit(scene, hits[lane], packet.directions[lane], pld);
+          packet.origins[lane]    = pld.rayOrigin;
+          packet.directions[lane] = pld.rayDirection;
+        }
+      }
+    }
+  });
+  std::erase_if(packets, [](const CpuRayPacket& packet) { return packet.activeMask == 0; });
+  return packets;
+}
+
+}  // namespace
+
+glm::vec3 cameraRayDirection(const PushConstants& pushConstants, const glm::vec2& pixelPosition, uint32_t width, uint32_t height)
+{
+  // Map the image to [-aspect, aspect] x [-1, 1], with y pointing up:
+  const float     resolutionX = float(width);
+  const float     resolutionY = float(height);
+  const glm::vec2 screenUV    = glm::vec2((2.0f * pixelPosition.x - resolutionX) / resolutionY,    //
+                                          -(2.0f * pixelPosition.y - resolutionY) / resolutionY);  // Flip the y axis
+  // Create a ray direction:
+  const glm::vec3 rayDirection = toVec3(pushConstants.cameraForward)
+                                 + pushConstants.fovVerticalSlope
+                                       * (screenUV.x * toVec3(pushConstants.cameraRight) + screenUV.y * toVec3(pushConstants.cameraUp));
+  return glm::normalize(rayDirection);
+}
+
+TileSchedulerStats renderSampleBatchOnCpu(const CpuScene&      scene,
+                                          const PushConstants& pushConstants,
+                                          uint32_t             width,
+                                          uint32_t             height,
+                                          ThreadPool&          threadPool,
+                                          std::span<float>     image)
+{
+  return parallelForTiles(width, height, k_tileSize, threadPool, [&](const Tile& tile) {
+    for(uint32_t blockY = tile.y; blockY < tile.y + tile.height; blockY += k_packetBlockHeight)
+    {
+      for(uint32_t blockX = tile.x; blockX < tile.x + tile.width; blockX += k_packetBlockWidth)
+      {
+        renderPixelBlock(scene, pushConstants, width, height, blockX, blockY, image);
+      }
+    }
+  });
+}
+
+void runCpuBvhBenchmark(std::span<const CpuMesh>     meshes,
+                        std::span<const CpuInstance> instances,
+                        const PushConstants&         pushConstants,
+                        uint32_t                     width,
+                        uint32_t                     height,
+                        ThreadPool&                  threadPool)
+{
+  LOGI("CPU BVH benchmark: building the scene's BVH with each builder and tracing one ray through each pixel\n");
+  LOGI("  %-14s %12s %10s %10s %6s %10s %18s\n", "Builder", "Build (ms)", "Nodes", "Leaves", "Depth", "SAH cost", "Primary (Mrays/s)");
+  // The scene keeps the BVH of the last builder, the default one, for the
+  // packet traversal benchmark below.
+  CpuScene scene;
+  for(const BvhBuildMethod method : {BvhBuildMethod::eMedianSplit, BvhBuildMethod::eBinnedSah})
+  {
+    const BvhBuildStats stats = buildCpuScene(meshes, instances, method, threadPool, scene);
+
+    std::vector<uint32_t> rowHits(height, 0);  // So that the traversal can't be optimized away
+    const glm::vec3       origin    = toVec3(pushConstants.cameraOrigin);
+    const auto            startTime = std::chrono::steady_clock::now();
+    threadPool.parallelFor(height, [&](size_t y) {
+      for(uint32_t x = 0; x < width; x++)
+      {
+        const glm::vec3 direction = cameraRayDirection(pushConstants, glm::vec2(float(x) + 0.5f, float(y) + 0.5f), width, height);
+        CpuHit          hit;
+        rowHits[y] += scene.intersect(origin, direction, 10000.0f, hit) ? 1 : 0;
+      }
+    });
+    const double traceMs = millisecondsSince(startTime);
+    LOGI("  %-14s %12.3f %10u %10u %6u %10.2f %18.2f\n", bvhBuildMethodName(method), stats.buildMs, stats.nodeCount,
+         stats.leafCount, stats.maxDepth, stats.sahCost, double(width) * height / (traceMs * 1000.0));
+  }
+
+  // The 8-wide BVH needs fewer, but larger nodes.
+  const size_t binaryBytes = scene.bvh.nodes.size() * sizeof(BvhNode);
+  const size_t wideBytes   = scene.bvh8.nodes.size() * sizeof(Bvh8Node);
+  LOGI("BVH memory: binary %zu nodes, %.3f MiB; 8-wide %zu nodes, %.3f MiB (%.2fx)\n", scene.bvh.nodes.size(),
+       toMB(binaryBytes), scene.bvh8.nodes.size(), toMB(wideBytes),
+       double(wideBytes) / double(std::max<size_t>(1, binaryBytes)));
+
+  // Compare tracing one ray at a time through each BVH with tracing packets,
+  // for the camera rays of 4x2 pixel blocks, and for the rays of their paths
+  // after 1 and 4 bounces, which are less and less coherent. Paths that left
+  // the scene leave inactive lanes in their packets.
+  LOGI("CPU traversal benchmark (%s): tracing the rays of 4x2 pixel blocks one at a time and as packets, in Mrays/s\n",
+       k_float8Implementation);
+  LOGI("  %-10s %10s %12s %14s %14s %14s\n", "Workload", "Rays", "Rays/packet", "Binary", "Binary packets", "8-wide");
+  for(const uint32_t bounces : {0u, 1u, 4u})
+  {
+    const std::vector<CpuRayPacket> packets = makeBenchmarkPackets(scene, pushConstants, width, height, bounces, threadPool);
+    size_t                          numRays = 0;
+    for(const CpuRayPacket& packet : packets)
+    {
+      numRays += std::popcount(packet.activeMask);
+    }
+
+    const size_t          numJobs = (packets.size() + k_benchmarkPacketsPerJob - 1) / k_benchmarkPacketsPerJob;
+    std::vector<uint32_t> jobHits(numJobs, 0);  // So that the traversal can't be optimized away
+    double                mraysPerSecond[3]{};
+    for(const BenchmarkTraversal traversal :
+        {BenchmarkTraversal::eBinary, BenchmarkTraversal::eBinaryPackets, BenchmarkTraversal::eBvh8})
+    {
+      const auto startTime = std::chrono::steady_clock::now();
+      threadPool.parallelFor(numJobs, [&](size_t job) {
+        for(size_t i = job * k_benchmarkPacketsPerJob; i < std::min(packets.size(), (job + 1) * k_benchmarkPacketsPerJob); i++)
+        {
+          const CpuRayPacket& packet = packets[i];
+          if(traversal == BenchmarkTraversal::eBinaryPackets)
+          {
+            std::array<CpuHit, k_simdWidth> hits;
+            jobHits[job] += std::popcount(scene.intersectPacket(packet, 10000.0f, hits));
+            continue;
+          }
+          for(uint32_t lanes = packet.activeMask; lanes != 0; lanes &= lanes - 1)
+          {
+            const int       lane      = std::countr_zero(lanes);
+            const glm::vec3 origin    = packet.origins[lane];
+            const glm::vec3 direction = packet.directions[lane];
+            CpuHit          hit;
+            const bool      found     = (traversal == BenchmarkTraversal::eBvh8) ? scene.intersectBvh8(origin, direction, 10000.0f, hit) :
+                                                                                  scene.intersect(origin, direction, 10000.0f, hit);
+            jobHits[job] += found ? 1 : 0;
+          }
+        }
+      });
+      const double traceMs = millisecondsSince(startTime);
+      mraysPerSecond[static_cast<int>(traversal)] = double(numRays) / (traceMs * 1000.0);
+    }
+
+    const std::string name = (bounces == 0) ? "primary" : std::to_string(bounces) + (bounces == 1 ? " bounce" : " bounces");
+    LOGI("  %-10s %10zu %12.2f %14.2f %14.2f %14.2f\n", name.c_str(), numRays, double(numRays) / std::max<size_t>(1, packets.size()),
+         mraysPerSecond[0], mraysPerSecond[1], mraysPerSecond[2]);
+  }
+}
@@ -0,0 +1,56 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+// A C++ port of the path tracer in shaders/, for machines without a ray
+// tracing GPU, and as a reference to validate changes to the shaders against
+// (--cpu-render). It follows raytrace.rgen.glsl, raytrace.rmiss.glsl and the
+// 9 closest-hit shaders step by step: the same camera, PCG random number
+// generator, Gaussian pixel filter, materials, sky and accumulation over
+// sample batches, drawing random numbers in the same order. Its floating-point
+// results differ slightly from the GPU's, so paths diverge after a while, but
+// its images converge to the same result.
+#ifndef VK_MINI_PATH_TRACER_CPU_RENDERER_H
+#define VK_MINI_PATH_TRACER_CPU_RENDERER_H
+
+#include <cstdint>
+#include <span>
+
+#include "common.h"
+#include "cpuScene.h"
+#include "tileScheduler.h"
+
+class ThreadPool;
+
+// Returns the direction of the camera ray through `pixelPosition`, in pixels
+// from the top left corner of the image, like raytrace.rgen.glsl.
+glm::vec3 cameraRayDirection(const PushConstants& pushConstants, const glm::vec2& pixelPosition, uint32_t width, uint32_t height);
+
+// Traces sample batch pushConstants.sample_batch of `scene`, like one launch
+// of raytrace.rgen.glsl with these push constants, and blends it into
+// `image`, which has 4 floats per pixel like the GPU's storage image. The
+// paths of each block of 4x2 pixels are traced together as ray packets
+// until only a few are left, which go through the 8-wide BVH one at a time,
+// and threads share out tiles of blocks by work stealing. Returns what each
+// thread did.
+TileSchedulerStats renderSampleBatchOnCpu(const CpuScene&      scene,
+                                          const PushConstants& pushConstants,
+                                          uint32_t             width,
+                                          uint32_t             height,
+                                          ThreadPool&          threadPool,
+                                          std::span<float>     image);
+
+// --bench-cpu-bvh: builds the CPU's BVH over the given meshes and instances
+// with each BvhBuildMethod, and logs how long each build took, the size and
+// SAH cost of each BVH, and how fast it traces one camera ray per pixel.
+// Then logs the memory of the SAH BVH and of its 8-wide collapse, and
+// measures how fast rays go through the SAH BVH one at a time and as
+// packets, and through the 8-wide BVH one at a time, for camera rays and for
+// the rays of paths after a few bounces.
+void runCpuBvhBenchmark(std::span<const CpuMesh>     meshes,
+                        std::span<const CpuInstance> instances,
+                        const PushConstants&         pushConstants,
+                        uint32_t                     width,
+                        uint32_t                     height,
+                        ThreadPool&                  threadPool);
+
+#endif  // #ifndef VK_MINI_PATH_TRACER_CPU_RENDERER_H
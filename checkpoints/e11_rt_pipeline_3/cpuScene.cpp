@@ -0,0 +1,515 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+#include "cpuScene.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <limits>
+
+#include <nvh/nvprint.hpp>
+
+#include "measurement.h"
+#include "threadPool.h"
+
+namespace {
+
+// Triangles each job copies into BVH order.
+const size_t k_reorderChunkSize = 4096;
+
+// When at most this many rays of a packet enter a node, they traverse its
+// subtree one at a time: testing 8 lanes then costs more than it saves.
+const int k_maxSparsePacketRays = 2;
+
+// Returns the distance at which the ray enters `box`, or infinity if it
+// misses it or enters it after `tMax`.
+float intersectBox(const Aabb& box, const glm::vec3& origin, const glm::vec3& inverseDirection, float tMax)
+{
+  const glm::vec3 t0    = (box.min - origin) * inverseDirection;
+  const glm::vec3 t1    = (box.max - origin) * inverseDirection;
+  const glm::vec3 tNear = glm::min(t0, t1);
+  const glm::vec3 tFar  = glm::max(t0, t1);
+  const float     enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+  const float     exit  = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, tMax));
+  return (enter <= exit) ? enter : std::numeric_limits<float>::infinity();
+}
+
+// The Moller-Trumbore ray-triangle test. Updates `hit` if the ray hits the
+// triangle closer than hit.t.
+bool intersectTriangle(const CpuTriangle& triangle, const glm::vec3& origin, const glm::vec3& direction, CpuHit& hit)
+{
+  const glm::vec3 p   = glm::cross(direction, triangle.edge2);
+  const float     det = glm::dot(triangle.edge1, p);
+  if(det == 0.0f)
+  {
+    return false;  // The ray is parallel to the triangle
+  }
+  const float     inverseDet = 1.0f / det;
+  const glm::vec3 s          = origin - triangle.v0;
+  const float     u          = glm::dot(s, p) * inverseDet;
+  if(u < 0.0f || u > 1.0f)
+  {
+    return false;
+  }
+  const glm::vec3 q = glm::cross(s, triangle.edge1);
+  const float     v = glm::dot(direction, q) * inverseDet;
+  if(v < 0.0f || u + v > 1.0f)
+  {
+    return false;
+  }
+  const float t = glm::dot(triangle.edge2, q) * inverseDet;
+  if(t < 0.0f || t >= hit.t)
+  {
+    return false;
+  }
+  hit.t = t;
+  hit.u = u;
+  hit.v = v;
+  return true;
+}
+
+// Finds the closest triangle closer than hit.t in the subtree under
+// `nodeIdx`, which the ray enters. Returns whether it updated `hit`.
+bool intersectSubtree(const CpuScene&  scene,
+                      uint32_t         nodeIdx,
+                      const glm::vec3& origin,
+                      const glm::vec3& direction,
+                      const glm::vec3& inverseDirection,
+                      CpuHit&          hit)
+{
+  const std::vector<BvhNode>& nodes = scene.bvh.nodes;
+  bool                        found = false;
+
+  std::array<uint32_t, k_maxBvhDepth> stack;
+  size_t                              stackSize = 0;
+  while(true)
+  {
+    const BvhNode& node = nodes[nodeIdx];
+    if(node.primitiveCount > 0)
+    {
+      for(uint32_t i = node.firstChildOrPrimitive; i < node.firstChildOrPrimitive + node.primitiveCount; i++)
+      {
+        if(intersectTriangle(scene.triangles[i], origin, direction, hit))
+        {
+          hit.triangle = i;
+          found        = true;
+        }
+      }
+    }
+    else
+    {
+      // Visit the nearer child first, and the other one later if the ray
+      // enters it before the closest hit so far.
+      uint32_t near  = node.firstChildOrPrimitive;
+      uint32_t far   = near + 1;
+      float    tNear = intersectBox(nodes[near].bounds, origin, inverseDirection, hit.t);
+      float    tFar  = intersectBox(nodes[far].bounds, origin, inverseDirection, hit.t);
+      if(tFar < tNear)
+      {
+        std::swap(near, far);
+        std::swap(tNear, tFar);
+      }
+      if(tNear != std::numeric_limits<float>::infinity())
+      {
+        if(tFar != std::numeric_limits<float>::infinity())
+        {
+          stack[stackSize++] = far;
+        }
+        nodeIdx = near;
+        continue;
+      }
+    }
+    if(stackSize == 0)
+    {
+      return found;
+    }
+    nodeIdx = stack[--stackSize];
+  }
+}
+
+// The rays of a CpuRayPacket, one Float8 per coordinate.
+struct PacketRays
+{
+  Float8 origin[3];
+  Float8 direction[3];
+  Float8 inverseDirection[3];
+};
+
+// The closest hits of the rays of a packet so far.
+struct PacketHits
+{
+  Float8                            t;
+  Float8                            u;
+  Float8                            v;
+  std::array<uint32_t, k_simdWidth> triangles;
+};
+
+// intersectBox() for 8 rays. Returns a mask of the rays that enter `box`
+// before tHit, and where each ray enters it in `enter`.
+uint32_t intersectBox8(const Aabb& box, const PacketRays& rays, Float8 tHit, Float8& enter)
+{
+  Float8 exit = tHit;
+  enter       = float8(0.0f);
+  for(uint32_t axis = 0; axis < 3; axis++)
+  {
+    const Float8 t0 = (float8(box.min[axis]) - rays.origin[axis]) * rays.inverseDirection[axis];
+    const Float8 t1 = (float8(box.max[axis]) - rays.origin[axis]) * rays.inverseDirection[axis];
+    enter           = max8(enter, min8(t0, t1));
+    exit            = min8(exit, max8(t0, t1));
+  }
+  return maskBits(enter <= exit);
+}
+
+// intersectTriangle() for 8 rays. Updates the t, u and v of the rays that hit
+// the triangle closer than their closest hit so far, and returns a mask of
+// them.
+uint32_t intersectTriangle8(const CpuTriangle& triangle, const PacketRays& rays, PacketHits& hits)
+{
+  const Float8  e1[3] = {float8(triangle.edge1.x), float8(triangle.edge1.y), float8(triangle.edge1.z)};
+  const Float8  e2[3] = {float8(triangle.edge2.x), float8(triangle.edge2.y), float8(triangle.edge2.z)};
+  const Float8* d     = rays.direction;
+  // p = cross(direction, edge2)
+  const Float8 p[3]       = {d[1] * e2[2] - e2[1] * d[2], d[2] * e2[0] - e2[2] * d[0], d[0] * e2[1] - e2[0] * d[1]};
+  const Float8 det        = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+  const Float8 inverseDet = float8(1.0f) / det;
+  const Float8 s[3]       = {rays.origin[0] - float8(triangle.v0.x),  //
+                             rays.origin[1] - float8(triangle.v0.y),  //
+                             rays.origin[2] - float8(triangle.v0.z)};
+  const Float8 u          = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inverseDet;
+  // q = cross(s, edge1)
+  const Float8 q[3] = {s[1] * e1[2] - e1[1] * s[2], s[2] * e1[0] - e1[2] * s[0], s[0] * e1[1] - e1[0] * s[1]};
+  const Float8 v    = (d[0] * q[0] + d[1] * q[1] + d[2] * q[2]) * inverseDet;
+  const Float8 t    = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * inverseDet;
+
+  const Float8 zero = float8(0.0f);
+  const Float8 one  = float8(1.0f);
+  const Mask8  hit  = (det != zero) & (u >= zero) & (u <= one) & (v >= zero) & (u + v <= one) & (t >= zero) & (t < hits.t);
+  hits.t            = select(hit, t, hits.t);
+  hits.u            = select(hit, u, hits.u);
+  hits.v            = select(hit, v, hits.v);
+  return maskBits(hit);
+}
+
+}  // namespace
+
+glm::vec3 CpuMesh::vertex(uint32_t index) const
+{
+  float position[3];
+  triangles.readPosition(index, position);
+  return {position[0], position[1], position[2]};
+}
+
+bool CpuScene::intersect(const glm::vec3& origin, const glm::vec3& direction, float tMax, CpuHit& hit) const
+{
+  const glm::vec3 inverseDirection = 1.0f / direction;
+  hit.t                            = tMax;
+  // The BVH of an empty scene is a root without primitives whose bounds are
+  // empty, which intersectBox() can't tell from an interior node that the ray
+  // enters.
+  if(triangles.empty()
+     || intersectBox(bvh.nodes[0].bounds, origin, inverseDirection, tMax) == std::numeric_limits<float>::infinity())
+  {
+    return false;
+  }
+  return intersectSubtree(*this, 0, origin, direction, inverseDirection, hit);
+}
+
+bool CpuScene::intersectBvh8(const glm::vec3& origin, const glm::vec3& direction, float tMax, CpuHit& hit) const
+{
+  const glm::vec3 inverseDirection = 1.0f / direction;
+  Float8          rayOrigin[3];
+  Float8          rayInverseDirection[3];
+  for(uint32_t axis = 0; axis < 3; axis++)
+  {
+    rayOrigin[axis]           = float8(origin[axis]);
+    rayInverseDirection[axis] = float8(inverseDirection[axis]);
+  }
+  hit.t      = tMax;
+  bool found = false;
+
+  // A stack of children to visit: nodes or leaves, and where the ray enters
+  // them. Each level of the BVH adds at most 7 more entries than it removes.
+  std::array<uint32_t, k_maxBvhDepth * k_bvh8Width> stackChildren;
+  std::array<uint32_t, k_maxBvhDepth * k_bvh8Width> stackPrimitiveCounts;
+  std::array<float, k_maxBvhDepth * k_bvh8Width>    stackEnter;
+  size_t                                            stackSize = 1;
+  stackChildren[0]                                  = 0;
+  stackPrimitiveCounts[0]                           = 0;
+  stackEnter[0]                                     = 0.0f;
+  while(stackSize > 0)
+  {
+    stackSize--;
+    if(stackEnter[stackSize] >= hit.t)
+    {
+      continue;  // The ray found a closer hit since this child was pushed
+    }
+    const uint32_t child          = stackChildren[stackSize];
+    const uint32_t primitiveCount = stackPrimitiveCounts[stackSize];
+    if(primitiveCount > 0)
+    {
+      for(uint32_t i = child; i < child + primitiveCount; i++)
+      {
+        if(intersectTriangle(triangles[i], origin, direction, hit))
+        {
+          hit.triangle = i;
+          found        = true;
+        }
+      }
+      continue;
+    }
+
+    // Test the boxes of all children at once, like intersectBox().
+    const Bvh8Node& node  = bvh8.nodes[child];
+    Float8          enter = float8(0.0f);
+    Float8          exit  = float8(hit.t);
+    for(uint32_t axis = 0; axis < 3; axis++)
+    {
+      const Float8 origin8 = float8(node.origin[axis]);
+      const Float8 scale8  = float8(node.scale[axis]);
+      const Float8 boxMin  = origin8 + loadBytes8(node.quantizedMin[axis]) * scale8;
+      const Float8 boxMax  = origin8 + loadBytes8(node.quantizedMax[axis]) * scale8;
+      const Float8 t0      = (boxMin - rayOrigin[axis]) * rayInverseDirection[axis];
+      const Float8 t1      = (boxMax - rayOrigin[axis]) * rayInverseDirection[axis];
+      enter                = max8(enter, min8(t0, t1));
+      exit                 = min8(exit, max8(t0, t1));
+    }
+    uint32_t hitMask = maskBits(enter <= exit) & ((1u << node.numChildren) - 1);
+    if(hitMask == 0)
+    {
+      continue;
+    }
+
+    // Push the children the ray enters, farthest first, so that the nearest
+    // one is visited next.
+    alignas(32) float enterLanes[k_simdWidth];
+    store8(enterLanes, enter);
+    const size_t firstPushed = stackSize;
+    for(; hitMask != 0; hitMask &= hitMask - 1)
+    {
+      const int lane = std::countr_zero(hitMask);
+      size_t    i    = stackSize++;
+      while(i > firstPushed && stackEnter[i - 1] < enterLanes[lane])
+      {
+        stackChildren[i]        = stackChildren[i - 1];
+        stackPrimitiveCounts[i] = stackPrimitiveCounts[i - 1];
+        stackEnter[i]           = stackEnter[i - 1];
+        i--;
+      }
+      stackChildren[i]        = node.children[lane];
+      stackPrimitiveCounts[i] = node.primitiveCounts[lane];
+      stackEnter[i]           = enterLanes[lane];
+    }
+  }
+  return found;
+}
+
+uint32_t CpuScene::intersectPacket(const CpuRayPacket& packet, float tMax, std::array<CpuHit, k_simdWidth>& hits) const
+{
+  // Transpose the rays into one Float8 per coordinate. Inactive rays get a
+  // closest hit distance below 0, so that they miss all boxes and triangles.
+  PacketRays rays;
+  alignas(32) float tHitLanes[k_simdWidth];
+  for(uint32_t axis = 0; axis < 3; axis++)
+  {
+    alignas(32) float origins[k_simdWidth];
+    alignas(32) float directions[k_simdWidth];
+    for(uint32_t lane = 0; lane < k_simdWidth; lane++)
+    {
+      origins[lane]    = packet.origins[lane][axis];
+      directions[lane] = packet.directions[lane][axis];
+    }
+    rays.origin[axis]           = load8(origins);
+    rays.direction[axis]        = load8(directions);
+    rays.inverseDirection[axis] = float8(1.0f) / rays.direction[axis];
+  }
+  for(uint32_t lane = 0; lane < k_simdWidth; lane++)
+  {
+    const bool active = (packet.activeMask >> lane) & 1;
+    tHitLanes[lane]   = active ? tMax : -1.0f;
+    hits[lane].t      = tMax;
+  }
+  if(triangles.empty())
+  {
+    return 0;  // See intersect()
+  }
+  PacketHits packetHits{.t = load8(tHitLanes), .u = float8(0.0f), .v = float8(0.0f), .triangles = {}};
+  uint32_t   foundMask = 0;
+
+  // Traverse the BVH with a stack of nodes and the rays that entered them.
+  std::array<uint32_t, k_maxBvhDepth> stackNodes;
+  std::array<uint32_t, k_maxBvhDepth> stackMasks;
+  size_t                              stackSize = 0;
+  uint32_t                            nodeIdx   = 0;
+  Float8                              enter;
+  uint32_t                            mask = intersectBox8(bvh.nodes[0].bounds, rays, packetHits.t, enter) & packet.activeMask;
+  while(true)
+  {
+    if(mask != 0)
+    {
+      const BvhNode& node = bvh.nodes[nodeIdx];
+      if(std::popcount(mask) <= k_maxSparsePacketRays)
+      {
+        // Few rays are left; trace them through this subtree one by one.
+        alignas(32) float tLanes[k_simdWidth];
+        alignas(32) float uLanes[k_simdWidth];
+        alignas(32) float vLanes[k_simdWidth];
+        store8(tLanes, packetHits.t);
+        store8(uLanes, packetHits.u);
+        store8(vLanes, packetHits.v);
+        for(uint32_t remaining = mask; remaining != 0; remaining &= remaining - 1)
+        {
+          const int       lane      = std::countr_zero(remaining);
+          const glm::vec3 origin    = packet.origins[lane];
+          const glm::vec3 direction = packet.directions[lane];
+          CpuHit          hit{.t = tLanes[lane], .u = uLanes[lane], .v = vLanes[lane], .triangle = packetHits.triangles[lane]};
+          if(intersectSubtree(*this, nodeIdx, origin, direction, 1.0f / direction, hit))
+          {
+            tLanes[lane]               = hit.t;
+            uLanes[lane]               = hit.u;
+            vLanes[lane]               = hit.v;
+            packetHits.triangles[lane] = hit.triangle;
+            foundMask |= 1u << lane;
+          }
+        }
+        packetHits.t = load8(tLanes);
+        packetHits.u = load8(uLanes);
+        packetHits.v = load8(vLanes);
+      }
+      else if(node.primitiveCount > 0)
+      {
+        for(uint32_t i = node.firstChildOrPrimitive; i < node.firstChildOrPrimitive + node.primitiveCount; i++)
+        {
+          const uint32_t hitMask = intersectTriangle8(triangles[i], rays, packetHits);
+          for(uint32_t remaining = hitMask; remaining != 0; remaining &= remaining - 1)
+          {
+            packetHits.triangles[std::countr_zero(remaining)] = i;
+          }
+          foundMask |= hitMask;
+        }
+      }
+      else
+      {
+        // Visit the child most rays enter first next, and the other one
+        // later with the rays that enter it.
+        uint32_t       near = node.firstChildOrPrimitive;
+        uint32_t       far  = near + 1;
+        Float8         enterNear, enterFar;
+        uint32_t       nearMask = intersectBox8(bvh.nodes[near].bounds, rays, packetHits.t, enterNear) & mask;
+        uint32_t       farMask  = intersectBox8(bvh.nodes[far].bounds, rays, packetHits.t, enterFar) & mask;
+        const uint32_t bothMask = nearMask & farMask;
+        if(2 * std::popcount(maskBits(enterFar < enterNear) & bothMask) > std::popcount(bothMask))
+        {
+          std::swap(near, far);
+          std::swap(nearMask, farMask);
+        }
+        if(nearMask == 0)
+        {
+          std::swap(near, far);
+          std::swap(nearMask, farMask);
+        }
+        if(nearMask != 0)
+        {
+          if(farMask != 0)
+          {
+            stackNodes[stackSize]   = far;
+            stackMasks[stackSize++] = farMask;
+          }
+          nodeIdx = near;
+          mask    = nearMask;
+          continue;
+        }
+      }
+    }
+    if(stackSize == 0)
+    {
+      break;
+    }
+    // Rays may have found hits closer than where they enter this node since
+    // it was pushed.
+    nodeIdx = stackNodes[--stackSize];
+    mask    = intersectBox8(bvh.nodes[nodeIdx].bounds, rays, packetHits.t, enter) & stackMasks[stackSize];
+  }
+
+  foundMask &= packet.activeMask;
+  alignas(32) float tLanes[k_simdWidth];
+  alignas(32) float uLanes[k_simdWidth];
+  alignas(32) float vLanes[k_simdWidth];
+  store8(tLanes, packetHits.t);
+  store8(uLanes, packetHits.u);
+  store8(vLanes, packetHits.v);
+  for(uint32_t remaining = foundMask; remaining != 0; remaining &= remaining - 1)
+  {
+    const int lane = std::countr_zero(remaining);
+    hits[lane]     = {.t = tLanes[lane], .u = uLanes[lane], .v = vLanes[lane], .triangle = packetHits.triangles[lane]};
+  }
+  return foundMask;
+}
+
+BvhBuildStats buildCpuScene(std::span<const CpuMesh>     meshes,
+                            std::span<const CpuInstance> instances,
+                            BvhBuildMethod               method,
+                            ThreadPool&                  threadPool,
+                            CpuScene&                    scene)
+{
+  const auto startTime = std::chrono::steady_clock::now();
+  scene.meshes.assign(meshes.begin(), meshes.end());
+  scene.instances.assign(instances.begin(), instances.end());
+
+  // Each instance's triangles start where the previous instance's end.
+  std::vector<size_t> firstTriangles(instances.size() + 1, 0);
+  for(size_t instanceIdx = 0; instanceIdx < instances.size(); instanceIdx++)
+  {
+    firstTriangles[instanceIdx + 1] = firstTriangles[instanceIdx] + meshes[instances[instanceIdx].mesh].numTriangles();
+  }
+  const size_t numTriangles = firstTriangles.back();
+
+  // Transform the triangles of each instance into world space.
+  std::vector<CpuTriangle> triangles(numTriangles);
+  std::vector<Aabb>        bounds(numTriangles);
+  threadPool.parallelFor(instances.size(), [&](size_t instanceIdx) {
+    const CpuInstance& instance = instances[instanceIdx];
+    const CpuMesh&     mesh     = meshes[instance.mesh];
+    for(uint32_t primitive = 0; primitive < mesh.numTriangles(); primitive++)
+    {
+      std::array<glm::vec3, 3> v;
+      Aabb                     box;
+      for(uint32_t corner = 0; corner < 3; corner++)
+      {
+        v[corner] = glm::vec3(instance.transform * glm::vec4(mesh.vertex(mesh.index(3 * primitive + corner)), 1.0f));
+        box.grow(v[corner]);
+      }
+      const size_t triangleIdx = firstTriangles[instanceIdx] + primitive;
+      triangles[triangleIdx]   = {.v0 = v[0], .edge1 = v[1] - v[0], .edge2 = v[2] - v[0]};
+      bounds[triangleIdx]      = box;
+    }
+  });
+
+  const BvhBuildStats bvhStats = buildBvh(bounds, method, threadPool, scene.bvh);
+
+  // Store the triangles in the order the BVH's leaves refer to them.
+  scene.triangles.resize(numTriangles);
+  scene.triangleInstances.resize(numTriangles);
+  scene.trianglePrimitives.resize(numTriangles);
+  const size_t numChunks = (numTriangles + k_reorderChunkSize - 1) / k_reorderChunkSize;
+  threadPool.parallelFor(numChunks, [&](size_t chunk) {
+    for(size_t i = chunk * k_reorderChunkSize; i < std::min(numTriangles, (chunk + 1) * k_reorderChunkSize); i++)
+    {
+      const uint32_t triangleIdx  = scene.bvh.primitiveOrder[i];
+      const auto     nextInstance = std::upper_bound(firstTriangles.begin(), firstTriangles.end(), size_t(triangleIdx));
+      const size_t   instanceIdx  = (nextInstance - firstTriangles.begin()) - 1;
+      scene.triangles[i]          = triangles[triangleIdx];
+      scene.triangleInstances[i]  = static_cast<uint32_t>(instanceIdx);
+      scene.trianglePrimitives[i] = static_cast<uint32_t>(triangleIdx - firstTriangles[instanceIdx]);
+    }
+  });
+
+  collapseBvh8(scene.bvh, scene.bvh8);
+
+  const double buildMs = millisecondsSince(startTime);
+  LOGI("Built the CPU scene: %zu instances, %zu triangles in %.3f ms, of which the %s BVH took %.3f ms "
+       "(%u nodes, %u leaves, depth %u, SAH cost %.2f; %zu 8-wide nodes).\n",
+       instances.size(), numTriangles, buildMs, bvhBuildMethodName(method), bvhStats.buildMs, bvhStats.nodeCount,
+       bvhStats.leafCount, bvhStats.maxDepth, bvhStats.sahCost, scene.bvh8.nodes.size());
+  return bvhStats;
+}
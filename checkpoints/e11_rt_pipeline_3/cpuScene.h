@@ -0,0 +1,114 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+// The scene as the CPU renderer (see cpuRenderer.h) traces it. Where the GPU
+// places instances of BLASes, the CPU copies each instance's triangles into
+// world space, and builds one BVH over all of them, which makes tracing a ray
+// a single traversal. Each triangle remembers its instance and primitive, so
+// that shading can read the mesh's vertices like the closest-hit shaders do.
+#ifndef VK_MINI_PATH_TRACER_CPU_SCENE_H
+#define VK_MINI_PATH_TRACER_CPU_SCENE_H
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "cpuBvh.h"
+#include "cpuBvh8.h"
+#include "cpuSimd.h"
+#include "meshView.h"
+
+class ThreadPool;
+
+// Where the triangles of one mesh are, like a GeometryInfo (see common.h),
+// but in host memory.
+struct CpuMesh
+{
+  MeshView        triangles;
+  const uint32_t* sourcePrimitives;  // Original primitive IDs (see triangleReorder.h), or nullptr
+
+  uint32_t  numTriangles() const { return triangles.numTriangles(); }
+  uint32_t  index(uint32_t i) const { return triangles.index(i); }
+  glm::vec3 vertex(uint32_t index) const;
+};
+
+// One copy of a mesh in the scene, like a TLAS instance.
+struct CpuInstance
+{
+  glm::mat4 transform;  // Object to world
+  uint32_t  mesh;
+  uint32_t  material;  // Which of the 9 materials shades the instance
+};
+
+// A triangle in world space, stored as one vertex and two edges for the
+// intersection test.
+struct CpuTriangle
+{
+  glm::vec3 v0;
+  glm::vec3 edge1;  // v1 - v0
+  glm::vec3 edge2;  // v2 - v0
+};
+
+// What a ray hit: the closest triangle (an index into CpuScene::triangles)
+// and where on it, with the same barycentrics as hit attributes on the GPU.
+struct CpuHit
+{
+  float    t;
+  float    u;  // Weight of v1
+  float    v;  // Weight of v2
+  uint32_t triangle;
+};
+
+// Up to 8 rays traced together through the BVH (see CpuScene::intersectPacket()).
+struct CpuRayPacket
+{
+  std::array<glm::vec3, k_simdWidth> origins{};
+  std::array<glm::vec3, k_simdWidth> directions{};
+  uint32_t                           activeMask = 0;  // Bit i is set if ray i is traced
+};
+
+struct CpuScene
+{
+  std::vector<CpuMesh>     meshes;
+  std::vector<CpuInstance> instances;
+  // World-space triangles, in the order of the BVH's leaves, and the instance
+  // and primitive index in the instance's mesh each one came from.
+  std::vector<CpuTriangle> triangles;
+  std::vector<uint32_t>    triangleInstances;
+  std::vector<uint32_t>    trianglePrimitives;
+  Bvh                      bvh;
+  Bvh8                     bvh8;  // `bvh` collapsed into an 8-wide BVH
+
+  // Finds the closest triangle along the ray within [0, tMax], like
+  // traceRayEXT with gl_RayFlagsOpaqueEXT and culling disabled.
+  bool intersect(const glm::vec3& origin, const glm::vec3& direction, float tMax, CpuHit& hit) const;
+
+  // Finds the closest triangles along the active rays of `packet`, like
+  // intersect() does for each of them (except that of two triangles at the
+  // same distance, either may win), and returns a mask of the rays that hit
+  // something. The rays traverse the BVH together, testing each node's
+  // bounds and each leaf's triangles against 8 rays at once, which is fast
+  // when they take the same path, like the camera rays of neighboring
+  // pixels. Rays that scattered off diffuse surfaces take different paths,
+  // though, and as soon as only a few rays of the packet enter a node, they
+  // traverse its subtree one ray at a time.
+  uint32_t intersectPacket(const CpuRayPacket& packet, float tMax, std::array<CpuHit, k_simdWidth>& hits) const;
+
+  // Like intersect(), but traverses the 8-wide BVH, testing the bounds of all
+  // children of a node at once. This is faster for single incoherent rays.
+  bool intersectBvh8(const glm::vec3& origin, const glm::vec3& direction, float tMax, CpuHit& hit) const;
+};
+
+// Copies the triangles of each instance into world space, builds the BVH
+// with `method`, and collapses it into the 8-wide BVH. Logs and returns how
+// long the BVH took and how good it is.
+BvhBuildStats buildCpuScene(std::span<const CpuMesh>     meshes,
+                            std::span<const CpuInstance> instances,
+                            BvhBuildMethod               method,
+                            ThreadPool&                  threadPool,
+                            CpuScene&                    scene);
+
+#endif  // #ifndef VK_MINI_PATH_TRACER_CPU_SCENE_H
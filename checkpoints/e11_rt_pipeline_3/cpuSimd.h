@@ -0,0 +1,250 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+// A minimal 8-wide floating-point type for tracing packets of rays on the
+// CPU (see CpuScene::intersectPacket()) and for testing the 8 children of a
+// wide BVH node at once (see cpuBvh8.h). Float8 holds one value per ray of a
+// packet or child of a node, and Mask8 one comparison result per lane. When
+// the compiler targets AVX2 (see VK_MINI_PATH_TRACER_AVX2 in CMakeLists.txt),
+// each operation is one AVX instruction. Otherwise each operation loops over
+// the 8 lanes, which compilers usually turn into pairs of SSE instructions,
+// and the results are the same.
+#ifndef VK_MINI_PATH_TRACER_CPU_SIMD_H
+#define VK_MINI_PATH_TRACER_CPU_SIMD_H
+
+#include <cstdint>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// The number of lanes of a Float8, and of rays in a packet.
+const uint32_t k_simdWidth = 8;
+
+#if defined(__AVX2__)
+
+// How Float8 operations are implemented, for logging.
+const char* const k_float8Implementation = "AVX2";
+
+struct Float8
+{
+  __m256 v;
+};
+
+struct Mask8
+{
+  __m256 v;
+};
+
+inline Float8 float8(float x)
+{
+  return {_mm256_set1_ps(x)};
+}
+inline Float8 load8(const float* p)
+{
+  return {_mm256_loadu_ps(p)};
+}
+inline void store8(float* p, Float8 a)
+{
+  _mm256_storeu_ps(p, a.v);
+}
+// Converts 8 bytes to floats.
+inline Float8 loadBytes8(const uint8_t* p)
+{
+  return {_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p))))};
+}
+
+inline Float8 operator+(Float8 a, Float8 b)
+{
+  return {_mm256_add_ps(a.v, b.v)};
+}
+inline Float8 operator-(Float8 a, Float8 b)
+{
+  return {_mm256_sub_ps(a.v, b.v)};
+}
+inline Float8 operator*(Float8 a, Float8 b)
+{
+  return {_mm256_mul_ps(a.v, b.v)};
+}
+inline Float8 operator/(Float8 a, Float8 b)
+{
+  return {_mm256_div_ps(a.v, b.v)};
+}
+// Like a < b ? a : b per lane, which returns b if either is NaN.
+inline Float8 min8(Float8 a, Float8 b)
+{
+  return {_mm256_min_ps(a.v, b.v)};
+}
+// Like a > b ? a : b per lane, which returns b if either is NaN.
+inline Float8 max8(Float8 a, Float8 b)
+{
+  return {_mm256_max_ps(a.v, b.v)};
+}
+
+// Comparisons are false for NaNs.
+inline Mask8 operator<(Float8 a, Float8 b)
+{
+  return {_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ)};
+}
+inline Mask8 operator<=(Float8 a, Float8 b)
+{
+  return {_mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ)};
+}
+inline Mask8 operator>=(Float8 a, Float8 b)
+{
+  return {_mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ)};
+}
+inline Mask8 operator!=(Float8 a, Float8 b)
+{
+  return {_mm256_cmp_ps(a.v, b.v, _CMP_NEQ_OQ)};
+}
+inline Mask8 operator&(Mask8 a, Mask8 b)
+{
+  return {_mm256_and_ps(a.v, b.v)};
+}
+
+// Returns a bit mask with bit i set if lane i of `m` is true.
+inline uint32_t maskBits(Mask8 m)
+{
+  return static_cast<uint32_t>(_mm256_movemask_ps(m.v));
+}
+// Returns the lanes of `a` where `m` is true, and those of `b` elsewhere.
+inline Float8 select(Mask8 m, Float8 a, Float8 b)
+{
+  return {_mm256_blendv_ps(b.v, a.v, m.v)};
+}
+
+#else  // #if defined(__AVX2__)
+
+const char* const k_float8Implementation = "8-lane loops";
+
+struct Float8
+{
+  float v[k_simdWidth];
+};
+
+struct Mask8
+{
+  uint32_t bits;
+};
+
+inline Float8 float8(float x)
+{
+  Float8 result;
+  for(uint32_t i = 0; i < k_simdWidth; i++)
+  {
+    result.v[i] = x;
+  }
+  return result;
+}
+inline Float8 load8(const float* p)
+{
+  Float8 result;
+  for(uint32_t i = 0; i < k_simdWidth; i++)
+  {
+    result.v[i] = p[i];
+  }
+  return result;
+}
+inline void store8(float* p, Float8 a)
+{
+  for(uint32_t i = 0; i < k_simdWidth; i++)
+  {
+    p[i] = a.v[i];
+  }
+}
+inline Float8 loadBytes8(const uint8_t* p)
+{
+  Float8 result;
+  for(uint32_t i = 0; i < k_simdWidth; i++)
+  {
+    result.v[i] = float(p[i]);
+  }
+  return result;
+}
+
+// Applies `op` to each pair of lanes of `a` and `b`.
+template <typename Op>
+inline Float8 map8(Float8 a, Float8 b, Op op)
+{
+  Float8 result;
+  for(uint32_t i = 0; i < k_simdWidth; i++)
+  {
+    result.v[i] = op(a.v[i], b.v[i]);
+  }
+  return result;
+}
+template <typename Op>
+inline Mask8 compare8(Float8 a, Float8 b, Op op)
+{
+  Mask8 result{0};
+  for(uint32_t i = 0; i < k_simdWidth; i++)
+  {
+    result.bits |= uint32_t(op(a.v[i], b.v[i])) << i;
+  }
+  return result;
+}
+
+inline Float8 operator+(Float8 a, Float8 b)
+{
+  return map8(a, b, [](float x, float y) { return x + y; });
+}
+inline Float8 operator-(Float8 a, Float8 b)
+{
+  return map8(a, b, [](float x, float y) { return x - y; });
+}
+inline Float8 operator*(Float8 a, Float8 b)
+{
+  return map8(a, b, [](float x, float y) { return x * y; });
+}
+inline Float8 operator/(Float8 a, Float8 b)
+{
+  return map8(a, b, [](float x, float y) { return x / y; });
+}
+inline Float8 min8(Float8 a, Float8 b)
+{
+  return map8(a, b, [](float x, float y) { return (x < y) ? x : y; });
+}
+inline Float8 max8(Float8 a, Float8 b)
+{
+  return map8(a, b, [](float x, float y) { return (x > y) ? x : y; });
+}
+
+inline Mask8 operator<(Float8 a, Float8 b)
+{
+  return compare8(a, b, [](float x, float y) { return x < y; });
+}
+inline Mask8 operator<=(Float8 a, Float8 b)
+{
+  return compare8(a, b, [](float x, float y) { return x <= y; });
+}
+inline Mask8 operator>=(Float8 a, Float8 b)
+{
+  return compare8(a, b, [](float x, float y) { return x >= y; });
+}
+inline Mask8 operator!=(Float8 a, Float8 b)
+{
+  return compare8(a, b, [](float x, float y) { return x != y; });
+}
+
+inline Mask8 operator&(Mask8 a, Mask8 b)
+{
+  return {a.bits & b.bits};
+}
+inline uint32_t maskBits(Mask8 m)
+{
+  return m.bits;
+}
+inline Float8 select(Mask8 m, Float8 a, Float8 b)
+{
+  Float8 result;
+  for(uint32_t i = 0; i < k_simdWidth; i++)
+  {
+    result.v[i] = ((m.bits >> i) & 1) ? a.v[i] : b.v[i];
+  }
+  return result;
+}
+
+#endif  // #if defined(__AVX2__)
+
+#endif  // #ifndef VK_MINI_PATH_TRACER_CPU_SIMD_H
@@ -0,0 +1,246 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+#include "deformableMeshes.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+
+#include <nvh/nvprint.hpp>
+
+#include "bufferUtils.h"
+#include "measurement.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const VkTransformMatrixKHR k_identityTransform{.matrix = {{1.0f, 0.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 1.0f, 0.0f}}};
+
+nvvk::Buffer createHostBuffer(nvvk::ResourceAllocator& allocator, std::span<const uint8_t> data)
+{
+  nvvk::Buffer buffer =
+      allocator.createBuffer(std::max<VkDeviceSize>(data.size(), 4),
+                             VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR,
+                             VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  memcpy(allocator.map(buffer), data.data(), data.size());
+  allocator.unmap(buffer);
+  return buffer;
+}
+
+// Describes one BLAS per shape, reading the shape's vertices and indices
+// from buffers laid out like SceneGeometry::positions and ::indexWords.
+std::vector<AccelManager::BlasInput> makeBlasInputs(const SceneGeometry& geometry, VkDeviceAddress vertexAddress, VkDeviceAddress indexAddress)
+{
+  std::vector<AccelManager::BlasInput> inputs(geometry.shapes.size());
+  for(size_t shapeIdx = 0; shapeIdx < geometry.shapes.size(); shapeIdx++)
+  {
+    const SceneShape&                               shape = geometry.shapes[shapeIdx];
+    VkAccelerationStructureGeometryTrianglesDataKHR triangles{
+        .sType        = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR,
+        .vertexFormat = VK_FORMAT_R32G32B32_SFLOAT,
+        .vertexData   = {.deviceAddress = vertexAddress + VkDeviceSize(shape.firstVertex) * 3 * sizeof(float)},
+        .vertexStride = 3 * sizeof(float),
+        .maxVertex    = shape.vertexCount - 1,
+        .indexType    = (shape.indexBits == 16) ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32,
+        .indexData    = {.deviceAddress = indexAddress + VkDeviceSize(shape.firstIndexWord) * sizeof(uint32_t)}};
+    inputs[shapeIdx].asGeometry.push_back({.sType        = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR,
+                                           .geometryType = VK_GEOMETRY_TYPE_TRIANGLES_KHR,
+                                           .geometry     = {.triangles = triangles},
+                                           .flags        = VK_GEOMETRY_OPAQUE_BIT_KHR});
+    inputs[shapeIdx].asBuildOffsetInfo.push_back({.primitiveCount = shape.indexCount / 3});
+  }
+  return inputs;
+}
+
+// Sets `bounds[i]` to the box around the vertices of `shapes[i]`, with
+// `positions` laid out like SceneGeometry::positions.
+void computeShapeBounds(std::span<const SceneShape> shapes, std::span<const float> positions, std::vector<VkAabbPositionsKHR>& bounds)
+{
+  bounds.resize(shapes.size());
+  for(size_t shapeIdx = 0; shapeIdx < shapes.size(); shapeIdx++)
+  {
+    const SceneShape& shape = shapes[shapeIdx];
+    float boundsMin[3] = {FLT_MAX, FLT_MAX, FLT_MAX}, boundsMax[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    for(size_t i = 3 * size_t(shape.firstVertex); i < 3 * (size_t(shape.firstVertex) + shape.vertexCount); i++)
+    {
+      boundsMin[i % 3] = std::min(boundsMin[i % 3], positions[i]);
+      boundsMax[i % 3] = std::max(boundsMax[i % 3], positions[i]);
+    }
+    bounds[shapeIdx] = {boundsMin[0], boundsMin[1], boundsMin[2], boundsMax[0], boundsMax[1], boundsMax[2]};
+  }
+}
+
+}  // namespace
+
+void DeformableMeshes::init(VkDevice                 device,
+                            VkPhysicalDevice         physicalDevice,
+                            VkQueue                  queue,
+                            uint32_t                 queueFamilyIndex,
+                            nvvk::ResourceAllocator& allocator,
+                            const SceneGeometry&     geometry,
+                            uint32_t                 rebuildInterval)
+{
+  m_allocator       = &allocator;
+  m_rebuildInterval = rebuildInterval;
+  m_frame           = 0;
+  m_vertexBuffer    = createHostBuffer(allocator, asBytes(geometry.positions));
+  m_indexBuffer     = createHostBuffer(allocator, asBytes(geometry.indexWords));
+  m_blasInputs      = makeBlasInputs(geometry, getBufferDeviceAddress(device, m_vertexBuffer.buffer),
+                                     getBufferDeviceAddress(device, m_indexBuffer.buffer));
+  m_blasIndices.resize(m_blasInputs.size());
+  std::iota(m_blasIndices.begin(), m_blasIndices.end(), 0);
+
+  m_accelManager.init(device, physicalDevice, queue, queueFamilyIndex, allocator);
+  m_accelManager.buildBlas(m_blasInputs, VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR
+                                             | VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR);
+  m_instances.resize(m_blasInputs.size());
+  for(uint32_t blasIdx = 0; blasIdx < m_blasInputs.size(); blasIdx++)
+  {
+    m_instances[blasIdx] = {.transform                      = k_identityTransform,
+                            .instanceCustomIndex            = blasIdx,
+                            .mask                           = 0xFF,
+                            .accelerationStructureReference = m_accelManager.getBlasDeviceAddress(blasIdx)};
+  }
+  m_shapes.assign(geometry.shapes.begin(), geometry.shapes.end());
+  computeShapeBounds(m_shapes, geometry.positions, m_instanceBounds);
+  m_accelManager.buildTlas(m_instances,
+                           VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR | VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR,
+                           m_instanceBounds);
+}
+
+void DeformableMeshes::deinit()
+{
+  if(m_allocator == nullptr)
+  {
+    return;
+  }
+  m_accelManager.deinit();
+  m_allocator->destroy(m_vertexBuffer);
+  m_allocator->destroy(m_indexBuffer);
+  m_allocator = nullptr;
+}
+
+DeformableMeshes::FrameTimings DeformableMeshes::update(std::span<const float> positions)
+{
+  FrameTimings timings;
+
+  // Every update waits for the GPU, so nothing reads the vertices while we overwrite them.
+  Clock::time_point start = Clock::now();
+  memcpy(m_allocator->map(m_vertexBuffer), positions.data(), positions.size_bytes());
+  m_allocator->unmap(m_vertexBuffer);
+  timings.uploadMs = millisecondsSince(start);
+
+  m_frame++;
+  timings.rebuiltBlas = (m_rebuildInterval > 0) && (m_frame % m_rebuildInterval == 0);
+  m_accelManager.refitBlas(m_blasIndices, m_blasInputs, timings.rebuiltBlas);
+  timings.blasMs = m_accelManager.blasRefitMs();
+
+  // Instances don't move, but their bounds come from the BLASes, so the TLAS
+  // update needs their new boxes to tell how much it degrades.
+  start = Clock::now();
+  computeShapeBounds(m_shapes, positions, m_instanceBounds);
+  const double boundsMs = millisecondsSince(start);
+  timings.tlasMs        = boundsMs
+                   + (m_accelManager.updateTlas(m_instances, m_instanceBounds) ? m_accelManager.tlasUpdateMs() :
+                                                                                  m_accelManager.tlasBuildMs());
+  return timings;
+}
+
+void runDeformBenchmark(VkDevice                 device,
+                        VkPhysicalDevice         physicalDevice,
+                        VkQueue                  queue,
+                        uint32_t                 queueFamilyIndex,
+                        nvvk::ResourceAllocator& allocator,
+                        const SceneGeometry&     geometry,
+                        uint32_t                 rebuildInterval)
+{
+  // Wobble every vertex sideways by a wave that travels up the scene, with an
+  // amplitude of 2% of the scene's size.
+  float boundsMin[3] = {FLT_MAX, FLT_MAX, FLT_MAX}, boundsMax[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+  for(size_t i = 0; i < geometry.positions.size(); i++)
+  {
+    boundsMin[i % 3] = std::min(boundsMin[i % 3], geometry.positions[i]);
+    boundsMax[i % 3] = std::max(boundsMax[i % 3], geometry.positions[i]);
+  }
+  const float extent =
+      std::max(std::hypot(boundsMax[0] - boundsMin[0], boundsMax[1] - boundsMin[1], boundsMax[2] - boundsMin[2]), FLT_MIN);
+  std::vector<float> positions(geometry.positions.begin(), geometry.positions.end());
+
+  const auto wobble = [&](uint32_t frame) {
+    const float time = 0.1f * float(frame);
+    for(size_t i = 0; i < positions.size(); i += 3)
+    {
+      const float* rest  = &geometry.positions[i];
+      const float  phase = time + 6.0f * rest[1] / extent;
+      positions[i]       = rest[0] + 0.02f * extent * std::sin(phase);
+      positions[i + 2]   = rest[2] + 0.02f * extent * std::cos(phase);
+    }
+  };
+
+  const uint32_t numFrames = 64;
+  LOGI("Deforming mesh benchmark: %zu shapes, %u vertices, %u triangles, %u frames, BLAS rebuild every %u frame(s)\n",
+       geometry.shapes.size(), geometry.numVertices(), geometry.numTriangles(), numFrames, rebuildInterval);
+
+  // Refitting, with periodic rebuilds:
+  DeformableMeshes meshes;
+  meshes.init(device, physicalDevice, queue, queueFamilyIndex, allocator, geometry, rebuildInterval);
+  DeformableMeshes::FrameTimings refitTotals, rebuildTotals;
+  uint32_t                       numRefits = 0, numRebuilds = 0;
+  for(uint32_t frame = 1; frame <= numFrames; frame++)
+  {
+    wobble(frame);
+    const DeformableMeshes::FrameTimings timings = meshes.update(positions);
+    DeformableMeshes::FrameTimings&      totals  = timings.rebuiltBlas ? rebuildTotals : refitTotals;
+    totals.uploadMs += timings.uploadMs;
+    totals.blasMs += timings.blasMs;
+    totals.tlasMs += timings.tlasMs;
+    (timings.rebuiltBlas ? numRebuilds : numRefits)++;
+  }
+  meshes.deinit();
+
+  // The static path: upload the vertices and build everything from scratch every frame.
+  const uint32_t numScratchFrames = 8;
+  double         scratchMs        = 0.0;
+  for(uint32_t frame = 1; frame <= numScratchFrames; frame++)
+  {
+    wobble(frame);
+    const Clock::time_point start        = Clock::now();
+    nvvk::Buffer            vertexBuffer = createHostBuffer(allocator, asBytes(std::span<const float>(positions)));
+    nvvk::Buffer            indexBuffer  = createHostBuffer(allocator, asBytes(geometry.indexWords));
+    const std::vector<AccelManager::BlasInput> inputs =
+        makeBlasInputs(geometry, getBufferDeviceAddress(device, vertexBuffer.buffer), getBufferDeviceAddress(device, indexBuffer.buffer));
+    AccelManager accelManager;
+    accelManager.init(device, physicalDevice, queue, queueFamilyIndex, allocator);
+    accelManager.buildBlas(inputs, VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR
+                                       | VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR);
+    std::vector<VkAccelerationStructureInstanceKHR> instances(inputs.size());
+    for(uint32_t blasIdx = 0; blasIdx < inputs.size(); blasIdx++)
+    {
+      instances[blasIdx] = {.transform                      = k_identityTransform,
+                            .mask                           = 0xFF,
+                            .accelerationStructureReference = accelManager.getBlasDeviceAddress(blasIdx)};
+    }
+    accelManager.buildTlas(instances, VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR);
+    accelManager.deinit();
+    allocator.destroy(vertexBuffer);
+    allocator.destroy(indexBuffer);
+    scratchMs += millisecondsSince(start);
+  }
+
+  const auto logAverage = [](const char* name, const DeformableMeshes::FrameTimings& totals, uint32_t count) {
+    if(count == 0)
+    {
+      return;
+    }
+    LOGI("  %-22s %6u frames, %9.3f ms per frame (vertices %.3f ms, BLAS %.3f ms, TLAS %.3f ms)\n", name, count,
+         (totals.uploadMs + totals.blasMs + totals.tlasMs) / count, totals.uploadMs / count, totals.blasMs / count,
+         totals.tlasMs / count);
+  };
+  logAverage("Refit:", refitTotals, numRefits);
+  logAverage("Rebuild in place:", rebuildTotals, numRebuilds);
+  LOGI("  %-22s %6u frames, %9.3f ms per frame\n", "Build from scratch:", numScratchFrames, scratchMs / numScratchFrames);
+}
@@ -0,0 +1,74 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+// Acceleration structures for meshes whose vertices move every frame, such as
+// skinned or simulated meshes. Instead of tearing down and rebuilding the
+// BLASes each frame, this keeps the vertex positions in host-visible memory,
+// overwrites them in place, and refits the BLASes
+// (VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR), followed by a TLAS
+// update. Refitting keeps each BLAS's tree and only moves its boxes, so the
+// BLASes get slower to trace as triangles move relative to each other; a full
+// rebuild every few frames (the rebuild interval) restores their quality.
+#ifndef VK_MINI_PATH_TRACER_DEFORMABLE_MESHES_H
+#define VK_MINI_PATH_TRACER_DEFORMABLE_MESHES_H
+
+#include "accelManager.h"
+#include "sceneGeometry.h"
+
+class DeformableMeshes
+{
+public:
+  // Where the time of one update went.
+  struct FrameTimings
+  {
+    double uploadMs    = 0.0;  // Writing vertex positions
+    double blasMs      = 0.0;  // Refitting or rebuilding the BLASes
+    double tlasMs      = 0.0;  // Finding the BLASes' new boxes and updating the TLAS
+    bool   rebuiltBlas = false;
+  };
+
+  // Uploads the shapes of `geometry`, and builds one BLAS per shape and a TLAS
+  // with one instance of each. Every `rebuildInterval`th update rebuilds the
+  // BLASes instead of refitting them; 0 means they are only refit.
+  void init(VkDevice                 device,
+            VkPhysicalDevice         physicalDevice,
+            VkQueue                  queue,
+            uint32_t                 queueFamilyIndex,
+            nvvk::ResourceAllocator& allocator,
+            const SceneGeometry&     geometry,
+            uint32_t                 rebuildInterval);
+  void deinit();
+
+  // Replaces the positions of all vertices (3 floats per vertex, like
+  // SceneGeometry::positions) and updates the acceleration structures.
+  FrameTimings update(std::span<const float> positions);
+
+  VkAccelerationStructureKHR getTlas() const { return m_accelManager.getTlas(); }
+
+private:
+  AccelManager                                    m_accelManager;
+  nvvk::ResourceAllocator*                        m_allocator = nullptr;
+  nvvk::Buffer                                    m_vertexBuffer;  // Host-visible, so that updates can write it directly
+  nvvk::Buffer                                    m_indexBuffer;
+  std::vector<AccelManager::BlasInput>            m_blasInputs;
+  std::vector<uint32_t>                           m_blasIndices;  // 0, 1, ..., so that updates cover all BLASes
+  std::vector<VkAccelerationStructureInstanceKHR> m_instances;
+  std::vector<SceneShape>                         m_shapes;          // For the object-space box of each BLAS
+  std::vector<VkAabbPositionsKHR>                 m_instanceBounds;  // Refreshed by each update
+  uint32_t                                        m_rebuildInterval = 0;
+  uint32_t                                        m_frame           = 0;
+};
+
+// --bench-deform: wobbles the vertices of `geometry` (e.g. the Cornell box)
+// for a number of frames, and logs the per-frame cost of writing vertices and
+// refitting or rebuilding acceleration structures, compared to building them
+// from scratch each frame. Arguments are otherwise as for DeformableMeshes::init().
+void runDeformBenchmark(VkDevice                 device,
+                        VkPhysicalDevice         physicalDevice,
+                        VkQueue                  queue,
+                        uint32_t                 queueFamilyIndex,
+                        nvvk::ResourceAllocator& allocator,
+                        const SceneGeometry&     geometry,
+                        uint32_t                 rebuildInterval);
+
+#endif  // #ifndef VK_MINI_PATH_TRACER_DEFORMABLE_MESHES_H
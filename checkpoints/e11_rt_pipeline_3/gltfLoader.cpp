@@ -0,0 +1,458 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+#include "gltfLoader.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtx/transform.hpp>
+#include <nvh/nvprint.hpp>
+
+#include "json.h"
+#include "measurement.h"
+
+namespace {
+
+const uint32_t k_glbMagic       = 0x46546C67;  // "glTF"
+const uint32_t k_glbChunkJson   = 0x4E4F534A;  // "JSON"
+const uint32_t k_glbChunkBinary = 0x004E4942;  // "BIN\0"
+
+// glTF accessor component types
+const int64_t k_componentUnsignedByte  = 5121;
+const int64_t k_componentUnsignedShort = 5123;
+const int64_t k_componentUnsignedInt   = 5125;
+const int64_t k_componentFloat         = 5126;
+
+const int64_t k_modeTriangles = 4;
+
+// Limits the depth of the node hierarchy, so that cycles in invalid files
+// can't make us recurse forever.
+const int k_maxNodeDepth = 64;
+
+uint32_t readU32(const uint8_t* data)
+{
+  uint32_t value;
+  memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+// Where the elements of an accessor are in the binary chunk.
+struct AccessorView
+{
+  uint64_t offset;         // Byte offset of the first element in the binary chunk
+  uint32_t stride;         // Bytes between elements
+  uint32_t count;          // Number of elements
+  int64_t  componentType;  // One of the k_component* constants
+  uint32_t elementSize;    // Size of one element in bytes
+};
+
+uint32_t componentSize(int64_t componentType)
+{
+  switch(componentType)
+  {
+    case 5120:  // BYTE
+    case k_componentUnsignedByte:
+      return 1;
+    case 5122:  // SHORT
+    case k_componentUnsignedShort:
+      return 2;
+    case k_componentUnsignedInt:
+    case k_componentFloat:
+      return 4;
+    default:
+      return 0;
+  }
+}
+
+uint32_t numComponents(const std::string& type)
+{
+  if(type == "SCALAR")
+    return 1;
+  if(type == "VEC2")
+    return 2;
+  if(type == "VEC3")
+    return 3;
+  if(type == "VEC4" || type == "MAT2")
+    return 4;
+  if(type == "MAT3")
+    return 9;
+  if(type == "MAT4")
+    return 16;
+  return 0;
+}
+
+class GlbReader
+{
+public:
+  GlbReader(const JsonValue& gltf, std::span<const uint8_t> binaryChunk, GltfScene& scene)
+      : m_gltf(gltf)
+      , m_binaryChunk(binaryChunk)
+      , m_scene(scene)
+  {
+  }
+
+  void readMeshes()
+  {
+    const JsonValue& meshes = m_gltf["meshes"];
+    for(size_t meshIdx = 0; meshIdx < meshes.size(); meshIdx++)
+    {
+      GltfMesh mesh{.firstPrimitive = static_cast<uint32_t>(m_scene.primitives.size()), .primitiveCount = 0};
+      const JsonValue& primitives = meshes[meshIdx]["primitives"];
+      for(size_t primIdx = 0; primIdx < primitives.size(); primIdx++)
+      {
+        std::string   why;
+        GltfPrimitive primitive{};
+        if(readPrimitive(primitives[primIdx], primitive, why))
+        {
+          m_scene.primitives.push_back(primitive);
+          mesh.primitiveCount++;
+        }
+        else
+        {
+          LOGW("Skipping primitive %zu of glTF mesh %zu: %s.\n", primIdx, meshIdx, why.c_str());
+        }
+      }
+      m_scene.meshes.push_back(mesh);
+    }
+  }
+
+  void readInstances()
+  {
+    const JsonValue& nodes = m_gltf["nodes"];
+    if(m_gltf["scenes"].size() > 0)
+    {
+      const JsonValue& roots = m_gltf["scenes"][static_cast<size_t>(m_gltf["scene"].asInt(0))]["nodes"];
+      for(size_t i = 0; i < roots.size(); i++)
+      {
+        addNode(roots[i].asInt(-1), glm::mat4(1.0f), 0);
+      }
+      return;
+    }
+
+    // Without scenes, every node that isn't a child of another node is a root.
+    std::vector<bool> isChild(nodes.size(), false);
+    for(size_t nodeIdx = 0; nodeIdx < nodes.size(); nodeIdx++)
+    {
+      const JsonValue& children = nodes[nodeIdx]["children"];
+      for(size_t i = 0; i < children.size(); i++)
+      {
+        const int64_t child = children[i].asInt(-1);
+        if(child >= 0 && static_cast<size_t>(child) < nodes.size())
+        {
+          isChild[child] = true;
+        }
+      }
+    }
+    for(size_t nodeIdx = 0; nodeIdx < nodes.size(); nodeIdx++)
+    {
+      if(!isChild[nodeIdx])
+      {
+        addNode(static_cast<int64_t>(nodeIdx), glm::mat4(1.0f), 0);
+      }
+    }
+  }
+
+private:
+  bool resolveAccessor(int64_t accessorIdx, AccessorView& view, std::string& why)
+  {
+    const JsonValue& accessor = m_gltf["accessors"][static_cast<size_t>(accessorIdx)];
+    if(accessorIdx < 0 || !accessor.isObject())
+    {
+      why = "invalid accessor index";
+      return false;
+    }
+    if(accessor.contains("sparse") || !accessor.contains("bufferView"))
+    {
+      why = "sparse accessors and accessors without buffer views aren't supported";
+      return false;
+    }
+    const JsonValue& bufferView = m_gltf["bufferViews"][static_cast<size_t>(accessor["bufferView"].asInt(-1))];
+    if(!bufferView.isObject())
+    {
+      why = "invalid buffer view index";
+      return false;
+    }
+    if(bufferView["buffer"].asInt(-1) != 0 || m_gltf["buffers"][0].contains("uri"))
+    {
+      why = "only the GLB binary chunk is supported as a buffer";
+      return false;
+    }
+
+    view.componentType = accessor["componentType"].asInt(0);
+    view.elementSize   = componentSize(view.componentType) * numComponents(accessor["type"].asString());
+    view.count         = static_cast<uint32_t>(accessor["count"].asInt(0));
+    view.stride        = static_cast<uint32_t>(bufferView["byteStride"].asInt(0));
+    view.stride        = (view.stride == 0) ? view.elementSize : view.stride;
+    const uint64_t viewStart = static_cast<uint64_t>(bufferView["byteOffset"].asInt(0));
+    const uint64_t viewEnd   = viewStart + static_cast<uint64_t>(bufferView["byteLength"].asInt(0));
+    view.offset              = viewStart + static_cast<uint64_t>(accessor["byteOffset"].asInt(0));
+    if(view.elementSize == 0 || view.count == 0)
+    {
+      why = "empty accessor or unknown accessor type";
+      return false;
+    }
+    const uint64_t accessorEnd = view.offset + static_cast<uint64_t>(view.stride) * (view.count - 1) + view.elementSize;
+    if(accessorEnd > viewEnd || viewEnd > m_binaryChunk.size())
+    {
+      why = "accessor lies outside its buffer view or the binary chunk";
+      return false;
+    }
+    return true;
+  }
+
+  // Appends `size` bytes to the converted data, and returns their offset.
+  uint64_t appendConverted(const void* data, size_t size)
+  {
+    std::vector<uint8_t>& converted = m_scene.convertedData;
+    const uint64_t        offset    = converted.size();
+    converted.resize(offset + ((size + 3) & ~size_t(3)), 0);  // Keep the next offset 4-byte aligned
+    memcpy(converted.data() + offset, data, size);
+    return offset;
+  }
+
+  template <class T>
+  T readElement(const AccessorView& view, uint32_t index) const
+  {
+    T value;
+    memcpy(&value, m_binaryChunk.data() + view.offset + static_cast<uint64_t>(view.stride) * index, sizeof(T));
+    return value;
+  }
+
+  bool readPrimitive(const JsonValue& primitive, GltfPrimitive& result, std::string& why)
+  {
+    if(primitive["mode"].asInt(k_modeTriangles) != k_modeTriangles)
+    {
+      why = "only triangle lists are supported";
+      return false;
+    }
+    result.material = static_cast<int32_t>(primitive["material"].asInt(-1));
+
+    // Positions: used in place if they're floats on a 4-byte boundary, which
+    // is what the spec requires of vertex attributes.
+    AccessorView positions;
+    if(!primitive["attributes"].contains("POSITION"))
+    {
+      why = "no POSITION attribute";
+      return false;
+    }
+    if(!resolveAccessor(primitive["attributes"]["POSITION"].asInt(-1), positions, why))
+    {
+      return false;
+    }
+    if(positions.componentType != k_componentFloat || positions.elementSize != 3 * sizeof(float))
+    {
+      why = "positions must be float VEC3";
+      return false;
+    }
+    result.vertexCount = positions.count;
+    if(positions.offset % 4 == 0 && positions.stride % 4 == 0)
+    {
+      result.positionSource = GltfDataSource::eBinaryChunk;
+      result.positionOffset = positions.offset;
+      result.positionStride = positions.stride;
+    }
+    else
+    {
+      std::vector<glm::vec3> packed(positions.count);
+      for(uint32_t i = 0; i < positions.count; i++)
+      {
+        packed[i] = readElement<glm::vec3>(positions, i);
+      }
+      result.positionSource = GltfDataSource::eConvertedData;
+      result.positionOffset = appendConverted(packed.data(), packed.size() * sizeof(glm::vec3));
+      result.positionStride = sizeof(glm::vec3);
+    }
+
+    // Indices: 16- and 32-bit indices are used in place when they start on a
+    // 4-byte boundary (so that shaders can read them as uints). Everything
+    // else is converted to 16 bits if possible, or 32 bits otherwise.
+    std::vector<uint32_t> indices;
+    if(primitive.contains("indices"))
+    {
+      AccessorView indexView;
+      if(!resolveAccessor(primitive["indices"].asInt(-1), indexView, why))
+      {
+        return false;
+      }
+      const uint32_t size = componentSize(indexView.componentType);
+      if((indexView.componentType != k_componentUnsignedByte && indexView.componentType != k_componentUnsignedShort
+          && indexView.componentType != k_componentUnsignedInt)
+         || indexView.elementSize != size)
+      {
+        why = "indices must be unsigned SCALAR values";
+        return false;
+      }
+      result.indexCount = indexView.count - indexView.count % 3;
+
+      // Indices past the end of the vertex data would make the acceleration
+      // structure build read out of bounds, so we check them even when we
+      // don't copy them.
+      uint32_t maxIndex = 0;
+      for(uint32_t i = 0; i < result.indexCount; i++)
+      {
+        const uint32_t index = (size == 1) ? readElement<uint8_t>(indexView, i) :
+                               (size == 2) ? readElement<uint16_t>(indexView, i) :
+                                             readElement<uint32_t>(indexView, i);
+        maxIndex = std::max(maxIndex, index);
+      }
+      if(result.indexCount > 0 && maxIndex >= result.vertexCount)
+      {
+        why = "indices reference vertices that don't exist";
+        return false;
+      }
+
+      if(size != 1 && indexView.offset % 4 == 0 && indexView.stride == size)
+      {
+        result.indexSource = GltfDataSource::eBinaryChunk;
+        result.indexOffset = indexView.offset;
+        result.indexBits   = 8 * size;
+      }
+      else
+      {
+        indices.resize(result.indexCount);
+        for(uint32_t i = 0; i < result.indexCount; i++)
+        {
+          indices[i] = (size == 1) ? readElement<uint8_t>(indexView, i) :
+                       (size == 2) ? readElement<uint16_t>(indexView, i) :
+                                     readElement<uint32_t>(indexView, i);
+        }
+      }
+    }
+    else
+    {
+      // Non-indexed triangles use consecutive vertices.
+      result.indexCount = result.vertexCount - result.vertexCount % 3;
+      indices.resize(result.indexCount);
+      for(uint32_t i = 0; i < result.indexCount; i++)
+      {
+        indices[i] = i;
+      }
+    }
+    if(result.indexCount == 0)
+    {
+      why = "no triangles";
+      return false;
+    }
+
+    if(!indices.empty())
+    {
+      result.indexSource = GltfDataSource::eConvertedData;
+      if(result.vertexCount <= 65536)
+      {
+        const std::vector<uint16_t> indices16(indices.begin(), indices.end());
+        result.indexOffset = appendConverted(indices16.data(), indices16.size() * sizeof(uint16_t));
+        result.indexBits   = 16;
+      }
+      else
+      {
+        result.indexOffset = appendConverted(indices.data(), indices.size() * sizeof(uint32_t));
+        result.indexBits   = 32;
+      }
+    }
+    return true;
+  }
+
+  static glm::mat4 localTransform(const JsonValue& node)
+  {
+    const JsonValue& matrix = node["matrix"];
+    if(matrix.size() == 16)
+    {
+      glm::mat4 result;
+      for(int i = 0; i < 16; i++)
+      {
+        result[i / 4][i % 4] = static_cast<float>(matrix[i].asNumber());  // glTF matrices are column-major
+      }
+      return result;
+    }
+
+    const JsonValue& t = node["translation"];
+    const JsonValue& r = node["rotation"];
+    const JsonValue& s = node["scale"];
+    const glm::vec3  translation(t[0].asNumber(0.0), t[1].asNumber(0.0), t[2].asNumber(0.0));
+    const glm::quat  rotation(static_cast<float>(r[3].asNumber(1.0)), static_cast<float>(r[0].asNumber(0.0)),
+                              static_cast<float>(r[1].asNumber(0.0)), static_cast<float>(r[2].asNumber(0.0)));
+    const glm::vec3  scale(s[0].asNumber(1.0), s[1].asNumber(1.0), s[2].asNumber(1.0));
+    return glm::translate(translation) * glm::mat4_cast(rotation) * glm::scale(scale);
+  }
+
+  void addNode(int64_t nodeIdx, const glm::mat4& parentTransform, int depth)
+  {
+    const JsonValue& node = m_gltf["nodes"][static_cast<size_t>(nodeIdx)];
+    if(nodeIdx < 0 || !node.isObject() || depth > k_maxNodeDepth)
+    {
+      return;
+    }
+    const glm::mat4 transform = parentTransform * localTransform(node);
+    const int64_t   mesh      = node["mesh"].asInt(-1);
+    if(mesh >= 0 && static_cast<size_t>(mesh) < m_scene.meshes.size())
+    {
+      m_scene.instances.push_back({.mesh = static_cast<uint32_t>(mesh), .transform = transform});
+    }
+    const JsonValue& children = node["children"];
+    for(size_t i = 0; i < children.size(); i++)
+    {
+      addNode(children[i].asInt(-1), transform, depth + 1);
+    }
+  }
+
+  const JsonValue&         m_gltf;
+  std::span<const uint8_t> m_binaryChunk;
+  GltfScene&               m_scene;
+};
+
+}  // namespace
+
+bool loadGlb(const std::string& glbPath, GltfScene& scene)
+{
+  scene = GltfScene();
+  if(!scene.mapping.open(glbPath))
+  {
+    LOGE("Could not open %s.\n", glbPath.c_str());
+    return false;
+  }
+  const uint8_t* data = scene.mapping.data();
+  const size_t   size = scene.mapping.size();
+
+  // A GLB file is a 12-byte header followed by a JSON chunk and an optional binary chunk.
+  if(size < 20 || readU32(data) != k_glbMagic || readU32(data + 4) != 2 || readU32(data + 8) > size)
+  {
+    LOGE("%s is not a binary glTF 2.0 file.\n", glbPath.c_str());
+    return false;
+  }
+  const size_t   fileLength = readU32(data + 8);
+  const uint32_t jsonLength = readU32(data + 12);
+  if(readU32(data + 16) != k_glbChunkJson || 20 + static_cast<size_t>(jsonLength) > fileLength)
+  {
+    LOGE("%s does not start with a JSON chunk.\n", glbPath.c_str());
+    return false;
+  }
+  const size_t binaryHeader = 20 + ((static_cast<size_t>(jsonLength) + 3) & ~size_t(3));
+  if(binaryHeader + 8 <= fileLength && readU32(data + binaryHeader + 4) == k_glbChunkBinary)
+  {
+    const size_t binaryLength = std::min<size_t>(readU32(data + binaryHeader), fileLength - binaryHeader - 8);
+    scene.binaryChunk         = {data + binaryHeader + 8, binaryLength};
+  }
+
+  JsonValue   gltf;
+  std::string error;
+  if(!parseJson(std::string_view(reinterpret_cast<const char*>(data + 20), jsonLength), gltf, error))
+  {
+    LOGE("Could not parse the JSON chunk of %s: %s\n", glbPath.c_str(), error.c_str());
+    return false;
+  }
+  if(gltf["asset"]["version"].asString().substr(0, 2) != "2.")
+  {
+    LOGE("%s is not a glTF 2.x file.\n", glbPath.c_str());
+    return false;
+  }
+
+  GlbReader reader(gltf, scene.binaryChunk, scene);
+  reader.readMeshes();
+  reader.readInstances();
+  LOGI("Loaded %s: %zu meshes, %zu primitives, %zu instances; %.3f MB used in place, %.3f MB converted.\n",
+       glbPath.c_str(), scene.meshes.size(), scene.primitives.size(), scene.instances.size(),
+       toMB(scene.binaryChunk.size()), toMB(scene.convertedData.size()));
+  return true;
+}
@@ -0,0 +1,84 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+// A loader for binary glTF 2.0 (.glb) files. glTF accessors already store
+// tightly packed float positions and 16- or 32-bit indices in the file's
+// binary chunk, so instead of copying them into new arrays, the loader
+// memory-maps the file and describes each primitive as byte ranges of that
+// chunk. The renderer uploads the chunk as it is, and points acceleration
+// structure builds directly at the ranges, using each accessor's stride and
+// index type.
+//
+// Only the data acceleration structures and closest-hit shaders need is
+// read: triangle positions and indices, material indices, and the node
+// hierarchy, which becomes a list of instances. Index data that Vulkan can't
+// use directly (8-bit indices, 16-bit indices that don't start on a 4-byte
+// boundary, and primitives without indices) is converted into a small second
+// buffer.
+#ifndef VK_MINI_PATH_TRACER_GLTF_LOADER_H
+#define VK_MINI_PATH_TRACER_GLTF_LOADER_H
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "mappedFile.h"
+
+// Which buffer the byte offsets of a GltfPrimitive refer to.
+enum class GltfDataSource : uint32_t
+{
+  eBinaryChunk,    // GltfScene::binaryChunk
+  eConvertedData,  // GltfScene::convertedData
+};
+
+// The triangles of one glTF mesh primitive.
+struct GltfPrimitive
+{
+  GltfDataSource positionSource;
+  uint64_t       positionOffset;  // Byte offset of the first position (3 floats)
+  uint32_t       positionStride;  // Bytes between consecutive positions
+  uint32_t       vertexCount;
+  GltfDataSource indexSource;
+  uint64_t       indexOffset;  // Byte offset of the first index
+  uint32_t       indexCount;   // 3 per triangle
+  uint32_t       indexBits;    // 16 or 32
+  int32_t        material;     // glTF material index, or -1 if none
+};
+
+// One glTF mesh is a range of `GltfScene::primitives`.
+struct GltfMesh
+{
+  uint32_t firstPrimitive;
+  uint32_t primitiveCount;
+};
+
+// A node of the default scene that references a mesh, with its world transform.
+struct GltfInstance
+{
+  uint32_t  mesh;
+  glm::mat4 transform;
+};
+
+class GltfScene
+{
+public:
+  std::span<const uint8_t>   binaryChunk;    // Points into the memory-mapped file
+  std::vector<uint8_t>       convertedData;  // Data that couldn't be used as it is, 4-byte aligned
+  std::vector<GltfPrimitive> primitives;
+  std::vector<GltfMesh>      meshes;
+  std::vector<GltfInstance>  instances;
+
+  // Keeps the file mapped for as long as `binaryChunk` points into it.
+  MappedFile mapping;
+};
+
+// Loads a .glb file. Returns false (and logs why) if the file isn't a valid
+// binary glTF 2.0 file. Primitives that can't be ray traced as triangles
+// (other topologies, non-float positions, sparse accessors, external buffers)
+// are skipped with a warning.
+bool loadGlb(const std::string& glbPath, GltfScene& scene);
+
+#endif  // #ifndef VK_MINI_PATH_TRACER_GLTF_LOADER_H
@@ -0,0 +1,236 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+#include "instanceGenerator.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+#include <nvh/nvprint.hpp>
+#include <nvvk/error_vk.hpp>
+#include <nvvk/shaders_vk.hpp>  // For nvvk::createShaderModule
+
+#include "accelManager.h"
+#include "bufferUtils.h"
+#include "measurement.h"
+
+namespace {
+
+// Devices must support at least this many workgroups per dispatch dimension.
+const uint32_t k_maxWorkgroupsX = 65535;
+
+static_assert(sizeof(InstanceGenParams) <= 128, "Devices only need to support 128 bytes of push constants");
+static_assert(sizeof(GeneratedMesh) == 24, "GeneratedMesh must match its scalar layout in GLSL");
+
+// The upper 3 rows of a column-major glm matrix.
+VkTransformMatrixKHR toTransformMatrix(const glm::mat4& matrix)
+{
+  VkTransformMatrixKHR result;
+  for(int row = 0; row < 3; row++)
+  {
+    for(int column = 0; column < 4; column++)
+    {
+      result.matrix[row][column] = matrix[column][row];
+    }
+  }
+  return result;
+}
+
+}  // namespace
+
+void InstanceGenerator::init(VkDevice device, VkPhysicalDevice physicalDevice, const std::string& spirv)
+{
+  m_device = device;
+
+  VkPhysicalDeviceAccelerationStructurePropertiesKHR asProperties{.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_PROPERTIES_KHR};
+  VkPhysicalDeviceProperties2 properties{.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2, .pNext = &asProperties};
+  vkGetPhysicalDeviceProperties2(physicalDevice, &properties);
+  // Build ranges count instances in 32 bits, whatever the device's limit.
+  m_maxInstances = std::min<uint64_t>(asProperties.maxInstanceCount, std::numeric_limits<uint32_t>::max());
+
+  // The shader reads everything it needs from push constants and buffer
+  // references, so it needs no descriptor sets.
+  VkPushConstantRange        pushConstantRange{.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT, .offset = 0, .size = sizeof(InstanceGenParams)};
+  VkPipelineLayoutCreateInfo layoutInfo{.sType                  = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+                                        .pushConstantRangeCount = 1,
+                                        .pPushConstantRanges    = &pushConstantRange};
+  NVVK_CHECK(vkCreatePipelineLayout(device, &layoutInfo, nullptr, &m_pipelineLayout));
+
+  VkShaderModule              module = nvvk::createShaderModule(device, spirv);
+  VkComputePipelineCreateInfo pipelineInfo{.sType  = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+                                           .stage  = {.sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                                                      .stage  = VK_SHADER_STAGE_COMPUTE_BIT,
+                                                      .module = module,
+                                                      .pName  = "main"},
+                                           .layout = m_pipelineLayout};
+  NVVK_CHECK(vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &m_pipeline));
+  vkDestroyShaderModule(device, module, nullptr);
+}
+
+void InstanceGenerator::deinit()
+{
+  if(m_device == VK_NULL_HANDLE)
+  {
+    return;
+  }
+  vkDestroyPipeline(m_device, m_pipeline, nullptr);
+  vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
+  m_device = VK_NULL_HANDLE;
+}
+
+void InstanceGenerator::cmdGenerate(VkCommandBuffer cmdBuffer, const InstanceGenParams& params) const
+{
+  const uint64_t numInstances = countGeneratedInstances(params);
+  if(numInstances == 0)
+  {
+    return;
+  }
+  // Spread the workgroups over rows, since each dimension of a dispatch has
+  // a limit; the shader skips the invocations past the last instance.
+  const uint64_t numWorkgroups = (numInstances + INSTANCE_GEN_WORKGROUP_SIZE - 1) / INSTANCE_GEN_WORKGROUP_SIZE;
+  const uint32_t groupsX       = static_cast<uint32_t>(std::min<uint64_t>(numWorkgroups, k_maxWorkgroupsX));
+  const uint32_t groupsY       = static_cast<uint32_t>((numWorkgroups + groupsX - 1) / groupsX);
+  vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+  vkCmdPushConstants(cmdBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(InstanceGenParams), &params);
+  vkCmdDispatch(cmdBuffer, groupsX, groupsY, 1);
+}
+
+void describeInstanceGrid(const SceneInstanceGrid& grid, InstanceGenParams& params)
+{
+  const uint32_t cellsPerRow = static_cast<uint32_t>(2 * grid.halfExtent + 1);
+  const float    firstCell   = -static_cast<float>(grid.halfExtent) * grid.spacing;
+  params.gridSize[0]         = cellsPerRow;
+  params.gridSize[1]         = cellsPerRow;
+  params.gridSize[2]         = static_cast<uint32_t>(grid.layers);
+  params.gridOrigin[0]       = firstCell;
+  params.gridOrigin[1]       = firstCell;
+  params.gridOrigin[2]       = 0.0f;
+  params.spacing             = grid.spacing;
+  std::copy_n(&grid.center.x, 3, params.center);
+  params.maxRotation    = grid.maxRotation;
+  params.scale          = grid.scale;
+  params.scaleVariation = grid.scaleVariation;
+  params.jitter         = grid.jitter;
+  params.seed           = grid.seed;
+
+  // Turn the material weights into a cumulative distribution.
+  std::array<float, 9> weights;
+  weights.fill(1.0f);
+  std::copy_n(grid.materialWeights.begin(), std::min<size_t>(grid.materialWeights.size(), weights.size()), weights.begin());
+  const float total = std::accumulate(weights.begin(), weights.end(), 0.0f);
+  float       sum   = 0.0f;
+  for(size_t material = 0; material < weights.size(); material++)
+  {
+    sum += weights[material];
+    params.materialCdf[material] = sum / total;
+  }
+  params.materialCdf[8] = 1.0f;  // Despite rounding
+}
+
+uint64_t countGeneratedInstances(const InstanceGenParams& params)
+{
+  return uint64_t(params.gridSize[0]) * params.gridSize[1] * params.gridSize[2] * params.numMeshes;
+}
+
+bool clampGeneratedInstances(InstanceGenParams& params, uint64_t maxInstances)
+{
+  if(countGeneratedInstances(params) <= maxInstances)
+  {
+    return false;
+  }
+  // Drop layers of cells along z, then y, then x. Every axis but x keeps at
+  // least one layer, so that x can still fit in as many cells as possible.
+  for(int axis = 2; axis >= 0; axis--)
+  {
+    const uint64_t cellsPerLayer = countGeneratedInstances(params) / params.gridSize[axis];
+    const uint64_t maxLayers     = std::max<uint64_t>(maxInstances / cellsPerLayer, (axis > 0) ? 1 : 0);
+    params.gridSize[axis]        = static_cast<uint32_t>(std::min<uint64_t>(params.gridSize[axis], maxLayers));
+    if(countGeneratedInstances(params) <= maxInstances)
+    {
+      break;
+    }
+  }
+  return true;
+}
+
+void runInstanceGenBenchmark(VkDevice                 device,
+                             VkPhysicalDevice         physicalDevice,
+                             VkQueue                  queue,
+                             uint32_t                 queueFamilyIndex,
+                             nvvk::ResourceAllocator& allocator,
+                             const InstanceGenerator& generator,
+                             VkDeviceAddress          blasAddress)
+{
+  const VkBuildAccelerationStructureFlagsKHR flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR;
+  AccelManager                               accelManager;
+  accelManager.init(device, physicalDevice, queue, queueFamilyIndex, allocator);
+
+  // The GPU places one mesh per cell: the BLAS at `blasAddress`.
+  const GeneratedMesh mesh{.blasAddress = blasAddress, .offset = {0.0f, 0.0f, 0.0f}, .customIndex = 0};
+  nvvk::Buffer        meshTable = allocator.createBuffer(sizeof(GeneratedMesh),
+                                                         VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                                         VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  memcpy(allocator.map(meshTable), &mesh, sizeof(mesh));
+  allocator.unmap(meshTable);
+  const VkDeviceAddress meshTableAddress = getBufferDeviceAddress(device, meshTable.buffer);
+
+  LOGI("Instance generation benchmark: building TLASes from instances made on the CPU or on the GPU\n");
+  LOGI("  %-12s %14s %14s %14s %10s\n", "Instances", "CPU (ms)", "GPU (ms)", "TLAS only", "Speedup");
+  for(const int32_t halfExtent : {10, 50, 500})
+  {
+    SceneInstanceGrid grid;
+    grid.halfExtent             = halfExtent;
+    const uint64_t numInstances = uint64_t(2 * halfExtent + 1) * uint64_t(2 * halfExtent + 1);
+    if(numInstances > generator.maxInstances())
+    {
+      LOGW("  Skipping %llu instances, since TLASes on this device can have at most %llu.\n",
+           static_cast<unsigned long long>(numInstances), static_cast<unsigned long long>(generator.maxInstances()));
+      continue;
+    }
+
+    // The CPU path: expand the grid, convert each instance, then copy them
+    // into the instance buffer and build.
+    const auto                                      cpuStart = std::chrono::steady_clock::now();
+    std::vector<VkAccelerationStructureInstanceKHR> instances;
+    instances.reserve(numInstances);
+    for(const SceneInstance& sceneInstance : expandInstanceGrid(grid))
+    {
+      VkAccelerationStructureInstanceKHR instance{};
+      instance.transform                              = toTransformMatrix(sceneInstance.transform);
+      instance.instanceShaderBindingTableRecordOffset = static_cast<uint32_t>(sceneInstance.material);
+      instance.flags                                  = VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR;
+      instance.mask                                   = 0xFF;
+      instance.accelerationStructureReference         = blasAddress;
+      instances.push_back(instance);
+    }
+    accelManager.buildTlas(instances, flags);
+    const double cpuMs = millisecondsSince(cpuStart);
+
+    // The GPU path: push the grid's description, and build.
+    InstanceGenParams params{};
+    describeInstanceGrid(grid, params);
+    params.meshTableAddress = meshTableAddress;
+    params.numMeshes        = 1;
+    const auto gpuStart     = std::chrono::steady_clock::now();
+    accelManager.buildTlasOnDevice(static_cast<uint32_t>(numInstances), flags, [&](VkCommandBuffer cmdBuffer, VkDeviceAddress address) {
+      params.instanceAddress = address;
+      generator.cmdGenerate(cmdBuffer, params);
+    });
+    const double gpuMs = millisecondsSince(gpuStart);
+
+    // For reference, the build alone: rebuild from the instances the GPU just wrote.
+    const auto tlasStart = std::chrono::steady_clock::now();
+    accelManager.buildTlasOnDevice(static_cast<uint32_t>(numInstances), flags, [](VkCommandBuffer, VkDeviceAddress) {});
+    const double tlasMs = millisecondsSince(tlasStart);
+
+    LOGI("  %-12llu %14.3f %14.3f %14.3f %9.2fx\n", static_cast<unsigned long long>(numInstances), cpuMs, gpuMs, tlasMs,
+         (gpuMs > 0.0) ? cpuMs / gpuMs : 0.0);
+  }
+
+  allocator.destroy(meshTable);
+  accelManager.deinit();
+}
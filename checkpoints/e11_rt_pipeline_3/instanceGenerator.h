@@ -0,0 +1,75 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+// Generates the TLAS instances of an instance grid on the GPU. The original
+// sample builds each VkAccelerationStructureInstanceKHR on the CPU (random
+// rotations, glm transforms, then a conversion to a 3x4 matrix) and uploads
+// them, like expandInstanceGrid() still does. For millions of procedurally
+// scattered instances, that loop and the upload take longer than the TLAS
+// build. Instead, instanceGen.comp.glsl expands a compact description of the
+// grid (InstanceGenParams in common.h: a seed, the grid's size, ranges of
+// rotations, scales and offsets, and material probabilities) straight into
+// the TLAS's device-local instance buffer, and the TLAS build follows in the
+// same command buffer (AccelManager::buildTlasOnDevice()).
+//
+// The shader draws random numbers from a hash of each cell's index, so its
+// grid looks different from the CPU's, but the same in every run.
+#ifndef VK_MINI_PATH_TRACER_INSTANCE_GENERATOR_H
+#define VK_MINI_PATH_TRACER_INSTANCE_GENERATOR_H
+
+#include <string>
+
+#include <nvvk/resourceallocator_vk.hpp>
+
+#include "common.h"
+#include "sceneDescription.h"
+
+class InstanceGenerator
+{
+public:
+  // Creates the compute pipeline from `spirv`, the compiled
+  // instanceGen.comp.glsl, and reads the device's limit on TLAS instances.
+  void init(VkDevice device, VkPhysicalDevice physicalDevice, const std::string& spirv);
+  void deinit();
+
+  // The most instances a TLAS can have on this device; at most 2^32 - 1.
+  uint64_t maxInstances() const { return m_maxInstances; }
+
+  // Records the dispatch that writes the instances `params` describes to
+  // params.instanceAddress. The caller must make the writes visible to
+  // whatever reads the instances next.
+  void cmdGenerate(VkCommandBuffer cmdBuffer, const InstanceGenParams& params) const;
+
+private:
+  VkDevice         m_device         = VK_NULL_HANDLE;
+  VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
+  VkPipeline       m_pipeline       = VK_NULL_HANDLE;
+  uint64_t         m_maxInstances   = 0;
+};
+
+// Fills the members of `params` that describe `grid`. The caller fills in the
+// mesh table, numMeshes, and instanceAddress.
+void describeInstanceGrid(const SceneInstanceGrid& grid, InstanceGenParams& params);
+
+// Returns how many instances `params` describes: one per mesh per cell.
+uint64_t countGeneratedInstances(const InstanceGenParams& params);
+
+// Shrinks the grid of `params` until it describes at most `maxInstances`
+// instances, dropping cells along z first, then y, then x. Returns true if
+// it had to.
+bool clampGeneratedInstances(InstanceGenParams& params, uint64_t maxInstances);
+
+// --bench-instance-gen: builds TLASes over grids of about 441, 10k and 1M
+// instances of the BLAS at `blasAddress`, once from instances made on the CPU
+// and uploaded, and once from instances `generator` writes on the GPU, and
+// logs how long each took. The arguments before `generator` are the same as
+// for AccelManager::init().
+void runInstanceGenBenchmark(VkDevice                 device,
+                             VkPhysicalDevice         physicalDevice,
+                             VkQueue                  queue,
+                             uint32_t                 queueFamilyIndex,
+                             nvvk::ResourceAllocator& allocator,
+                             const InstanceGenerator& generator,
+                             VkDeviceAddress          blasAddress);
+
+#endif  // #ifndef VK_MINI_PATH_TRACER_INSTANCE_GENERATOR_H
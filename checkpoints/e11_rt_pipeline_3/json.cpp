@@ -0,0 +1,442 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+#include "json.h"
+
+#include <charconv>
+#include <cstdint>
+#include <system_error>
+
+bool JsonValue::asBool(bool fallback) const
+{
+  return (m_type == Type::eBool) ? m_bool : fallback;
+}
+
+double JsonValue::asNumber(double fallback) const
+{
+  return (m_type == Type::eNumber) ? m_number : fallback;
+}
+
+int64_t JsonValue::asInt(int64_t fallback) const
+{
+  // Converting a double outside the range of int64_t is undefined behavior;
+  // -2^63 and 2^63 are exact as doubles.
+  const double k_limit = 9223372036854775808.0;
+  if(m_type != Type::eNumber || !(m_number >= -k_limit && m_number < k_limit))
+  {
+    return fallback;
+  }
+  return static_cast<int64_t>(m_number);
+}
+
+const std::string& JsonValue::asString() const
+{
+  return m_string;  // Only non-empty for strings
+}
+
+size_t JsonValue::size() const
+{
+  return (m_type == Type::eArray) ? m_elements.size() : ((m_type == Type::eObject) ? m_members.size() : 0);
+}
+
+namespace {
+
+const JsonValue& nullJsonValue()
+{
+  static const JsonValue value;
+  return value;
+}
+
+}  // namespace
+
+const JsonValue& JsonValue::operator[](size_t index) const
+{
+  return (m_type == Type::eArray && index < m_elements.size()) ? m_elements[index] : nullJsonValue();
+}
+
+const JsonValue& JsonValue::operator[](std::string_view key) const
+{
+  for(const auto& [memberKey, value] : m_members)
+  {
+    if(memberKey == key)
+    {
+      return value;
+    }
+  }
+  return nullJsonValue();
+}
+
+bool JsonValue::contains(std::string_view key) const
+{
+  return !(*this)[key].isNull();
+}
+
+// A recursive-descent parser following RFC 8259.
+class JsonParser
+{
+public:
+  explicit JsonParser(std::string_view text)
+      : m_text(text)
+  {
+  }
+
+  bool parseDocument(JsonValue& value)
+  {
+    skipWhitespace();
+    if(!parseValue(value, 0))
+    {
+      return false;
+    }
+    skipWhitespace();
+    return m_pos == m_text.size() || fail("unexpected characters after the JSON value");
+  }
+
+  const std::string& error() const { return m_error; }
+
+private:
+  // Limits recursion, so that malicious files can't overflow the stack.
+  static const int k_maxDepth = 256;
+
+  bool fail(const char* message)
+  {
+    if(m_error.empty())
+    {
+      m_error = std::string(message) + " at byte " + std::to_string(m_pos);
+    }
+    return false;
+  }
+
+  void skipWhitespace()
+  {
+    while(m_pos < m_text.size()
+          && (m_text[m_pos] == ' ' || m_text[m_pos] == '\t' || m_text[m_pos] == '\n' || m_text[m_pos] == '\r'))
+    {
+      m_pos++;
+    }
+  }
+
+  bool consume(char c)
+  {
+    if(m_pos < m_text.size() && m_text[m_pos] == c)
+    {
+      m_pos++;
+      return true;
+    }
+    return false;
+  }
+
+  bool consumeLiteral(std::string_view literal)
+  {
+    if(m_text.substr(m_pos, literal.size()) == literal)
+    {
+      m_pos += literal.size();
+      return true;
+    }
+    return fail("invalid literal");
+  }
+
+  bool parseValue(JsonValue& value, int depth)
+  {
+    if(depth > k_maxDepth)
+    {
+      return fail("JSON nested too deeply");
+    }
+    if(m_pos >= m_text.size())
+    {
+      return fail("unexpected end of JSON");
+    }
+    switch(m_text[m_pos])
+    {
+      case '{':
+        return parseObject(value, depth);
+      case '[':
+        return parseArray(value, depth);
+      case '"':
+        value.m_type = JsonValue::Type::eString;
+        return parseString(value.m_string);
+      case 't':
+        value.m_type = JsonValue::Type::eBool;
+        value.m_bool = true;
+        return consumeLiteral("true");
+      case 'f':
+        value.m_type = JsonValue::Type::eBool;
+        value.m_bool = false;
+        return consumeLiteral("false");
+      case 'n':
+        value.m_type = JsonValue::Type::eNull;
+        return consumeLiteral("null");
+      default:
+        return parseNumber(value);
+    }
+  }
+
+  bool parseObject(JsonValue& value, int depth)
+  {
+    value.m_type = JsonValue::Type::eObject;
+    m_pos++;  // '{'
+    skipWhitespace();
+    if(consume('}'))
+    {
+      return true;
+    }
+    while(true)
+    {
+      skipWhitespace();
+      std::string key;
+      if(m_pos >= m_text.size() || m_text[m_pos] != '"' || !parseString(key))
+      {
+        return fail("expected a string key");
+      }
+      skipWhitespace();
+      if(!consume(':'))
+      {
+        return fail("expected ':'");
+      }
+      skipWhitespace();
+      JsonValue member;
+      if(!parseValue(member, depth + 1))
+      {
+        return false;
+      }
+      value.m_members.emplace_back(std::move(key), std::move(member));
+      skipWhitespace();
+      if(consume('}'))
+      {
+        return true;
+      }
+      if(!consume(','))
+      {
+        return fail("expected ',' or '}'");
+      }
+    }
+  }
+
+  bool parseArray(JsonValue& value, int depth)
+  {
+    value.m_type = JsonValue::Type::eArray;
+    m_pos++;  // '['
+    skipWhitespace();
+    if(consume(']'))
+    {
+      return true;
+    }
+    while(true)
+    {
+      skipWhitespace();
+      JsonValue element;
+      if(!parseValue(element, depth + 1))
+      {
+        return false;
+      }
+      value.m_elements.push_back(std::move(element));
+      skipWhitespace();
+      if(consume(']'))
+      {
+        return true;
+      }
+      if(!consume(','))
+      {
+        return fail("expected ',' or ']'");
+      }
+    }
+  }
+
+  bool parseHex4(uint32_t& codeUnit)
+  {
+    if(m_pos + 4 > m_text.size())
+    {
+      return fail("truncated \\u escape");
+    }
+    codeUnit = 0;
+    for(int i = 0; i < 4; i++)
+    {
+      const char c = m_text[m_pos++];
+      int        digit;
+      if(c >= '0' && c <= '9')
+      {
+        digit = c - '0';
+      }
+      else if(c >= 'a' && c <= 'f')
+      {
+        digit = c - 'a' + 10;
+      }
+      else if(c >= 'A' && c <= 'F')
+      {
+        digit = c - 'A' + 10;
+      }
+      else
+      {
+        return fail("invalid \\u escape");
+      }
+      codeUnit = (codeUnit << 4) | static_cast<uint32_t>(digit);
+    }
+    return true;
+  }
+
+  static void appendUtf8(std::string& out, uint32_t codePoint)
+  {
+    if(codePoint < 0x80)
+    {
+      out += static_cast<char>(codePoint);
+    }
+    else if(codePoint < 0x800)
+    {
+      out += static_cast<char>(0xC0 | (codePoint >> 6));
+      out += static_cast<char>(0x80 | (codePoint & 0x3F));
+    }
+    else if(codePoint < 0x10000)
+    {
+      out += static_cast<char>(0xE0 | (codePoint >> 12));
+      out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+      out += static_cast<char>(0x80 | (codePoint & 0x3F));
+    }
+    else
+    {
+      out += static_cast<char>(0xF0 | (codePoint >> 18));
+      out += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+      out += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+      out += static_cast<char>(0x80 | (codePoint & 0x3F));
+    }
+  }
+
+  bool parseString(std::string& out)
+  {
+    m_pos++;  // '"'
+    while(m_pos < m_text.size())
+    {
+      const char c = m_text[m_pos++];
+      if(c == '"')
+      {
+        return true;
+      }
+      if(static_cast<unsigned char>(c) < 0x20)
+      {
+        return fail("control character in string");
+      }
+      if(c != '\\')
+      {
+        out += c;
+        continue;
+      }
+      if(m_pos >= m_text.size())
+      {
+        break;
+      }
+      const char escape = m_text[m_pos++];
+      switch(escape)
+      {
+        case '"':
+        case '\\':
+        case '/':
+          out += escape;
+          break;
+        case 'b':
+          out += '\b';
+          break;
+        case 'f':
+          out += '\f';
+          break;
+        case 'n':
+          out += '\n';
+          break;
+        case 'r':
+          out += '\r';
+          break;
+        case 't':
+          out += '\t';
+          break;
+        case 'u': {
+          uint32_t codePoint = 0;
+          if(!parseHex4(codePoint))
+          {
+            return false;
+          }
+          // Combine UTF-16 surrogate pairs:
+          if(codePoint >= 0xD800 && codePoint < 0xDC00 && m_text.substr(m_pos, 2) == "\\u")
+          {
+            m_pos += 2;
+            uint32_t low = 0;
+            if(!parseHex4(low))
+            {
+              return false;
+            }
+            if(low < 0xDC00 || low >= 0xE000)
+            {
+              return fail("invalid UTF-16 surrogate pair");
+            }
+            codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+          }
+          appendUtf8(out, codePoint);
+          break;
+        }
+        default:
+          return fail("invalid escape sequence");
+      }
+    }
+    return fail("unterminated string");
+  }
+
+  bool parseNumber(JsonValue& value)
+  {
+    // Validate the JSON number grammar, then let from_chars do the conversion.
+    const size_t start = m_pos;
+    consume('-');
+    if(!consume('0'))
+    {
+      if(m_pos >= m_text.size() || m_text[m_pos] < '1' || m_text[m_pos] > '9')
+      {
+        return fail("unexpected character");
+      }
+      skipDigits();
+    }
+    if(consume('.') && !skipDigits())
+    {
+      return fail("expected digits after '.'");
+    }
+    if(consume('e') || consume('E'))
+    {
+      if(!consume('+'))
+      {
+        consume('-');
+      }
+      if(!skipDigits())
+      {
+        return fail("expected digits in exponent");
+      }
+    }
+    // Unlike strtod, from_chars doesn't depend on the locale's decimal point.
+    const std::from_chars_result result = std::from_chars(m_text.data() + start, m_text.data() + m_pos, value.m_number);
+    if(result.ec != std::errc())
+    {
+      m_pos = start;
+      return fail("number out of range of a double");
+    }
+    value.m_type = JsonValue::Type::eNumber;
+    return true;
+  }
+
+  bool skipDigits()
+  {
+    const size_t start = m_pos;
+    while(m_pos < m_text.size() && m_text[m_pos] >= '0' && m_text[m_pos] <= '9')
+    {
+      m_pos++;
+    }
+    return m_pos > start;
+  }
+
+  std::string_view m_text;
+  size_t           m_pos = 0;
+  std::string      m_error;
+};
+
+bool parseJson(std::string_view text, JsonValue& value, std::string& error)
+{
+  value = JsonValue();
+  JsonParser parser(text);
+  if(!parser.parseDocument(value))
+  {
+    error = parser.error();
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,72 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+// A small read-only JSON document model and parser, for the JSON parts of
+// scene files (e.g. the JSON chunk of a .glb file).
+#ifndef VK_MINI_PATH_TRACER_JSON_H
+#define VK_MINI_PATH_TRACER_JSON_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+class JsonValue
+{
+public:
+  enum class Type
+  {
+    eNull,
+    eBool,
+    eNumber,
+    eString,
+    eArray,
+    eObject
+  };
+
+  Type type() const { return m_type; }
+  bool isNull() const { return m_type == Type::eNull; }
+  bool isNumber() const { return m_type == Type::eNumber; }
+  bool isString() const { return m_type == Type::eString; }
+  bool isArray() const { return m_type == Type::eArray; }
+  bool isObject() const { return m_type == Type::eObject; }
+
+  // These return `fallback` if the value has a different type. asInt() rounds
+  // toward zero, and also returns `fallback` if the number doesn't fit.
+  bool               asBool(bool fallback = false) const;
+  double             asNumber(double fallback = 0.0) const;
+  int64_t            asInt(int64_t fallback = 0) const;
+  const std::string& asString() const;  // Empty if not a string
+
+  // Number of elements of an array or members of an object; 0 otherwise.
+  size_t size() const;
+  // Array element; a null value if out of range or not an array.
+  const JsonValue& operator[](size_t index) const;
+  const JsonValue& operator[](int index) const { return (*this)[static_cast<size_t>(index)]; }
+  // Object member; a null value if missing or not an object. If a key
+  // appears more than once, the first one wins.
+  const JsonValue& operator[](std::string_view key) const;
+  const JsonValue& operator[](const char* key) const { return (*this)[std::string_view(key)]; }
+  bool             contains(std::string_view key) const;
+
+  const std::vector<JsonValue>&                          elements() const { return m_elements; }
+  const std::vector<std::pair<std::string, JsonValue>>& members() const { return m_members; }
+
+private:
+  friend class JsonParser;
+
+  Type                                           m_type   = Type::eNull;
+  bool                                           m_bool   = false;
+  double                                         m_number = 0.0;
+  std::string                                    m_string;
+  std::vector<JsonValue>                         m_elements;
+  std::vector<std::pair<std::string, JsonValue>> m_members;
+};
+
+// Parses `text` into `value`. On failure, returns false and describes the
+// problem and where it occurred in `error`.
+bool parseJson(std::string_view text, JsonValue& value, std::string& error);
+
+#endif  // #ifndef VK_MINI_PATH_TRACER_JSON_H
@@ -1,28 +1,49 @@
 // Copyright 2020-2024 NVIDIA Corporation
 // SPDX-License-Identifier: Apache-2.0
 #include <array>
-#include <random>
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <functional>
+#include <span>
+#include <utility>
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include <stb_image_write.h>
-#define TINYOBJLOADER_IMPLEMENTATION
-#include <tiny_obj_loader.h>
 
 #include <glm/glm.hpp>
-#include <glm/gtx/transform.hpp>
 #include <nvh/fileoperations.hpp>  // For nvh::loadFile
 #include <nvvk/context_vk.hpp>
 #include <nvvk/descriptorsets_vk.hpp>  // For nvvk::DescriptorSetContainer
 #include <nvvk/error_vk.hpp>
 #include <nvvk/images_vk.hpp>
-#include <nvvk/raytraceKHR_vk.hpp>        // For nvvk::RaytracingBuilderKHR
 #include <nvvk/resourceallocator_vk.hpp>  // For NVVK memory allocators
 #include <nvvk/shaders_vk.hpp>            // For nvvk::createShaderModule
 
+#include "accelCache.h"
+#include "accelManager.h"
+#include "accelTuner.h"
+#include "bufferUtils.h"
 #include "common.h"
+#include "cpuRenderer.h"
+#include "cpuScene.h"
+#include "deformableMeshes.h"
+#include "gltfLoader.h"
+#include "instanceGenerator.h"
+#include "measurement.h"
+#include "meshDedup.h"
+#include "meshView.h"
+#include "objParser.h"
+#include "options.h"
+#include "sceneCache.h"
+#include "sceneDescription.h"
+#include "shadingStream.h"
+#include "stagingRing.h"
+#include "taskGraph.h"
+#include "threadPool.h"
+#include "triangleReorder.h"
+#include "triangleSplitter.h"
 
-PushConstants  pushConstants;
-const uint32_t render_width  = 800;
-const uint32_t render_height = 600;
+PushConstants pushConstants;
 
 VkCommandBuffer AllocateAndBeginOneTimeCommandBuffer(VkDevice device, VkCommandPool cmdPool)
 {
@@ -47,476 +68,1177 @@ void EndSubmitWaitAndFreeCommandBuffer(VkDevice device, VkQueue queue, VkCommand
   vkFreeCommandBuffers(device, cmdPool, 1, &cmdBuffer);
 }
 
-VkDeviceAddress GetBufferDeviceAddress(VkDevice device, VkBuffer buffer)
+// Marks a MeshSource without a primitive remap table.
+const uint32_t k_noBuffer = ~0u;
+
+// Where the triangles of one BLAS are. The offsets are relative to the start
+// of one of the scene's data buffers, which are uploaded as they are.
+struct MeshSource
+{
+  uint32_t     vertexBuffer;  // Index of the buffer containing the vertices
+  VkDeviceSize vertexOffset;  // Byte offset of the first vertex
+  uint32_t     vertexStride;  // Bytes between vertices
+  uint32_t     vertexCount;
+  uint32_t     indexBuffer;  // Index of the buffer containing the indices
+  VkDeviceSize indexOffset;  // Byte offset of the first index
+  uint32_t     indexCount;   // 3 per triangle
+  uint32_t     indexBits;    // 16 or 32
+  uint32_t     remapBuffer;  // Index of the buffer with the original primitive IDs (see triangleReorder.h), or k_noBuffer
+  VkDeviceSize remapOffset;  // Byte offset of the mesh's first original primitive ID
+};
+
+// Returns the triangles of `mesh` in the host copies of the scene's data buffers.
+MeshView GetMeshView(const MeshSource& mesh, std::span<const std::span<const uint8_t>> sceneData)
+{
+  return {.positions      = sceneData[mesh.vertexBuffer].data() + mesh.vertexOffset,
+          .positionStride = mesh.vertexStride,
+          .vertexCount    = mesh.vertexCount,
+          .indices        = sceneData[mesh.indexBuffer].data() + mesh.indexOffset,
+          .indexBits      = mesh.indexBits,
+          .indexCount     = mesh.indexCount};
+}
+
+// Returns the box around the vertices of `mesh`.
+VkAabbPositionsKHR GetMeshBounds(const MeshView& mesh)
+{
+  float boundsMin[3] = {FLT_MAX, FLT_MAX, FLT_MAX}, boundsMax[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+  for(uint32_t vertex = 0; vertex < mesh.vertexCount; vertex++)
+  {
+    float position[3];
+    mesh.readPosition(vertex, position);
+    for(int c = 0; c < 3; c++)
+    {
+      boundsMin[c] = std::min(boundsMin[c], position[c]);
+      boundsMax[c] = std::max(boundsMax[c], position[c]);
+    }
+  }
+  return {boundsMin[0], boundsMin[1], boundsMin[2], boundsMax[0], boundsMax[1], boundsMax[2]};
+}
+
+// Loads the meshes of all shapes from an OBJ file, and splits its triangles
+// if --split-budget asks for it.
+void LoadObjGeometry(const std::string& objPath, const Options& options, ThreadPool& threadPool, SceneGeometry& sceneGeometry)
+{
+  const bool loaded = loadSceneGeometry(objPath, options.useSceneCache, options.weldVertices, options.reorderTriangles,
+                                        threadPool, sceneGeometry);
+  assert(loaded);                          // Make sure we were able to load this file
+  assert(!sceneGeometry.shapes.empty());  // Check that this file has at least one shape
+  if(options.splitBudgetPercent > 0)
+  {
+    // Split long, thin triangles so the BLASes bound them more tightly.
+    // This keeps the original primitive IDs in sourcePrimitives.
+    const uint64_t maxExtraTriangles = uint64_t(sceneGeometry.numTriangles()) * options.splitBudgetPercent / 100;
+    SceneGeometry  splitGeometry;
+    splitSceneTriangles(sceneGeometry, static_cast<uint32_t>(std::min<uint64_t>(maxExtraTriangles, UINT32_MAX)),
+                        threadPool, splitGeometry);
+    sceneGeometry = std::move(splitGeometry);
+  }
+}
+
+// Calls place(meshIdx, transform, material) for each instance of a mesh the
+// scene places. `gltfScene` is the loaded glTF file, or nullptr for OBJ
+// scenes. With `includeGrid` false, skips the instances of the scene's
+// instance grid.
+void PlaceSceneInstances(const SceneDescription&                                          sceneDescription,
+                         const GltfScene*                                                 gltfScene,
+                         uint32_t                                                         numMeshes,
+                         bool                                                             includeGrid,
+                         const std::function<void(uint32_t, const glm::mat4&, uint32_t)>& place)
+{
+  // glTF materials select one of the 9 hit shaders; OBJ shapes use the first one.
+  const auto meshMaterial = [&](uint32_t meshIdx) {
+    const int32_t material = (gltfScene != nullptr) ? gltfScene->primitives[meshIdx].material : 0;
+    return (material < 0) ? 0u : static_cast<uint32_t>(material % 9);
+  };
+
+  if(gltfScene != nullptr && !sceneDescription.hasInstances())
+  {
+    // Each glTF node with a mesh becomes one instance per primitive of the
+    // mesh, using the node's world transform.
+    for(const GltfInstance& gltfInstance : gltfScene->instances)
+    {
+      const GltfMesh& mesh = gltfScene->meshes[gltfInstance.mesh];
+      for(uint32_t primIdx = mesh.firstPrimitive; primIdx < mesh.firstPrimitive + mesh.primitiveCount; primIdx++)
+      {
+        place(primIdx, gltfInstance.transform, meshMaterial(primIdx));
+      }
+    }
+    return;
+  }
+
+  // Place the scene description's instances. Without a scene file, this
+  // places a copy of the OBJ scene at each of 441 grid cells with a random
+  // rotation, using one instance per shape.
+  std::vector<SceneInstance> sceneInstances = sceneDescription.instances;
+  if((sceneDescription.instanceGrid || !sceneDescription.hasInstances()) && includeGrid)
+  {
+    const std::vector<SceneInstance> gridInstances = expandInstanceGrid(sceneDescription.instanceGrid.value_or(SceneInstanceGrid{}));
+    sceneInstances.insert(sceneInstances.end(), gridInstances.begin(), gridInstances.end());
+  }
+  for(const SceneInstance& sceneInstance : sceneInstances)
+  {
+    if(sceneInstance.mesh != k_sceneDefault && static_cast<uint32_t>(sceneInstance.mesh) >= numMeshes)
+    {
+      LOGW("Skipping an instance of mesh %d, since the scene only has %u meshes.\n", sceneInstance.mesh, numMeshes);
+      continue;
+    }
+    const uint32_t firstMesh = (sceneInstance.mesh == k_sceneDefault) ? 0 : static_cast<uint32_t>(sceneInstance.mesh);
+    const uint32_t endMesh   = (sceneInstance.mesh == k_sceneDefault) ? numMeshes : firstMesh + 1;
+    for(uint32_t meshIdx = firstMesh; meshIdx < endMesh; meshIdx++)
+    {
+      const uint32_t material = (sceneInstance.material == k_sceneDefault) ? meshMaterial(meshIdx) :
+                                                                             static_cast<uint32_t>(sceneInstance.material);
+      place(meshIdx, sceneInstance.transform, material);
+    }
+  }
+}
+
+// --cpu-render: loads the scene, renders it with the C++ port of the shaders
+// (see cpuRenderer.h) instead of on the GPU, and writes the image like the
+// GPU path does.
+void RenderOnCpu(const Options&          options,
+                 const SceneDescription& sceneDescription,
+                 const std::string&      objPath,
+                 const std::string&      glbPath,
+                 ThreadPool&             threadPool)
 {
-  VkBufferDeviceAddressInfo addressInfo{.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO, .buffer = buffer};
-  return vkGetBufferDeviceAddress(device, &addressInfo);
+  // Describe where the triangles of each mesh are in the loaded data, like
+  // the scene stage does for the GPU.
+  SceneGeometry        sceneGeometry;
+  GltfScene            gltfScene;
+  const bool           useGltf = !glbPath.empty();
+  std::vector<CpuMesh> meshes;
+  if(useGltf)
+  {
+    const bool loaded = loadGlb(glbPath, gltfScene);
+    assert(loaded);                           // Make sure we were able to load this file
+    assert(!gltfScene.primitives.empty());  // Check that this file has at least one primitive we can ray trace
+    const std::array<const uint8_t*, 2> sources = {gltfScene.binaryChunk.data(), gltfScene.convertedData.data()};
+    for(const GltfPrimitive& primitive : gltfScene.primitives)
+    {
+      const MeshView triangles{.positions = sources[static_cast<uint32_t>(primitive.positionSource)] + primitive.positionOffset,
+                               .positionStride = primitive.positionStride,
+                               .vertexCount    = primitive.vertexCount,
+                               .indices        = sources[static_cast<uint32_t>(primitive.indexSource)] + primitive.indexOffset,
+                               .indexBits      = primitive.indexBits,
+                               .indexCount     = primitive.indexCount};
+      meshes.push_back({.triangles = triangles, .sourcePrimitives = nullptr});
+    }
+  }
+  else
+  {
+    LoadObjGeometry(objPath, options, threadPool, sceneGeometry);
+    const bool reordered = !sceneGeometry.sourcePrimitives.empty();
+    for(const SceneShape& shape : sceneGeometry.shapes)
+    {
+      const float*    positions = sceneGeometry.positions.data() + 3 * size_t(shape.firstVertex);
+      const uint32_t* indices   = sceneGeometry.indexWords.data() + shape.firstIndexWord;
+      const MeshView  triangles{.positions      = reinterpret_cast<const uint8_t*>(positions),
+                                .positionStride = 3 * sizeof(float),
+                                .vertexCount    = shape.vertexCount,
+                                .indices        = reinterpret_cast<const uint8_t*>(indices),
+                                .indexBits      = shape.indexBits,
+                                .indexCount     = shape.indexCount};
+      meshes.push_back({.triangles        = triangles,
+                        .sourcePrimitives = reordered ? sceneGeometry.sourcePrimitives.data() + shape.firstIndex / 3 : nullptr});
+    }
+  }
+
+  // Place the same instances as the TLAS, and flatten them into one BVH.
+  std::vector<CpuInstance> instances;
+  PlaceSceneInstances(sceneDescription, useGltf ? &gltfScene : nullptr, static_cast<uint32_t>(meshes.size()), true,
+                      [&](uint32_t meshIdx, const glm::mat4& transform, uint32_t material) {
+                        instances.push_back({.transform = transform, .mesh = meshIdx, .material = material});
+                      });
+  CpuScene scene;
+  buildCpuScene(meshes, instances, BvhBuildMethod::eBinnedSah, threadPool, scene);
+
+  // Trace the sample batches one after another, like the GPU's launches.
+  const uint32_t     width  = sceneDescription.render.width;
+  const uint32_t     height = sceneDescription.render.height;
+  PushConstants      cpuPushConstants{};
+  std::vector<float> image(size_t(width) * height * 4, 0.0f);
+  setCameraPushConstants(sceneDescription, cpuPushConstants);
+  TileSchedulerStats tileStats;
+  const auto         renderStartTime = std::chrono::steady_clock::now();
+  for(uint32_t sampleBatch = 0; sampleBatch < sceneDescription.render.sampleBatches; sampleBatch++)
+  {
+    cpuPushConstants.sample_batch = sampleBatch;
+    tileStats.add(renderSampleBatchOnCpu(scene, cpuPushConstants, width, height, threadPool, image));
+    nvprintf("Rendered sample batch index %d.\n", sampleBatch);
+  }
+  const double renderMs = millisecondsSince(renderStartTime);
+  const double numPaths = double(width) * double(height) * cpuPushConstants.samplesPerBatch * sceneDescription.render.sampleBatches;
+  LOGI("Rendered %u sample batches on the CPU with %u worker threads in %.3f ms (%.2f million paths/s).\n",
+       sceneDescription.render.sampleBatches, threadPool.numThreads(), renderMs, numPaths / (renderMs * 1000.0));
+  logTileSchedulerStats(tileStats);
+
+  stbi_write_hdr(sceneDescription.render.outputPath.c_str(), width, height, 4, image.data());
 }
 
 int main(int argc, const char** argv)
 {
-  // Create the Vulkan context, consisting of an instance, device, physical device, and queues.
-  nvvk::ContextCreateInfo deviceInfo;  // One can modify this to load different extensions or pick the Vulkan core version
-  deviceInfo.apiMajor = 1;             // Specify the version of Vulkan we'll use
-  deviceInfo.apiMinor = 2;
-  // Required by KHR_acceleration_structure; allows work to be offloaded onto background threads and parallelized
-  deviceInfo.addDeviceExtension(VK_KHR_DEFERRED_HOST_OPERATIONS_EXTENSION_NAME);
-  VkPhysicalDeviceAccelerationStructureFeaturesKHR asFeatures{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_FEATURES_KHR};
-  deviceInfo.addDeviceExtension(VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME, false, &asFeatures);
-  VkPhysicalDeviceRayTracingPipelineFeaturesKHR rtPipelineFeatures{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_FEATURES_KHR};
-  deviceInfo.addDeviceExtension(VK_KHR_RAY_TRACING_PIPELINE_EXTENSION_NAME, false, &rtPipelineFeatures);
-
-  nvvk::Context context;     // Encapsulates device state in a single object
-  context.init(deviceInfo);  // Initialize the context
-
-  // Get the properties of ray tracing pipelines on this device. We do this by
-  // using vkGetPhysicalDeviceProperties2, and extending this by chaining on a
-  // VkPhysicalDeviceRayTracingPipelinePropertiesKHR object to get both
-  // physical device properties and ray tracing pipeline properties.
-  // This gives us information about shader binding tables.
-  VkPhysicalDeviceRayTracingPipelinePropertiesKHR rtPipelineProperties{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_PROPERTIES_KHR};
-  VkPhysicalDeviceProperties2 physicalDeviceProperties{.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
-                                                       .pNext = &rtPipelineProperties};
-  vkGetPhysicalDeviceProperties2(context.m_physicalDevice, &physicalDeviceProperties);
-  const VkDeviceSize sbtHeaderSize      = rtPipelineProperties.shaderGroupHandleSize;
-  const VkDeviceSize sbtBaseAlignment   = rtPipelineProperties.shaderGroupBaseAlignment;
-  const VkDeviceSize sbtHandleAlignment = rtPipelineProperties.shaderGroupHandleAlignment;
-
-  // Compute the stride between shader binding table (SBT) records.
-  // This must be:
-  // - Greater than rtPipelineProperties.shaderGroupHandleSize (since a record
-  //     contains a shader group handle)
-  // - A multiple of rtPipelineProperties.shaderGroupHandleAlignment
-  // - Less than or equal to rtPipelineProperties.maxShaderGroupStride
-  // In addition, each SBT must start at a multiple of
-  // rtPipelineProperties.shaderGroupBaseAlignment.
-  // Since we store all records contiguously in a single SBT, we assert that
-  // sbtBaseAlignment is a multiple of sbtHandleAlignment, round sbtHeaderSize
-  // up to a multiple of sbtBaseAlignment, and then assert that the result is
-  // less than or equal to maxShaderGroupStride.
-  assert(sbtBaseAlignment % sbtHandleAlignment == 0);
-  const VkDeviceSize sbtStride = sbtBaseAlignment *  //
-                                 ((sbtHeaderSize + sbtBaseAlignment - 1) / sbtBaseAlignment);
-  assert(sbtStride <= rtPipelineProperties.maxShaderGroupStride);
-
-  // Initialize the debug utilities:
-  nvvk::DebugUtil debugUtil(context);
-
-  // Create the allocator
-  nvvk::ResourceAllocatorDedicated allocator;
-  allocator.init(context, context.m_physicalDevice);
-
-  // Create an image. Images are more complex than buffers - they can have
-  // multiple dimensions, different color+depth formats, be arrays of mips,
-  // have multisampling, be tiled in memory in e.g. row-linear order or in an
-  // implementation-dependent way (and this layout of memory can depend on
-  // what the image is being used for), and be shared across multiple queues.
-  // Here's how we specify the image we'll use:
-  VkImageCreateInfo imageCreateInfo =  //
-      {.sType     = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
-       .imageType = VK_IMAGE_TYPE_2D,
-       // RGB32 images aren't usually supported, so we change this to a RGBA32 image.
-       .format = VK_FORMAT_R32G32B32A32_SFLOAT,
-       // Defines the size of the image:
-       .extent = {render_width, render_height, 1},
-       // The image is an array of length 1, and each element contains only 1 mip:
-       .mipLevels   = 1,
-       .arrayLayers = 1,
-       // We aren't using MSAA (i.e. the image only contains 1 sample per pixel -
-       // note that this isn't the same use of the word "sample" as in ray tracing):
-       .samples = VK_SAMPLE_COUNT_1_BIT,
-       // The driver controls the tiling of the image for performance:
-       .tiling = VK_IMAGE_TILING_OPTIMAL,
-       // This image is read and written on the GPU, and data can be transferred
-       // from it:
-       .usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
-       // Image is only used by one queue:
-       .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
-       // The image must be in either VK_IMAGE_LAYOUT_UNDEFINED or VK_IMAGE_LAYOUT_PREINITIALIZED
-       // according to the specification; we'll transition the layout shortly,
-       // in the same command buffer used to upload the vertex and index buffers:
-       .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED};
-  nvvk::Image image = allocator.createImage(imageCreateInfo);
-  debugUtil.setObjectName(image.image, "image");
-
-  // Create an image view for the entire image
-  // When we create a descriptor for the image, we'll also need an image view
-  // that the descriptor will point to. This specifies what part of the image
-  // the descriptor views, and how the descriptor views it.
-  VkImageViewCreateInfo imageViewCreateInfo =  //
-      {.sType    = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
-       .image    = image.image,
-       .viewType = VK_IMAGE_VIEW_TYPE_2D,
-       .format   = imageCreateInfo.format,
-       // We could use imageViewCreateInfo.components to make the components of the
-       // image appear to be "swizzled", but we don't want to do that. Luckily,
-       // all values are set to VK_COMPONENT_SWIZZLE_IDENTITY, which means
-       // "don't change anything", by zero initialization.
-       // This says that the ImageView views the color part of the image (since
-       // images can contain depth or stencil aspects):
-       .subresourceRange = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-                            // This says that we only look at mip level and array layer 0:
-                            .baseMipLevel   = 0,
-                            .levelCount     = 1,
-                            .baseArrayLayer = 0,
-                            .layerCount     = 1}};
-  VkImageView imageView;
-  NVVK_CHECK(vkCreateImageView(context, &imageViewCreateInfo, nullptr, &imageView));
-  debugUtil.setObjectName(imageView, "imageView");
-
-  // Also create an image using linear tiling that can be accessed from the CPU,
-  // much like how we created the buffer in the main tutorial. The first image
-  // will be entirely local to the GPU for performance, while this image can
-  // be mapped to CPU memory. We'll copy data from the first image to this
-  // image in order to read the image data back on the CPU.
-  // As before, we'll transition the image layout in the same command buffer
-  // used to upload the vertex and index buffers.
-  imageCreateInfo.tiling  = VK_IMAGE_TILING_LINEAR;
-  imageCreateInfo.usage   = VK_IMAGE_USAGE_TRANSFER_DST_BIT;
-  nvvk::Image imageLinear = allocator.createImage(imageCreateInfo,                           //
-                                                  VK_MEMORY_PROPERTY_HOST_COHERENT_BIT       //
-                                                      | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT  //
-                                                      | VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
-  debugUtil.setObjectName(imageLinear.image, "imageLinear");
-
-  // Load the mesh of the first shape from an OBJ file
+  Options                  options = parseOptions(argc, argv);
   const std::string        exePath(argv[0], std::string(argv[0]).find_last_of("/\\") + 1);
   std::vector<std::string> searchPaths = {exePath + PROJECT_RELDIRECTORY, exePath + PROJECT_RELDIRECTORY "..",
                                           exePath + PROJECT_RELDIRECTORY "../..", exePath + PROJECT_NAME};
-  tinyobj::ObjReader       reader;  // Used to read an OBJ file
-  reader.ParseFromFile(nvh::findFile("scenes/CornellBox-Original-Merged.obj", searchPaths));
-  assert(reader.Valid());  // Make sure tinyobj was able to parse this file
-  const std::vector<tinyobj::real_t>   objVertices = reader.GetAttrib().GetVertices();
-  const std::vector<tinyobj::shape_t>& objShapes   = reader.GetShapes();  // All shapes in the file
-  assert(objShapes.size() == 1);                                          // Check that this file has only one shape
-  const tinyobj::shape_t& objShape = objShapes[0];                        // Get the first shape
-  // Get the indices of the vertices of the first mesh of `objShape` in `attrib.vertices`:
-  std::vector<uint32_t> objIndices;
-  objIndices.reserve(objShape.mesh.indices.size());
-  for(const tinyobj::index_t& index : objShape.mesh.indices)
+
+  // Read what to render from the scene file, if there is one. Otherwise, the
+  // scene description's defaults reproduce the original sample.
+  SceneDescription sceneDescription;
+  if(!options.scenePath.empty())
   {
-    objIndices.push_back(index.vertex_index);
+    const bool loaded = loadSceneDescription(nvh::findFile(options.scenePath, searchPaths), sceneDescription);
+    assert(loaded);  // Make sure we were able to load this file
+    // The scene file's geometry replaces the command line's:
+    if(!sceneDescription.objPath.empty())
+    {
+      options.objPath = sceneDescription.objPath;
+      options.glbPath.clear();
+    }
+    else if(!sceneDescription.glbPath.empty())
+    {
+      options.glbPath = sceneDescription.glbPath;
+    }
+  }
+  const uint32_t    render_width  = sceneDescription.render.width;
+  const uint32_t    render_height = sceneDescription.render.height;
+  const std::string objPath       = nvh::findFile(options.objPath, searchPaths);
+  if(options.benchmarkObjParser)
+  {
+    runObjParserBenchmark(objPath);
+    return 0;
   }
 
-  // Create the command pool
-  VkCommandPoolCreateInfo cmdPoolInfo{.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,  //
-                                      .queueFamilyIndex = context.m_queueGCT};
-  VkCommandPool           cmdPool;
-  NVVK_CHECK(vkCreateCommandPool(context, &cmdPoolInfo, nullptr, &cmdPool));
-  debugUtil.setObjectName(cmdPool, "cmdPool");
-
-  // Upload the vertex and index buffers to the GPU.
-  nvvk::Buffer vertexBuffer, indexBuffer;
+  // Worker threads for CPU-side loading work
+  ThreadPool threadPool;
+  if(options.benchmarkReorderLocality)
   {
-    // Start a command buffer for uploading the buffers
-    VkCommandBuffer uploadCmdBuffer = AllocateAndBeginOneTimeCommandBuffer(context, cmdPool);
-    // We get these buffers' device addresses, and use them as storage buffers and build inputs.
-    const VkBufferUsageFlags usage = VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
-                                     | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR;
-    vertexBuffer = allocator.createBuffer(uploadCmdBuffer, objVertices, usage);
-    indexBuffer  = allocator.createBuffer(uploadCmdBuffer, objIndices, usage);
-
-    // Also, let's transition the layout of `image` to `VK_IMAGE_LAYOUT_GENERAL`,
-    // and the layout of `imageLinear` to `VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL`.
-    // Although we use `imageLinear` later, we're transferring its layout as
-    // early as possible. For more complex applications, tracking images and
-    // operations using a graph is a good way to handle these types of images
-    // automatically. However, for this tutorial, we'll show how to write
-    // image transitions by hand.
-
-    // To do this, we combine both transitions in a single pipeline barrier.
-    // This pipeline barrier will say "Make it so that all writes to memory by
-    const VkAccessFlags srcAccesses = 0;  // Since image and imageLinear aren't initially accessible
-    // finish and can be read correctly by
-    const VkAccessFlags dstImageAccesses       = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;  // for image
-    const VkAccessFlags dstImageLinearAccesses = VK_ACCESS_TRANSFER_WRITE_BIT;  // for imageLinear
-    // "
-
-    // Here's how to do that:
-    const VkPipelineStageFlags srcStages = nvvk::makeAccessMaskPipelineStageFlags(srcAccesses);
-    const VkPipelineStageFlags dstStages = nvvk::makeAccessMaskPipelineStageFlags(dstImageAccesses | dstImageLinearAccesses);
-    VkImageMemoryBarrier imageBarriers[2];
-    // Image memory barrier for `image` from UNDEFINED to GENERAL layout:
-    imageBarriers[0] = nvvk::makeImageMemoryBarrier(image.image,                    // The VkImage
-                                                    srcAccesses, dstImageAccesses,  // Source and destination access masks
-                                                    VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,  // Source and destination layouts
-                                                    VK_IMAGE_ASPECT_COLOR_BIT);  // Aspects of an image (color, depth, etc.)
-    // Image memory barrier for `imageLinear` from UNDEFINED to TRANSFER_DST_OPTIMAL layout:
-    imageBarriers[1] = nvvk::makeImageMemoryBarrier(imageLinear.image,                    // The VkImage
-                                                    srcAccesses, dstImageLinearAccesses,  // Source and destination access masks
-                                                    VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,  // Source and dst layouts
-                                                    VK_IMAGE_ASPECT_COLOR_BIT);  // Aspects of an image (color, depth, etc.)
-    // Include the two image barriers in the pipeline barrier:
-    vkCmdPipelineBarrier(uploadCmdBuffer,       // The command buffer
-                         srcStages, dstStages,  // Src and dst pipeline stages
-                         0,                     // Flags for memory dependencies
-                         0, nullptr,            // Global memory barrier objects
-                         0, nullptr,            // Buffer memory barrier objects
-                         2, imageBarriers);     // Image barrier objects
-
-    EndSubmitWaitAndFreeCommandBuffer(context, context.m_queueGCT, cmdPool, uploadCmdBuffer);
-    allocator.finalizeAndReleaseStaging();
+    runReorderLocalityBenchmark(objPath, options.weldVertices, threadPool);
+    return 0;
+  }
+  if(options.cpuRender)
+  {
+    const std::string glbPath = options.glbPath.empty() ? std::string() : nvh::findFile(options.glbPath, searchPaths);
+    RenderOnCpu(options, sceneDescription, objPath, glbPath, threadPool);
+    return 0;
   }
 
-  // Describe the bottom-level acceleration structure (BLAS)
-  std::vector<nvvk::RaytracingBuilderKHR::BlasInput> blases;
+  // Build flags for the acceleration structures; --tune-accel-flags can
+  // replace them after startup.
+  const AccelFlagPreset* accelFlags = findAccelFlagPreset(options.accelFlags);
+  if(accelFlags == nullptr)
   {
-    nvvk::RaytracingBuilderKHR::BlasInput blas;
-    // Get the device addresses of the vertex and index buffers
-    VkDeviceAddress vertexBufferAddress = GetBufferDeviceAddress(context, vertexBuffer.buffer);
-    VkDeviceAddress indexBufferAddress  = GetBufferDeviceAddress(context, indexBuffer.buffer);
-    // Specify where the builder can find the vertices and indices for triangles, and their formats:
-    VkAccelerationStructureGeometryTrianglesDataKHR triangles{
-        .sType         = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR,
-        .vertexFormat  = VK_FORMAT_R32G32B32_SFLOAT,
-        .vertexData    = {.deviceAddress = vertexBufferAddress},
-        .vertexStride  = 3 * sizeof(float),
-        .maxVertex     = static_cast<uint32_t>(objVertices.size() / 3 - 1),
-        .indexType     = VK_INDEX_TYPE_UINT32,
-        .indexData     = {.deviceAddress = indexBufferAddress},
-        .transformData = {.deviceAddress = 0}  // No transform
-    };
-    // Create a VkAccelerationStructureGeometryKHR object that says it handles opaque triangles and points to the above:
-    VkAccelerationStructureGeometryKHR geometry{.sType        = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR,
-                                                .geometryType = VK_GEOMETRY_TYPE_TRIANGLES_KHR,
-                                                .geometry     = {.triangles = triangles},
-                                                .flags        = VK_GEOMETRY_OPAQUE_BIT_KHR};
-    blas.asGeometry.push_back(geometry);
-    // Create offset info that allows us to say how many triangles and vertices to read
-    VkAccelerationStructureBuildRangeInfoKHR offsetInfo{
-        .primitiveCount  = static_cast<uint32_t>(objIndices.size() / 3),  // Number of triangles
-        .primitiveOffset = 0,                                             // Offset added when looking up triangles
-        .firstVertex     = 0,  // Offset added when looking up vertices in the vertex buffer
-        .transformOffset = 0   // Offset added when looking up transformation matrices, if we used them
-    };
-    blas.asBuildOffsetInfo.push_back(offsetInfo);
-    blases.push_back(blas);
+    LOGW("Unknown --accel-flags preset %s; using %s.\n", options.accelFlags.c_str(), accelFlagPresets()[0].name);
+    accelFlags = &accelFlagPresets()[0];
   }
-  // Create the BLAS
-  nvvk::RaytracingBuilderKHR raytracingBuilder;
-  raytracingBuilder.setup(context, &allocator, context.m_queueGCT);
-  raytracingBuilder.buildBlas(blases, VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR
-                                          | VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR);
 
-  // Create 441 instances with random rotations pointing to BLAS 0, and build these instances into a TLAS:
+  // Startup runs as a small graph of stages on the thread pool. Each stage
+  // starts as soon as the stages it depends on have finished, so parsing the
+  // scene and loading SPIR-V overlap with creating the device, and compiling
+  // the ray tracing pipeline overlaps with uploading the scene and building
+  // acceleration structures:
+  //
+  //               +------------------------------------------+
+  //               |                                          v
+  //   scene --> dedup --> shading stream --+
+  //                                        +--> upload --> blas --> tlas --+
+  //   device --+--> allocator -------------+                         ^     +--> bind
+  //            |                                                     |     |
+  //            |   shader files --+----------------------------------+     |
+  //            |                  |                                        |
+  //            +------------------+--> pipeline ---------------------------+
+  //
+  // The shading stream stage appends to sceneData, so it waits for the dedup
+  // stage, which reads it. Stages that submit to the queue or allocate memory
+  // run one after another, since neither the queue nor the allocator is
+  // thread-safe. We declare the objects stages share up front.
+  nvvk::Context                    context;  // Encapsulates device state in a single object
+  VkDeviceSize                     sbtHeaderSize = 0, sbtStride = 0;
+  nvvk::DebugUtil                  debugUtil;
+  nvvk::ResourceAllocatorDedicated allocator;
+  nvvk::Image                      image, imageLinear;
+  VkImageView                      imageView = VK_NULL_HANDLE;
+  VkCommandPool                    cmdPool   = VK_NULL_HANDLE;
+  StagingRing                      stagingRing;
+
+  SceneGeometry                         sceneGeometry;
+  GltfScene                             gltfScene;
+  const bool                            useGltf = !options.glbPath.empty();
+  std::vector<std::span<const uint8_t>> sceneData;    // One buffer each
+  std::vector<MeshSource>               meshSources;  // One per mesh
+  MeshDedup                             meshDedup;    // Which BLAS each mesh uses
+  uint32_t                              numMeshes               = 0;
+  size_t                                numFullPrecisionBuffers = 0;
+  ShadingStream                         shadingStream;
+
+  std::vector<nvvk::Buffer>    sceneBuffers;
+  std::vector<VkDeviceAddress> sceneBufferAddresses, vertexAddresses, indexAddresses;
+  AccelManager                 accelManager;
+  // One BLAS input per mesh, reading through device addresses, and the same
+  // inputs reading host memory, for building BLASes on the CPU.
+  std::vector<AccelManager::BlasInput> blases, hostBlases;
+  bool                                 hostAccelCommands = false;  // accelerationStructureHostCommands
+  // The TLAS's instances, and the index of the BLAS each one uses.
+  // Both are empty if the GPU generated the instances (--gpu-instances).
   std::vector<VkAccelerationStructureInstanceKHR> instances;
-  std::default_random_engine                      randomEngine;  // The random number generator
-  std::uniform_real_distribution<float>           uniformDist(-0.5f, 0.5f);
-  std::uniform_int_distribution<int>              uniformIntDist(0, 8);
-  for(int x = -10; x <= 10; x++)
-  {
-    for(int y = -10; y <= 10; y++)
+  std::vector<uint32_t>                           instanceBlases;
+  std::string                                     instanceGenCode;  // SPIR-V of instanceGen.comp.glsl
+  InstanceGenerator                               instanceGenerator;
+  nvvk::Buffer                                    generatedMeshBuffer;  // The instance generator's mesh table
+  nvvk::Buffer                 geometryTableBuffer;
+
+  const size_t                                      NUM_C_HIT_SHADERS = 9;
+  std::array<std::string, 2 + NUM_C_HIT_SHADERS>    shaderCode;  // SPIR-V of each module
+  std::array<VkShaderModule, 2 + NUM_C_HIT_SHADERS> modules;
+  nvvk::DescriptorSetContainer                      descriptorSetContainer;
+  VkPipeline                                        rtPipeline = VK_NULL_HANDLE;
+  nvvk::Buffer                                      rtSBTBuffer;  // The buffer for the Shader Binding Table
+
+  TaskGraph startup;
+  const TaskGraph::TaskId deviceStage = startup.add("device", {}, [&]() {
+    // Create the Vulkan context, consisting of an instance, device, physical device, and queues.
+    nvvk::ContextCreateInfo deviceInfo;  // One can modify this to load different extensions or pick the Vulkan core version
+    deviceInfo.apiMajor = 1;             // Specify the version of Vulkan we'll use
+    deviceInfo.apiMinor = 2;
+    // Required by KHR_acceleration_structure; allows work to be offloaded onto background threads and parallelized
+    deviceInfo.addDeviceExtension(VK_KHR_DEFERRED_HOST_OPERATIONS_EXTENSION_NAME);
+    VkPhysicalDeviceAccelerationStructureFeaturesKHR asFeatures{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_FEATURES_KHR};
+    deviceInfo.addDeviceExtension(VK_KHR_ACCELERATION_STRUCTURE_EXTENSION_NAME, false, &asFeatures);
+    VkPhysicalDeviceRayTracingPipelineFeaturesKHR rtPipelineFeatures{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_FEATURES_KHR};
+    deviceInfo.addDeviceExtension(VK_KHR_RAY_TRACING_PIPELINE_EXTENSION_NAME, false, &rtPipelineFeatures);
+
+    context.init(deviceInfo);  // Initialize the context
+    // The context enabled every feature in asFeatures the device supports, and
+    // left the others false.
+    hostAccelCommands = (asFeatures.accelerationStructureHostCommands == VK_TRUE);
+
+    // Get the properties of ray tracing pipelines on this device. We do this by
+    // using vkGetPhysicalDeviceProperties2, and extending this by chaining on a
+    // VkPhysicalDeviceRayTracingPipelinePropertiesKHR object to get both
+    // physical device properties and ray tracing pipeline properties.
+    // This gives us information about shader binding tables.
+    VkPhysicalDeviceRayTracingPipelinePropertiesKHR rtPipelineProperties{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_PROPERTIES_KHR};
+    VkPhysicalDeviceProperties2 physicalDeviceProperties{.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+                                                         .pNext = &rtPipelineProperties};
+    vkGetPhysicalDeviceProperties2(context.m_physicalDevice, &physicalDeviceProperties);
+    sbtHeaderSize                         = rtPipelineProperties.shaderGroupHandleSize;
+    const VkDeviceSize sbtBaseAlignment   = rtPipelineProperties.shaderGroupBaseAlignment;
+    const VkDeviceSize sbtHandleAlignment = rtPipelineProperties.shaderGroupHandleAlignment;
+
+    // Compute the stride between shader binding table (SBT) records.
+    // This must be:
+    // - Greater than rtPipelineProperties.shaderGroupHandleSize (since a record
+    //     contains a shader group handle)
+    // - A multiple of rtPipelineProperties.shaderGroupHandleAlignment
+    // - Less than or equal to rtPipelineProperties.maxShaderGroupStride
+    // In addition, each SBT must start at a multiple of
+    // rtPipelineProperties.shaderGroupBaseAlignment.
+    // Since we store all records contiguously in a single SBT, we assert that
+    // sbtBaseAlignment is a multiple of sbtHandleAlignment, round sbtHeaderSize
+    // up to a multiple of sbtBaseAlignment, and then assert that the result is
+    // less than or equal to maxShaderGroupStride.
+    assert(sbtBaseAlignment % sbtHandleAlignment == 0);
+    sbtStride = sbtBaseAlignment *  //
+                ((sbtHeaderSize + sbtBaseAlignment - 1) / sbtBaseAlignment);
+    assert(sbtStride <= rtPipelineProperties.maxShaderGroupStride);
+
+    // Initialize the debug utilities:
+    debugUtil.setup(context);
+  });
+
+  const TaskGraph::TaskId allocatorStage = startup.add("allocator", {deviceStage}, [&]() {
+    // Create the allocator
+    allocator.init(context, context.m_physicalDevice);
+
+    // Create an image. Images are more complex than buffers - they can have
+    // multiple dimensions, different color+depth formats, be arrays of mips,
+    // have multisampling, be tiled in memory in e.g. row-linear order or in an
+    // implementation-dependent way (and this layout of memory can depend on
+    // what the image is being used for), and be shared across multiple queues.
+    // Here's how we specify the image we'll use:
+    VkImageCreateInfo imageCreateInfo =  //
+        {.sType     = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+         .imageType = VK_IMAGE_TYPE_2D,
+         // RGB32 images aren't usually supported, so we change this to a RGBA32 image.
+         .format = VK_FORMAT_R32G32B32A32_SFLOAT,
+         // Defines the size of the image:
+         .extent = {render_width, render_height, 1},
+         // The image is an array of length 1, and each element contains only 1 mip:
+         .mipLevels   = 1,
+         .arrayLayers = 1,
+         // We aren't using MSAA (i.e. the image only contains 1 sample per pixel -
+         // note that this isn't the same use of the word "sample" as in ray tracing):
+         .samples = VK_SAMPLE_COUNT_1_BIT,
+         // The driver controls the tiling of the image for performance:
+         .tiling = VK_IMAGE_TILING_OPTIMAL,
+         // This image is read and written on the GPU, and data can be transferred
+         // from it:
+         .usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+         // Image is only used by one queue:
+         .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+         // The image must be in either VK_IMAGE_LAYOUT_UNDEFINED or VK_IMAGE_LAYOUT_PREINITIALIZED
+         // according to the specification; we'll transition the layout shortly,
+         // right after we start uploading the vertex and index buffers:
+         .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED};
+    image = allocator.createImage(imageCreateInfo);
+    debugUtil.setObjectName(image.image, "image");
+
+    // Create an image view for the entire image
+    // When we create a descriptor for the image, we'll also need an image view
+    // that the descriptor will point to. This specifies what part of the image
+    // the descriptor views, and how the descriptor views it.
+    VkImageViewCreateInfo imageViewCreateInfo =  //
+        {.sType    = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+         .image    = image.image,
+         .viewType = VK_IMAGE_VIEW_TYPE_2D,
+         .format   = imageCreateInfo.format,
+         // We could use imageViewCreateInfo.components to make the components of the
+         // image appear to be "swizzled", but we don't want to do that. Luckily,
+         // all values are set to VK_COMPONENT_SWIZZLE_IDENTITY, which means
+         // "don't change anything", by zero initialization.
+         // This says that the ImageView views the color part of the image (since
+         // images can contain depth or stencil aspects):
+         .subresourceRange = {.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                              // This says that we only look at mip level and array layer 0:
+                              .baseMipLevel   = 0,
+                              .levelCount     = 1,
+                              .baseArrayLayer = 0,
+                              .layerCount     = 1}};
+    NVVK_CHECK(vkCreateImageView(context, &imageViewCreateInfo, nullptr, &imageView));
+    debugUtil.setObjectName(imageView, "imageView");
+
+    // Also create an image using linear tiling that can be accessed from the CPU,
+    // much like how we created the buffer in the main tutorial. The first image
+    // will be entirely local to the GPU for performance, while this image can
+    // be mapped to CPU memory. We'll copy data from the first image to this
+    // image in order to read the image data back on the CPU.
+    // As before, we'll transition the image layout right after we start
+    // uploading the vertex and index buffers.
+    imageCreateInfo.tiling  = VK_IMAGE_TILING_LINEAR;
+    imageCreateInfo.usage   = VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    imageLinear             = allocator.createImage(imageCreateInfo,                           //
+                                                    VK_MEMORY_PROPERTY_HOST_COHERENT_BIT       //
+                                                        | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT  //
+                                                        | VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+    debugUtil.setObjectName(imageLinear.image, "imageLinear");
+
+    // Create the command pool
+    VkCommandPoolCreateInfo cmdPoolInfo{.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,  //
+                                        .queueFamilyIndex = context.m_queueGCT};
+    NVVK_CHECK(vkCreateCommandPool(context, &cmdPoolInfo, nullptr, &cmdPool));
+    debugUtil.setObjectName(cmdPool, "cmdPool");
+
+    // Create a fixed-size staging ring for streaming buffer data to the GPU.
+    // Unlike creating buffers with data through the allocator, this never
+    // needs more host memory for staging than the size of the ring.
+    stagingRing.init(context, context.m_queueGCT, context.m_queueGCT.familyIndex, allocator,
+                     static_cast<VkDeviceSize>(options.stagingBufferMB) * 1024 * 1024);
+  });
+
+  const TaskGraph::TaskId sceneStage = startup.add("scene", {}, [&]() {
+    // Load the scene, and describe where the triangles of each BLAS are in its
+    // data. Both loaders give us data we can upload without reformatting it.
+    if(useGltf)
+    {
+      // Memory-map a binary glTF file. Its accessors point into the file's
+      // binary chunk, which we upload as a whole, along with the few index
+      // arrays the loader had to convert.
+      if(options.splitBudgetPercent > 0)
+      {
+        LOGW("--split-budget only applies to OBJ scenes; not splitting triangles.\n");
+      }
+      const bool loaded = loadGlb(nvh::findFile(options.glbPath, searchPaths), gltfScene);
+      assert(loaded);                           // Make sure we were able to load this file
+      assert(!gltfScene.primitives.empty());  // Check that this file has at least one primitive we can ray trace
+      sceneData = {gltfScene.binaryChunk, gltfScene.convertedData};
+      for(const GltfPrimitive& primitive : gltfScene.primitives)
+      {
+        meshSources.push_back({.vertexBuffer = static_cast<uint32_t>(primitive.positionSource),
+                               .vertexOffset = primitive.positionOffset,
+                               .vertexStride = primitive.positionStride,
+                               .vertexCount  = primitive.vertexCount,
+                               .indexBuffer  = static_cast<uint32_t>(primitive.indexSource),
+                               .indexOffset  = primitive.indexOffset,
+                               .indexCount   = primitive.indexCount,
+                               .indexBits    = primitive.indexBits,
+                               .remapBuffer  = k_noBuffer});
+      }
+    }
+    else
     {
-      glm::mat4 transform = glm::translate(glm::vec3(0.0f, -1.0f, 0.0f));
-      transform           = glm::rotate(uniformDist(randomEngine), glm::vec3(1.0f, 0.0f, 0.0f)) * transform;
-      transform           = glm::rotate(uniformDist(randomEngine), glm::vec3(0.0f, 1.0f, 0.0f)) * transform;
-      transform           = glm::scale(glm::vec3(1.0f / 2.7f)) * transform;
-      transform           = glm::translate(glm::vec3(float(x), float(y), 0.0f)) * transform;
+      // Load the meshes of all shapes from an OBJ file, using a multithreaded
+      // parser, weld their vertices, and reorder their triangles. After the
+      // first run, this memory-maps a binary cache of the result instead.
+      LoadObjGeometry(objPath, options, threadPool, sceneGeometry);
+      sceneData = {asBytes(sceneGeometry.positions), asBytes(sceneGeometry.indexWords)};
+      const bool reordered = !sceneGeometry.sourcePrimitives.empty();
+      if(reordered)
+      {
+        sceneData.push_back(asBytes(sceneGeometry.sourcePrimitives));
+      }
+      for(const SceneShape& shape : sceneGeometry.shapes)
+      {
+        // Indices are relative to the shape's first vertex, and shapes with few
+        // enough vertices use 16-bit indices:
+        meshSources.push_back({.vertexBuffer = 0,
+                               .vertexOffset = shape.firstVertex * 3 * sizeof(float),
+                               .vertexStride = 3 * sizeof(float),
+                               .vertexCount  = shape.vertexCount,
+                               .indexBuffer  = 1,
+                               .indexOffset  = shape.firstIndexWord * sizeof(uint32_t),
+                               .indexCount   = shape.indexCount,
+                               .indexBits    = shape.indexBits,
+                               .remapBuffer  = reordered ? 2 : k_noBuffer,
+                               .remapOffset  = (shape.firstIndex / 3) * sizeof(uint32_t)});
+      }
+    }
+    numMeshes               = static_cast<uint32_t>(meshSources.size());
+    numFullPrecisionBuffers = sceneData.size();
+  });
+
+  // Find meshes with the same triangles, so that they can share BLASes.
+  const TaskGraph::TaskId dedupStage = startup.add("dedup", {sceneStage}, [&]() {
+    if(!options.dedupMeshes)
+    {
+      meshDedup = makeUniqueMeshes(numMeshes);
+      return;
+    }
+    std::vector<MeshView> dedupInputs;
+    for(const MeshSource& mesh : meshSources)
+    {
+      dedupInputs.push_back(GetMeshView(mesh, sceneData));
+    }
+    meshDedup = findDuplicateMeshes(dedupInputs, options.dedupNormalizeTranslation, threadPool);
+  });
+
+  // Optionally build a quantized copy of the data closest-hit shaders read,
+  // and upload it as two more scene buffers after the full-precision ones.
+  const TaskGraph::TaskId shadingStage = startup.add("shading stream", {dedupStage}, [&]() {
+    if(options.quantizedShading)
+    {
+      std::vector<MeshView> shadingInputs;
+      for(const MeshSource& mesh : meshSources)
+      {
+        shadingInputs.push_back(GetMeshView(mesh, sceneData));
+      }
+      buildShadingStream(shadingInputs, threadPool, shadingStream);
+      sceneData.push_back(asBytes(std::span<const uint16_t>(shadingStream.positions)));
+      sceneData.push_back(asBytes(std::span<const uint16_t>(shadingStream.normals)));
+    }
+  });
+
+  // Load the SPIR-V of all shaders. This only reads files, so it doesn't need the device.
+  const TaskGraph::TaskId shaderFilesStage = startup.add("shader files", {}, [&]() {
+    shaderCode[0] = nvh::loadFile("shaders/raytrace.rgen.glsl.spv", true, searchPaths);
+    shaderCode[1] = nvh::loadFile("shaders/raytrace.rmiss.glsl.spv", true, searchPaths);
+    for(int closestHitShaderIdx = 0; closestHitShaderIdx < NUM_C_HIT_SHADERS; closestHitShaderIdx++)
+    {
+      const std::string filename = "shaders/material" + std::to_string(closestHitShaderIdx) + ".rchit.glsl.spv";
+      shaderCode[2 + closestHitShaderIdx] = nvh::loadFile(filename, true, searchPaths);
+    }
+    if(options.gpuInstances || options.benchmarkInstanceGen)
+    {
+      instanceGenCode = nvh::loadFile("shaders/instanceGen.comp.glsl.spv", true, searchPaths);
+    }
+  });
+
+  const TaskGraph::TaskId uploadStage = startup.add("upload", {allocatorStage, shadingStage}, [&]() {
+    // Upload the scene's data buffers (vertices and indices) to the GPU.
+    sceneBuffers.resize(sceneData.size());
+    {
+      // We get these buffers' device addresses, and use them as storage buffers and build inputs.
+      const VkBufferUsageFlags usage = VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                                       | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR
+                                       | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+      for(size_t i = 0; i < sceneData.size(); i++)
+      {
+        // Vulkan doesn't allow empty buffers, e.g. when a glTF file needed no conversions
+        sceneBuffers[i] = allocator.createBuffer(std::max<VkDeviceSize>(sceneData[i].size(), 4), usage);
+        debugUtil.setObjectName(sceneBuffers[i].buffer, "sceneBuffer" + std::to_string(i));
+        // The data may point directly into a memory-mapped file, so we stream
+        // from it without making intermediate copies. While the ring copies
+        // one segment into the next, the GPU copies earlier segments:
+        stagingRing.upload(sceneBuffers[i].buffer, 0, sceneData[i].data(), sceneData[i].size());
+      }
+
+      // Start a command buffer for the image layout transitions
+      VkCommandBuffer uploadCmdBuffer = AllocateAndBeginOneTimeCommandBuffer(context, cmdPool);
+
+      // Also, let's transition the layout of `image` to `VK_IMAGE_LAYOUT_GENERAL`,
+      // and the layout of `imageLinear` to `VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL`.
+      // Although we use `imageLinear` later, we're transferring its layout as
+      // early as possible. For more complex applications, tracking images and
+      // operations using a graph is a good way to handle these types of images
+      // automatically. However, for this tutorial, we'll show how to write
+      // image transitions by hand.
+
+      // To do this, we combine both transitions in a single pipeline barrier.
+      // This pipeline barrier will say "Make it so that all writes to memory by
+      const VkAccessFlags srcAccesses = 0;  // Since image and imageLinear aren't initially accessible
+      // finish and can be read correctly by
+      const VkAccessFlags dstImageAccesses       = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;  // for image
+      const VkAccessFlags dstImageLinearAccesses = VK_ACCESS_TRANSFER_WRITE_BIT;  // for imageLinear
+      // "
+
+      // Here's how to do that:
+      const VkPipelineStageFlags srcStages = nvvk::makeAccessMaskPipelineStageFlags(srcAccesses);
+      const VkPipelineStageFlags dstStages = nvvk::makeAccessMaskPipelineStageFlags(dstImageAccesses | dstImageLinearAccesses);
+      VkImageMemoryBarrier imageBarriers[2];
+      // Image memory barrier for `image` from UNDEFINED to GENERAL layout:
+      imageBarriers[0] = nvvk::makeImageMemoryBarrier(image.image,                    // The VkImage
+                                                      srcAccesses, dstImageAccesses,  // Source and destination access masks
+                                                      VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,  // Source and destination layouts
+                                                      VK_IMAGE_ASPECT_COLOR_BIT);  // Aspects of an image (color, depth, etc.)
+      // Image memory barrier for `imageLinear` from UNDEFINED to TRANSFER_DST_OPTIMAL layout:
+      imageBarriers[1] = nvvk::makeImageMemoryBarrier(imageLinear.image,                    // The VkImage
+                                                      srcAccesses, dstImageLinearAccesses,  // Source and destination access masks
+                                                      VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,  // Source and dst layouts
+                                                      VK_IMAGE_ASPECT_COLOR_BIT);  // Aspects of an image (color, depth, etc.)
+      // Include the two image barriers in the pipeline barrier:
+      vkCmdPipelineBarrier(uploadCmdBuffer,       // The command buffer
+                           srcStages, dstStages,  // Src and dst pipeline stages
+                           0,                     // Flags for memory dependencies
+                           0, nullptr,            // Global memory barrier objects
+                           0, nullptr,            // Buffer memory barrier objects
+                           2, imageBarriers);     // Image barrier objects
 
+      EndSubmitWaitAndFreeCommandBuffer(context, context.m_queueGCT, cmdPool, uploadCmdBuffer);
+      // Wait for the streamed data, and report the upload bandwidth:
+      stagingRing.finish();
+    }
+
+    // Get the device addresses of the first vertex and index of each mesh
+    for(const nvvk::Buffer& buffer : sceneBuffers)
+    {
+      sceneBufferAddresses.push_back(getBufferDeviceAddress(context, buffer.buffer));
+    }
+    for(const MeshSource& mesh : meshSources)
+    {
+      vertexAddresses.push_back(sceneBufferAddresses[mesh.vertexBuffer] + mesh.vertexOffset);
+      indexAddresses.push_back(sceneBufferAddresses[mesh.indexBuffer] + mesh.indexOffset);
+    }
+  });
+
+  const TaskGraph::TaskId blasStage = startup.add("blas", {uploadStage, dedupStage}, [&]() {
+    // Describe one bottom-level acceleration structure (BLAS) per unique mesh
+    // (an OBJ shape or a glTF primitive). Meshes share the scene's buffers;
+    // each BLAS reads the range of vertices and triangles that belongs to its mesh.
+    for(const uint32_t meshIdx : meshDedup.uniqueMeshes)
+    {
+      const MeshSource&       mesh = meshSources[meshIdx];
+      AccelManager::BlasInput blas;
+      // Specify where the builder can find the vertices and indices for triangles, and their formats.
+      VkAccelerationStructureGeometryTrianglesDataKHR triangles{
+          .sType         = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR,
+          .vertexFormat  = VK_FORMAT_R32G32B32_SFLOAT,
+          .vertexData    = {.deviceAddress = vertexAddresses[meshIdx]},
+          .vertexStride  = mesh.vertexStride,
+          .maxVertex     = mesh.vertexCount - 1,
+          .indexType     = (mesh.indexBits == 16) ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32,
+          .indexData     = {.deviceAddress = indexAddresses[meshIdx]},
+          .transformData = {.deviceAddress = 0}  // No transform
+      };
+      // Create a VkAccelerationStructureGeometryKHR object that says it handles opaque triangles and points to the above:
+      VkAccelerationStructureGeometryKHR geometry{.sType        = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR,
+                                                  .geometryType = VK_GEOMETRY_TYPE_TRIANGLES_KHR,
+                                                  .geometry     = {.triangles = triangles},
+                                                  .flags        = VK_GEOMETRY_OPAQUE_BIT_KHR};
+      blas.asGeometry.push_back(geometry);
+      // Create offset info that allows us to say how many triangles and vertices to read
+      VkAccelerationStructureBuildRangeInfoKHR offsetInfo{
+          .primitiveCount  = mesh.indexCount / 3,  // Number of triangles
+          .primitiveOffset = 0,                     // Byte offset added to the index address
+          .firstVertex     = 0,                     // Offset added when looking up vertices in the vertex buffer
+          .transformOffset = 0   // Offset added when looking up transformation matrices, if we used them
+      };
+      blas.asBuildOffsetInfo.push_back(offsetInfo);
+      blases.push_back(blas);
+    }
+    // Host builds read the same data from the scene's memory instead.
+    if(options.hostAccelBuilds || options.benchmarkHostBuild)
+    {
+      hostBlases = blases;
+      for(uint32_t blasIdx = 0; blasIdx < hostBlases.size(); blasIdx++)
+      {
+        const MeshSource&                                mesh      = meshSources[meshDedup.uniqueMeshes[blasIdx]];
+        VkAccelerationStructureGeometryTrianglesDataKHR& triangles = hostBlases[blasIdx].asGeometry[0].geometry.triangles;
+        triangles.vertexData = {.hostAddress = sceneData[mesh.vertexBuffer].data() + mesh.vertexOffset};
+        triangles.indexData  = {.hostAddress = sceneData[mesh.indexBuffer].data() + mesh.indexOffset};
+      }
+    }
+    // Create the BLAS
+    accelManager.init(context, context.m_physicalDevice, context.m_queueGCT, context.m_queueGCT.familyIndex, allocator);
+    {
+      // buildBlas() waits for the GPU, so this measures the whole build including compaction:
+      const auto blasStartTime = std::chrono::steady_clock::now();
+      const VkBuildAccelerationStructureFlagsKHR blasFlags = accelFlags->blasFlags;
+      // With --accel-cache, try to load the BLASes from the acceleration structure
+      // cache (see accelCache.h). Its key includes a hash of everything the builds read.
+      const std::string accelCachePath = getAccelCachePath(useGltf ? nvh::findFile(options.glbPath, searchPaths) : objPath);
+      AccelCacheKey     accelCacheKey{};
+      if(options.useAccelCache)
+      {
+        uint64_t geometryHash = 0;
+        for(std::span<const uint8_t> data : sceneData)
+        {
+          geometryHash = hashBytes(data, geometryHash);
+        }
+        for(const MeshSource& mesh : meshSources)
+        {
+          const std::array<uint64_t, 8> layout = {mesh.vertexBuffer, mesh.vertexOffset, mesh.vertexStride, mesh.vertexCount,
+                                                  mesh.indexBuffer,  mesh.indexOffset,  mesh.indexCount,   mesh.indexBits};
+          geometryHash = hashBytes(asBytes(std::span<const uint64_t>(layout)), geometryHash);
+        }
+        // Sharing BLASes changes which meshes get one:
+        geometryHash = hashBytes(asBytes(std::span<const uint32_t>(meshDedup.uniqueMeshes)), geometryHash);
+        accelCacheKey = makeAccelCacheKey(context.m_physicalDevice, blasFlags, geometryHash);
+      }
+      if(options.useAccelCache && readAccelCache(context, accelCachePath, accelCacheKey, blases, accelManager))
+      {
+        LOGI("Loaded %zu BLAS(es) from the acceleration structure cache %s in %.3f ms.\n", blases.size(),
+             accelCachePath.c_str(), millisecondsSince(blasStartTime));
+      }
+      else
+      {
+        if(options.hostAccelBuilds && !hostAccelCommands)
+        {
+          LOGW("This device doesn't support building acceleration structures on the host; building them on the GPU.\n");
+        }
+        if(options.hostAccelBuilds && hostAccelCommands)
+        {
+          accelManager.buildBlasOnHost(hostBlases, blasFlags, threadPool, threadPool.numThreads() + 1);
+        }
+        else
+        {
+          accelManager.buildBlas(blases, blasFlags, VkDeviceSize(options.blasBudgetMB) * 1024 * 1024);
+        }
+        LOGI("Built %zu BLAS(es) in %.3f ms (%s, on the %s).\n", blases.size(), millisecondsSince(blasStartTime),
+             useGltf ? "glTF" : (options.weldVertices ? "welded" : "not welded"),
+             (options.hostAccelBuilds && hostAccelCommands) ? "host" : "GPU");
+        logMeshDedupSavings(meshDedup, accelManager.blasStats(), accelManager.blasTotalMs());
+        if(options.useAccelCache && !writeAccelCache(accelCachePath, accelCacheKey, blases, accelManager))
+        {
+          LOGW("Could not write the acceleration structure cache %s; the next run will build BLASes again.\n",
+               accelCachePath.c_str());
+        }
+      }
+    }
+    if(options.quantizedShading)
+    {
+      // Shaders no longer read full-precision vertices, and BLASes don't need
+      // their build inputs anymore, so we can free buffers that only contain
+      // vertices. (glTF binary chunks usually contain indices as well.)
+      VkDeviceSize freedBytes = 0;
+      for(uint32_t bufferIdx = 0; bufferIdx < numFullPrecisionBuffers; bufferIdx++)
+      {
+        const auto usesBufferForShading = [&](const MeshSource& mesh) {
+          return mesh.indexBuffer == bufferIdx || mesh.remapBuffer == bufferIdx;
+        };
+        if(std::ranges::none_of(meshSources, usesBufferForShading))
+        {
+          freedBytes += sceneData[bufferIdx].size();
+          allocator.destroy(sceneBuffers[bufferIdx]);
+        }
+      }
+      LOGI("Freed %.3f MB of full-precision vertex data after building the BLASes.\n", toMB(freedBytes));
+    }
+  });
+
+  const TaskGraph::TaskId tlasStage = startup.add("tlas", {blasStage, shaderFilesStage}, [&]() {
+    // Create the geometry table: entry i tells the closest-hit shaders where to
+    // find the vertices and indices of BLAS i. Instances select their entry
+    // using their instanceCustomIndex, so shaders can look up any mesh without
+    // a descriptor per mesh.
+    {
+      std::vector<GeometryInfo> geometryInfos;
+      geometryInfos.reserve(numMeshes);
+      for(uint32_t meshIdx = 0; meshIdx < numMeshes; meshIdx++)
+      {
+        GeometryInfo info{.vertexAddress = vertexAddresses[meshIdx],
+                          .indexAddress  = indexAddresses[meshIdx],
+                          .indexBits     = meshSources[meshIdx].indexBits,
+                          .vertexStride  = meshSources[meshIdx].vertexStride};
+        if(meshSources[meshIdx].remapBuffer != k_noBuffer)
+        {
+          info.primitiveRemapAddress = sceneBufferAddresses[meshSources[meshIdx].remapBuffer] + meshSources[meshIdx].remapOffset;
+        }
+        if(options.quantizedShading)
+        {
+          const QuantizedMesh& quantized = shadingStream.meshes[meshIdx];
+          info.vertexAddress             = 0;  // Freed above
+          info.quantizedPositionAddress  = sceneBufferAddresses[numFullPrecisionBuffers] + quantized.positionsOffset;
+          info.quantizedNormalAddress    = sceneBufferAddresses[numFullPrecisionBuffers + 1] + quantized.normalsOffset;
+          std::copy_n(quantized.positionMin, 3, info.positionMin);
+          std::copy_n(quantized.positionScale, 3, info.positionScale);
+        }
+        geometryInfos.push_back(info);
+      }
+      const VkDeviceSize geometryTableSize = geometryInfos.size() * sizeof(GeometryInfo);
+      geometryTableBuffer = allocator.createBuffer(geometryTableSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+      stagingRing.upload(geometryTableBuffer.buffer, 0, geometryInfos.data(), geometryTableSize);
+      stagingRing.finish();
+      debugUtil.setObjectName(geometryTableBuffer.buffer, "geometryTableBuffer");
+    }
+
+    // Create the instances and build them into a TLAS.
+    const auto addInstance = [&](uint32_t meshIdx, const glm::mat4& transform, uint32_t sbtOffset) {
+      // Copies of a mesh use the BLAS of its first copy (see meshDedup.h),
+      // moved by the difference between their positions, if any.
+      const uint32_t             blasIdx   = meshDedup.blasOfMesh[meshIdx];
+      const std::array<float, 3> offset    = meshDedup.offsets[meshIdx];
+      glm::mat4                  placement = transform;
+      placement[3] = transform * glm::vec4(offset[0], offset[1], offset[2], 1.0f);
       VkAccelerationStructureInstanceKHR instance{};
-      instance.transform = nvvk::toTransformMatrixKHR(transform);
-      instance.instanceCustomIndex = 0;  // 24 bits accessible to ray shaders via rayQueryGetIntersectionInstanceCustomIndexEXT
+      instance.transform = nvvk::toTransformMatrixKHR(placement);
+      // 24 bits accessible to ray shaders via gl_InstanceCustomIndexEXT; we use it to index the geometry table.
+      // Shaders must read the mesh the BLAS was built from, so that hit positions match.
+      instance.instanceCustomIndex = meshDedup.uniqueMeshes[blasIdx];
       // The address of the BLAS in `blases` that this instance points to
-      instance.accelerationStructureReference = raytracingBuilder.getBlasDeviceAddress(0);
+      instance.accelerationStructureReference = accelManager.getBlasDeviceAddress(blasIdx);
       // An offset that will be added when looking up the instance's shader in the SBT.
-      instance.instanceShaderBindingTableRecordOffset = uniformIntDist(randomEngine);
+      instance.instanceShaderBindingTableRecordOffset = sbtOffset;
       instance.flags = VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR;  // How to trace this instance
       instance.mask  = 0xFF;
       instances.push_back(instance);
+      instanceBlases.push_back(blasIdx);
+    };
+    // With --gpu-instances, the GPU writes the instances of scenes that only
+    // place an instance grid (see instanceGenerator.h).
+    const bool generateGrid = options.gpuInstances && sceneDescription.instances.empty() && (sceneDescription.instanceGrid || !useGltf);
+    if(options.gpuInstances && !sceneDescription.instances.empty())
+    {
+      LOGW("--gpu-instances only applies to scenes whose instances all come from an instance grid; making them on the CPU.\n");
     }
-  }
-  raytracingBuilder.buildTlas(instances, VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR);
-
-  // Here's the list of bindings for the descriptor set layout, from raytrace.comp.glsl:
-  // 0 - a storage image (the image `image`)
-  // 1 - an acceleration structure (the TLAS)
-  // 2 - a storage buffer (the vertex buffer)
-  // 3 - a storage buffer (the index buffer)
-  nvvk::DescriptorSetContainer descriptorSetContainer(context);
-  descriptorSetContainer.addBinding(BINDING_IMAGEDATA, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_RAYGEN_BIT_KHR);
-  descriptorSetContainer.addBinding(BINDING_TLAS, VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR, 1, VK_SHADER_STAGE_RAYGEN_BIT_KHR);
-  descriptorSetContainer.addBinding(BINDING_VERTICES, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR);
-  descriptorSetContainer.addBinding(BINDING_INDICES, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR);
-  // Create a layout from the list of bindings
-  descriptorSetContainer.initLayout();
-  // Create a descriptor pool from the list of bindings with space for 1 set, and allocate that set
-  descriptorSetContainer.initPool(1);
-  // Create a push constant range describing the amount of data for the push constants.
-  static_assert(sizeof(PushConstants) % 4 == 0, "Push constant size must be a multiple of 4 per the Vulkan spec!");
-  VkPushConstantRange pushConstantRange{.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR,  //
-                                        .offset     = 0,                               //
-                                        .size       = sizeof(PushConstants)};
-  // Create a pipeline layout from the descriptor set layout and push constant range:
-  descriptorSetContainer.initPipeLayout(1,                    // Number of push constant ranges
-                                        &pushConstantRange);  // Pointer to push constant ranges
-
-  // Write values into the descriptor set.
-  std::array<VkWriteDescriptorSet, 4> writeDescriptorSets;
-  // Color image
-  VkDescriptorImageInfo descriptorImageInfo{.imageView   = imageView,  // How the image should be accessed
-                                            .imageLayout = VK_IMAGE_LAYOUT_GENERAL};  // The image's layout
-  writeDescriptorSets[0] = descriptorSetContainer.makeWrite(0 /*set index*/, BINDING_IMAGEDATA /*binding*/, &descriptorImageInfo);
-  // Top-level acceleration structure (TLAS)
-  VkAccelerationStructureKHR tlasCopy = raytracingBuilder.getAccelerationStructure();  // So that we can take its address
-  VkWriteDescriptorSetAccelerationStructureKHR descriptorAS{.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET_ACCELERATION_STRUCTURE_KHR,
-                                                            .accelerationStructureCount = 1,
-                                                            .pAccelerationStructures    = &tlasCopy};
-  writeDescriptorSets[1] = descriptorSetContainer.makeWrite(0, BINDING_TLAS, &descriptorAS);
-  // Vertex buffer
-  VkDescriptorBufferInfo vertexDescriptorBufferInfo{.buffer = vertexBuffer.buffer, .range = VK_WHOLE_SIZE};
-  writeDescriptorSets[2] = descriptorSetContainer.makeWrite(0, BINDING_VERTICES, &vertexDescriptorBufferInfo);
-  // Index buffer
-  VkDescriptorBufferInfo indexDescriptorBufferInfo{.buffer = indexBuffer.buffer, .range = VK_WHOLE_SIZE};
-  writeDescriptorSets[3] = descriptorSetContainer.makeWrite(0, BINDING_INDICES, &indexDescriptorBufferInfo);
-  vkUpdateDescriptorSets(context,                                            // The context
-                         static_cast<uint32_t>(writeDescriptorSets.size()),  // Number of VkWriteDescriptorSet objects
-                         writeDescriptorSets.data(),                         // Pointer to VkWriteDescriptorSet objects
-                         0, nullptr);  // An array of VkCopyDescriptorSet objects (unused)
-
-  // Shader loading and pipeline creation
-  const size_t                                      NUM_C_HIT_SHADERS = 9;
-  std::array<VkShaderModule, 2 + NUM_C_HIT_SHADERS> modules;
-  modules[0] = nvvk::createShaderModule(context, nvh::loadFile("shaders/raytrace.rgen.glsl.spv", true, searchPaths));
-  debugUtil.setObjectName(modules[0], "Ray generation module (raytrace.rgen.glsl.spv)");
-  modules[1] = nvvk::createShaderModule(context, nvh::loadFile("shaders/raytrace.rmiss.glsl.spv", true, searchPaths));
-  debugUtil.setObjectName(modules[1], "Miss module (raytrace.rmiss.glsl.spv)");
-  for(int closestHitShaderIdx = 0; closestHitShaderIdx < NUM_C_HIT_SHADERS; closestHitShaderIdx++)
-  {
-    const int         moduleIdx = 2 + closestHitShaderIdx;
-    const std::string filename  = "shaders/material" + std::to_string(closestHitShaderIdx) + ".rchit.glsl.spv";
-    modules[moduleIdx]          = nvvk::createShaderModule(context, nvh::loadFile(filename, true, searchPaths));
+    // If the GPU generates the instance grid's instances below, only place the others here.
+    PlaceSceneInstances(sceneDescription, useGltf ? &gltfScene : nullptr, numMeshes, !generateGrid, addInstance);
+    if(options.gpuInstances || options.benchmarkInstanceGen)
+    {
+      instanceGenerator.init(context, context.m_physicalDevice, instanceGenCode);
+    }
+    if(generateGrid)
+    {
+      // The generator reads which BLAS to place for each mesh from a table,
+      // and each cell places all meshes, like SceneInstance::mesh == k_sceneDefault.
+      std::vector<GeneratedMesh> generatedMeshes;
+      generatedMeshes.reserve(numMeshes);
+      for(uint32_t meshIdx = 0; meshIdx < numMeshes; meshIdx++)
+      {
+        const uint32_t blasIdx = meshDedup.blasOfMesh[meshIdx];
+        GeneratedMesh  mesh{.blasAddress = accelManager.getBlasDeviceAddress(blasIdx), .customIndex = meshDedup.uniqueMeshes[blasIdx]};
+        std::copy_n(meshDedup.offsets[meshIdx].begin(), 3, mesh.offset);
+        generatedMeshes.push_back(mesh);
+      }
+      const VkDeviceSize meshTableSize = generatedMeshes.size() * sizeof(GeneratedMesh);
+      generatedMeshBuffer              = allocator.createBuffer(meshTableSize, VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT
+                                                                                   | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                                                                                   | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+      stagingRing.upload(generatedMeshBuffer.buffer, 0, generatedMeshes.data(), meshTableSize);
+      stagingRing.finish();
+      debugUtil.setObjectName(generatedMeshBuffer.buffer, "generatedMeshBuffer");
 
-    const std::string debugName = "Material " + std::to_string(closestHitShaderIdx) + " shader module";
-    debugUtil.setObjectName(modules[moduleIdx], debugName);
-  }
+      InstanceGenParams params{};
+      describeInstanceGrid(sceneDescription.instanceGrid.value_or(SceneInstanceGrid{}), params);
+      params.meshTableAddress = getBufferDeviceAddress(context, generatedMeshBuffer.buffer);
+      params.numMeshes        = numMeshes;
 
-  // Create the shader binding table and ray tracing pipeline.
-  // We'll create the ray tracing pipeline by specifying the shaders + layout,
-  // and then get the handles of the shaders for the shader binding table from
-  // the pipeline.
-  VkPipeline   rtPipeline;
-  nvvk::Buffer rtSBTBuffer;  // The buffer for the Shader Binding Table
-  {
-    // First, we create objects that point to each of our shaders.
-    // These are called "shader stages" in this context.
-    // These are shader module + entry point + stage combinations, because each
-    // shader module can contain multiple entry points (e.g. main1, main2...)
-    std::array<VkPipelineShaderStageCreateInfo, 2 + NUM_C_HIT_SHADERS> stages;  // Pointers to shaders
-
-    // Stage 0 will be the raygen shader.
-    stages[0] = {.sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-                 .stage  = VK_SHADER_STAGE_RAYGEN_BIT_KHR,  // Kind of shader
-                 .module = modules[0],                      // Contains the shader
-                 .pName  = "main"};                          // Name of the entry point
-    // Stage 1 will be the miss shader.
-    stages[1]        = stages[0];
-    stages[1].stage  = VK_SHADER_STAGE_MISS_BIT_KHR;  // Kind of shader
-    stages[1].module = modules[1];                    // Contains the shader
-    // Stages 2 through the end will be closest-hit shaders.
+      // Shrink grids that a TLAS can't hold, instead of writing past the instance buffer.
+      const uint64_t gridInstances = countGeneratedInstances(params);
+      if(clampGeneratedInstances(params, instanceGenerator.maxInstances()))
+      {
+        LOGW("The instance grid has %llu instances, but TLASes on this device can have at most %llu; using a %ux%ux%u grid.\n",
+             static_cast<unsigned long long>(gridInstances), static_cast<unsigned long long>(instanceGenerator.maxInstances()),
+             params.gridSize[0], params.gridSize[1], params.gridSize[2]);
+      }
+      // maxInstances() fits in 32 bits, so this doesn't truncate.
+      const uint64_t numInstances = countGeneratedInstances(params);
+      accelManager.buildTlasOnDevice(static_cast<uint32_t>(numInstances), accelFlags->tlasFlags,
+                                     [&](VkCommandBuffer cmdBuffer, VkDeviceAddress instanceAddress) {
+                                       params.instanceAddress = instanceAddress;
+                                       instanceGenerator.cmdGenerate(cmdBuffer, params);
+                                     });
+      LOGI("Generated %llu instances on the GPU and built the TLAS over them in %.3f ms.\n",
+           static_cast<unsigned long long>(numInstances), accelManager.tlasBuildMs());
+    }
+    else
+    {
+      accelManager.buildTlas(instances, accelFlags->tlasFlags);
+    }
+    accelManager.logReport();
+  });
+
+  // Create the pipeline layout and compile the ray tracing pipeline. This only
+  // needs the device and the SPIR-V, so it overlaps with the upload and
+  // acceleration structure builds.
+  const TaskGraph::TaskId pipelineStage = startup.add("pipeline", {deviceStage, shaderFilesStage}, [&]() {
+    // Here's the list of bindings for the descriptor set layout, from raytrace.comp.glsl:
+    // 0 - a storage image (the image `image`)
+    // 1 - an acceleration structure (the TLAS)
+    // 2 - a storage buffer (the geometry table)
+    descriptorSetContainer.init(context);
+    descriptorSetContainer.addBinding(BINDING_IMAGEDATA, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_RAYGEN_BIT_KHR);
+    descriptorSetContainer.addBinding(BINDING_TLAS, VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR, 1, VK_SHADER_STAGE_RAYGEN_BIT_KHR);
+    descriptorSetContainer.addBinding(BINDING_GEOMETRIES, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR);
+    // Create a layout from the list of bindings
+    descriptorSetContainer.initLayout();
+    // Create a descriptor pool from the list of bindings with space for 1 set, and allocate that set
+    descriptorSetContainer.initPool(1);
+    // Create a push constant range describing the amount of data for the push constants.
+    static_assert(sizeof(PushConstants) % 4 == 0, "Push constant size must be a multiple of 4 per the Vulkan spec!");
+    VkPushConstantRange pushConstantRange{.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR,  //
+                                          .offset     = 0,                               //
+                                          .size       = sizeof(PushConstants)};
+    // Create a pipeline layout from the descriptor set layout and push constant range:
+    descriptorSetContainer.initPipeLayout(1,                    // Number of push constant ranges
+                                          &pushConstantRange);  // Pointer to push constant ranges
+
+    // Shader module and pipeline creation
+    modules[0] = nvvk::createShaderModule(context, shaderCode[0]);
+    debugUtil.setObjectName(modules[0], "Ray generation module (raytrace.rgen.glsl.spv)");
+    modules[1] = nvvk::createShaderModule(context, shaderCode[1]);
+    debugUtil.setObjectName(modules[1], "Miss module (raytrace.rmiss.glsl.spv)");
     for(int closestHitShaderIdx = 0; closestHitShaderIdx < NUM_C_HIT_SHADERS; closestHitShaderIdx++)
     {
-      const int moduleIdx      = 2 + closestHitShaderIdx;
-      stages[moduleIdx]        = stages[0];
-      stages[moduleIdx].stage  = VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR;
-      stages[moduleIdx].module = modules[moduleIdx];
-    }
-
-    // Then we make groups point to the shader stages. Each group can point to
-    // 1-3 shader stages depending on the type, by specifying the index in the
-    // stages array. These groups of handles then become the most important
-    // part of the entries in the shader binding table.
-    // Stores the indices of stages in each group:
-    std::array<VkRayTracingShaderGroupCreateInfoKHR, 2 + NUM_C_HIT_SHADERS> groups;
-
-    // The vkCmdTraceRays call will eventually refer to ray gen, miss, hit, and
-    // callable shader binding tables and ranges.
-    // A VK_RAY_TRACING_SHADER_GROUP_TYPE_GENERAL_KHR group type is for a group
-    // of one shader (a ray gen shader in a ray gen SBT region, a miss shader in
-    // a miss SBT region, and so on.)
-    // A VK_RAY_TRACING_SHADER_GROUP_TYPE_TRIANGLES_HIT_GROUP_KHR group type
-    // is for an instance containing triangles. It can point to closest hit and
-    // any hit shaders.
-    // A VK_RAY_TRACING_SHADER_GROUP_TYPE_PROCEDURAL_HIT_GROUP_KHR group type
-    // is for a procedural instance, and can point to an intersection, any hit,
-    // and closest hit shader.
-
-    // We lay out our shader binding table like this:
-    // RAY GEN REGION
-    // Group 0 - points to Stage 0
-    groups[0] = {.sType              = VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR,
-                 .type               = VK_RAY_TRACING_SHADER_GROUP_TYPE_GENERAL_KHR,
-                 .generalShader      = 0,                      // Index of ray gen, miss, or callable in `stages`
-                 .closestHitShader   = VK_SHADER_UNUSED_KHR,   // No closest hit shader
-                 .anyHitShader       = VK_SHADER_UNUSED_KHR,   // No any-hit shader
-                 .intersectionShader = VK_SHADER_UNUSED_KHR};  // No intersection shader
-    // MISS SHADER REGION
-    // Group 1 - points to Stage 1
-    groups[1] = {.sType              = VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR,
-                 .type               = VK_RAY_TRACING_SHADER_GROUP_TYPE_GENERAL_KHR,
-                 .generalShader      = 1,                      // Index of ray gen, miss, or callable in `stages`
-                 .closestHitShader   = VK_SHADER_UNUSED_KHR,   // No closest hit shader
-                 .anyHitShader       = VK_SHADER_UNUSED_KHR,   // No any-hit shader
-                 .intersectionShader = VK_SHADER_UNUSED_KHR};  // No intersection shader
-    // CLOSEST-HIT REGION
-    // Group N - uses Stage N as its closest-hit shader
-    for(uint32_t closestHitShaderIdx = 0; closestHitShaderIdx < NUM_C_HIT_SHADERS; closestHitShaderIdx++)
-    {
-      const uint32_t moduleIdx = 2 + closestHitShaderIdx;
-      groups[moduleIdx]        = {.sType              = VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR,
-                                  .type               = VK_RAY_TRACING_SHADER_GROUP_TYPE_TRIANGLES_HIT_GROUP_KHR,
-                                  .generalShader      = VK_SHADER_UNUSED_KHR,   // No ray gen, miss, or callable shader
-                                  .closestHitShader   = moduleIdx,              // Index of closest-hit in `stages`
-                                  .anyHitShader       = VK_SHADER_UNUSED_KHR,   // No any-hit shader
-                                  .intersectionShader = VK_SHADER_UNUSED_KHR};  // No intersection shader
-    }
-
-    // Now, describe the ray tracing pipeline, ike creating a compute pipeline:
-    VkRayTracingPipelineCreateInfoKHR pipelineCreateInfo =  //
-        {.sType                        = VK_STRUCTURE_TYPE_RAY_TRACING_PIPELINE_CREATE_INFO_KHR,
-         .flags                        = 0,  // No flags to set
-         .stageCount                   = static_cast<uint32_t>(stages.size()),
-         .pStages                      = stages.data(),
-         .groupCount                   = static_cast<uint32_t>(groups.size()),
-         .pGroups                      = groups.data(),
-         .maxPipelineRayRecursionDepth = 1,  // Depth of call tree
-         .layout                       = descriptorSetContainer.getPipeLayout()};
-    NVVK_CHECK(vkCreateRayTracingPipelinesKHR(context,                 // Device
-                                              VK_NULL_HANDLE,          // Deferred operation or VK_NULL_HANDLE
-                                              VK_NULL_HANDLE,          // Pipeline cache or VK_NULL_HANDLE
-                                              1, &pipelineCreateInfo,  // Array of create infos
-                                              nullptr,                 // Allocator
-                                              &rtPipeline));
-    debugUtil.setObjectName(rtPipeline, "rtPipeline");
+      const int moduleIdx = 2 + closestHitShaderIdx;
+      modules[moduleIdx]  = nvvk::createShaderModule(context, shaderCode[moduleIdx]);
+
+      const std::string debugName = "Material " + std::to_string(closestHitShaderIdx) + " shader module";
+      debugUtil.setObjectName(modules[moduleIdx], debugName);
+    }
+
+    // Create the ray tracing pipeline.
+    // We'll create the ray tracing pipeline by specifying the shaders + layout,
+    // and then get the handles of the shaders for the shader binding table from
+    // the pipeline once it's ready.
+    {
+      // First, we create objects that point to each of our shaders.
+      // These are called "shader stages" in this context.
+      // These are shader module + entry point + stage combinations, because each
+      // shader module can contain multiple entry points (e.g. main1, main2...)
+      std::array<VkPipelineShaderStageCreateInfo, 2 + NUM_C_HIT_SHADERS> stages;  // Pointers to shaders
+
+      // Stage 0 will be the raygen shader.
+      stages[0] = {.sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+                   .stage  = VK_SHADER_STAGE_RAYGEN_BIT_KHR,  // Kind of shader
+                   .module = modules[0],                      // Contains the shader
+                   .pName  = "main"};                          // Name of the entry point
+      // Stage 1 will be the miss shader.
+      stages[1]        = stages[0];
+      stages[1].stage  = VK_SHADER_STAGE_MISS_BIT_KHR;  // Kind of shader
+      stages[1].module = modules[1];                    // Contains the shader
+      // Stages 2 through the end will be closest-hit shaders.
+      for(int closestHitShaderIdx = 0; closestHitShaderIdx < NUM_C_HIT_SHADERS; closestHitShaderIdx++)
+      {
+        const int moduleIdx      = 2 + closestHitShaderIdx;
+        stages[moduleIdx]        = stages[0];
+        stages[moduleIdx].stage  = VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR;
+        stages[moduleIdx].module = modules[moduleIdx];
+      }
+
+      // Then we make groups point to the shader stages. Each group can point to
+      // 1-3 shader stages depending on the type, by specifying the index in the
+      // stages array. These groups of handles then become the most important
+      // part of the entries in the shader binding table.
+      // Stores the indices of stages in each group:
+      std::array<VkRayTracingShaderGroupCreateInfoKHR, 2 + NUM_C_HIT_SHADERS> groups;
+
+      // The vkCmdTraceRays call will eventually refer to ray gen, miss, hit, and
+      // callable shader binding tables and ranges.
+      // A VK_RAY_TRACING_SHADER_GROUP_TYPE_GENERAL_KHR group type is for a group
+      // of one shader (a ray gen shader in a ray gen SBT region, a miss shader in
+      // a miss SBT region, and so on.)
+      // A VK_RAY_TRACING_SHADER_GROUP_TYPE_TRIANGLES_HIT_GROUP_KHR group type
+      // is for an instance containing triangles. It can point to closest hit and
+      // any hit shaders.
+      // A VK_RAY_TRACING_SHADER_GROUP_TYPE_PROCEDURAL_HIT_GROUP_KHR group type
+      // is for a procedural instance, and can point to an intersection, any hit,
+      // and closest hit shader.
+
+      // We lay out our shader binding table like this:
+      // RAY GEN REGION
+      // Group 0 - points to Stage 0
+      groups[0] = {.sType              = VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR,
+                   .type               = VK_RAY_TRACING_SHADER_GROUP_TYPE_GENERAL_KHR,
+                   .generalShader      = 0,                      // Index of ray gen, miss, or callable in `stages`
+                   .closestHitShader   = VK_SHADER_UNUSED_KHR,   // No closest hit shader
+                   .anyHitShader       = VK_SHADER_UNUSED_KHR,   // No any-hit shader
+                   .intersectionShader = VK_SHADER_UNUSED_KHR};  // No intersection shader
+      // MISS SHADER REGION
+      // Group 1 - points to Stage 1
+      groups[1] = {.sType              = VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR,
+                   .type               = VK_RAY_TRACING_SHADER_GROUP_TYPE_GENERAL_KHR,
+                   .generalShader      = 1,                      // Index of ray gen, miss, or callable in `stages`
+                   .closestHitShader   = VK_SHADER_UNUSED_KHR,   // No closest hit shader
+                   .anyHitShader       = VK_SHADER_UNUSED_KHR,   // No any-hit shader
+                   .intersectionShader = VK_SHADER_UNUSED_KHR};  // No intersection shader
+      // CLOSEST-HIT REGION
+      // Group N - uses Stage N as its closest-hit shader
+      for(uint32_t closestHitShaderIdx = 0; closestHitShaderIdx < NUM_C_HIT_SHADERS; closestHitShaderIdx++)
+      {
+        const uint32_t moduleIdx = 2 + closestHitShaderIdx;
+        groups[moduleIdx]        = {.sType              = VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR,
+                                    .type               = VK_RAY_TRACING_SHADER_GROUP_TYPE_TRIANGLES_HIT_GROUP_KHR,
+                                    .generalShader      = VK_SHADER_UNUSED_KHR,   // No ray gen, miss, or callable shader
+                                    .closestHitShader   = moduleIdx,              // Index of closest-hit in `stages`
+                                    .anyHitShader       = VK_SHADER_UNUSED_KHR,   // No any-hit shader
+                                    .intersectionShader = VK_SHADER_UNUSED_KHR};  // No intersection shader
+      }
+
+      // Now, describe the ray tracing pipeline, ike creating a compute pipeline:
+      VkRayTracingPipelineCreateInfoKHR pipelineCreateInfo =  //
+          {.sType                        = VK_STRUCTURE_TYPE_RAY_TRACING_PIPELINE_CREATE_INFO_KHR,
+           .flags                        = 0,  // No flags to set
+           .stageCount                   = static_cast<uint32_t>(stages.size()),
+           .pStages                      = stages.data(),
+           .groupCount                   = static_cast<uint32_t>(groups.size()),
+           .pGroups                      = groups.data(),
+           .maxPipelineRayRecursionDepth = 1,  // Depth of call tree
+           .layout                       = descriptorSetContainer.getPipeLayout()};
+      NVVK_CHECK(vkCreateRayTracingPipelinesKHR(context,                 // Device
+                                                VK_NULL_HANDLE,          // Deferred operation or VK_NULL_HANDLE
+                                                VK_NULL_HANDLE,          // Pipeline cache or VK_NULL_HANDLE
+                                                1, &pipelineCreateInfo,  // Array of create infos
+                                                nullptr,                 // Allocator
+                                                &rtPipeline));
+      debugUtil.setObjectName(rtPipeline, "rtPipeline");
+    }
+  });
+
+  // Write the descriptor set and the shader binding table, once both the TLAS
+  // and the pipeline exist.
+  startup.add("bind", {tlasStage, pipelineStage}, [&]() {
+    // Write values into the descriptor set.
+    std::array<VkWriteDescriptorSet, 3> writeDescriptorSets;
+    // Color image
+    VkDescriptorImageInfo descriptorImageInfo{.imageView   = imageView,  // How the image should be accessed
+                                              .imageLayout = VK_IMAGE_LAYOUT_GENERAL};  // The image's layout
+    writeDescriptorSets[0] = descriptorSetContainer.makeWrite(0 /*set index*/, BINDING_IMAGEDATA /*binding*/, &descriptorImageInfo);
+    // Top-level acceleration structure (TLAS)
+    VkAccelerationStructureKHR tlasCopy = accelManager.getTlas();  // So that we can take its address
+    VkWriteDescriptorSetAccelerationStructureKHR descriptorAS{.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET_ACCELERATION_STRUCTURE_KHR,
+                                                              .accelerationStructureCount = 1,
+                                                              .pAccelerationStructures    = &tlasCopy};
+    writeDescriptorSets[1] = descriptorSetContainer.makeWrite(0, BINDING_TLAS, &descriptorAS);
+    // Geometry table
+    VkDescriptorBufferInfo geometryTableDescriptorBufferInfo{.buffer = geometryTableBuffer.buffer, .range = VK_WHOLE_SIZE};
+    writeDescriptorSets[2] = descriptorSetContainer.makeWrite(0, BINDING_GEOMETRIES, &geometryTableDescriptorBufferInfo);
+    vkUpdateDescriptorSets(context,                                            // The context
+                           static_cast<uint32_t>(writeDescriptorSets.size()),  // Number of VkWriteDescriptorSet objects
+                           writeDescriptorSets.data(),                         // Pointer to VkWriteDescriptorSet objects
+                           0, nullptr);  // An array of VkCopyDescriptorSet objects (unused)
 
     // Now create and write the shader binding table, by getting the shader
     // group handles from the ray tracing pipeline and writing them into a
-    // Vulkan buffer object.
+    // Vulkan buffer object. Each module has its own group.
+    const size_t numGroups = modules.size();
 
     // Get the shader group handles:
-    std::vector<uint8_t> cpuShaderHandleStorage(sbtHeaderSize * groups.size());
+    std::vector<uint8_t> cpuShaderHandleStorage(sbtHeaderSize * numGroups);
     NVVK_CHECK(vkGetRayTracingShaderGroupHandlesKHR(context,                               // Device
                                                     rtPipeline,                            // Pipeline
                                                     0,                                     // First group
-                                                    static_cast<uint32_t>(groups.size()),  // Number of groups
+                                                    static_cast<uint32_t>(numGroups),  // Number of groups
                                                     cpuShaderHandleStorage.size(),         // Size of buffer
                                                     cpuShaderHandleStorage.data()));       // Data buffer
     // Allocate the shader binding table. We get its device address, and
     // use it as a shader binding table. As before, we set its memory property
     // flags so that it can be read and written from the CPU.
-    const uint32_t sbtSize = static_cast<uint32_t>(sbtStride * groups.size());
+    const uint32_t sbtSize = static_cast<uint32_t>(sbtStride * numGroups);
     rtSBTBuffer            = allocator.createBuffer(
         sbtSize, VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_SHADER_BINDING_TABLE_BIT_KHR,
         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
     debugUtil.setObjectName(rtSBTBuffer.buffer, "rtSBTBuffer");
     // Copy the shader group handles to the SBT:
     uint8_t* mappedSBT = reinterpret_cast<uint8_t*>(allocator.map(rtSBTBuffer));
-    for(size_t groupIndex = 0; groupIndex < groups.size(); groupIndex++)
+    for(size_t groupIndex = 0; groupIndex < numGroups; groupIndex++)
     {
       memcpy(&mappedSBT[groupIndex * sbtStride], &cpuShaderHandleStorage[groupIndex * sbtHeaderSize], sbtHeaderSize);
     }
     allocator.unmap(rtSBTBuffer);
     // Clean up:
     allocator.finalizeAndReleaseStaging();
+  });
+
+  startup.run(threadPool);
+  startup.logTimings("Startup");
+  // Benchmarks that need a device run after startup; the sample then renders as usual.
+  if(options.benchmarkBlasBudgetMeshes > 0)
+  {
+    runBlasBudgetBenchmark(context, context.m_physicalDevice, context.m_queueGCT, context.m_queueGCT.familyIndex, allocator,
+                           options.benchmarkBlasBudgetMeshes);
+  }
+  if(options.benchmarkTlasUpdate)
+  {
+    runTlasUpdateBenchmark(context, context.m_physicalDevice, context.m_queueGCT, context.m_queueGCT.familyIndex, allocator,
+                           accelManager.getBlasDeviceAddress(0),
+                           GetMeshBounds(GetMeshView(meshSources[meshDedup.uniqueMeshes[0]], sceneData)));
+  }
+  if(options.benchmarkDeform)
+  {
+    if(useGltf)
+    {
+      LOGW("--bench-deform only supports OBJ scenes; skipping it.\n");
+    }
+    else
+    {
+      runDeformBenchmark(context, context.m_physicalDevice, context.m_queueGCT, context.m_queueGCT.familyIndex, allocator,
+                         sceneGeometry, options.blasRebuildInterval);
+    }
+  }
+  if(options.benchmarkHostBuild)
+  {
+    if(!hostAccelCommands)
+    {
+      LOGW("--bench-host-build needs the accelerationStructureHostCommands feature, which this device lacks; skipping it.\n");
+    }
+    else if(options.quantizedShading)
+    {
+      LOGW("--bench-host-build can't be combined with --quantized-shading, which frees the vertices GPU builds read; skipping it.\n");
+    }
+    else
+    {
+      runHostBuildBenchmark(context, context.m_physicalDevice, context.m_queueGCT, context.m_queueGCT.familyIndex, allocator,
+                            blases, hostBlases, threadPool);
+    }
+  }
+  if(options.benchmarkInstanceGen)
+  {
+    runInstanceGenBenchmark(context, context.m_physicalDevice, context.m_queueGCT, context.m_queueGCT.familyIndex, allocator,
+                            instanceGenerator, accelManager.getBlasDeviceAddress(0));
+  }
+  if(options.benchmarkCpuBvh)
+  {
+    // The CPU builds its BVH over the same meshes and instances as the GPU's
+    // acceleration structures, so compare with the GPU's builds first.
+    if(accelManager.blasFromCache())
+    {
+      LOGI("GPU acceleration structures with --accel-flags %s: BLASes came from the cache, so there is no BLAS build time "
+           "to compare with (run without --accel-cache); the TLAS took %.3f ms.\n",
+           accelFlags->name, accelManager.tlasBuildMs());
+    }
+    else
+    {
+      LOGI("GPU acceleration structures with --accel-flags %s: BLASes took %.3f ms, and the TLAS %.3f ms.\n",
+           accelFlags->name, accelManager.blasTotalMs(), accelManager.tlasBuildMs());
+    }
+    std::vector<CpuMesh> cpuMeshes;
+    for(const MeshSource& mesh : meshSources)
+    {
+      const uint32_t* sourcePrimitives = nullptr;
+      if(mesh.remapBuffer != k_noBuffer)
+      {
+        sourcePrimitives = reinterpret_cast<const uint32_t*>(sceneData[mesh.remapBuffer].data() + mesh.remapOffset);
+      }
+      cpuMeshes.push_back({.triangles = GetMeshView(mesh, sceneData), .sourcePrimitives = sourcePrimitives});
+    }
+    std::vector<CpuInstance> cpuInstances;
+    PlaceSceneInstances(sceneDescription, useGltf ? &gltfScene : nullptr, numMeshes, true,
+                        [&](uint32_t meshIdx, const glm::mat4& transform, uint32_t material) {
+                          cpuInstances.push_back({.transform = transform, .mesh = meshIdx, .material = material});
+                        });
+    PushConstants benchmarkCamera{};
+    setCameraPushConstants(sceneDescription, benchmarkCamera);
+    runCpuBvhBenchmark(cpuMeshes, cpuInstances, benchmarkCamera, render_width, render_height, threadPool);
   }
 
   // vkCmdTraceRaysKHR uses VkStridedDeviceAddressregionKHR objects to say
@@ -524,7 +1246,7 @@ int main(int argc, const char** argv)
   // draw call, but let's create them up front since they're the same
   // every time here:
   VkStridedDeviceAddressRegionKHR sbtRayGenRegion, sbtMissRegion, sbtHitRegion, sbtCallableRegion;
-  const VkDeviceAddress           sbtStartAddress = GetBufferDeviceAddress(context, rtSBTBuffer.buffer);
+  const VkDeviceAddress           sbtStartAddress = getBufferDeviceAddress(context, rtSBTBuffer.buffer);
   {
     // The ray generation shader region:
     sbtRayGenRegion.deviceAddress = sbtStartAddress;  // Starts here
@@ -543,12 +1265,10 @@ int main(int argc, const char** argv)
     sbtCallableRegion.size = 0;                // Is empty
   }
 
-  const uint32_t NUM_SAMPLE_BATCHES = 32;
-  for(uint32_t sampleBatch = 0; sampleBatch < NUM_SAMPLE_BATCHES; sampleBatch++)
-  {
-    // Create and start recording a command buffer
-    VkCommandBuffer cmdBuffer = AllocateAndBeginOneTimeCommandBuffer(context, cmdPool);
-
+  const uint32_t NUM_SAMPLE_BATCHES = sceneDescription.render.sampleBatches;
+  setCameraPushConstants(sceneDescription, pushConstants);
+  // Records the commands that trace sample batch `sampleBatch`.
+  const auto recordTraceRays = [&](VkCommandBuffer cmdBuffer, uint32_t sampleBatch) {
     // Bind the ray tracing pipeline:
     vkCmdBindPipeline(cmdBuffer, VK_PIPELINE_BIND_POINT_RAY_TRACING_KHR, rtPipeline);
     // Bind the descriptor set
@@ -574,6 +1294,61 @@ int main(int argc, const char** argv)
                       render_width,        // Width of dispatch
                       render_height,       // Height of dispatch
                       1);                  // Depth of dispatch
+  };
+
+  if(options.tuneAccelFlagsSpp > 0)
+  {
+    if(options.quantizedShading)
+    {
+      LOGW("--tune-accel-flags can't be combined with --quantized-shading, which frees the vertices BLAS builds read; skipping it.\n");
+    }
+    else if(instances.empty())
+    {
+      LOGW("--tune-accel-flags needs the instances on the CPU, so it can't be combined with --gpu-instances; skipping it.\n");
+    }
+    else
+    {
+      // Points the descriptor set's TLAS binding at `tlas`.
+      const auto bindTlas = [&](VkAccelerationStructureKHR tlas) {
+        VkWriteDescriptorSetAccelerationStructureKHR descriptorAS{.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET_ACCELERATION_STRUCTURE_KHR,
+                                                                  .accelerationStructureCount = 1,
+                                                                  .pAccelerationStructures    = &tlas};
+        const VkWriteDescriptorSet writeDescriptorSet = descriptorSetContainer.makeWrite(0, BINDING_TLAS, &descriptorAS);
+        vkUpdateDescriptorSets(context, 1, &writeDescriptorSet, 0, nullptr);
+      };
+      // Traces all sample batches of the image with `tlas`, like the render loop below.
+      const auto traceWithTlas = [&](VkAccelerationStructureKHR tlas) {
+        bindTlas(tlas);
+        const auto traceStartTime = std::chrono::steady_clock::now();
+        for(uint32_t sampleBatch = 0; sampleBatch < NUM_SAMPLE_BATCHES; sampleBatch++)
+        {
+          VkCommandBuffer cmdBuffer = AllocateAndBeginOneTimeCommandBuffer(context, cmdPool);
+          recordTraceRays(cmdBuffer, sampleBatch);
+          EndSubmitWaitAndFreeCommandBuffer(context, context.m_queueGCT, cmdPool, cmdBuffer);
+        }
+        return millisecondsSince(traceStartTime);
+      };
+      AccelManager   tunedAccelManager;
+      const uint32_t presetIdx =
+          tuneAccelFlags(context, context.m_physicalDevice, context.m_queueGCT, context.m_queueGCT.familyIndex, allocator, blases,
+                         instances, instanceBlases, traceWithTlas, NUM_SAMPLE_BATCHES * pushConstants.samplesPerBatch,
+                         options.tuneAccelFlagsSpp, tunedAccelManager);
+      // Render with the recommended acceleration structures. Moving them
+      // into accelManager frees the ones it built at startup.
+      accelManager = std::move(tunedAccelManager);
+      accelFlags   = &accelFlagPresets()[presetIdx];
+      bindTlas(accelManager.getTlas());
+      LOGI("Rendering with --accel-flags %s.\n", accelFlags->name);
+    }
+  }
+
+  // Each batch waits for the GPU to finish, so this measures how long tracing and shading take:
+  const auto renderStartTime = std::chrono::steady_clock::now();
+  for(uint32_t sampleBatch = 0; sampleBatch < NUM_SAMPLE_BATCHES; sampleBatch++)
+  {
+    // Create and start recording a command buffer
+    VkCommandBuffer cmdBuffer = AllocateAndBeginOneTimeCommandBuffer(context, cmdPool);
+    recordTraceRays(cmdBuffer, sampleBatch);
 
     // On the last sample batch:
     if(sampleBatch == NUM_SAMPLE_BATCHES - 1)
@@ -637,10 +1412,18 @@ int main(int argc, const char** argv)
 
     nvprintf("Rendered sample batch index %d.\n", sampleBatch);
   }
+  {
+    const double renderMs = millisecondsSince(renderStartTime);
+    const double numPaths = double(render_width) * double(render_height) * pushConstants.samplesPerBatch * NUM_SAMPLE_BATCHES;
+    LOGI("Rendered %u sample batches in %.3f ms (%.2f million paths/s, %s shading, %s triangle order, split budget %u%%, "
+         "%s accel flags).\n",
+         NUM_SAMPLE_BATCHES, renderMs, numPaths / (renderMs * 1000.0), options.quantizedShading ? "quantized" : "full-precision",
+         useGltf ? "glTF" : (options.reorderTriangles ? "Morton" : "original"), options.splitBudgetPercent, accelFlags->name);
+  }
 
   // Get the image data back from the GPU
   void* data = allocator.map(imageLinear);
-  stbi_write_hdr("out.hdr", render_width, render_height, 4, reinterpret_cast<float*>(data));
+  stbi_write_hdr(sceneDescription.render.outputPath.c_str(), render_width, render_height, 4, reinterpret_cast<float*>(data));
   allocator.unmap(imageLinear);
 
   allocator.destroy(rtSBTBuffer);
@@ -650,9 +1433,15 @@ int main(int argc, const char** argv)
     vkDestroyShaderModule(context, shaderModule, nullptr);
   }
   descriptorSetContainer.deinit();
-  raytracingBuilder.destroy();
-  allocator.destroy(vertexBuffer);
-  allocator.destroy(indexBuffer);
+  accelManager.deinit();
+  instanceGenerator.deinit();
+  allocator.destroy(generatedMeshBuffer);
+  stagingRing.deinit();
+  allocator.destroy(geometryTableBuffer);
+  for(nvvk::Buffer& buffer : sceneBuffers)
+  {
+    allocator.destroy(buffer);
+  }
   vkDestroyCommandPool(context, cmdPool, nullptr);
   allocator.destroy(imageLinear);
   vkDestroyImageView(context, imageView, nullptr);
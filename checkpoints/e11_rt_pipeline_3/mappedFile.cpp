@@ -0,0 +1,121 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+#include "mappedFile.h"
+
+#include <utility>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+{
+  *this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+  if(this != &other)
+  {
+    close();
+#ifdef _WIN32
+    m_fileHandle    = std::exchange(other.m_fileHandle, nullptr);
+    m_mappingHandle = std::exchange(other.m_mappingHandle, nullptr);
+#else
+    m_fd = std::exchange(other.m_fd, -1);
+#endif
+    m_data = std::exchange(other.m_data, nullptr);
+    m_size = std::exchange(other.m_size, 0);
+  }
+  return *this;
+}
+
+bool MappedFile::open(const std::string& path)
+{
+  close();
+#ifdef _WIN32
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if(file == INVALID_HANDLE_VALUE)
+  {
+    return false;
+  }
+  LARGE_INTEGER fileSize{};
+  if(!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+  {
+    CloseHandle(file);
+    return false;
+  }
+  HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if(mapping == nullptr)
+  {
+    CloseHandle(file);
+    return false;
+  }
+  const void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if(view == nullptr)
+  {
+    CloseHandle(mapping);
+    CloseHandle(file);
+    return false;
+  }
+  m_fileHandle    = file;
+  m_mappingHandle = mapping;
+  m_data          = static_cast<const uint8_t*>(view);
+  m_size          = static_cast<size_t>(fileSize.QuadPart);
+#else
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if(fd < 0)
+  {
+    return false;
+  }
+  struct stat fileStat{};
+  if(fstat(fd, &fileStat) != 0 || fileStat.st_size == 0)
+  {
+    ::close(fd);
+    return false;
+  }
+  void* view = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+  if(view == MAP_FAILED)
+  {
+    ::close(fd);
+    return false;
+  }
+  m_fd   = fd;
+  m_data = static_cast<const uint8_t*>(view);
+  m_size = static_cast<size_t>(fileStat.st_size);
+#endif
+  return true;
+}
+
+void MappedFile::close()
+{
+  if(m_data == nullptr)
+  {
+    return;
+  }
+#ifdef _WIN32
+  UnmapViewOfFile(m_data);
+  CloseHandle(m_mappingHandle);
+  CloseHandle(m_fileHandle);
+  m_mappingHandle = nullptr;
+  m_fileHandle    = nullptr;
+#else
+  munmap(const_cast<uint8_t*>(m_data), m_size);
+  ::close(m_fd);
+  m_fd = -1;
+#endif
+  m_data = nullptr;
+  m_size = 0;
+}
@@ -0,0 +1,45 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+// A read-only memory mapping of a whole file. The operating system pages the
+// file in on demand, so reading from a mapping avoids copying the file into
+// intermediate std::vector objects before uploading it to the GPU.
+#ifndef VK_MINI_PATH_TRACER_MAPPED_FILE_H
+#define VK_MINI_PATH_TRACER_MAPPED_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+class MappedFile
+{
+public:
+  MappedFile() = default;
+  ~MappedFile() { close(); }
+
+  MappedFile(const MappedFile&)            = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  MappedFile(MappedFile&& other) noexcept;
+  MappedFile& operator=(MappedFile&& other) noexcept;
+
+  // Maps the file at `path`. Returns false (and leaves the object closed) if
+  // the file could not be opened or is empty.
+  bool open(const std::string& path);
+  void close();
+
+  bool           isOpen() const { return m_data != nullptr; }
+  const uint8_t* data() const { return m_data; }
+  size_t         size() const { return m_size; }
+
+private:
+#ifdef _WIN32
+  void* m_fileHandle    = nullptr;  // HANDLE
+  void* m_mappingHandle = nullptr;  // HANDLE
+#else
+  int m_fd = -1;
+#endif
+  const uint8_t* m_data = nullptr;
+  size_t         m_size = 0;
+};
+
+#endif  // #ifndef VK_MINI_PATH_TRACER_MAPPED_FILE_H
@@ -0,0 +1,23 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+// Small helpers for logging how long work took and how much memory it uses.
+#ifndef VK_MINI_PATH_TRACER_MEASUREMENT_H
+#define VK_MINI_PATH_TRACER_MEASUREMENT_H
+
+#include <chrono>
+#include <cstdint>
+
+// Returns the time since `start`, in milliseconds.
+inline double millisecondsSince(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Converts a size in bytes to megabytes (2^20 bytes).
+inline double toMB(uint64_t bytes)
+{
+  return static_cast<double>(bytes) / (1024.0 * 1024.0);
+}
+
+#endif  // #ifndef VK_MINI_PATH_TRACER_MEASUREMENT_H
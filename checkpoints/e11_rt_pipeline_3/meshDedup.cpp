@@ -0,0 +1,206 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+#include "meshDedup.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <unordered_map>
+
+#include <nvh/nvprint.hpp>
+
+#include "accelCache.h"  // For hashBytes()
+#include "measurement.h"
+
+namespace {
+
+// With normalized translations, positions match to within this fraction of
+// their mesh's bounding box size.
+const float k_relativeTolerance = 1.0f / 65536.0f;
+
+// What the hash and comparison of one mesh need.
+struct MeshKey
+{
+  uint64_t hash;
+  float    boundsMin[3];
+  float    cellSize;  // Quantization step for normalized positions
+};
+
+MeshKey makeMeshKey(const MeshView& mesh, bool normalizeTranslation)
+{
+  MeshKey key{.boundsMin = {0.0f, 0.0f, 0.0f}, .cellSize = 1.0f};
+  if(normalizeTranslation && mesh.vertexCount > 0)
+  {
+    float boundsMax[3];
+    mesh.readPosition(0, key.boundsMin);
+    mesh.readPosition(0, boundsMax);
+    for(uint32_t vertex = 1; vertex < mesh.vertexCount; vertex++)
+    {
+      float position[3];
+      mesh.readPosition(vertex, position);
+      for(int c = 0; c < 3; c++)
+      {
+        key.boundsMin[c] = std::min(key.boundsMin[c], position[c]);
+        boundsMax[c]     = std::max(boundsMax[c], position[c]);
+      }
+    }
+    const float extent = std::max({boundsMax[0] - key.boundsMin[0], boundsMax[1] - key.boundsMin[1], boundsMax[2] - key.boundsMin[2]});
+    key.cellSize       = (extent > 0.0f) ? extent * k_relativeTolerance : 1.0f;
+  }
+
+  // Gather everything that must match into words, then hash them at once.
+  std::vector<uint32_t> words;
+  words.reserve(2 + mesh.indexCount + 3 * static_cast<size_t>(mesh.vertexCount));
+  words.push_back(mesh.vertexCount);
+  words.push_back(mesh.indexCount);
+  for(uint32_t corner = 0; corner < mesh.indexCount; corner++)
+  {
+    words.push_back(mesh.index(corner));
+  }
+  for(uint32_t vertex = 0; vertex < mesh.vertexCount; vertex++)
+  {
+    float position[3];
+    mesh.readPosition(vertex, position);
+    for(int c = 0; c < 3; c++)
+    {
+      uint32_t word;
+      if(normalizeTranslation)
+      {
+        // Values near a cell boundary can round differently in two copies;
+        // then they just aren't found, which is safe.
+        word = static_cast<uint32_t>(static_cast<int32_t>(std::round((position[c] - key.boundsMin[c]) / key.cellSize)));
+      }
+      else
+      {
+        memcpy(&word, &position[c], sizeof(word));
+      }
+      words.push_back(word);
+    }
+  }
+  key.hash = hashBytes({reinterpret_cast<const uint8_t*>(words.data()), words.size() * sizeof(uint32_t)});
+  return key;
+}
+
+// Compares two meshes in full, to rule out hash collisions.
+bool meshesMatch(const MeshView& a, const MeshKey& keyA, const MeshView& b, const MeshKey& keyB, bool normalizeTranslation)
+{
+  if(a.vertexCount != b.vertexCount || a.indexCount != b.indexCount)
+  {
+    return false;
+  }
+  for(uint32_t corner = 0; corner < a.indexCount; corner++)
+  {
+    if(a.index(corner) != b.index(corner))
+    {
+      return false;
+    }
+  }
+  const float tolerance = std::max(keyA.cellSize, keyB.cellSize);
+  for(uint32_t vertex = 0; vertex < a.vertexCount; vertex++)
+  {
+    float positionA[3], positionB[3];
+    a.readPosition(vertex, positionA);
+    b.readPosition(vertex, positionB);
+    for(int c = 0; c < 3; c++)
+    {
+      if(normalizeTranslation ? std::abs((positionA[c] - keyA.boundsMin[c]) - (positionB[c] - keyB.boundsMin[c])) > tolerance :
+                                memcmp(&positionA[c], &positionB[c], sizeof(float)) != 0)
+      {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+MeshDedup makeUniqueMeshes(uint32_t numMeshes)
+{
+  MeshDedup dedup;
+  dedup.uniqueMeshes.resize(numMeshes);
+  std::iota(dedup.uniqueMeshes.begin(), dedup.uniqueMeshes.end(), 0);
+  dedup.blasOfMesh = dedup.uniqueMeshes;
+  dedup.offsets.assign(numMeshes, {0.0f, 0.0f, 0.0f});
+  return dedup;
+}
+
+MeshDedup findDuplicateMeshes(std::span<const MeshView> meshes, bool normalizeTranslation, ThreadPool& pool)
+{
+  const auto           startTime = std::chrono::steady_clock::now();
+  const uint32_t       numMeshes = static_cast<uint32_t>(meshes.size());
+  std::vector<MeshKey> keys(numMeshes);
+  pool.parallelFor(numMeshes, [&](size_t meshIdx) { keys[meshIdx] = makeMeshKey(meshes[meshIdx], normalizeTranslation); });
+
+  // Go through the meshes in order, so that each BLAS is built from the first
+  // copy of its mesh. Equal hashes can still be different meshes, so each
+  // hash leads to all BLASes with that hash.
+  MeshDedup dedup;
+  dedup.blasOfMesh.resize(numMeshes);
+  dedup.offsets.assign(numMeshes, {0.0f, 0.0f, 0.0f});
+  std::unordered_map<uint64_t, std::vector<uint32_t>> blasesByHash;
+  uint64_t                                            duplicateTriangles = 0;
+  for(uint32_t meshIdx = 0; meshIdx < numMeshes; meshIdx++)
+  {
+    std::vector<uint32_t>& candidates = blasesByHash[keys[meshIdx].hash];
+    const auto             isCopyOf   = [&](uint32_t blasIdx) {
+      const uint32_t original = dedup.uniqueMeshes[blasIdx];
+      return meshesMatch(meshes[original], keys[original], meshes[meshIdx], keys[meshIdx], normalizeTranslation);
+    };
+    const auto match = std::find_if(candidates.begin(), candidates.end(), isCopyOf);
+    if(match != candidates.end())
+    {
+      const uint32_t original   = dedup.uniqueMeshes[*match];
+      dedup.blasOfMesh[meshIdx] = *match;
+      if(normalizeTranslation)
+      {
+        for(int c = 0; c < 3; c++)
+        {
+          dedup.offsets[meshIdx][c] = keys[meshIdx].boundsMin[c] - keys[original].boundsMin[c];
+        }
+      }
+      duplicateTriangles += meshes[meshIdx].indexCount / 3;
+    }
+    else
+    {
+      dedup.blasOfMesh[meshIdx] = static_cast<uint32_t>(dedup.uniqueMeshes.size());
+      candidates.push_back(dedup.blasOfMesh[meshIdx]);
+      dedup.uniqueMeshes.push_back(meshIdx);
+    }
+  }
+
+  const double elapsedMs = millisecondsSince(startTime);
+  LOGI("Mesh deduplication%s: %u meshes, %zu unique; %u duplicate(s) with %llu triangles share BLASes (%.3f ms).\n",
+       normalizeTranslation ? " (normalizing translations)" : "", numMeshes, dedup.uniqueMeshes.size(),
+       dedup.numDuplicates(), static_cast<unsigned long long>(duplicateTriangles), elapsedMs);
+  return dedup;
+}
+
+void logMeshDedupSavings(const MeshDedup& dedup, std::span<const AccelManager::AccelStats> blasStats, double blasBuildMs)
+{
+  if(dedup.numDuplicates() == 0)
+  {
+    return;
+  }
+  // Each duplicate would have needed a BLAS as large as the one it shares.
+  uint64_t savedBytes = 0, savedTriangles = 0, builtTriangles = 0;
+  for(uint32_t meshIdx = 0; meshIdx < dedup.blasOfMesh.size(); meshIdx++)
+  {
+    const uint32_t                  blasIdx = dedup.blasOfMesh[meshIdx];
+    const AccelManager::AccelStats& stats   = blasStats[blasIdx];
+    if(dedup.uniqueMeshes[blasIdx] != meshIdx)
+    {
+      savedBytes += stats.finalSize;
+      savedTriangles += stats.primitiveCount;
+    }
+  }
+  for(const AccelManager::AccelStats& stats : blasStats)
+  {
+    builtTriangles += stats.primitiveCount;
+  }
+  const double savedMs = (builtTriangles > 0) ? blasBuildMs * static_cast<double>(savedTriangles) / static_cast<double>(builtTriangles) : 0.0;
+  LOGI("Sharing BLASes between %u duplicate mesh(es) saved %.3f MB of BLASes and about %.3f ms of BLAS builds (%llu triangles).\n",
+       dedup.numDuplicates(), toMB(savedBytes), savedMs, static_cast<unsigned long long>(savedTriangles));
+}
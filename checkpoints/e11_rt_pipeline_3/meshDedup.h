@@ -0,0 +1,50 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+// Finds meshes with the same triangles, so that they can share one BLAS.
+// Scenes exported from DCC tools often contain the same mesh many times as
+// separate shapes; each copy would otherwise get a BLAS of its own. Instead,
+// every copy becomes another TLAS instance of the first one's BLAS.
+//
+// Each mesh is hashed over its indices and vertex positions, then meshes with
+// equal hashes are compared in full. Exporters often bake each copy's
+// placement into its vertices; with `normalizeTranslation`, meshes also match
+// if they only differ by a translation, which the copy's instances then
+// apply. Positions are then compared relative to each mesh's bounding box
+// minimum, to within 1/65536 of the box's size (like shadingStream.h), so
+// the shared BLAS can be off from a copy by that much.
+#ifndef VK_MINI_PATH_TRACER_MESH_DEDUP_H
+#define VK_MINI_PATH_TRACER_MESH_DEDUP_H
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "accelManager.h"
+#include "meshView.h"
+#include "threadPool.h"
+
+struct MeshDedup
+{
+  std::vector<uint32_t> uniqueMeshes;  // The meshes that get a BLAS; BLAS i is built from mesh uniqueMeshes[i]
+  std::vector<uint32_t> blasOfMesh;    // For each mesh, the index of the BLAS it uses
+  // For each mesh, what to add to the positions of its BLAS's mesh to get its
+  // own; zero unless translations were normalized.
+  std::vector<std::array<float, 3>> offsets;
+
+  uint32_t numDuplicates() const { return static_cast<uint32_t>(blasOfMesh.size() - uniqueMeshes.size()); }
+};
+
+// Returns a MeshDedup in which each of `numMeshes` meshes has its own BLAS.
+MeshDedup makeUniqueMeshes(uint32_t numMeshes);
+
+// Finds which of `meshes` are copies of earlier ones, and logs how many.
+MeshDedup findDuplicateMeshes(std::span<const MeshView> meshes, bool normalizeTranslation, ThreadPool& pool);
+
+// Logs how much BLAS memory and build time sharing BLASes saved, given the
+// statistics of the BLASes built for `dedup.uniqueMeshes`, and how long they
+// took to build. The build time saved is estimated from the triangle counts.
+void logMeshDedupSavings(const MeshDedup& dedup, std::span<const AccelManager::AccelStats> blasStats, double blasBuildMs);
+
+#endif  // #ifndef VK_MINI_PATH_TRACER_MESH_DEDUP_H
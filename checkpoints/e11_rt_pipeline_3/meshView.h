@@ -0,0 +1,48 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+// A view of the triangles of one mesh in host memory, wherever they were
+// loaded: from an OBJ file or its cache (see sceneGeometry.h), or from a
+// binary glTF file (see gltfLoader.h). The CPU-side passes over the scene's
+// meshes read vertices and indices through it, since meshes differ in their
+// vertex strides and index sizes.
+#ifndef VK_MINI_PATH_TRACER_MESH_VIEW_H
+#define VK_MINI_PATH_TRACER_MESH_VIEW_H
+
+#include <cstdint>
+#include <cstring>
+
+struct MeshView
+{
+  const uint8_t* positions;       // First vertex; 3 floats each
+  uint32_t       positionStride;  // Bytes between vertices
+  uint32_t       vertexCount;
+  const uint8_t* indices;     // First index; 16-bit indices are little-endian
+  uint32_t       indexBits;   // 16 or 32
+  uint32_t       indexCount;  // 3 per triangle
+
+  uint32_t numTriangles() const { return indexCount / 3; }
+
+  // Returns the vertex index at `corner`, which is 3 * triangle + 0, 1 or 2.
+  uint32_t index(uint32_t corner) const
+  {
+    if(indexBits == 16)
+    {
+      uint16_t value;
+      memcpy(&value, indices + 2 * static_cast<size_t>(corner), sizeof(value));
+      return value;
+    }
+    uint32_t value;
+    memcpy(&value, indices + 4 * static_cast<size_t>(corner), sizeof(value));
+    return value;
+  }
+
+  // Copies the position of vertex `vertex` into `position`. Vertices may not
+  // be aligned to 4 bytes in glTF files, so this doesn't return a reference.
+  void readPosition(uint32_t vertex, float position[3]) const
+  {
+    memcpy(position, positions + static_cast<size_t>(vertex) * positionStride, 3 * sizeof(float));
+  }
+};
+
+#endif  // #ifndef VK_MINI_PATH_TRACER_MESH_VIEW_H
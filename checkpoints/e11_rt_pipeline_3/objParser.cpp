@@ -0,0 +1,682 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+#include "objParser.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <map>
+
+#include <nvh/nvprint.hpp>
+#include <tiny_obj_loader.h>
+
+#include "mappedFile.h"
+#include "measurement.h"
+
+namespace {
+
+// Chunks are at least this large, so that small files don't pay for threading.
+const size_t k_minChunkBytes = 1 << 20;
+
+inline bool isSpace(char c)
+{
+  return c == ' ' || c == '\t';
+}
+
+inline bool isDigit(char c)
+{
+  return c >= '0' && c <= '9';
+}
+
+// Returns a pointer to the first character in [s, end) that is one of `chars`,
+// or `end`. Like strcspn, but for strings that aren't null-terminated.
+inline const char* findAny(const char* s, const char* end, const char* chars)
+{
+  while(s < end && strchr(chars, *s) == nullptr)
+  {
+    s++;
+  }
+  return s;
+}
+
+inline const char* skipSpaces(const char* s, const char* end)
+{
+  while(s < end && isSpace(*s))
+  {
+    s++;
+  }
+  return s;
+}
+
+// A port of tinyobj's tryParseDouble. Its results aren't always correctly
+// rounded, so we use the same algorithm instead of std::from_chars in order
+// to get bit-identical vertex positions.
+bool tryParseDouble(const char* s, const char* s_end, double* result)
+{
+  if(s >= s_end)
+  {
+    return false;
+  }
+
+  double      mantissa             = 0.0;
+  int         exponent             = 0;
+  char        sign                 = '+';
+  char        exp_sign             = '+';
+  const char* curr                 = s;
+  int         read                 = 0;
+  bool        end_not_reached      = false;
+  bool        leading_decimal_dots = false;
+
+  // Find out what sign we've got.
+  if(*curr == '+' || *curr == '-')
+  {
+    sign = *curr;
+    curr++;
+    if((curr != s_end) && (*curr == '.'))
+    {
+      leading_decimal_dots = true;
+    }
+  }
+  else if(isDigit(*curr))
+  {
+  }
+  else if(*curr == '.')
+  {
+    leading_decimal_dots = true;
+  }
+  else
+  {
+    return false;
+  }
+
+  // Read the integer part.
+  end_not_reached = (curr != s_end);
+  if(!leading_decimal_dots)
+  {
+    while(end_not_reached && isDigit(*curr))
+    {
+      mantissa *= 10;
+      mantissa += static_cast<int>(*curr - 0x30);
+      curr++;
+      read++;
+      end_not_reached = (curr != s_end);
+    }
+    if(read == 0)
+    {
+      return false;
+    }
+  }
+
+  if(end_not_reached)
+  {
+    // Read the decimal part.
+    bool readExponent = false;
+    if(*curr == '.')
+    {
+      curr++;
+      read            = 1;
+      end_not_reached = (curr != s_end);
+      while(end_not_reached && isDigit(*curr))
+      {
+        static const double pow_lut[] = {1.0, 0.1, 0.01, 0.001, 0.0001, 0.00001, 0.000001, 0.0000001};
+        const int           lut_entries = sizeof pow_lut / sizeof pow_lut[0];
+        mantissa += static_cast<int>(*curr - 0x30) * (read < lut_entries ? pow_lut[read] : std::pow(10.0, -read));
+        read++;
+        curr++;
+        end_not_reached = (curr != s_end);
+      }
+      readExponent = end_not_reached;
+    }
+    else if(*curr == 'e' || *curr == 'E')
+    {
+      readExponent = true;
+    }
+
+    // Read the exponent part.
+    if(readExponent && (*curr == 'e' || *curr == 'E'))
+    {
+      curr++;
+      end_not_reached = (curr != s_end);
+      if(end_not_reached && (*curr == '+' || *curr == '-'))
+      {
+        exp_sign = *curr;
+        curr++;
+      }
+      else if(end_not_reached && isDigit(*curr))
+      {
+      }
+      else
+      {
+        return false;  // Empty E is not allowed.
+      }
+
+      read            = 0;
+      end_not_reached = (curr != s_end);
+      while(end_not_reached && isDigit(*curr))
+      {
+        if(exponent > (2147483647 / 10))
+        {
+          return false;  // Integer overflow
+        }
+        exponent *= 10;
+        exponent += static_cast<int>(*curr - 0x30);
+        curr++;
+        read++;
+        end_not_reached = (curr != s_end);
+      }
+      exponent *= (exp_sign == '+' ? 1 : -1);
+      if(read == 0)
+      {
+        return false;
+      }
+    }
+  }
+
+  *result = (sign == '+' ? 1 : -1) * (exponent ? std::ldexp(mantissa * std::pow(5.0, exponent), exponent) : mantissa);
+  return true;
+}
+
+// Parses one number of a `v` record, like tinyobj's parseReal.
+float parseReal(const char*& token, const char* lineEnd)
+{
+  token              = skipSpaces(token, lineEnd);
+  const char* numEnd = findAny(token, lineEnd, " \t\r");
+  double      val    = 0.0;
+  tryParseDouble(token, numEnd, &val);
+  token = numEnd;
+  return static_cast<float>(val);
+}
+
+// Parses an integer like atoi. Returns false if it doesn't fit in 32 bits.
+bool parseInt(const char*& token, const char* lineEnd, int64_t& value)
+{
+  token         = skipSpaces(token, lineEnd);
+  bool negative = false;
+  if(token < lineEnd && (*token == '+' || *token == '-'))
+  {
+    negative = (*token == '-');
+    token++;
+  }
+  value = 0;
+  while(token < lineEnd && isDigit(*token))
+  {
+    value = value * 10 + (*token - '0');
+    if(value > std::numeric_limits<int32_t>::max())
+    {
+      return false;
+    }
+    token++;
+  }
+  if(negative)
+  {
+    value = -value;
+  }
+  return true;
+}
+
+// Something that changes state while parsing; these are rare, so we record
+// them per chunk and replay them in file order when merging.
+struct ObjEvent
+{
+  enum Type
+  {
+    eNewShape,  // `o` or `g`
+    eUseMtl,    // `usemtl name`
+    eMtlLib,    // `mtllib file...`
+  };
+  Type        type;
+  uint64_t    triangleIndex;  // Chunk-local number of triangles before this record
+  std::string name;
+};
+
+// The parsed contents of a line-aligned chunk of the file.
+struct ObjChunk
+{
+  const char* begin = nullptr;
+  const char* end   = nullptr;
+
+  std::vector<float>    positions;
+  std::vector<uint32_t> corners;    // Vertex indices of face corners
+  std::vector<uint8_t>  faceSizes;  // 3 or 4 corners per face
+  // Indices in `corners` that were relative (negative) in the file. These hold
+  // (vertices defined so far in this chunk + relative index), and need the
+  // number of vertices in earlier chunks added to them.
+  std::vector<size_t>   relativeCorners;
+  std::vector<ObjEvent> events;
+  uint64_t              numTriangles = 0;
+  // The smallest value of (vertices defined so far in this chunk - absolute
+  // index) over all corners; used to detect references to later vertices.
+  int64_t minSlack = std::numeric_limits<int64_t>::max();
+  // True if the chunk contains records that only tinyobj handles.
+  bool unsupported = false;
+
+  // Set while merging:
+  uint64_t vertexBase      = 0;
+  uint64_t triangleBase    = 0;
+  int32_t  materialAtStart = -1;
+};
+
+// Parses a face corner like tinyobj's parseTriple, keeping only the vertex
+// index. Texture coordinate and normal indices must be positive, since
+// checking relative ones would require their counts as well.
+bool parseCorner(const char*& token, const char* lineEnd, ObjChunk& chunk)
+{
+  int64_t index = 0;
+  if(!parseInt(token, lineEnd, index) || index == 0)
+  {
+    return false;  // tinyobj rejects index 0
+  }
+  const int64_t localCount = static_cast<int64_t>(chunk.positions.size() / 3);
+  if(index > 0)
+  {
+    chunk.corners.push_back(static_cast<uint32_t>(index - 1));
+    chunk.minSlack = std::min(chunk.minSlack, localCount - (index - 1));
+  }
+  else
+  {
+    chunk.relativeCorners.push_back(chunk.corners.size());
+    chunk.corners.push_back(static_cast<uint32_t>(static_cast<int32_t>(localCount + index)));
+  }
+  token = findAny(token, lineEnd, "/ \t\r");
+
+  // Up to two more indices separated by slashes; `i//k` skips the middle one.
+  for(int slash = 0; slash < 2 && token < lineEnd && *token == '/'; slash++)
+  {
+    token++;
+    if(slash == 0 && token < lineEnd && *token == '/')
+    {
+      token++;
+      slash++;
+    }
+    int64_t otherIndex = 0;
+    if(!parseInt(token, lineEnd, otherIndex) || otherIndex <= 0)
+    {
+      return false;
+    }
+    token = findAny(token, lineEnd, "/ \t\r");
+  }
+  return true;
+}
+
+void parseLine(const char* token, const char* lineEnd, ObjChunk& chunk)
+{
+  token = skipSpaces(token, lineEnd);
+  if(token == lineEnd || *token == '#')
+  {
+    return;
+  }
+  const size_t length     = lineEnd - token;
+  const auto   startsWith = [&](const char* keyword, size_t keywordLength) {
+    return length > keywordLength && strncmp(token, keyword, keywordLength) == 0 && isSpace(token[keywordLength]);
+  };
+
+  if(startsWith("v", 1))
+  {
+    token += 2;
+    for(int axis = 0; axis < 3; axis++)
+    {
+      chunk.positions.push_back(parseReal(token, lineEnd));
+    }
+  }
+  else if(startsWith("f", 1))
+  {
+    const size_t firstCorner = chunk.corners.size();
+    token                    = skipSpaces(token + 2, lineEnd);
+    while(token < lineEnd && *token != '\r')
+    {
+      if(!parseCorner(token, lineEnd, chunk))
+      {
+        chunk.unsupported = true;
+        return;
+      }
+      while(token < lineEnd && (isSpace(*token) || *token == '\r'))
+      {
+        token++;
+      }
+    }
+    const size_t numCorners = chunk.corners.size() - firstCorner;
+    if(numCorners != 3 && numCorners != 4)
+    {
+      chunk.unsupported = true;  // tinyobj triangulates larger polygons by ear clipping
+      return;
+    }
+    chunk.faceSizes.push_back(static_cast<uint8_t>(numCorners));
+    chunk.numTriangles += numCorners - 2;
+  }
+  else if(startsWith("o", 1) || startsWith("g", 1))
+  {
+    chunk.events.push_back({ObjEvent::eNewShape, chunk.numTriangles, {}});
+  }
+  else if(startsWith("usemtl", 6))
+  {
+    const char* nameBegin = skipSpaces(token + 7, lineEnd);
+    const char* nameEnd   = findAny(nameBegin, lineEnd, " \t\r");
+    chunk.events.push_back({ObjEvent::eUseMtl, chunk.numTriangles, std::string(nameBegin, nameEnd)});
+  }
+  else if(startsWith("mtllib", 6))
+  {
+    chunk.events.push_back({ObjEvent::eMtlLib, chunk.numTriangles, std::string(token + 7, lineEnd)});
+  }
+  else if(startsWith("l", 1) || startsWith("p", 1))
+  {
+    chunk.unsupported = true;  // Lines and points change how tinyobj creates shapes
+  }
+  // Everything else (normals, texture coordinates, smoothing groups...) isn't used.
+}
+
+void parseChunk(ObjChunk& chunk)
+{
+  const char* lineBegin = chunk.begin;
+  while(lineBegin < chunk.end && !chunk.unsupported)
+  {
+    // Lines end in \n, \r\n, or \r, like in tinyobj's safeGetline.
+    const char* lineEnd = findAny(lineBegin, chunk.end, "\r\n");
+    parseLine(lineBegin, lineEnd, chunk);
+    lineBegin = lineEnd;
+    if(lineBegin < chunk.end && *lineBegin == '\r')
+    {
+      lineBegin++;
+    }
+    if(lineBegin < chunk.end && *lineBegin == '\n')
+    {
+      lineBegin++;
+    }
+  }
+}
+
+// Returns the names of the materials in an MTL file in the order tinyobj
+// numbers them, or false if the file can't be opened.
+bool readMaterialNames(const std::string& mtlPath, std::vector<std::string>& names)
+{
+  std::ifstream file(mtlPath);
+  if(!file)
+  {
+    return false;
+  }
+  // tinyobj only adds a material when the next one starts if it has a name,
+  // but always adds the last one.
+  bool        hasMaterial = false;
+  std::string currentName;
+  std::string line;
+  while(std::getline(file, line))
+  {
+    if(!line.empty() && line.back() == '\r')
+    {
+      line.pop_back();
+    }
+    const size_t start = line.find_first_not_of(" \t");
+    if(start != std::string::npos && line.compare(start, 6, "newmtl") == 0 && line.size() > start + 6
+       && isSpace(line[start + 6]))
+    {
+      if(!currentName.empty())
+      {
+        names.push_back(currentName);
+      }
+      currentName = line.substr(start + 7);
+      hasMaterial = true;
+    }
+  }
+  if(hasMaterial || !currentName.empty())
+  {
+    names.push_back(currentName);
+  }
+  return true;
+}
+
+}  // namespace
+
+bool parseObjParallel(const std::string& objPath, ThreadPool& pool, SceneGeometry& geometry)
+{
+  MappedFile file;
+  if(!file.open(objPath))
+  {
+    LOGE("Could not open %s.\n", objPath.c_str());
+    return false;
+  }
+  const char* fileBegin = reinterpret_cast<const char*>(file.data());
+  const char* fileEnd   = fileBegin + file.size();
+
+  // Split the file into about 4 chunks per thread, moving each split point
+  // forward to the start of the next line.
+  const size_t numParticipants = pool.numThreads() + 1;
+  const size_t chunkBytes      = std::max(k_minChunkBytes, file.size() / (4 * numParticipants) + 1);
+  std::vector<ObjChunk> chunks;
+  for(const char* chunkBegin = fileBegin; chunkBegin < fileEnd;)
+  {
+    const char* chunkEnd = chunkBegin + std::min(chunkBytes, static_cast<size_t>(fileEnd - chunkBegin));
+    chunkEnd             = findAny(chunkEnd, fileEnd, "\r\n");
+    chunkEnd             = std::min(chunkEnd + 1, fileEnd);
+    ObjChunk& chunk      = chunks.emplace_back();
+    chunk.begin          = chunkBegin;
+    chunk.end            = chunkEnd;
+    chunkBegin           = chunkEnd;
+  }
+
+  pool.parallelFor(chunks.size(), [&chunks](size_t chunkIdx) { parseChunk(chunks[chunkIdx]); });
+
+  // Prefix sums give each chunk's first vertex and first triangle in the output.
+  uint64_t numVertices = 0, numTriangles = 0;
+  bool     supported   = true;
+  for(ObjChunk& chunk : chunks)
+  {
+    supported          = supported && !chunk.unsupported;
+    chunk.vertexBase   = numVertices;
+    chunk.triangleBase = numTriangles;
+    numVertices += chunk.positions.size() / 3;
+    numTriangles += chunk.numTriangles;
+    // Faces must only reference vertices that were defined before them:
+    supported = supported && (chunk.minSlack > -static_cast<int64_t>(chunk.vertexBase));
+    for(size_t cornerIdx : chunk.relativeCorners)
+    {
+      supported = supported && (static_cast<int64_t>(chunk.vertexBase) + static_cast<int32_t>(chunk.corners[cornerIdx]) >= 0);
+    }
+  }
+  if(!supported || numVertices > std::numeric_limits<uint32_t>::max()
+     || 3 * numTriangles > std::numeric_limits<uint32_t>::max())
+  {
+    LOGI("%s uses OBJ features the parallel parser doesn't handle; using tinyobjloader.\n", objPath.c_str());
+    return loadObjGeometry(objPath, geometry);
+  }
+
+  // Replay the state-changing records in file order. This gives us the
+  // material each chunk starts with, and the triangle indices where shapes start.
+  const std::string             mtlBaseDir = objPath.substr(0, objPath.find_last_of("/\\") + 1);
+  std::map<std::string, int32_t> materialMap;
+  int32_t                       numMaterials = 0;
+  int32_t                       material     = -1;
+  std::vector<uint64_t>         shapeStarts  = {0};
+  for(ObjChunk& chunk : chunks)
+  {
+    chunk.materialAtStart = material;
+    for(const ObjEvent& event : chunk.events)
+    {
+      const uint64_t triangleIndex = chunk.triangleBase + event.triangleIndex;
+      if(event.type == ObjEvent::eNewShape)
+      {
+        shapeStarts.push_back(triangleIndex);
+      }
+      else if(event.type == ObjEvent::eUseMtl)
+      {
+        const auto it = materialMap.find(event.name);
+        material      = (it == materialMap.end()) ? -1 : it->second;
+      }
+      else if(event.type == ObjEvent::eMtlLib)
+      {
+        // Load the first file in the list that exists:
+        size_t start = 0;
+        while(start < event.name.size())
+        {
+          size_t nameEnd = event.name.find(' ', start);
+          nameEnd        = (nameEnd == std::string::npos) ? event.name.size() : nameEnd;
+          std::vector<std::string> names;
+          if(nameEnd > start && readMaterialNames(mtlBaseDir + event.name.substr(start, nameEnd - start), names))
+          {
+            for(const std::string& name : names)
+            {
+              materialMap.insert({name, numMaterials++});  // The first material with a name wins
+            }
+            break;
+          }
+          start = nameEnd + 1;
+        }
+      }
+    }
+  }
+  shapeStarts.push_back(numTriangles);
+
+  // Write out the vertices, triangles, and material IDs of each chunk in parallel.
+  std::vector<float>    positions(3 * numVertices);
+  std::vector<uint32_t> indices(3 * numTriangles);
+  std::vector<int32_t>  materialIds(numTriangles);
+  pool.parallelFor(chunks.size(), [&](size_t chunkIdx) {
+    ObjChunk& chunk = chunks[chunkIdx];
+    std::copy(chunk.positions.begin(), chunk.positions.end(), positions.begin() + 3 * chunk.vertexBase);
+    for(size_t cornerIdx : chunk.relativeCorners)
+    {
+      chunk.corners[cornerIdx] += static_cast<uint32_t>(chunk.vertexBase);
+    }
+
+    // Write out triangles. Splitting a quad needs vertices from other chunks,
+    // so for now we only store its corners in the space for its two triangles.
+    uint32_t*       outIndex = indices.data() + 3 * chunk.triangleBase;
+    const uint32_t* corner   = chunk.corners.data();
+    for(uint8_t faceSize : chunk.faceSizes)
+    {
+      if(faceSize == 3)
+      {
+        outIndex[0] = corner[0];
+        outIndex[1] = corner[1];
+        outIndex[2] = corner[2];
+        outIndex += 3;
+      }
+      else
+      {
+        std::copy(corner, corner + 4, outIndex);
+        outIndex += 6;
+      }
+      corner += faceSize;
+    }
+
+    // Fill in material IDs, changing them at each `usemtl` in this chunk.
+    int32_t  chunkMaterial = chunk.materialAtStart;
+    uint64_t triangle      = chunk.triangleBase;
+    for(const ObjEvent& event : chunk.events)
+    {
+      if(event.type == ObjEvent::eUseMtl)
+      {
+        const uint64_t eventTriangle = chunk.triangleBase + event.triangleIndex;
+        std::fill(materialIds.begin() + triangle, materialIds.begin() + eventTriangle, chunkMaterial);
+        triangle = eventTriangle;
+        const auto it = materialMap.find(event.name);
+        chunkMaterial = (it == materialMap.end()) ? -1 : it->second;
+      }
+    }
+    std::fill(materialIds.begin() + triangle, materialIds.begin() + chunk.triangleBase + chunk.numTriangles, chunkMaterial);
+  });
+
+  // Now that all positions are known, split quads along their shorter
+  // diagonal, like tinyobj does.
+  pool.parallelFor(chunks.size(), [&](size_t chunkIdx) {
+    const ObjChunk& chunk    = chunks[chunkIdx];
+    uint32_t*       outIndex = indices.data() + 3 * chunk.triangleBase;
+    for(uint8_t faceSize : chunk.faceSizes)
+    {
+      if(faceSize == 4)
+      {
+        const uint32_t i0 = outIndex[0], i1 = outIndex[1], i2 = outIndex[2], i3 = outIndex[3];
+        const float*   v0 = &positions[3 * i0];
+        const float*   v1 = &positions[3 * i1];
+        const float*   v2 = &positions[3 * i2];
+        const float*   v3 = &positions[3 * i3];
+        const float    e02x = v2[0] - v0[0], e02y = v2[1] - v0[1], e02z = v2[2] - v0[2];
+        const float    e13x = v3[0] - v1[0], e13y = v3[1] - v1[1], e13z = v3[2] - v1[2];
+        const float    sqr02 = e02x * e02x + e02y * e02y + e02z * e02z;
+        const float    sqr13 = e13x * e13x + e13y * e13y + e13z * e13z;
+        if(sqr02 < sqr13)
+        {
+          // [0, 1, 2], [0, 2, 3]
+          const uint32_t quad[6] = {i0, i1, i2, i0, i2, i3};
+          std::copy(quad, quad + 6, outIndex);
+        }
+        else
+        {
+          // [0, 1, 3], [1, 2, 3]
+          const uint32_t quad[6] = {i0, i1, i3, i1, i2, i3};
+          std::copy(quad, quad + 6, outIndex);
+        }
+      }
+      outIndex += 3 * (faceSize - 2);
+    }
+  });
+
+  // Shapes start at each `o` or `g` record; like tinyobj, we skip empty ones.
+  std::vector<SceneShape> shapes;
+  for(size_t i = 0; i + 1 < shapeStarts.size(); i++)
+  {
+    if(shapeStarts[i + 1] > shapeStarts[i])
+    {
+      shapes.push_back(makeUnweldedShape(static_cast<uint32_t>(3 * shapeStarts[i]),
+                                         static_cast<uint32_t>(3 * (shapeStarts[i + 1] - shapeStarts[i])),
+                                         static_cast<uint32_t>(numVertices)));
+    }
+  }
+
+  geometry.setOwnedData(std::move(positions), std::move(indices), std::move(shapes), std::move(materialIds));
+  return true;
+}
+
+void runObjParserBenchmark(const std::string& objPath)
+{
+  using Clock          = std::chrono::steady_clock;
+  const auto timeMs    = [](const auto& fn) {
+    const Clock::time_point start = Clock::now();
+    fn();
+    return millisecondsSince(start);
+  };
+  const double fileMB      = toMB(std::filesystem::file_size(objPath));
+  const int    repetitions = 3;
+
+  // Baseline: what the samples used before.
+  double bestTinyobjMs = std::numeric_limits<double>::max();
+  for(int rep = 0; rep < repetitions; rep++)
+  {
+    bestTinyobjMs = std::min(bestTinyobjMs, timeMs([&]() {
+                               tinyobj::ObjReader reader;
+                               reader.ParseFromFile(objPath);
+                             }));
+  }
+  LOGI("OBJ parser benchmark: %s (%.2f MB)\n", objPath.c_str(), fileMB);
+  LOGI("  tinyobj::ObjReader::ParseFromFile: %9.3f ms, %8.2f MB/s\n", bestTinyobjMs, fileMB * 1000.0 / bestTinyobjMs);
+
+  SceneGeometry reference;
+  if(!loadObjGeometry(objPath, reference))
+  {
+    return;
+  }
+
+  const uint32_t maxThreads = ThreadPool::defaultNumThreads();
+  for(uint32_t numThreads = 1;; numThreads = std::min(2 * numThreads, maxThreads))
+  {
+    ThreadPool    pool(numThreads - 1);  // The calling thread participates as well
+    SceneGeometry geometry;
+    double        bestMs = std::numeric_limits<double>::max();
+    for(int rep = 0; rep < repetitions; rep++)
+    {
+      bestMs = std::min(bestMs, timeMs([&]() { parseObjParallel(objPath, pool, geometry); }));
+    }
+    const bool identical = std::ranges::equal(geometry.positions, reference.positions)
+                           && std::ranges::equal(geometry.indexWords, reference.indexWords)
+                           && std::ranges::equal(geometry.materialIds, reference.materialIds)
+                           && std::ranges::equal(geometry.shapes, reference.shapes);
+    LOGI("  parseObjParallel, %3u thread(s):   %9.3f ms, %8.2f MB/s, %s tinyobj\n", numThreads, bestMs,
+         fileMB * 1000.0 / bestMs, identical ? "identical to" : "DIFFERENT FROM");
+    if(numThreads == maxThreads)
+    {
+      break;
+    }
+  }
+}
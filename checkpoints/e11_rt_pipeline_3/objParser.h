@@ -0,0 +1,29 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+// A multithreaded OBJ parser for large files. The file is memory-mapped and
+// split into line-aligned chunks; each chunk's `v`, `f`, `o`/`g`, `usemtl` and
+// `mtllib` records are parsed on a thread pool, and the per-chunk results are
+// merged using prefix sums over their vertex and triangle counts.
+//
+// The result is the same as what loadObjGeometry() (tinyobjloader) produces:
+// numbers are parsed with the same algorithm as tinyobj, quads are split along
+// the same diagonal, and shapes and material IDs follow the same rules. For
+// records this parser doesn't handle (polygons with more than 4 vertices,
+// lines, points, or unusual face indices) it falls back to tinyobjloader.
+#ifndef VK_MINI_PATH_TRACER_OBJ_PARSER_H
+#define VK_MINI_PATH_TRACER_OBJ_PARSER_H
+
+#include <string>
+
+#include "sceneGeometry.h"
+#include "threadPool.h"
+
+bool parseObjParallel(const std::string& objPath, ThreadPool& pool, SceneGeometry& geometry);
+
+// Measures the throughput of parseObjParallel() for increasing thread counts,
+// compares it with tinyobj::ObjReader::ParseFromFile, and checks that both
+// produce the same geometry.
+void runObjParserBenchmark(const std::string& objPath);
+
+#endif  // #ifndef VK_MINI_PATH_TRACER_OBJ_PARSER_H
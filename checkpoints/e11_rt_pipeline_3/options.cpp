@@ -0,0 +1,131 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+#include "options.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include <nvh/nvprint.hpp>
+
+Options parseOptions(int argc, const char** argv)
+{
+  Options options;
+  for(int argIdx = 1; argIdx < argc; argIdx++)
+  {
+    const char* arg = argv[argIdx];
+    if(strcmp(arg, "--obj") == 0 && argIdx + 1 < argc)
+    {
+      options.objPath = argv[++argIdx];
+    }
+    else if(strcmp(arg, "--glb") == 0 && argIdx + 1 < argc)
+    {
+      options.glbPath = argv[++argIdx];
+    }
+    else if(strcmp(arg, "--scene") == 0 && argIdx + 1 < argc)
+    {
+      options.scenePath = argv[++argIdx];
+    }
+    else if(strcmp(arg, "--scene-cache") == 0)
+    {
+      options.useSceneCache = true;
+    }
+    else if(strcmp(arg, "--accel-cache") == 0)
+    {
+      options.useAccelCache = true;
+    }
+    else if(strcmp(arg, "--no-weld") == 0)
+    {
+      options.weldVertices = false;
+    }
+    else if(strcmp(arg, "--no-reorder") == 0)
+    {
+      options.reorderTriangles = false;
+    }
+    else if(strcmp(arg, "--no-dedup") == 0)
+    {
+      options.dedupMeshes = false;
+    }
+    else if(strcmp(arg, "--dedup-normalize") == 0)
+    {
+      options.dedupNormalizeTranslation = true;
+    }
+    else if(strcmp(arg, "--split-budget") == 0 && argIdx + 1 < argc)
+    {
+      options.splitBudgetPercent = std::max(0, atoi(argv[++argIdx]));
+    }
+    else if(strcmp(arg, "--quantized-shading") == 0)
+    {
+      options.quantizedShading = true;
+    }
+    else if(strcmp(arg, "--staging-mb") == 0 && argIdx + 1 < argc)
+    {
+      options.stagingBufferMB = std::max(1, atoi(argv[++argIdx]));
+    }
+    else if(strcmp(arg, "--blas-budget-mb") == 0 && argIdx + 1 < argc)
+    {
+      options.blasBudgetMB = std::max(0, atoi(argv[++argIdx]));
+    }
+    else if(strcmp(arg, "--host-accel-builds") == 0)
+    {
+      options.hostAccelBuilds = true;
+    }
+    else if(strcmp(arg, "--accel-flags") == 0 && argIdx + 1 < argc)
+    {
+      options.accelFlags = argv[++argIdx];
+    }
+    else if(strcmp(arg, "--tune-accel-flags") == 0 && argIdx + 1 < argc)
+    {
+      options.tuneAccelFlagsSpp = std::max(1, atoi(argv[++argIdx]));
+    }
+    else if(strcmp(arg, "--gpu-instances") == 0)
+    {
+      options.gpuInstances = true;
+    }
+    else if(strcmp(arg, "--cpu-render") == 0)
+    {
+      options.cpuRender = true;
+    }
+    else if(strcmp(arg, "--bench-obj-parse") == 0)
+    {
+      options.benchmarkObjParser = true;
+    }
+    else if(strcmp(arg, "--bench-reorder-locality") == 0)
+    {
+      options.benchmarkReorderLocality = true;
+    }
+    else if(strcmp(arg, "--bench-blas-budget") == 0 && argIdx + 1 < argc)
+    {
+      options.benchmarkBlasBudgetMeshes = std::max(1, atoi(argv[++argIdx]));
+    }
+    else if(strcmp(arg, "--bench-tlas-update") == 0)
+    {
+      options.benchmarkTlasUpdate = true;
+    }
+    else if(strcmp(arg, "--bench-deform") == 0)
+    {
+      options.benchmarkDeform = true;
+    }
+    else if(strcmp(arg, "--bench-host-build") == 0)
+    {
+      options.benchmarkHostBuild = true;
+    }
+    else if(strcmp(arg, "--bench-instance-gen") == 0)
+    {
+      options.benchmarkInstanceGen = true;
+    }
+    else if(strcmp(arg, "--bench-cpu-bvh") == 0)
+    {
+      options.benchmarkCpuBvh = true;
+    }
+    else if(strcmp(arg, "--blas-rebuild-interval") == 0 && argIdx + 1 < argc)
+    {
+      options.blasRebuildInterval = std::max(0, atoi(argv[++argIdx]));
+    }
+    else
+    {
+      LOGW("Ignoring unknown command-line argument %s.\n", arg);
+    }
+  }
+  return options;
+}
@@ -0,0 +1,119 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+// Command-line options for the sample.
+#ifndef VK_MINI_PATH_TRACER_OPTIONS_H
+#define VK_MINI_PATH_TRACER_OPTIONS_H
+
+#include <cstdint>
+#include <string>
+
+struct Options
+{
+  // The OBJ file to render, relative to the sample's search paths (--obj <path>).
+  std::string objPath = "scenes/CornellBox-Original-Merged.obj";
+  // If set, renders this binary glTF file instead of the OBJ file
+  // (--glb <path>; see gltfLoader.h).
+  std::string glbPath;
+  // If set, reads the geometry file, instances, camera and render settings
+  // from this JSON scene file (--scene <path>; see sceneDescription.h).
+  std::string scenePath;
+  // If true, loads the scene from its binary cache when possible, and writes
+  // the cache next to the OBJ file otherwise (--scene-cache; see sceneCache.h).
+  // Off by default, so that the sample doesn't write files next to its scenes
+  // and always measures parsing them.
+  bool useSceneCache = false;
+  // If true, loads BLASes from their serialized cache when it matches the
+  // device, driver and geometry, and writes the cache next to the scene
+  // otherwise (--accel-cache; see accelCache.h). Off by default, so that the
+  // sample doesn't write files next to its scenes and always builds BLASes,
+  // which the benchmarks measure.
+  bool useAccelCache = false;
+  // If true, merges duplicate vertices at load time and uses 16-bit indices
+  // where possible (see vertexWelder.h). Pass --no-weld to compare memory use
+  // and acceleration structure build times without welding.
+  bool weldVertices = true;
+  // If true, sorts triangles along a Morton curve and renumbers vertices at
+  // load time for better cache locality in hit shaders (see triangleReorder.h).
+  // Pass --no-reorder to compare rendering performance without it: renders
+  // log the triangle order next to their paths/s.
+  bool reorderTriangles = true;
+  // If true, meshes with the same triangles share one BLAS, and copies become
+  // instances of it (see meshDedup.h). Pass --no-dedup to compare BLAS memory
+  // and build times without sharing.
+  bool dedupMeshes = true;
+  // If true, meshes that only differ by a translation also share a BLAS
+  // (--dedup-normalize).
+  bool dedupNormalizeTranslation = false;
+  // If not 0, splits OBJ triangles with loose bounding boxes before building
+  // BLASes, adding at most this percentage of the scene's triangle count
+  // (--split-budget <percent>; see triangleSplitter.h).
+  uint32_t splitBudgetPercent = 0;
+  // If true, closest-hit shaders read quantized positions and normals
+  // instead of full-precision vertices (--quantized-shading; see shadingStream.h).
+  bool quantizedShading = false;
+  // Size of the staging ring used to stream buffers to the GPU, in MiB
+  // (--staging-mb <n>; see stagingRing.h).
+  uint32_t stagingBufferMB = 64;
+  // If not 0, builds BLASes in batches whose uncompacted size is at most this
+  // many MiB, compacting each batch before building the next
+  // (--blas-budget-mb <n>; see accelManager.h).
+  uint32_t blasBudgetMB = 0;
+  // If true and the device supports accelerationStructureHostCommands, builds
+  // the scene's BLASes on the CPU with the thread pool instead of on the GPU
+  // (--host-accel-builds; see AccelManager::buildBlasOnHost()).
+  bool hostAccelBuilds = false;
+  // Which build flags the acceleration structures use (--accel-flags <name>;
+  // see accelTuner.h for the presets).
+  std::string accelFlags = "fast-trace";
+  // --tune-accel-flags <spp>: after startup, builds and traces the scene with
+  // each flag preset, recommends the one with the shortest time to an image
+  // with this many samples per pixel, and renders with it.
+  uint32_t tuneAccelFlagsSpp = 0;
+  // If true, a compute shader writes the instances of the scene's instance
+  // grid directly into the TLAS's instance buffer (--gpu-instances; see
+  // instanceGenerator.h).
+  bool gpuInstances = false;
+  // If true, renders the scene on the CPU with a C++ port of the shaders
+  // instead of creating a Vulkan device (--cpu-render; see cpuRenderer.h).
+  // Options that only affect the GPU have no effect.
+  bool cpuRender = false;
+  // --bench-obj-parse: measures OBJ parsing throughput for `objPath` and exits.
+  bool benchmarkObjParser = false;
+  // --bench-reorder-locality: simulates on the CPU how many cache lines the
+  // closest-hit shaders' loads touch for `objPath` before and after triangle
+  // reordering, and exits. This is only a proxy; to measure GPU hit-shading
+  // throughput, compare the million paths/s a render logs with and without
+  // --no-reorder.
+  bool benchmarkReorderLocality = false;
+  // --bench-blas-budget <meshes>: after startup, measures peak memory use and
+  // build time of BLASes for this many synthetic meshes under several budgets.
+  uint32_t benchmarkBlasBudgetMeshes = 0;
+  // --bench-tlas-update: after startup, measures how long refitting TLASes of
+  // animated instances takes compared to rebuilding them.
+  bool benchmarkTlasUpdate = false;
+  // --bench-deform: after startup, wobbles the OBJ scene's vertices and
+  // measures the per-frame cost of refitting its acceleration structures
+  // (see deformableMeshes.h).
+  bool benchmarkDeform = false;
+  // --bench-host-build: after startup, measures how building the scene's
+  // BLASes on the CPU scales with the number of threads, compared to the GPU.
+  bool benchmarkHostBuild = false;
+  // --bench-instance-gen: after startup, measures building TLASes over large
+  // instance grids from instances made on the CPU and on the GPU.
+  bool benchmarkInstanceGen = false;
+  // --bench-cpu-bvh: after startup, builds the BVH of the CPU renderer over
+  // the scene with each builder, and logs build times, BVH sizes and SAH
+  // costs next to the GPU's acceleration structure build times, and how
+  // fast the CPU traces rays and ray packets through its binary and 8-wide
+  // BVHs.
+  bool benchmarkCpuBvh = false;
+  // How often deforming meshes rebuild their BLASes instead of refitting
+  // them, in frames; 0 means never (--blas-rebuild-interval <n>).
+  uint32_t blasRebuildInterval = 16;
+};
+
+// Parses the command-line arguments. Unknown arguments are reported and ignored.
+Options parseOptions(int argc, const char** argv);
+
+#endif  // #ifndef VK_MINI_PATH_TRACER_OPTIONS_H
@@ -0,0 +1,200 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+#include "sceneCache.h"
+
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include <nvh/nvprint.hpp>
+
+#include "bufferUtils.h"
+#include "measurement.h"
+#include "objParser.h"
+#include "triangleReorder.h"
+#include "vertexWelder.h"
+
+namespace {
+
+const char   k_sceneCacheMagic[8] = "VKMPTSC";
+const size_t k_sectionAlignment   = 16;
+
+// Gets the size and last write time of a file, so that we can tell when a
+// cache is out of date.
+bool getSourceStamp(const std::string& path, uint64_t& size, int64_t& writeTime)
+{
+  std::error_code ec;
+  size = std::filesystem::file_size(path, ec);
+  if(ec)
+  {
+    return false;
+  }
+  writeTime = std::filesystem::last_write_time(path, ec).time_since_epoch().count();
+  return !ec;
+}
+
+}  // namespace
+
+std::string getSceneCachePath(const std::string& objPath)
+{
+  return objPath + ".vkmptcache";
+}
+
+bool writeSceneCache(const std::string&   cachePath,
+                     const std::string&   objPath,
+                     bool                 welded,
+                     bool                 reordered,
+                     const SceneGeometry& geometry)
+{
+  SceneCacheHeader header{};
+  memcpy(header.magic, k_sceneCacheMagic, sizeof(header.magic));
+  header.version    = SCENE_CACHE_VERSION;
+  header.headerSize = sizeof(SceneCacheHeader);
+  if(!getSourceStamp(objPath, header.sourceSize, header.sourceWriteTime))
+  {
+    return false;
+  }
+  header.welded                 = welded ? 1 : 0;
+  header.reordered              = reordered ? 1 : 0;
+  header.numVertices            = geometry.numVertices();
+  header.numIndexWords          = geometry.indexWords.size();
+  header.numShapes              = geometry.shapes.size();
+  header.numTriangles           = geometry.numTriangles();
+  header.positionsOffset        = alignUp(sizeof(SceneCacheHeader), k_sectionAlignment);
+  header.indexWordsOffset       = alignUp(header.positionsOffset + geometry.positions.size_bytes(), k_sectionAlignment);
+  header.shapesOffset           = alignUp(header.indexWordsOffset + geometry.indexWords.size_bytes(), k_sectionAlignment);
+  header.materialIdsOffset      = alignUp(header.shapesOffset + geometry.shapes.size_bytes(), k_sectionAlignment);
+  header.sourcePrimitivesOffset = alignUp(header.materialIdsOffset + geometry.materialIds.size_bytes(), k_sectionAlignment);
+  if(reordered != (geometry.sourcePrimitives.size() == geometry.numTriangles()))
+  {
+    return false;
+  }
+
+  // Write to a temporary file first, so that an interrupted run never leaves
+  // a truncated cache behind:
+  const std::string tempPath = cachePath + ".tmp";
+  {
+    std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+    if(!file)
+    {
+      return false;
+    }
+    const auto writeSection = [&file](uint64_t offset, const void* data, size_t size) {
+      static const char zeros[k_sectionAlignment] = {};
+      const uint64_t    padding = offset - static_cast<uint64_t>(file.tellp());
+      file.write(zeros, static_cast<std::streamsize>(padding));
+      file.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(size));
+    };
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    writeSection(header.positionsOffset, geometry.positions.data(), geometry.positions.size_bytes());
+    writeSection(header.indexWordsOffset, geometry.indexWords.data(), geometry.indexWords.size_bytes());
+    writeSection(header.shapesOffset, geometry.shapes.data(), geometry.shapes.size_bytes());
+    writeSection(header.materialIdsOffset, geometry.materialIds.data(), geometry.materialIds.size_bytes());
+    if(reordered)
+    {
+      writeSection(header.sourcePrimitivesOffset, geometry.sourcePrimitives.data(), geometry.sourcePrimitives.size_bytes());
+    }
+    if(!file)
+    {
+      return false;
+    }
+  }
+
+  std::error_code ec;
+  std::filesystem::rename(tempPath, cachePath, ec);
+  if(ec)
+  {
+    std::filesystem::remove(tempPath, ec);
+    return false;
+  }
+  return true;
+}
+
+bool mapSceneCache(const std::string& cachePath, const std::string& objPath, bool welded, bool reordered, SceneGeometry& geometry)
+{
+  MappedFile mapping;
+  if(!mapping.open(cachePath) || mapping.size() < sizeof(SceneCacheHeader))
+  {
+    return false;
+  }
+
+  SceneCacheHeader header;
+  memcpy(&header, mapping.data(), sizeof(header));
+  if(memcmp(header.magic, k_sceneCacheMagic, sizeof(header.magic)) != 0  //
+     || header.version != SCENE_CACHE_VERSION || header.headerSize != sizeof(SceneCacheHeader)
+     || header.welded != (welded ? 1 : 0) || header.reordered != (reordered ? 1 : 0))
+  {
+    return false;
+  }
+
+  // The cache is stale if the OBJ file changed since it was written:
+  uint64_t sourceSize      = 0;
+  int64_t  sourceWriteTime = 0;
+  if(!getSourceStamp(objPath, sourceSize, sourceWriteTime)  //
+     || sourceSize != header.sourceSize || sourceWriteTime != header.sourceWriteTime)
+  {
+    return false;
+  }
+
+  // Make sure every section lies within the file before pointing into it:
+  if(header.positionsOffset + header.numVertices * 3 * sizeof(float) > mapping.size()
+     || header.indexWordsOffset + header.numIndexWords * sizeof(uint32_t) > mapping.size()
+     || header.shapesOffset + header.numShapes * sizeof(SceneShape) > mapping.size()
+     || header.materialIdsOffset + header.numTriangles * sizeof(int32_t) > mapping.size()
+     || (reordered && header.sourcePrimitivesOffset + header.numTriangles * sizeof(uint32_t) > mapping.size()))
+  {
+    return false;
+  }
+
+  const uint8_t* base  = mapping.data();
+  geometry.positions   = {reinterpret_cast<const float*>(base + header.positionsOffset), header.numVertices * 3};
+  geometry.indexWords  = {reinterpret_cast<const uint32_t*>(base + header.indexWordsOffset), header.numIndexWords};
+  geometry.shapes      = {reinterpret_cast<const SceneShape*>(base + header.shapesOffset), header.numShapes};
+  geometry.materialIds = {reinterpret_cast<const int32_t*>(base + header.materialIdsOffset), header.numTriangles};
+  if(reordered)
+  {
+    geometry.sourcePrimitives = {reinterpret_cast<const uint32_t*>(base + header.sourcePrimitivesOffset), header.numTriangles};
+  }
+  geometry.setMapping(std::move(mapping));
+  return true;
+}
+
+bool loadSceneGeometry(const std::string& objPath, bool useCache, bool weld, bool reorder, ThreadPool& pool, SceneGeometry& geometry)
+{
+  const auto        startTime = std::chrono::steady_clock::now();
+  const std::string cachePath = getSceneCachePath(objPath);
+
+  if(useCache && mapSceneCache(cachePath, objPath, weld, reorder, geometry))
+  {
+    LOGI("Mapped scene cache %s in %.3f ms (%u vertices, %u triangles).\n", cachePath.c_str(),
+         millisecondsSince(startTime), geometry.numVertices(), geometry.numTriangles());
+    return true;
+  }
+
+  if(!parseObjParallel(objPath, pool, geometry))
+  {
+    return false;
+  }
+  LOGI("Parsed OBJ file %s in %.3f ms (%u vertices, %u triangles).\n", objPath.c_str(), millisecondsSince(startTime),
+       geometry.numVertices(), geometry.numTriangles());
+
+  if(weld)
+  {
+    SceneGeometry welded;
+    weldSceneGeometry(geometry, pool, welded);
+    geometry = std::move(welded);
+  }
+  if(reorder)
+  {
+    SceneGeometry reordered;
+    reorderSceneGeometry(geometry, pool, reordered);
+    geometry = std::move(reordered);
+  }
+
+  if(useCache && !writeSceneCache(cachePath, objPath, weld, reorder, geometry))
+  {
+    LOGW("Could not write scene cache %s; the next run will parse the OBJ file again.\n", cachePath.c_str());
+  }
+  return true;
+}
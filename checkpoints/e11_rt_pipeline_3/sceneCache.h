@@ -0,0 +1,70 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+// A versioned binary cache of SceneGeometry. Parsing text OBJ files dominates
+// startup for large meshes; the first run writes the parsed geometry next to
+// the OBJ file, and later runs memory-map it and upload it directly.
+//
+// File layout (all sections 16-byte aligned, little-endian):
+//   SceneCacheHeader
+//   float      positions[3 * numVertices]
+//   uint32_t   indexWords[numIndexWords]
+//   SceneShape shapes[numShapes]
+//   int32_t    materialIds[numTriangles]
+//   uint32_t   sourcePrimitives[numTriangles]  (only if reordered)
+#ifndef VK_MINI_PATH_TRACER_SCENE_CACHE_H
+#define VK_MINI_PATH_TRACER_SCENE_CACHE_H
+
+#include <cstdint>
+#include <string>
+
+#include "sceneGeometry.h"
+#include "threadPool.h"
+
+// Increment this whenever the layout of the cache file changes.
+static const uint32_t SCENE_CACHE_VERSION = 3;
+
+struct SceneCacheHeader
+{
+  char     magic[8];         // "VKMPTSC" followed by a null terminator
+  uint32_t version;          // SCENE_CACHE_VERSION
+  uint32_t headerSize;       // sizeof(SceneCacheHeader)
+  uint64_t sourceSize;       // Size of the OBJ file this was created from
+  int64_t  sourceWriteTime;  // Last write time of the OBJ file this was created from
+  uint32_t welded;           // 1 if the geometry went through weldSceneGeometry(), 0 otherwise
+  uint32_t reordered;        // 1 if the geometry went through reorderSceneGeometry(), 0 otherwise
+  uint64_t numVertices;
+  uint64_t numIndexWords;
+  uint64_t numShapes;
+  uint64_t numTriangles;
+  uint64_t positionsOffset;  // Byte offsets of each section from the start of the file
+  uint64_t indexWordsOffset;
+  uint64_t shapesOffset;
+  uint64_t materialIdsOffset;
+  uint64_t sourcePrimitivesOffset;
+};
+
+// Returns the path of the cache file used for the given OBJ file.
+std::string getSceneCachePath(const std::string& objPath);
+
+// Writes `geometry` to `cachePath`, tagged with the size and write time of
+// `objPath` and with whether it was welded and reordered. Returns false if
+// the file could not be written.
+bool writeSceneCache(const std::string&   cachePath,
+                     const std::string&   objPath,
+                     bool                 welded,
+                     bool                 reordered,
+                     const SceneGeometry& geometry);
+
+// Maps `cachePath` and points `geometry` into it. Returns false if the cache
+// doesn't exist, has a different version, is older than `objPath`, or wasn't
+// welded or reordered the same way.
+bool mapSceneCache(const std::string& cachePath, const std::string& objPath, bool welded, bool reordered, SceneGeometry& geometry);
+
+// Loads `objPath`, using the binary cache if it's valid and `useCache` is true.
+// Otherwise, parses the OBJ file on `pool` (see objParser.h), welds it if
+// `weld` is true (see vertexWelder.h), reorders it if `reorder` is true (see
+// triangleReorder.h), and writes the cache if `useCache` is true.
+bool loadSceneGeometry(const std::string& objPath, bool useCache, bool weld, bool reorder, ThreadPool& pool, SceneGeometry& geometry);
+
+#endif  // #ifndef VK_MINI_PATH_TRACER_SCENE_CACHE_H
@@ -0,0 +1,316 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+#include "sceneDescription.h"
+
+#include <algorithm>
+#include <random>
+#include <string_view>
+
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtx/transform.hpp>
+#include <nvh/nvprint.hpp>
+
+#include "json.h"
+#include "mappedFile.h"
+
+namespace {
+
+// Each reader leaves its output alone if the member is missing, and returns
+// false with a description in `error` if the member has the wrong type.
+
+bool readNumbers(const JsonValue& parent, const char* key, size_t count, float* result, std::string& error)
+{
+  if(!parent.contains(key))
+  {
+    return true;
+  }
+  const JsonValue& value = parent[key];
+  if(!value.isArray() || value.size() != count)
+  {
+    error = "\"" + std::string(key) + "\" must be an array of " + std::to_string(count) + " numbers";
+    return false;
+  }
+  for(size_t i = 0; i < count; i++)
+  {
+    if(!value[i].isNumber())
+    {
+      error = "\"" + std::string(key) + "\" must only contain numbers";
+      return false;
+    }
+    result[i] = static_cast<float>(value[i].asNumber());
+  }
+  return true;
+}
+
+bool readFloat(const JsonValue& parent, const char* key, float& result, std::string& error)
+{
+  if(!parent.contains(key))
+  {
+    return true;
+  }
+  if(!parent[key].isNumber())
+  {
+    error = "\"" + std::string(key) + "\" must be a number";
+    return false;
+  }
+  result = static_cast<float>(parent[key].asNumber());
+  return true;
+}
+
+bool readVec3(const JsonValue& parent, const char* key, glm::vec3& result, std::string& error)
+{
+  return readNumbers(parent, key, 3, &result.x, error);
+}
+
+// Reads an integer in [minimum, maximum].
+template <class T>
+bool readInt(const JsonValue& parent, const char* key, int64_t minimum, int64_t maximum, T& result, std::string& error)
+{
+  if(!parent.contains(key))
+  {
+    return true;
+  }
+  const JsonValue& value = parent[key];
+  if(!value.isNumber() || static_cast<double>(value.asInt()) != value.asNumber() || value.asInt() < minimum
+     || value.asInt() > maximum)
+  {
+    error = "\"" + std::string(key) + "\" must be an integer from " + std::to_string(minimum) + " to " + std::to_string(maximum);
+    return false;
+  }
+  result = static_cast<T>(value.asInt());
+  return true;
+}
+
+bool readString(const JsonValue& parent, const char* key, std::string& result, std::string& error)
+{
+  if(!parent.contains(key))
+  {
+    return true;
+  }
+  if(!parent[key].isString() || parent[key].asString().empty())
+  {
+    error = "\"" + std::string(key) + "\" must be a non-empty string";
+    return false;
+  }
+  result = parent[key].asString();
+  return true;
+}
+
+bool readInstance(const JsonValue& value, SceneInstance& instance, std::string& error)
+{
+  if(!value.isObject())
+  {
+    error = "instances must be objects";
+    return false;
+  }
+  if(!readInt(value, "mesh", 0, INT32_MAX, instance.mesh, error)  //
+     || !readInt(value, "material", 0, 8, instance.material, error))
+  {
+    return false;
+  }
+  if(value.contains("matrix"))
+  {
+    float matrix[16];
+    if(!readNumbers(value, "matrix", 16, matrix, error))
+    {
+      return false;
+    }
+    for(int i = 0; i < 16; i++)
+    {
+      instance.transform[i / 4][i % 4] = matrix[i];  // Column-major, like glTF
+    }
+    return true;
+  }
+  glm::vec3 translation(0.0f), scale(1.0f);
+  float     rotation[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+  if(!readVec3(value, "translation", translation, error) || !readNumbers(value, "rotation", 4, rotation, error)
+     || !readVec3(value, "scale", scale, error))
+  {
+    return false;
+  }
+  const glm::quat quaternion(rotation[3], rotation[0], rotation[1], rotation[2]);
+  instance.transform = glm::translate(translation) * glm::mat4_cast(glm::normalize(quaternion)) * glm::scale(scale);
+  return true;
+}
+
+bool readScene(const JsonValue& root, SceneDescription& scene, std::string& error)
+{
+  if(!root.isObject())
+  {
+    error = "the scene must be a JSON object";
+    return false;
+  }
+
+  const JsonValue& geometry = root["geometry"];
+  if(!readString(geometry, "obj", scene.objPath, error) || !readString(geometry, "glb", scene.glbPath, error))
+  {
+    return false;
+  }
+  if(!scene.objPath.empty() && !scene.glbPath.empty())
+  {
+    error = "\"geometry\" must contain either \"obj\" or \"glb\", not both";
+    return false;
+  }
+
+  const JsonValue& camera = root["camera"];
+  if(!readVec3(camera, "origin", scene.camera.origin, error) || !readVec3(camera, "target", scene.camera.target, error)
+     || !readVec3(camera, "up", scene.camera.up, error)  //
+     || !readFloat(camera, "fovVerticalSlope", scene.camera.fovVerticalSlope, error))
+  {
+    return false;
+  }
+  const glm::vec3 forward = scene.camera.target - scene.camera.origin;
+  if(glm::length(glm::cross(forward, scene.camera.up)) == 0.0f || !(scene.camera.fovVerticalSlope > 0.0f))
+  {
+    error = "the camera's up vector must not be parallel to its view direction, and its field of view must be positive";
+    return false;
+  }
+
+  const JsonValue&     render   = root["render"];
+  SceneRenderSettings& settings = scene.render;
+  if(!readInt(render, "width", 1, 16384, settings.width, error) || !readInt(render, "height", 1, 16384, settings.height, error)
+     || !readInt(render, "samplesPerBatch", 1, 1 << 16, settings.samplesPerBatch, error)
+     || !readInt(render, "sampleBatches", 1, 1 << 20, settings.sampleBatches, error)
+     || !readInt(render, "maxSegments", 1, 1024, settings.maxSegments, error)  //
+     || !readString(render, "output", settings.outputPath, error))
+  {
+    return false;
+  }
+
+  const JsonValue& instances = root["instances"];
+  if(root.contains("instances") && !instances.isArray())
+  {
+    error = "\"instances\" must be an array";
+    return false;
+  }
+  for(const JsonValue& value : instances.elements())
+  {
+    SceneInstance instance;
+    if(!readInstance(value, instance, error))
+    {
+      error = "instance " + std::to_string(scene.instances.size()) + ": " + error;
+      return false;
+    }
+    scene.instances.push_back(instance);
+  }
+
+  if(root.contains("instanceGrid"))
+  {
+    const JsonValue&  gridValue = root["instanceGrid"];
+    SceneInstanceGrid grid;
+    if(!gridValue.isObject() || !readInt(gridValue, "halfExtent", 0, 1000, grid.halfExtent, error)
+       || !readFloat(gridValue, "spacing", grid.spacing, error) || !readVec3(gridValue, "center", grid.center, error)
+       || !readFloat(gridValue, "scale", grid.scale, error) || !readFloat(gridValue, "maxRotation", grid.maxRotation, error)
+       || !readInt(gridValue, "seed", 0, UINT32_MAX, grid.seed, error)
+       || !readInt(gridValue, "layers", 1, 1000, grid.layers, error)
+       || !readFloat(gridValue, "scaleVariation", grid.scaleVariation, error)
+       || !readFloat(gridValue, "jitter", grid.jitter, error))
+    {
+      error = "\"instanceGrid\": " + (error.empty() ? std::string("must be an object") : error);
+      return false;
+    }
+    if(gridValue.contains("materialWeights"))
+    {
+      float weights[9];
+      if(!readNumbers(gridValue, "materialWeights", 9, weights, error))
+      {
+        error = "\"instanceGrid\": " + error;
+        return false;
+      }
+      if(std::ranges::any_of(weights, [](float w) { return !(w >= 0.0f); })
+         || std::ranges::none_of(weights, [](float w) { return w > 0.0f; }))
+      {
+        error = "\"instanceGrid\": \"materialWeights\" must not be negative, and at least one must be positive";
+        return false;
+      }
+      grid.materialWeights.assign(weights, weights + 9);
+    }
+    if(!(grid.scaleVariation >= 0.0f && grid.scaleVariation < 1.0f) || !(grid.jitter >= 0.0f))
+    {
+      error = "\"instanceGrid\": \"scaleVariation\" must be in [0, 1), and \"jitter\" must not be negative";
+      return false;
+    }
+    scene.instanceGrid = grid;
+  }
+  return true;
+}
+
+}  // namespace
+
+bool loadSceneDescription(const std::string& path, SceneDescription& scene)
+{
+  MappedFile file;
+  if(!file.open(path))
+  {
+    LOGE("Could not open the scene file %s.\n", path.c_str());
+    return false;
+  }
+  JsonValue   root;
+  std::string error;
+  if(!parseJson(std::string_view(reinterpret_cast<const char*>(file.data()), file.size()), root, error)
+     || !readScene(root, scene, error))
+  {
+    LOGE("Could not read the scene file %s: %s\n", path.c_str(), error.c_str());
+    return false;
+  }
+  LOGI("Loaded the scene file %s (%zu instances%s).\n", path.c_str(), scene.instances.size(),
+       scene.instanceGrid ? " and an instance grid" : "");
+  return true;
+}
+
+std::vector<SceneInstance> expandInstanceGrid(const SceneInstanceGrid& grid)
+{
+  // These draw random numbers in the same order as the original sample, so
+  // the default grid places the same rotations and materials.
+  std::default_random_engine            randomEngine(grid.seed);  // The random number generator
+  std::uniform_real_distribution<float> uniformDist(-grid.maxRotation, grid.maxRotation);
+  std::uniform_int_distribution<int>    uniformIntDist(0, 8);
+  std::uniform_real_distribution<float> signedDist(-1.0f, 1.0f);
+  std::discrete_distribution<int>       materialDist(grid.materialWeights.begin(), grid.materialWeights.end());
+  std::vector<SceneInstance>            instances;
+  for(int z = 0; z < grid.layers; z++)
+  {
+    for(int x = -grid.halfExtent; x <= grid.halfExtent; x++)
+    {
+      for(int y = -grid.halfExtent; y <= grid.halfExtent; y++)
+      {
+        glm::mat4 transform = glm::translate(-grid.center);
+        transform           = glm::rotate(uniformDist(randomEngine), glm::vec3(1.0f, 0.0f, 0.0f)) * transform;
+        transform           = glm::rotate(uniformDist(randomEngine), glm::vec3(0.0f, 1.0f, 0.0f)) * transform;
+        // Only draw the numbers the original sample didn't when we need them.
+        const float scale    = (grid.scaleVariation != 0.0f) ? grid.scale * (1.0f + grid.scaleVariation * signedDist(randomEngine)) : grid.scale;
+        glm::vec3   position = glm::vec3(float(x), float(y), -float(z)) * grid.spacing;
+        if(grid.jitter != 0.0f)
+        {
+          position.x += grid.jitter * grid.spacing * signedDist(randomEngine);
+          position.y += grid.jitter * grid.spacing * signedDist(randomEngine);
+        }
+        transform = glm::scale(glm::vec3(scale)) * transform;
+        transform = glm::translate(position) * transform;
+        // All meshes in a cell share the same material.
+        const int material = grid.materialWeights.empty() ? uniformIntDist(randomEngine) : materialDist(randomEngine);
+        instances.push_back({.mesh = k_sceneDefault, .material = material, .transform = transform});
+      }
+    }
+  }
+  return instances;
+}
+
+void setCameraPushConstants(const SceneDescription& scene, PushConstants& pushConstants)
+{
+  // An orthonormal basis for the camera; with the defaults, this is the
+  // sample's original camera looking down -z.
+  const glm::vec3 forward = glm::normalize(scene.camera.target - scene.camera.origin);
+  const glm::vec3 right   = glm::normalize(glm::cross(forward, scene.camera.up));
+  const glm::vec3 up      = glm::cross(right, forward);
+  for(int c = 0; c < 3; c++)
+  {
+    pushConstants.cameraOrigin[c]  = scene.camera.origin[c];
+    pushConstants.cameraRight[c]   = right[c];
+    pushConstants.cameraUp[c]      = up[c];
+    pushConstants.cameraForward[c] = forward[c];
+  }
+  pushConstants.fovVerticalSlope = scene.camera.fovVerticalSlope;
+  pushConstants.samplesPerBatch  = scene.render.samplesPerBatch;
+  pushConstants.maxSegments      = scene.render.maxSegments;
+}
@@ -0,0 +1,113 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+// A declarative description of what to render, read from a JSON scene file
+// at startup (--scene <path>), so that one binary can render many scenes
+// without recompiling. A scene file looks like this; every part is optional:
+//
+// {
+//   "geometry": {"obj": "scenes/CornellBox-Original-Merged.obj"},  // Or {"glb": "<path>"}
+//   "camera": {"origin": [-0.001, 0, 53], "target": [-0.001, 0, 0], "up": [0, 1, 0], "fovVerticalSlope": 0.2},
+//   "render": {"width": 800, "height": 600, "samplesPerBatch": 64, "sampleBatches": 32,
+//              "maxSegments": 32, "output": "out.hdr"},
+//   "instances": [
+//     {"mesh": 0, "material": 3, "translation": [0, 1, 0], "rotation": [0, 0, 0, 1], "scale": [1, 1, 1]},
+//     {"material": 5, "matrix": [1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 2, 0, 0, 1]}
+//   ],
+//   "instanceGrid": {"halfExtent": 10, "spacing": 1, "center": [0, 1, 0], "scale": 0.37037, "maxRotation": 0.5,
+//                    "layers": 1, "scaleVariation": 0, "jitter": 0, "materialWeights": [1, 1, 1, 1, 1, 1, 1, 1, 1]}
+// }
+//
+// Instances use the conventions of glTF nodes: "matrix" is column-major, and
+// "rotation" is a unit quaternion (x, y, z, w). "mesh" is the index of an OBJ
+// shape or glTF primitive; without it, an instance places all meshes.
+// "material" selects one of the 9 closest-hit shaders; without it, glTF
+// primitives use their own material, and OBJ shapes use material 0.
+//
+// "instanceGrid" places copies of all meshes on a grid like the original
+// sample, each cell with a random rotation and material. Without a scene
+// file, OBJ scenes use the default grid, and glTF scenes use their nodes.
+// With --gpu-instances, a compute shader generates the grid's instances
+// instead (see instanceGenerator.h); it draws different random numbers.
+#ifndef VK_MINI_PATH_TRACER_SCENE_DESCRIPTION_H
+#define VK_MINI_PATH_TRACER_SCENE_DESCRIPTION_H
+
+#include <cstdint>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "common.h"
+
+// Means "all meshes" for SceneInstance::mesh, and "the mesh's own material" for SceneInstance::material.
+const int32_t k_sceneDefault = -1;
+
+struct SceneInstance
+{
+  int32_t   mesh      = k_sceneDefault;
+  int32_t   material  = k_sceneDefault;
+  glm::mat4 transform = glm::mat4(1.0f);
+};
+
+struct SceneInstanceGrid
+{
+  int32_t   halfExtent  = 10;  // Cells go from -halfExtent to +halfExtent in x and y
+  float     spacing     = 1.0f;
+  glm::vec3 center      = glm::vec3(0.0f, 1.0f, 0.0f);  // Point of the meshes placed at each cell's center
+  float     scale       = 1.0f / 2.7f;
+  float     maxRotation = 0.5f;  // Maximum random rotation around x and y, in radians
+  uint32_t  seed        = static_cast<uint32_t>(std::default_random_engine::default_seed);  // Seed of std::default_random_engine
+  // The defaults below reproduce the original sample's grid.
+  int32_t            layers         = 1;     // Copies of the grid, each `spacing` further along -z
+  float              scaleVariation = 0.0f;  // Each cell's scale varies randomly by up to this fraction
+  float              jitter         = 0.0f;  // Maximum random offset in x and y from a cell's center, relative to `spacing`
+  std::vector<float> materialWeights;        // Relative probabilities of the 9 materials; uniform if empty
+};
+
+struct SceneCamera
+{
+  glm::vec3 origin           = glm::vec3(-0.001f, 0.0f, 53.0f);
+  glm::vec3 target           = glm::vec3(-0.001f, 0.0f, 0.0f);  // A point the camera looks at
+  glm::vec3 up               = glm::vec3(0.0f, 1.0f, 0.0f);
+  float     fovVerticalSlope = 1.0f / 5.0f;  // Vertical slope of the topmost rays
+};
+
+struct SceneRenderSettings
+{
+  uint32_t    width           = 800;
+  uint32_t    height          = 600;
+  uint32_t    samplesPerBatch = 64;  // Samples per pixel traced by each launch
+  uint32_t    sampleBatches   = 32;  // Number of launches
+  uint32_t    maxSegments     = 32;  // Maximum number of segments per path
+  std::string outputPath      = "out.hdr";
+};
+
+class SceneDescription
+{
+public:
+  // Geometry file paths, relative to the sample's search paths. If both are
+  // empty, the command line's --obj or --glb file is used.
+  std::string                      objPath;
+  std::string                      glbPath;
+  std::vector<SceneInstance>       instances;
+  std::optional<SceneInstanceGrid> instanceGrid;
+  SceneCamera                      camera;
+  SceneRenderSettings              render;
+
+  bool hasInstances() const { return !instances.empty() || instanceGrid.has_value(); }
+};
+
+// Reads the scene file at `path` into `scene`. On failure, logs the problem
+// and returns false. Members the file doesn't mention keep their defaults.
+bool loadSceneDescription(const std::string& path, SceneDescription& scene);
+
+// Returns the instances of `grid`; see SceneInstanceGrid.
+std::vector<SceneInstance> expandInstanceGrid(const SceneInstanceGrid& grid);
+
+// Fills the camera and render settings of `pushConstants`.
+void setCameraPushConstants(const SceneDescription& scene, PushConstants& pushConstants);
+
+#endif  // #ifndef VK_MINI_PATH_TRACER_SCENE_DESCRIPTION_H
@@ -0,0 +1,79 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+#include "sceneGeometry.h"
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include <tiny_obj_loader.h>
+
+#include <nvh/nvprint.hpp>
+
+void SceneGeometry::setOwnedData(std::vector<float>&&      positions_,
+                                 std::vector<uint32_t>&&   indexWords_,
+                                 std::vector<SceneShape>&& shapes_,
+                                 std::vector<int32_t>&&    materialIds_,
+                                 std::vector<uint32_t>&&   sourcePrimitives_)
+{
+  m_positions        = std::move(positions_);
+  m_indexWords       = std::move(indexWords_);
+  m_shapes           = std::move(shapes_);
+  m_materialIds      = std::move(materialIds_);
+  m_sourcePrimitives = std::move(sourcePrimitives_);
+  positions          = m_positions;
+  indexWords         = m_indexWords;
+  shapes             = m_shapes;
+  materialIds        = m_materialIds;
+  sourcePrimitives   = m_sourcePrimitives;
+}
+
+SceneShape makeUnweldedShape(uint32_t firstIndex, uint32_t indexCount, uint32_t numVertices)
+{
+  return {.firstIndex     = firstIndex,
+          .indexCount     = indexCount,
+          .firstVertex    = 0,
+          .vertexCount    = numVertices,
+          .firstIndexWord = firstIndex,
+          .indexBits      = 32};
+}
+
+bool loadObjGeometry(const std::string& objPath, SceneGeometry& geometry)
+{
+  // We use tinyobj::LoadObj instead of tinyobj::ObjReader so that we can move
+  // the vertex array out of `attrib` instead of copying it.
+  tinyobj::attrib_t                attrib;
+  std::vector<tinyobj::shape_t>    objShapes;
+  std::vector<tinyobj::material_t> objMaterials;
+  std::string                      warn, err;
+  const std::string                mtlBaseDir = objPath.substr(0, objPath.find_last_of("/\\") + 1);
+  if(!tinyobj::LoadObj(&attrib, &objShapes, &objMaterials, &warn, &err, objPath.c_str(), mtlBaseDir.c_str(), true))
+  {
+    LOGE("Could not parse %s: %s\n", objPath.c_str(), err.c_str());
+    return false;
+  }
+
+  // Concatenate the vertex indices of all shapes, and remember where each shape starts:
+  size_t totalIndices = 0;
+  for(const tinyobj::shape_t& objShape : objShapes)
+  {
+    totalIndices += objShape.mesh.indices.size();
+  }
+  std::vector<uint32_t>   indices;
+  std::vector<SceneShape> shapes;
+  std::vector<int32_t>    materialIds;
+  indices.reserve(totalIndices);
+  materialIds.reserve(totalIndices / 3);
+  shapes.reserve(objShapes.size());
+  for(const tinyobj::shape_t& objShape : objShapes)
+  {
+    shapes.push_back(makeUnweldedShape(static_cast<uint32_t>(indices.size()),  //
+                                       static_cast<uint32_t>(objShape.mesh.indices.size()),
+                                       static_cast<uint32_t>(attrib.vertices.size() / 3)));
+    for(const tinyobj::index_t& index : objShape.mesh.indices)
+    {
+      indices.push_back(index.vertex_index);
+    }
+    materialIds.insert(materialIds.end(), objShape.mesh.material_ids.begin(), objShape.mesh.material_ids.end());
+  }
+
+  geometry.setOwnedData(std::move(attrib.vertices), std::move(indices), std::move(shapes), std::move(materialIds));
+  return true;
+}
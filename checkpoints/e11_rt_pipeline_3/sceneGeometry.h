@@ -0,0 +1,92 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+// CPU-side triangle geometry of a scene, as loaded from an OBJ file or from a
+// binary scene cache (see sceneCache.h).
+#ifndef VK_MINI_PATH_TRACER_SCENE_GEOMETRY_H
+#define VK_MINI_PATH_TRACER_SCENE_GEOMETRY_H
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "mappedFile.h"
+
+// The triangles and vertices of one OBJ shape. A shape's vertex indices are
+// relative to its first vertex, and are stored either as 32-bit values, or as
+// 16-bit values packed two per word (low half first) when the shape has at
+// most 65536 vertices (see vertexWelder.h).
+struct SceneShape
+{
+  uint32_t firstIndex;      // Index of the first triangle corner of this shape, over all shapes
+  uint32_t indexCount;      // Number of triangle corners (3 per triangle)
+  uint32_t firstVertex;     // Index of the first vertex this shape's indices are relative to
+  uint32_t vertexCount;     // Number of vertices this shape's indices can reference
+  uint32_t firstIndexWord;  // Where this shape's indices start in `SceneGeometry::indexWords`
+  uint32_t indexBits;       // 16 or 32
+
+  bool operator==(const SceneShape&) const = default;
+};
+
+// The arrays below are views. They either point into vectors owned by this
+// object (after parsing an OBJ file), or directly into a memory-mapped scene
+// cache; either way, they can be handed to the GPU upload as they are.
+class SceneGeometry
+{
+public:
+  std::span<const float>      positions;    // 3 floats per vertex
+  std::span<const uint32_t>   indexWords;   // 3 vertex indices per triangle, packed as described by each shape
+  std::span<const SceneShape> shapes;       // Ranges of triangles and vertices, one per shape
+  std::span<const int32_t>    materialIds;  // One OBJ material ID per triangle (-1 if none)
+  // Empty, or for each triangle, the index it had within its shape in the OBJ
+  // file, if a pass changed the order of triangles (see triangleReorder.h).
+  std::span<const uint32_t>   sourcePrimitives;
+
+  uint32_t numVertices() const { return static_cast<uint32_t>(positions.size() / 3); }
+  uint32_t numTriangles() const { return static_cast<uint32_t>(materialIds.size()); }
+
+  // Returns the index in `positions` of corner `corner` of `shape`.
+  uint32_t vertexIndex(const SceneShape& shape, uint32_t corner) const
+  {
+    if(shape.indexBits == 16)
+    {
+      const uint32_t word = indexWords[shape.firstIndexWord + corner / 2];
+      return shape.firstVertex + ((corner % 2 == 0) ? (word & 0xFFFF) : (word >> 16));
+    }
+    return shape.firstVertex + indexWords[shape.firstIndexWord + corner];
+  }
+
+  SceneGeometry()                                = default;
+  SceneGeometry(const SceneGeometry&)            = delete;
+  SceneGeometry& operator=(const SceneGeometry&) = delete;
+  SceneGeometry(SceneGeometry&&)                 = default;
+  SceneGeometry& operator=(SceneGeometry&&)      = default;
+
+  // Takes ownership of the given arrays and points the views at them.
+  void setOwnedData(std::vector<float>&&      positions,
+                    std::vector<uint32_t>&&   indexWords,
+                    std::vector<SceneShape>&& shapes,
+                    std::vector<int32_t>&&    materialIds,
+                    std::vector<uint32_t>&&   sourcePrimitives = {});
+  // Keeps `mapping` alive for as long as the views point into it.
+  void setMapping(MappedFile&& mapping) { m_mapping = std::move(mapping); }
+
+private:
+  std::vector<float>      m_positions;
+  std::vector<uint32_t>   m_indexWords;
+  std::vector<SceneShape> m_shapes;
+  std::vector<int32_t>    m_materialIds;
+  std::vector<uint32_t>   m_sourcePrimitives;
+  MappedFile              m_mapping;
+};
+
+// Returns a shape covering the given range of triangle corners, whose 32-bit
+// indices point directly into all `numVertices` vertices. This is how OBJ
+// parsers describe shapes before welding.
+SceneShape makeUnweldedShape(uint32_t firstIndex, uint32_t indexCount, uint32_t numVertices);
+
+// Parses an OBJ file using tinyobjloader. Returns false if parsing failed.
+bool loadObjGeometry(const std::string& objPath, SceneGeometry& geometry);
+
+#endif  // #ifndef VK_MINI_PATH_TRACER_SCENE_GEOMETRY_H
@@ -10,6 +10,7 @@
 
 #extension GL_EXT_ray_tracing : require
 #extension GL_EXT_scalar_block_layout : require
+#extension GL_EXT_buffer_reference : require
 #include "../common.h"
 #include "shaderCommon.h"
 
@@ -17,17 +18,90 @@
 // closest-hit shaders are called:
 hitAttributeEXT vec2 attributes;
 
-// These shaders can access the vertex and index buffers:
+// These shaders can access the vertex and index buffers of every mesh through
+// buffer references, using the device addresses in the geometry table.
 // The scalar layout qualifier here means to align types according to the alignment
 // of their scalar components, instead of e.g. padding them to std140 rules.
-layout(binding = BINDING_VERTICES, set = 0, scalar) buffer Vertices
+// Vertices are read as floats, since their stride depends on the mesh (for
+// instance, glTF files can interleave positions with other attributes).
+layout(buffer_reference, scalar) readonly buffer Vertices
 {
-  vec3 vertices[];
+  float vertices[];
 };
-layout(binding = BINDING_INDICES, set = 0, scalar) buffer Indices
+// 16-bit indices are packed two per uint, so that we don't need 16-bit storage support.
+layout(buffer_reference, scalar) readonly buffer Indices
 {
   uint indices[];
 };
+// The quantized shading stream packs 16-bit values, which we read as uints
+// for the same reason.
+layout(buffer_reference, scalar) readonly buffer PackedHalves
+{
+  uint words[];
+};
+layout(buffer_reference, scalar) readonly buffer PrimitiveRemap
+{
+  uint sourcePrimitives[];
+};
+layout(binding = BINDING_GEOMETRIES, set = 0, scalar) readonly buffer Geometries
+{
+  GeometryInfo geometries[];
+};
+
+// Reads the index of corner `corner` of a mesh, unpacking 16-bit indices.
+uint getIndex(Indices indices, uint indexBits, uint corner)
+{
+  if(indexBits == 16)
+  {
+    const uint word = indices.indices[corner >> 1];
+    return ((corner & 1) == 0) ? (word & 0xFFFF) : (word >> 16);
+  }
+  return indices.indices[corner];
+}
+
+// Reads the position of vertex `index` of a mesh.
+vec3 getVertex(Vertices vertices, uint vertexStride, uint index)
+{
+  const uint first = index * (vertexStride / 4);
+  return vec3(vertices.vertices[first], vertices.vertices[first + 1], vertices.vertices[first + 2]);
+}
+
+// Reads the quantized position of vertex `index`. Positions are 3 16-bit
+// values each, so a vertex starts either at the start or in the middle of a uint.
+vec3 getQuantizedVertex(PackedHalves positions, uint index, vec3 positionMin, vec3 positionScale)
+{
+  const uint  firstHalf = 3 * index;
+  const uint  w0        = positions.words[firstHalf >> 1];
+  const uint  w1        = positions.words[(firstHalf >> 1) + 1];
+  const uvec3 quantized = ((firstHalf & 1) == 0) ? uvec3(w0 & 0xFFFF, w0 >> 16, w1 & 0xFFFF) :  //
+                              uvec3(w0 >> 16, w1 & 0xFFFF, w1 >> 16);
+  return positionMin + vec3(quantized) * positionScale;
+}
+
+// Decodes a normal stored as two 8-bit snorm octahedral coordinates.
+vec3 decodeOctahedralNormal(uint bits)
+{
+  const ivec2 signedBits = ivec2(int(bits << 24) >> 24, int(bits << 16) >> 24);
+  vec3        normal     = vec3(max(vec2(signedBits) / 127.0, vec2(-1.0)), 0.0);
+  normal.z               = 1.0 - abs(normal.x) - abs(normal.y);
+  const float t          = max(-normal.z, 0.0);
+  normal.x += (normal.x >= 0.0) ? -t : t;
+  normal.y += (normal.y >= 0.0) ? -t : t;
+  return normalize(normal);
+}
+
+// Returns the primitive ID the hit triangle had in the original scene file.
+// Load-time reordering changes gl_PrimitiveID, so shaders that depend on
+// primitive IDs should use this instead.
+int getSourcePrimitiveID()
+{
+  const uint64_t remapAddress = geometries[gl_InstanceCustomIndexEXT].primitiveRemapAddress;
+  if(remapAddress == 0)
+  {
+    return gl_PrimitiveID;
+  }
+  return int(PrimitiveRemap(remapAddress).sourcePrimitives[gl_PrimitiveID]);
+}
 
 // The payload:
 layout(location = 0) rayPayloadInEXT PassableInfo pld;
@@ -48,37 +122,65 @@ HitInfo getObjectHitInfo()
   // Get the ID of the triangle
   const int primitiveID = gl_PrimitiveID;
 
-  // Get the indices of the vertices of the triangle
-  const uint i0 = indices[3 * primitiveID + 0];
-  const uint i1 = indices[3 * primitiveID + 1];
-  const uint i2 = indices[3 * primitiveID + 2];
-
-  // Get the vertices of the triangle
-  const vec3 v0 = vertices[i0];
-  const vec3 v1 = vertices[i1];
-  const vec3 v2 = vertices[i2];
+  // Look up the mesh of this instance
+  const GeometryInfo geometry = geometries[gl_InstanceCustomIndexEXT];
+  Indices            indices  = Indices(geometry.indexAddress);
 
+  // Get the indices of the vertices of the triangle
+  const uint i0 = getIndex(indices, geometry.indexBits, 3 * primitiveID + 0);
+  const uint i1 = getIndex(indices, geometry.indexBits, 3 * primitiveID + 1);
+  const uint i2 = getIndex(indices, geometry.indexBits, 3 * primitiveID + 2);
 
   // Get the barycentric coordinates of the intersection
   vec3 barycentrics = vec3(0.0, attributes.x, attributes.y);
   barycentrics.x    = 1.0 - barycentrics.y - barycentrics.z;
 
-  // Compute the coordinates of the intersection
-  result.objectPosition = v0 * barycentrics.x + v1 * barycentrics.y + v2 * barycentrics.z;
-  // Transform from object space to world space:
-  result.worldPosition = gl_ObjectToWorldEXT * vec4(result.objectPosition, 1.0f);
-
-
-  // Compute the normal of the triangle in object space, using the right-hand rule:
-  //    v2      .
-  //    |\      .
-  //    | \     .
-  //    |/ \    .
-  //    /   \   .
-  //   /|    \  .
-  //  L v0---v1 .
-  // n
-  const vec3 objectNormal = cross(v1 - v0, v2 - v0);
+  vec3 objectNormal;
+  if(geometry.quantizedPositionAddress != 0)
+  {
+    // Decode the triangle's vertices and normal from the quantized shading stream.
+    PackedHalves positions     = PackedHalves(geometry.quantizedPositionAddress);
+    PackedHalves normals       = PackedHalves(geometry.quantizedNormalAddress);
+    const vec3   positionMin   = vec3(geometry.positionMin[0], geometry.positionMin[1], geometry.positionMin[2]);
+    const vec3   positionScale = vec3(geometry.positionScale[0], geometry.positionScale[1], geometry.positionScale[2]);
+    const vec3   v0            = getQuantizedVertex(positions, i0, positionMin, positionScale);
+    const vec3   v1            = getQuantizedVertex(positions, i1, positionMin, positionScale);
+    const vec3   v2            = getQuantizedVertex(positions, i2, positionMin, positionScale);
+    const uint   normalWord    = normals.words[primitiveID >> 1];
+    objectNormal               = decodeOctahedralNormal(((primitiveID & 1) == 0) ? normalWord : (normalWord >> 16));
+
+    // The quantized positions are only accurate to half a quantization step,
+    // which is too far from the surface to start new rays from. But the BLAS
+    // used full-precision positions to find the hit distance, so we use that
+    // instead:
+    result.objectPosition = v0 * barycentrics.x + v1 * barycentrics.y + v2 * barycentrics.z;
+    result.worldPosition  = gl_WorldRayOriginEXT + gl_HitTEXT * gl_WorldRayDirectionEXT;
+  }
+  else
+  {
+    Vertices vertices = Vertices(geometry.vertexAddress);
+
+    // Get the vertices of the triangle
+    const vec3 v0 = getVertex(vertices, geometry.vertexStride, i0);
+    const vec3 v1 = getVertex(vertices, geometry.vertexStride, i1);
+    const vec3 v2 = getVertex(vertices, geometry.vertexStride, i2);
+
+    // Compute the coordinates of the intersection
+    result.objectPosition = v0 * barycentrics.x + v1 * barycentrics.y + v2 * barycentrics.z;
+    // Transform from object space to world space:
+    result.worldPosition = gl_ObjectToWorldEXT * vec4(result.objectPosition, 1.0f);
+
+    // Compute the normal of the triangle in object space, using the right-hand rule:
+    //    v2      .
+    //    |\      .
+    //    | \     .
+    //    |/ \    .
+    //    /   \   .
+    //   /|    \  .
+    //  L v0---v1 .
+    // n
+    objectNormal = cross(v1 - v0, v2 - v0);
+  }
   // Transform normals from object space to world space. These use the transpose of the inverse matrix,
   // because they're directions of normals, not positions:
   result.worldNormal = normalize((objectNormal * gl_WorldToObjectEXT).xyz);
@@ -0,0 +1,132 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+// Writes the TLAS instances of an instance grid (see instanceGenerator.h).
+// Each invocation writes one VkAccelerationStructureInstanceKHR: that of mesh
+// (index % numMeshes) in cell (index / numMeshes). All invocations of a cell
+// draw the same random numbers, since they seed their generator from the cell.
+#version 460
+#extension GL_EXT_scalar_block_layout : require
+#extension GL_EXT_buffer_reference : require
+#extension GL_GOOGLE_include_directive : require
+#include "../common.h"
+#include "shaderCommon.h"
+
+layout(local_size_x = INSTANCE_GEN_WORKGROUP_SIZE, local_size_y = 1, local_size_z = 1) in;
+
+layout(push_constant) uniform PushConsts
+{
+  InstanceGenParams params;
+};
+
+layout(buffer_reference, scalar) readonly buffer MeshTable
+{
+  GeneratedMesh meshes[];
+};
+
+// The layout of VkAccelerationStructureInstanceKHR. The 24-bit custom index
+// and SBT record offset share their words with the 8-bit mask and flags,
+// which are in the high bits.
+struct InstanceRecord
+{
+  float    transform[12];  // Row-major 3x4 matrix
+  uint     customIndexAndMask;
+  uint     sbtOffsetAndFlags;
+  uint64_t blasAddress;
+};
+layout(buffer_reference, scalar) writeonly buffer Instances
+{
+  InstanceRecord instances[];
+};
+
+// VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR, like the instances the CPU writes.
+const uint k_instanceFlags = 0x1;
+
+// Mixes the seed and the cell's index into the initial state of the random
+// number generator, so that neighboring cells get unrelated numbers.
+uint hashCell(uint seed, uint cell)
+{
+  uint h = seed ^ (cell * 0x9E3779B9u);
+  h      = (h ^ (h >> 16)) * 0x7FEB352Du;
+  h      = (h ^ (h >> 15)) * 0x846CA68Bu;
+  return h ^ (h >> 16);
+}
+
+// Returns a random value in [-1, 1].
+float randomSigned(inout uint rngState)
+{
+  return 2.0 * stepAndOutputRNGFloat(rngState) - 1.0;
+}
+
+mat4 rotationX(float angle)
+{
+  const float c = cos(angle), s = sin(angle);
+  return mat4(1, 0, 0, 0, 0, c, s, 0, 0, -s, c, 0, 0, 0, 0, 1);
+}
+
+mat4 rotationY(float angle)
+{
+  const float c = cos(angle), s = sin(angle);
+  return mat4(c, 0, -s, 0, 0, 1, 0, 0, s, 0, c, 0, 0, 0, 0, 1);
+}
+
+mat4 translation(vec3 t)
+{
+  return mat4(1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, t.x, t.y, t.z, 1);
+}
+
+void main()
+{
+  // Large grids dispatch several rows of workgroups, since a dispatch can
+  // only have so many workgroups along x.
+  const uint index    = gl_GlobalInvocationID.y * (gl_NumWorkGroups.x * INSTANCE_GEN_WORKGROUP_SIZE) + gl_GlobalInvocationID.x;
+  const uint numCells = params.gridSize[0] * params.gridSize[1] * params.gridSize[2];
+  if(index >= numCells * params.numMeshes)
+  {
+    return;
+  }
+  const uint  cell      = index / params.numMeshes;
+  const uint  meshIdx   = index % params.numMeshes;
+  const uvec3 cellCoord = uvec3(cell % params.gridSize[0], (cell / params.gridSize[0]) % params.gridSize[1],
+                                cell / (params.gridSize[0] * params.gridSize[1]));
+
+  // Draw the cell's random numbers, in the same order for every mesh.
+  uint        rngState = hashCell(params.seed, cell);
+  const float angleX   = params.maxRotation * randomSigned(rngState);
+  const float angleY   = params.maxRotation * randomSigned(rngState);
+  const float scale    = params.scale * (1.0 + params.scaleVariation * randomSigned(rngState));
+  const vec2  jitter   = params.jitter * params.spacing * vec2(randomSigned(rngState), randomSigned(rngState));
+  const float u        = stepAndOutputRNGFloat(rngState);
+  uint        material = 0;
+  while(material < 8 && u > params.materialCdf[material])
+  {
+    material++;
+  }
+
+  // Same order of transformations as expandInstanceGrid() on the CPU.
+  const vec3 gridOrigin   = vec3(params.gridOrigin[0], params.gridOrigin[1], params.gridOrigin[2]);
+  const vec3 cellPosition = gridOrigin + vec3(cellCoord.x, cellCoord.y, -float(cellCoord.z)) * params.spacing + vec3(jitter, 0.0);
+  mat4       transform    = translation(-vec3(params.center[0], params.center[1], params.center[2]));
+  transform               = rotationX(angleX) * transform;
+  transform               = rotationY(angleY) * transform;
+  transform               = mat4(mat3(scale)) * transform;
+  transform               = translation(cellPosition) * transform;
+
+  // Copies of a mesh that share a BLAS are moved by their offset first.
+  const MeshTable     meshTable = MeshTable(params.meshTableAddress);
+  const GeneratedMesh mesh      = meshTable.meshes[meshIdx];
+  transform[3]                  = transform * vec4(mesh.offset[0], mesh.offset[1], mesh.offset[2], 1.0);
+
+  InstanceRecord record;
+  for(int row = 0; row < 3; row++)
+  {
+    for(int column = 0; column < 4; column++)
+    {
+      record.transform[4 * row + column] = transform[column][row];
+    }
+  }
+  record.customIndexAndMask = (mesh.customIndex & 0xFFFFFF) | (0xFFu << 24);
+  record.sbtOffsetAndFlags  = material | (k_instanceFlags << 24);
+  record.blasAddress        = mesh.blasAddress;
+  Instances(params.instanceAddress).instances[index] = record;
+}
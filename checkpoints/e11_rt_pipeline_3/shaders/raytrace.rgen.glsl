@@ -17,6 +17,12 @@ layout(push_constant) uniform PushConsts
   PushConstants pushConstants;
 };
 
+// Push constants store vectors as float arrays; see common.h.
+vec3 toVec3(float v[3])
+{
+  return vec3(v[0], v[1], v[2]);
+}
+
 // Ray payloads are used to send information between shaders.
 layout(location = 0) rayPayloadEXT PassableInfo pld;
 
@@ -56,19 +62,23 @@ void main()
   // State of the random number generator with an initial seed.
   pld.rngState = uint((pushConstants.sample_batch * resolution.y + pixel.y) * resolution.x + pixel.x);
 
-  // This scene uses a right-handed coordinate system like the OBJ file format, where the
-  // +x axis points right, the +y axis points up, and the -z axis points into the screen.
-  // The camera is located at (-0.001, 0, 53).
-  const vec3 cameraOrigin = vec3(-0.001, 0.0, 53.0);
+  // This scene uses a right-handed coordinate system like the OBJ file format.
+  // The camera comes from the scene description; by default, it's located at
+  // (-0.001, 0, 53), and looks down the -z axis with +x pointing right and +y
+  // pointing up.
+  const vec3 cameraOrigin  = toVec3(pushConstants.cameraOrigin);
+  const vec3 cameraRight   = toVec3(pushConstants.cameraRight);
+  const vec3 cameraUp      = toVec3(pushConstants.cameraUp);
+  const vec3 cameraForward = toVec3(pushConstants.cameraForward);
   // Define the field of view by the vertical slope of the topmost rays:
-  const float fovVerticalSlope = 1.0 / 5.0;
+  const float fovVerticalSlope = pushConstants.fovVerticalSlope;
 
   // The sum of the colors of all of the samples.
   vec3 summedPixelColor = vec3(0.0);
 
-  // Limit the kernel to trace at most 64 samples.
-  const int NUM_SAMPLES = 64;
-  for(int sampleIdx = 0; sampleIdx < NUM_SAMPLES; sampleIdx++)
+  // Trace the number of samples per pixel the scene asks for.
+  const uint NUM_SAMPLES = pushConstants.samplesPerBatch;
+  for(uint sampleIdx = 0; sampleIdx < NUM_SAMPLES; sampleIdx++)
   {
     // Rays always originate at the camera for now. In the future, they'll
     // bounce around the scene.
@@ -89,13 +99,13 @@ void main()
     const vec2 screenUV          = vec2((2.0 * randomPixelCenter.x - resolution.x) / resolution.y,    //
                                -(2.0 * randomPixelCenter.y - resolution.y) / resolution.y);  // Flip the y axis
     // Create a ray direction:
-    vec3 rayDirection = vec3(fovVerticalSlope * screenUV.x, fovVerticalSlope * screenUV.y, -1.0);
+    vec3 rayDirection = cameraForward + fovVerticalSlope * (screenUV.x * cameraRight + screenUV.y * cameraUp);
     rayDirection      = normalize(rayDirection);
 
     vec3 accumulatedRayColor = vec3(1.0);  // The amount of light that made it to the end of the current ray.
 
-    // Limit the kernel to trace at most 32 segments.
-    for(int tracedSegments = 0; tracedSegments < 32; tracedSegments++)
+    // Limit the kernel to trace at most maxSegments segments.
+    for(uint tracedSegments = 0; tracedSegments < pushConstants.maxSegments; tracedSegments++)
     {
       // Trace the ray into the scene and get data back!
       traceRayEXT(tlas,                  // Top-level acceleration structure
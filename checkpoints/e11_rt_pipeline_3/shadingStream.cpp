@@ -0,0 +1,234 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+#include "shadingStream.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+#include <nvh/nvprint.hpp>
+
+#include "measurement.h"
+
+namespace {
+
+// Number of vertices or triangles each task processes at once. This is even,
+// so that every block of positions starts on a 4-byte boundary.
+const uint32_t k_blockSize = 1 << 16;
+
+// One block of vertices or triangles of a mesh.
+struct Block
+{
+  uint32_t mesh;
+  uint32_t begin;
+  uint32_t end;
+};
+
+float signNotZero(float value)
+{
+  return (value >= 0.0f) ? 1.0f : -1.0f;
+}
+
+// Decodes an octahedral normal; this matches decodeOctahedralNormal() in
+// shaders/closestHitCommon.h.
+void decodeOctahedral(int x, int y, float normal[3])
+{
+  normal[0]     = std::max(static_cast<float>(x) / 127.0f, -1.0f);
+  normal[1]     = std::max(static_cast<float>(y) / 127.0f, -1.0f);
+  normal[2]     = 1.0f - std::abs(normal[0]) - std::abs(normal[1]);
+  const float t = std::max(-normal[2], 0.0f);
+  normal[0] += (normal[0] >= 0.0f) ? -t : t;
+  normal[1] += (normal[1] >= 0.0f) ? -t : t;
+  const float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+  for(int c = 0; c < 3; c++)
+  {
+    normal[c] /= length;
+  }
+}
+
+// Encodes a unit vector using 8 bits for each octahedral coordinate. Since
+// rounding each coordinate independently doesn't always give the closest
+// direction, this tries all four neighboring grid points and keeps the best.
+uint16_t encodeOctahedral(const float normal[3])
+{
+  // Project onto the octahedron |x| + |y| + |z| = 1, and fold the lower half over the upper one:
+  const float l1 = std::abs(normal[0]) + std::abs(normal[1]) + std::abs(normal[2]);
+  float       u  = normal[0] / l1;
+  float       v  = normal[1] / l1;
+  if(normal[2] < 0.0f)
+  {
+    const float foldedU = (1.0f - std::abs(v)) * signNotZero(u);
+    v                   = (1.0f - std::abs(u)) * signNotZero(v);
+    u                   = foldedU;
+  }
+
+  int   bestX = 0, bestY = 0;
+  float bestDot = -std::numeric_limits<float>::infinity();
+  for(int candidate = 0; candidate < 4; candidate++)
+  {
+    const int x = std::clamp(static_cast<int>((candidate & 1) ? std::ceil(u * 127.0f) : std::floor(u * 127.0f)), -127, 127);
+    const int y = std::clamp(static_cast<int>((candidate & 2) ? std::ceil(v * 127.0f) : std::floor(v * 127.0f)), -127, 127);
+    float decoded[3];
+    decodeOctahedral(x, y, decoded);
+    const float dot = decoded[0] * normal[0] + decoded[1] * normal[1] + decoded[2] * normal[2];
+    if(dot > bestDot)
+    {
+      bestDot = dot;
+      bestX   = x;
+      bestY   = y;
+    }
+  }
+  return static_cast<uint16_t>(static_cast<uint8_t>(bestX) | (static_cast<uint8_t>(bestY) << 8));
+}
+
+std::vector<Block> makeBlocks(std::span<const MeshView> meshes, bool triangles)
+{
+  std::vector<Block> blocks;
+  for(uint32_t meshIdx = 0; meshIdx < meshes.size(); meshIdx++)
+  {
+    const uint32_t count = triangles ? meshes[meshIdx].numTriangles() : meshes[meshIdx].vertexCount;
+    for(uint32_t begin = 0; begin < count; begin += k_blockSize)
+    {
+      blocks.push_back({.mesh = meshIdx, .begin = begin, .end = std::min(count, begin + k_blockSize)});
+    }
+  }
+  return blocks;
+}
+
+}  // namespace
+
+void buildShadingStream(std::span<const MeshView> meshes, ThreadPool& pool, ShadingStream& stream)
+{
+  const auto startTime = std::chrono::steady_clock::now();
+
+  // Compute the bounding box of each block of vertices in parallel, then merge them per mesh.
+  const std::vector<Block> vertexBlocks = makeBlocks(meshes, false);
+  std::vector<float>       blockBounds(vertexBlocks.size() * 6);
+  pool.parallelFor(vertexBlocks.size(), [&](size_t blockIdx) {
+    const Block& block  = vertexBlocks[blockIdx];
+    float*       bounds = &blockBounds[blockIdx * 6];
+    for(int c = 0; c < 3; c++)
+    {
+      bounds[c]     = std::numeric_limits<float>::infinity();
+      bounds[c + 3] = -std::numeric_limits<float>::infinity();
+    }
+    for(uint32_t vertex = block.begin; vertex < block.end; vertex++)
+    {
+      float position[3];
+      meshes[block.mesh].readPosition(vertex, position);
+      for(int c = 0; c < 3; c++)
+      {
+        bounds[c]     = std::min(bounds[c], position[c]);
+        bounds[c + 3] = std::max(bounds[c + 3], position[c]);
+      }
+    }
+  });
+
+  // Lay out the meshes, starting each one on a 4-byte boundary so that
+  // shaders can read its data as uints.
+  stream.meshes.assign(meshes.size(), QuantizedMesh{});
+  std::vector<float> meshBounds(meshes.size() * 6);
+  for(size_t meshIdx = 0; meshIdx < meshes.size(); meshIdx++)
+  {
+    for(int c = 0; c < 3; c++)
+    {
+      meshBounds[meshIdx * 6 + c]     = std::numeric_limits<float>::infinity();
+      meshBounds[meshIdx * 6 + c + 3] = -std::numeric_limits<float>::infinity();
+    }
+  }
+  for(size_t blockIdx = 0; blockIdx < vertexBlocks.size(); blockIdx++)
+  {
+    float* bounds = &meshBounds[vertexBlocks[blockIdx].mesh * 6];
+    for(int c = 0; c < 3; c++)
+    {
+      bounds[c]     = std::min(bounds[c], blockBounds[blockIdx * 6 + c]);
+      bounds[c + 3] = std::max(bounds[c + 3], blockBounds[blockIdx * 6 + c + 3]);
+    }
+  }
+  size_t numPositions = 0, numNormals = 0;
+  for(size_t meshIdx = 0; meshIdx < meshes.size(); meshIdx++)
+  {
+    QuantizedMesh& quantized = stream.meshes[meshIdx];
+    for(int c = 0; c < 3; c++)
+    {
+      const float minimum = meshBounds[meshIdx * 6 + c];
+      const float extent  = meshBounds[meshIdx * 6 + c + 3] - minimum;
+      // Meshes without vertices have an empty bounding box:
+      quantized.positionMin[c]   = std::isfinite(minimum) ? minimum : 0.0f;
+      quantized.positionScale[c] = (extent > 0.0f) ? extent / 65535.0f : 0.0f;
+    }
+    quantized.positionsOffset = numPositions * sizeof(uint16_t);
+    quantized.normalsOffset   = numNormals * sizeof(uint16_t);
+    numPositions += (3 * static_cast<size_t>(meshes[meshIdx].vertexCount) + 1) & ~size_t(1);
+    numNormals += (static_cast<size_t>(meshes[meshIdx].numTriangles()) + 1) & ~size_t(1);
+  }
+  stream.positions.assign(numPositions, 0);
+  stream.normals.assign(numNormals, 0);
+
+  // Quantize the positions:
+  pool.parallelFor(vertexBlocks.size(), [&](size_t blockIdx) {
+    const Block&         block     = vertexBlocks[blockIdx];
+    const QuantizedMesh& quantized = stream.meshes[block.mesh];
+    uint16_t*            output    = &stream.positions[quantized.positionsOffset / sizeof(uint16_t)];
+    for(uint32_t vertex = block.begin; vertex < block.end; vertex++)
+    {
+      float position[3];
+      meshes[block.mesh].readPosition(vertex, position);
+      for(int c = 0; c < 3; c++)
+      {
+        const float scale = quantized.positionScale[c];
+        const float value = (scale > 0.0f) ? std::round((position[c] - quantized.positionMin[c]) / scale) : 0.0f;
+        output[3 * static_cast<size_t>(vertex) + c] = static_cast<uint16_t>(std::clamp(value, 0.0f, 65535.0f));
+      }
+    }
+  });
+
+  // Encode the face normals, computed from full-precision positions:
+  const std::vector<Block> triangleBlocks = makeBlocks(meshes, true);
+  pool.parallelFor(triangleBlocks.size(), [&](size_t blockIdx) {
+    const Block&    block  = triangleBlocks[blockIdx];
+    const MeshView& mesh   = meshes[block.mesh];
+    uint16_t*       output = &stream.normals[stream.meshes[block.mesh].normalsOffset / sizeof(uint16_t)];
+    for(uint32_t triangle = block.begin; triangle < block.end; triangle++)
+    {
+      float v[3][3];
+      for(uint32_t corner = 0; corner < 3; corner++)
+      {
+        mesh.readPosition(mesh.index(3 * triangle + corner), v[corner]);
+      }
+      const float e1[3] = {v[1][0] - v[0][0], v[1][1] - v[0][1], v[1][2] - v[0][2]};
+      const float e2[3] = {v[2][0] - v[0][0], v[2][1] - v[0][1], v[2][2] - v[0][2]};
+      float normal[3]   = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+      const float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+      if(length > 0.0f && std::isfinite(length))
+      {
+        for(int c = 0; c < 3; c++)
+        {
+          normal[c] /= length;
+        }
+      }
+      else
+      {
+        // Degenerate triangles can't be hit, but give them a valid normal anyway:
+        normal[0] = 0.0f;
+        normal[1] = 0.0f;
+        normal[2] = 1.0f;
+      }
+      output[triangle] = encodeOctahedral(normal);
+    }
+  });
+
+  size_t fullPrecisionBytes = 0;
+  for(const MeshView& mesh : meshes)
+  {
+    fullPrecisionBytes += 3 * sizeof(float) * static_cast<size_t>(mesh.vertexCount);
+  }
+  const size_t positionBytes = stream.positions.size() * sizeof(uint16_t);
+  const size_t normalBytes   = stream.normals.size() * sizeof(uint16_t);
+  LOGI("Built the quantized shading stream for %zu meshes in %.3f ms.\n", meshes.size(), millisecondsSince(startTime));
+  LOGI("  Positions: %.3f MB; normals: %.3f MB; %.3f MB in total, versus %.3f MB of full-precision positions (%.1f%%).\n",
+       toMB(positionBytes), toMB(normalBytes), toMB(positionBytes + normalBytes), toMB(fullPrecisionBytes),
+       (fullPrecisionBytes > 0) ? 100.0 * static_cast<double>(positionBytes + normalBytes) / static_cast<double>(fullPrecisionBytes) : 0.0);
+  LOGI("  Each hit reads 20 bytes of vertex data (3 positions and a normal) instead of 36.\n");
+}
@@ -0,0 +1,46 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+// A compact copy of the geometry data closest-hit shaders read. Acceleration
+// structure builds need full-precision positions, but shading only needs
+// each hit's object-space position (for procedural materials) and its
+// normal. So for each mesh, this stores:
+// - positions as three 16-bit unorm values relative to the mesh's bounding
+//   box (6 bytes per vertex instead of 12), and
+// - one face normal per triangle in 16-bit octahedral encoding, computed
+//   from the full-precision positions, so that normals of small triangles
+//   don't suffer from position quantization.
+// Shaders then compute the hit position that new rays start from using the
+// ray's hit distance, which the full-precision BLAS determined.
+#ifndef VK_MINI_PATH_TRACER_SHADING_STREAM_H
+#define VK_MINI_PATH_TRACER_SHADING_STREAM_H
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "meshView.h"
+#include "threadPool.h"
+
+// How to find and decode the shading data of one mesh.
+struct QuantizedMesh
+{
+  float    positionMin[3];    // Position = positionMin + quantized * positionScale
+  float    positionScale[3];  // Bounding box extent / 65535
+  uint64_t positionsOffset;   // Byte offset in ShadingStream::positions; 4-byte aligned
+  uint64_t normalsOffset;     // Byte offset in ShadingStream::normals; 4-byte aligned
+};
+
+class ShadingStream
+{
+public:
+  std::vector<uint16_t>      positions;  // 3 per vertex
+  std::vector<uint16_t>      normals;    // 1 per triangle: x in the low byte, y in the high byte
+  std::vector<QuantizedMesh> meshes;
+};
+
+// Builds the shading stream for `meshes`, and logs how its size compares to
+// full-precision vertices.
+void buildShadingStream(std::span<const MeshView> meshes, ThreadPool& pool, ShadingStream& stream);
+
+#endif  // #ifndef VK_MINI_PATH_TRACER_SHADING_STREAM_H
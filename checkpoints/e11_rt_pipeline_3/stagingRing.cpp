@@ -0,0 +1,184 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+#include "stagingRing.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <nvh/nvprint.hpp>
+#include <nvvk/error_vk.hpp>
+
+#include "measurement.h"
+
+void StagingRing::init(VkDevice                 device,
+                       VkQueue                  queue,
+                       uint32_t                 queueFamilyIndex,
+                       nvvk::ResourceAllocator& allocator,
+                       VkDeviceSize             size,
+                       uint32_t                 numSegments)
+{
+  m_device      = device;
+  m_queue       = queue;
+  m_allocator   = &allocator;
+  m_segmentSize = std::max<VkDeviceSize>(1, size / numSegments);
+
+  // The ring stays mapped for its whole lifetime. Host-coherent memory means
+  // we don't need to flush after writing to it.
+  m_buffer = allocator.createBuffer(m_segmentSize * numSegments, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  m_mapped = reinterpret_cast<uint8_t*>(allocator.map(m_buffer));
+
+  // Each segment has its own command buffer, reset whenever the segment is reused.
+  VkCommandPoolCreateInfo cmdPoolInfo{.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+                                      .flags            = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+                                      .queueFamilyIndex = queueFamilyIndex};
+  NVVK_CHECK(vkCreateCommandPool(device, &cmdPoolInfo, nullptr, &m_cmdPool));
+  m_segments.resize(numSegments);
+  std::vector<VkCommandBuffer> cmdBuffers(numSegments);
+  VkCommandBufferAllocateInfo  cmdAllocInfo{.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+                                            .commandPool        = m_cmdPool,
+                                            .level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+                                            .commandBufferCount = numSegments};
+  NVVK_CHECK(vkAllocateCommandBuffers(device, &cmdAllocInfo, cmdBuffers.data()));
+  for(uint32_t i = 0; i < numSegments; i++)
+  {
+    m_segments[i].cmdBuffer = cmdBuffers[i];
+  }
+
+  // A timeline semaphore lets us track every submission with a single object,
+  // instead of one fence per segment.
+  VkSemaphoreTypeCreateInfo semaphoreTypeInfo{.sType         = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+                                              .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+                                              .initialValue  = 0};
+  VkSemaphoreCreateInfo     semaphoreInfo{.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO, .pNext = &semaphoreTypeInfo};
+  NVVK_CHECK(vkCreateSemaphore(device, &semaphoreInfo, nullptr, &m_timeline));
+  m_lastSignaledValue = 0;
+  m_currentSegment    = 0;
+  m_segmentUsed       = 0;
+  m_recording         = false;
+}
+
+void StagingRing::deinit()
+{
+  if(m_device == VK_NULL_HANDLE)
+  {
+    return;
+  }
+  finish();
+  vkDestroySemaphore(m_device, m_timeline, nullptr);
+  vkDestroyCommandPool(m_device, m_cmdPool, nullptr);  // Also frees the command buffers
+  m_allocator->unmap(m_buffer);
+  m_allocator->destroy(m_buffer);
+  m_segments.clear();
+  m_mapped = nullptr;
+  m_device = VK_NULL_HANDLE;
+}
+
+void StagingRing::waitForValue(uint64_t value)
+{
+  VkSemaphoreWaitInfo waitInfo{.sType          = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+                               .semaphoreCount = 1,
+                               .pSemaphores    = &m_timeline,
+                               .pValues        = &value};
+  NVVK_CHECK(vkWaitSemaphores(m_device, &waitInfo, UINT64_MAX));
+}
+
+void StagingRing::beginSegment()
+{
+  Segment& segment = m_segments[m_currentSegment];
+  // Wait until the GPU has finished copying out of this segment the last time we used it:
+  const Clock::time_point waitStart = Clock::now();
+  waitForValue(segment.timelineValue);
+  m_waitMs += millisecondsSince(waitStart);
+
+  NVVK_CHECK(vkResetCommandBuffer(segment.cmdBuffer, 0));
+  VkCommandBufferBeginInfo beginInfo{.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+                                     .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT};
+  NVVK_CHECK(vkBeginCommandBuffer(segment.cmdBuffer, &beginInfo));
+  m_segmentUsed = 0;
+  m_recording   = true;
+}
+
+void StagingRing::submitSegment()
+{
+  Segment& segment = m_segments[m_currentSegment];
+  // Make the copied data visible to everything that runs after this on the
+  // queue, such as acceleration structure builds and shaders:
+  VkMemoryBarrier barrier{.sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                          .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+                          .dstAccessMask = VK_ACCESS_MEMORY_READ_BIT};
+  vkCmdPipelineBarrier(segment.cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 1,
+                       &barrier, 0, nullptr, 0, nullptr);
+  NVVK_CHECK(vkEndCommandBuffer(segment.cmdBuffer));
+
+  segment.timelineValue = ++m_lastSignaledValue;
+  VkTimelineSemaphoreSubmitInfo timelineInfo{.sType                     = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+                                             .signalSemaphoreValueCount = 1,
+                                             .pSignalSemaphoreValues    = &segment.timelineValue};
+  VkSubmitInfo                  submitInfo{.sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+                                           .pNext                = &timelineInfo,
+                                           .commandBufferCount   = 1,
+                                           .pCommandBuffers      = &segment.cmdBuffer,
+                                           .signalSemaphoreCount = 1,
+                                           .pSignalSemaphores    = &m_timeline};
+  NVVK_CHECK(vkQueueSubmit(m_queue, 1, &submitInfo, VK_NULL_HANDLE));
+  m_numSubmits++;
+
+  m_currentSegment = (m_currentSegment + 1) % static_cast<uint32_t>(m_segments.size());
+  m_recording      = false;
+}
+
+void StagingRing::upload(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void* data, VkDeviceSize size)
+{
+  if(m_bytesUploaded == 0 && m_numSubmits == 0 && !m_recording)
+  {
+    m_startTime = Clock::now();
+  }
+
+  const uint8_t* src = reinterpret_cast<const uint8_t*>(data);
+  while(size > 0)
+  {
+    if(!m_recording)
+    {
+      beginSegment();
+    }
+    if(m_segmentUsed == m_segmentSize)
+    {
+      submitSegment();
+      continue;
+    }
+
+    // Copy as much as fits into the current segment, and record a copy from there:
+    const VkDeviceSize chunkSize  = std::min(size, m_segmentSize - m_segmentUsed);
+    const VkDeviceSize ringOffset = m_currentSegment * m_segmentSize + m_segmentUsed;
+    memcpy(m_mapped + ringOffset, src, chunkSize);
+    const VkBufferCopy region{.srcOffset = ringOffset, .dstOffset = dstOffset, .size = chunkSize};
+    vkCmdCopyBuffer(m_segments[m_currentSegment].cmdBuffer, m_buffer.buffer, dstBuffer, 1, &region);
+
+    m_segmentUsed += chunkSize;
+    m_bytesUploaded += chunkSize;
+    src += chunkSize;
+    dstOffset += chunkSize;
+    size -= chunkSize;
+  }
+}
+
+void StagingRing::finish()
+{
+  if(m_recording)
+  {
+    submitSegment();
+  }
+  waitForValue(m_lastSignaledValue);
+
+  if(m_bytesUploaded > 0)
+  {
+    const double totalMs = millisecondsSince(m_startTime);
+    const double mb      = toMB(m_bytesUploaded);
+    LOGI("Staging ring uploaded %.3f MB in %.3f ms (%.2f MB/s) using %u submits and %.3f MB of staging memory; waited %.3f ms for free segments.\n",
+         mb, totalMs, mb * 1000.0 / totalMs, m_numSubmits, toMB(m_segmentSize * m_segments.size()), m_waitMs);
+  }
+  m_bytesUploaded = 0;
+  m_numSubmits    = 0;
+  m_waitMs        = 0.0;
+}
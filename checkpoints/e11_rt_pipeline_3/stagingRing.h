@@ -0,0 +1,79 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+// A fixed-size, persistently mapped staging buffer for streaming data into
+// device-local buffers. Creating buffers with data through the allocator
+// allocates a staging copy as large as each buffer and then waits for the
+// queue to go idle; for scenes larger than free host memory, this doesn't work.
+//
+// Instead, the ring is split into segments. The CPU fills one segment while
+// the GPU copies from the segments submitted before it. Each submission
+// signals a new value on a timeline semaphore, and a segment is only reused
+// once the GPU has reached the value of its last submission. This way, host
+// memory used for staging never exceeds the size of the ring.
+#ifndef VK_MINI_PATH_TRACER_STAGING_RING_H
+#define VK_MINI_PATH_TRACER_STAGING_RING_H
+
+#include <chrono>
+#include <vector>
+
+#include <nvvk/resourceallocator_vk.hpp>
+
+class StagingRing
+{
+public:
+  // Creates a ring of `size` bytes split into `numSegments` segments, whose
+  // copies will be submitted to `queue`.
+  void init(VkDevice                 device,
+            VkQueue                  queue,
+            uint32_t                 queueFamilyIndex,
+            nvvk::ResourceAllocator& allocator,
+            VkDeviceSize             size,
+            uint32_t                 numSegments = 4);
+  void deinit();
+
+  // Copies `size` bytes at `data` to `dstBuffer` at `dstOffset`. This returns
+  // once the data is in the ring; the GPU may still be copying it.
+  void upload(VkBuffer dstBuffer, VkDeviceSize dstOffset, const void* data, VkDeviceSize size);
+
+  // Submits any pending copies, waits for all copies to finish, and logs the
+  // upload bandwidth since the last call to finish().
+  void finish();
+
+private:
+  struct Segment
+  {
+    VkCommandBuffer cmdBuffer     = VK_NULL_HANDLE;
+    uint64_t        timelineValue = 0;  // Value signaled once the GPU is done with this segment
+  };
+
+  // Waits until the current segment is free and starts recording into it.
+  void beginSegment();
+  // Ends the current segment's command buffer, submits it, and moves on to the next segment.
+  void submitSegment();
+  // Waits on the host until the timeline semaphore reaches `value`.
+  void waitForValue(uint64_t value);
+
+  VkDevice                 m_device    = VK_NULL_HANDLE;
+  VkQueue                  m_queue     = VK_NULL_HANDLE;
+  nvvk::ResourceAllocator* m_allocator = nullptr;
+  nvvk::Buffer             m_buffer;
+  uint8_t*                 m_mapped            = nullptr;
+  VkCommandPool            m_cmdPool           = VK_NULL_HANDLE;
+  VkSemaphore              m_timeline          = VK_NULL_HANDLE;
+  uint64_t                 m_lastSignaledValue = 0;
+  std::vector<Segment>     m_segments;
+  VkDeviceSize             m_segmentSize    = 0;
+  uint32_t                 m_currentSegment = 0;
+  VkDeviceSize             m_segmentUsed    = 0;  // Bytes written to the current segment
+  bool                     m_recording      = false;
+
+  // Statistics since the last call to finish():
+  using Clock = std::chrono::steady_clock;
+  Clock::time_point m_startTime;
+  uint64_t          m_bytesUploaded = 0;
+  uint32_t          m_numSubmits    = 0;
+  double            m_waitMs        = 0.0;  // Time the CPU spent waiting for free segments
+};
+
+#endif  // #ifndef VK_MINI_PATH_TRACER_STAGING_RING_H
@@ -0,0 +1,131 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+#include "taskGraph.h"
+
+#include <algorithm>
+#include <cassert>
+
+#include <nvh/nvprint.hpp>
+
+#include "measurement.h"
+
+TaskGraph::TaskId TaskGraph::add(std::string name, std::vector<TaskId> dependencies, std::function<void()> fn)
+{
+  const TaskId id = static_cast<TaskId>(m_tasks.size());
+  for(TaskId dependency : dependencies)
+  {
+    assert(dependency < id);
+    m_tasks[dependency].dependents.push_back(id);
+  }
+  m_tasks.push_back({.name = std::move(name), .dependencies = std::move(dependencies), .dependents = {}, .fn = std::move(fn)});
+  return id;
+}
+
+double TaskGraph::elapsedMs() const
+{
+  return millisecondsSince(m_startTime);
+}
+
+void TaskGraph::run(ThreadPool& pool)
+{
+  m_startTime   = std::chrono::steady_clock::now();
+  m_numFinished = 0;
+  std::vector<TaskId> roots;
+  for(TaskId id = 0; id < m_tasks.size(); id++)
+  {
+    m_tasks[id].remainingDependencies = static_cast<uint32_t>(m_tasks[id].dependencies.size());
+    if(m_tasks[id].dependencies.empty())
+    {
+      roots.push_back(id);
+    }
+  }
+  for(TaskId id : roots)
+  {
+    start(id, pool);
+  }
+
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_allFinished.wait(lock, [this]() { return m_numFinished == m_tasks.size(); });
+}
+
+void TaskGraph::start(TaskId id, ThreadPool& pool)
+{
+  // Nothing waits on the future; run() waits for m_numFinished instead.
+  pool.submit([this, id, &pool]() {
+    Task& task   = m_tasks[id];
+    task.startMs = elapsedMs();
+    task.fn();
+    task.endMs = elapsedMs();
+
+    std::vector<TaskId> ready;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      for(TaskId dependent : task.dependents)
+      {
+        if(--m_tasks[dependent].remainingDependencies == 0)
+        {
+          ready.push_back(dependent);
+        }
+      }
+      // Notify while holding the lock, so that run() can't return (and this
+      // object can't be destroyed) before we're done with it.
+      if(++m_numFinished == m_tasks.size())
+      {
+        m_allFinished.notify_all();
+      }
+    }
+    for(TaskId dependent : ready)
+    {
+      start(dependent, pool);
+    }
+  });
+}
+
+void TaskGraph::logTimings(const char* title) const
+{
+  if(m_tasks.empty())
+  {
+    return;
+  }
+
+  std::vector<TaskId> order(m_tasks.size());
+  for(TaskId id = 0; id < order.size(); id++)
+  {
+    order[id] = id;
+  }
+  std::ranges::stable_sort(order, {}, [this](TaskId id) { return m_tasks[id].startMs; });
+
+  double totalMs = 0.0, wallMs = 0.0;
+  for(const Task& task : m_tasks)
+  {
+    totalMs += task.endMs - task.startMs;
+    wallMs = std::max(wallMs, task.endMs);
+  }
+  LOGI("%s took %.3f ms (%.3f ms of work in %zu stages):\n", title, wallMs, totalMs, m_tasks.size());
+  LOGI("  %-16s %12s %12s %12s\n", "Stage", "Start (ms)", "End (ms)", "Time (ms)");
+  for(TaskId id : order)
+  {
+    const Task& task = m_tasks[id];
+    LOGI("  %-16s %12.3f %12.3f %12.3f\n", task.name.c_str(), task.startMs, task.endMs, task.endMs - task.startMs);
+  }
+
+  // Walk back from the task that finished last, each time to the dependency
+  // that finished last. Any time between that dependency's end and the
+  // task's start was spent waiting for a free worker.
+  TaskId current = *std::ranges::max_element(order, {}, [this](TaskId id) { return m_tasks[id].endMs; });
+  std::vector<TaskId> path = {current};
+  while(!m_tasks[current].dependencies.empty())
+  {
+    current = *std::ranges::max_element(m_tasks[current].dependencies, {}, [this](TaskId id) { return m_tasks[id].endMs; });
+    path.push_back(current);
+  }
+  std::string pathText;
+  double      pathMs = 0.0;
+  for(auto it = path.rbegin(); it != path.rend(); ++it)
+  {
+    const Task& task = m_tasks[*it];
+    pathText += (pathText.empty() ? "" : " -> ") + task.name;
+    pathMs += task.endMs - task.startMs;
+  }
+  LOGI("  Critical path (%.3f ms of work): %s\n", pathMs, pathText.c_str());
+}
@@ -0,0 +1,63 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+// A small dependency graph of tasks that runs on a ThreadPool. Each task
+// starts as soon as all tasks it depends on have finished, so independent
+// tasks (such as parsing a scene and creating a Vulkan device) overlap.
+// The graph records when each task ran, and can log a timing breakdown
+// along with the critical path: the chain of dependencies that determined
+// when the last task finished.
+#ifndef VK_MINI_PATH_TRACER_TASK_GRAPH_H
+#define VK_MINI_PATH_TRACER_TASK_GRAPH_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "threadPool.h"
+
+class TaskGraph
+{
+public:
+  using TaskId = uint32_t;
+
+  // Adds a task named `name` that calls `fn` once all of `dependencies` have
+  // finished. Dependencies must have been added before, so the graph can't
+  // contain cycles. Tasks must not throw.
+  TaskId add(std::string name, std::vector<TaskId> dependencies, std::function<void()> fn);
+
+  // Runs all tasks on `pool`, and returns once all of them have finished.
+  // Tasks may call pool.parallelFor().
+  void run(ThreadPool& pool);
+
+  // Logs when each task started and how long it took, then the critical path.
+  void logTimings(const char* title) const;
+
+private:
+  struct Task
+  {
+    std::string           name;
+    std::vector<TaskId>   dependencies;
+    std::vector<TaskId>   dependents;
+    std::function<void()> fn;
+    uint32_t              remainingDependencies = 0;
+    double                startMs               = 0.0;  // Relative to the start of run()
+    double                endMs                 = 0.0;
+  };
+
+  // Submits task `id` to `pool`; when it finishes, it starts the dependents it was the last dependency of.
+  void start(TaskId id, ThreadPool& pool);
+  double elapsedMs() const;
+
+  std::vector<Task>                     m_tasks;
+  std::chrono::steady_clock::time_point m_startTime;
+  std::mutex                            m_mutex;
+  std::condition_variable               m_allFinished;
+  size_t                                m_numFinished = 0;
+};
+
+#endif  // #ifndef VK_MINI_PATH_TRACER_TASK_GRAPH_H
@@ -0,0 +1,115 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+#include "threadPool.h"
+
+#include <algorithm>
+#include <atomic>
+
+uint32_t ThreadPool::defaultNumThreads()
+{
+  return std::max(1u, std::thread::hardware_concurrency());
+}
+
+ThreadPool::ThreadPool(uint32_t numThreads)
+{
+  m_workers.reserve(numThreads);
+  for(uint32_t i = 0; i < numThreads; i++)
+  {
+    m_workers.emplace_back([this]() { workerLoop(); });
+  }
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = true;
+  }
+  m_jobAvailable.notify_all();
+  for(std::thread& worker : m_workers)
+  {
+    worker.join();
+  }
+}
+
+void ThreadPool::enqueue(std::function<void()>&& job)
+{
+  if(m_workers.empty())
+  {
+    job();
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_jobs.push_back(std::move(job));
+  }
+  m_jobAvailable.notify_one();
+}
+
+void ThreadPool::workerLoop()
+{
+  while(true)
+  {
+    std::function<void()> job;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_jobAvailable.wait(lock, [this]() { return m_stopping || !m_jobs.empty(); });
+      if(m_jobs.empty())
+      {
+        return;  // Stopping, and there's no work left
+      }
+      job = std::move(m_jobs.front());
+      m_jobs.pop_front();
+    }
+    job();
+  }
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& fn)
+{
+  if(count == 0)
+  {
+    return;
+  }
+  if(count == 1)
+  {
+    fn(0);
+    return;
+  }
+
+  // Each participating thread claims indices from `next` until they run out.
+  // The calling thread participates too, so this makes progress even if all
+  // workers are busy (e.g. when called from inside a worker).
+  struct SharedState
+  {
+    std::atomic<size_t>     next{0};
+    std::atomic<size_t>     finished{0};
+    std::mutex              mutex;
+    std::condition_variable done;
+  };
+  auto       state      = std::make_shared<SharedState>();
+  const auto runIndices = [state, count, &fn]() {
+    size_t index;
+    while((index = state->next.fetch_add(1)) < count)
+    {
+      fn(index);
+      if(state->finished.fetch_add(1) + 1 == count)
+      {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->done.notify_all();
+      }
+    }
+  };
+
+  // Helpers that start after all indices were claimed return immediately, so
+  // they never touch `fn` after this function returns.
+  const size_t numHelpers = std::min(count - 1, m_workers.size());
+  for(size_t i = 0; i < numHelpers; i++)
+  {
+    enqueue(runIndices);
+  }
+  runIndices();
+
+  std::unique_lock<std::mutex> lock(state->mutex);
+  state->done.wait(lock, [&state, count]() { return state->finished.load() == count; });
+}
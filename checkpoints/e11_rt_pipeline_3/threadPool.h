@@ -0,0 +1,63 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+// A small fixed-size pool of worker threads, used to parallelize CPU-side
+// loading work.
+#ifndef VK_MINI_PATH_TRACER_THREAD_POOL_H
+#define VK_MINI_PATH_TRACER_THREAD_POOL_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+class ThreadPool
+{
+public:
+  // Creates `numThreads` workers. With 0 workers, all work runs on the
+  // calling thread.
+  explicit ThreadPool(uint32_t numThreads = defaultNumThreads());
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&)            = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  uint32_t numThreads() const { return static_cast<uint32_t>(m_workers.size()); }
+
+  // One worker per hardware thread.
+  static uint32_t defaultNumThreads();
+
+  // Calls fn(i) for every i in [0, count), spread over the workers and the
+  // calling thread, and returns once all calls have finished. This may be
+  // called from inside a worker.
+  void parallelFor(size_t count, const std::function<void(size_t)>& fn);
+
+  // Runs `fn` on a worker and returns a future for its result.
+  template <class Fn>
+  std::future<std::invoke_result_t<Fn>> submit(Fn&& fn)
+  {
+    using Result = std::invoke_result_t<Fn>;
+    auto task    = std::make_shared<std::packaged_task<Result()>>(std::forward<Fn>(fn));
+    std::future<Result> result = task->get_future();
+    enqueue([task]() { (*task)(); });
+    return result;
+  }
+
+private:
+  void enqueue(std::function<void()>&& job);
+  void workerLoop();
+
+  std::vector<std::thread>          m_workers;
+  std::deque<std::function<void()>> m_jobs;
+  std::mutex                        m_mutex;
+  std::condition_variable           m_jobAvailable;
+  bool                              m_stopping = false;
+};
+
+#endif  // #ifndef VK_MINI_PATH_TRACER_THREAD_POOL_H
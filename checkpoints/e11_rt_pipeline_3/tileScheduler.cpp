@@ -0,0 +1,198 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+#include "tileScheduler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <numeric>
+
+#include <nvh/nvprint.hpp>
+
+#include "measurement.h"
+#include "threadPool.h"
+
+namespace {
+
+// Spreads the low 16 bits of `v` out so that there is a zero bit between each of them.
+uint32_t expandBits16(uint32_t v)
+{
+  v &= 0xFFFF;
+  v = (v | (v << 8)) & 0x00FF00FF;
+  v = (v | (v << 4)) & 0x0F0F0F0F;
+  v = (v | (v << 2)) & 0x33333333;
+  v = (v | (v << 1)) & 0x55555555;
+  return v;
+}
+
+// The tiles [begin, end) a slot has left, as indices into the Morton-ordered
+// tiles, packed into one word: begin in the low and end in the high 32 bits.
+// Each range sits in its own cache line, so that threads taking tiles from
+// their own ranges don't slow each other down.
+struct alignas(64) TileRange
+{
+  std::atomic<uint64_t> packed{0};
+};
+
+uint64_t packRange(uint32_t begin, uint32_t end)
+{
+  return (uint64_t(end) << 32) | begin;
+}
+uint32_t rangeBegin(uint64_t packed)
+{
+  return static_cast<uint32_t>(packed);
+}
+uint32_t rangeEnd(uint64_t packed)
+{
+  return static_cast<uint32_t>(packed >> 32);
+}
+
+// Takes the first tile of `range`. Returns false if it is empty.
+bool popFront(TileRange& range, uint32_t& tileIdx)
+{
+  uint64_t packed = range.packed.load();
+  while(rangeBegin(packed) < rangeEnd(packed))
+  {
+    // If a thief changed the range in the meantime, this reloads it and tries again.
+    if(range.packed.compare_exchange_weak(packed, packRange(rangeBegin(packed) + 1, rangeEnd(packed))))
+    {
+      tileIdx = rangeBegin(packed);
+      return true;
+    }
+  }
+  return false;
+}
+
+// Steals the back half of the tiles of the slot with the most tiles left:
+// returns the first stolen tile, and puts the others into the range of
+// `thief`, which must be empty. Returns false if no slot has tiles left.
+//
+// The first tile of a range only leaves it to be rendered, so a range never
+// returns to a value a thief loaded before it changed, and compare-and-swap
+// can't mistake a changed range for the one the thief split.
+bool steal(std::vector<TileRange>& ranges, size_t thief, uint32_t& tileIdx)
+{
+  while(true)
+  {
+    size_t   victim       = thief;
+    uint64_t victimPacked = 0;
+    uint32_t mostTiles    = 0;
+    for(size_t i = 1; i < ranges.size(); i++)
+    {
+      const size_t   candidate = (thief + i) % ranges.size();
+      const uint64_t packed    = ranges[candidate].packed.load();
+      const uint32_t numTiles  = rangeEnd(packed) - rangeBegin(packed);
+      if(numTiles > mostTiles)
+      {
+        victim       = candidate;
+        victimPacked = packed;
+        mostTiles    = numTiles;
+      }
+    }
+    if(mostTiles == 0)
+    {
+      return false;
+    }
+
+    const uint32_t begin  = rangeBegin(victimPacked);
+    const uint32_t end    = rangeEnd(victimPacked);
+    const uint32_t newEnd = end - (mostTiles + 1) / 2;
+    if(ranges[victim].packed.compare_exchange_strong(victimPacked, packRange(begin, newEnd)))
+    {
+      tileIdx = newEnd;
+      ranges[thief].packed.store(packRange(newEnd + 1, end));
+      return true;
+    }
+    // The victim or another thief took tiles in the meantime; look again.
+  }
+}
+
+}  // namespace
+
+void TileSchedulerStats::add(const TileSchedulerStats& other)
+{
+  wallMs += other.wallMs;
+  slots.resize(std::max(slots.size(), other.slots.size()));
+  for(size_t i = 0; i < other.slots.size(); i++)
+  {
+    slots[i].tiles += other.slots[i].tiles;
+    slots[i].steals += other.slots[i].steals;
+    slots[i].busyMs += other.slots[i].busyMs;
+  }
+}
+
+TileSchedulerStats parallelForTiles(uint32_t                                width,
+                                    uint32_t                                height,
+                                    uint32_t                                tileSize,
+                                    ThreadPool&                             threadPool,
+                                    const std::function<void(const Tile&)>& renderTile)
+{
+  const auto startTime = std::chrono::steady_clock::now();
+
+  // Sort the tiles along a Morton curve.
+  const uint32_t        numTilesX = (width + tileSize - 1) / tileSize;
+  const uint32_t        numTilesY = (height + tileSize - 1) / tileSize;
+  std::vector<uint32_t> mortonCodes;
+  std::vector<Tile>     tiles;
+  for(uint32_t tileY = 0; tileY < numTilesY; tileY++)
+  {
+    for(uint32_t tileX = 0; tileX < numTilesX; tileX++)
+    {
+      tiles.push_back({.x      = tileX * tileSize,
+                       .y      = tileY * tileSize,
+                       .width  = std::min(tileSize, width - tileX * tileSize),
+                       .height = std::min(tileSize, height - tileY * tileSize)});
+      mortonCodes.push_back(expandBits16(tileX) | (expandBits16(tileY) << 1));
+    }
+  }
+  std::vector<uint32_t> order(tiles.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return mortonCodes[a] < mortonCodes[b]; });
+
+  // Give each slot an equal share of the curve to start with.
+  const size_t           numSlots = size_t(threadPool.numThreads()) + 1;
+  const size_t           numTiles = tiles.size();
+  std::vector<TileRange> ranges(numSlots);
+  for(size_t slot = 0; slot < numSlots; slot++)
+  {
+    ranges[slot].packed.store(packRange(static_cast<uint32_t>(slot * numTiles / numSlots),
+                                        static_cast<uint32_t>((slot + 1) * numTiles / numSlots)));
+  }
+
+  TileSchedulerStats stats;
+  stats.slots.resize(numSlots);
+  threadPool.parallelFor(numSlots, [&](size_t slot) {
+    TileSlotStats& slotStats = stats.slots[slot];
+    uint32_t       tileIdx;
+    while(true)
+    {
+      if(!popFront(ranges[slot], tileIdx))
+      {
+        if(!steal(ranges, slot, tileIdx))
+        {
+          break;
+        }
+        slotStats.steals++;
+      }
+      const auto tileStartTime = std::chrono::steady_clock::now();
+      renderTile(tiles[order[tileIdx]]);
+      slotStats.busyMs += millisecondsSince(tileStartTime);
+      slotStats.tiles++;
+    }
+  });
+
+  stats.wallMs = millisecondsSince(startTime);
+  return stats;
+}
+
+void logTileSchedulerStats(const TileSchedulerStats& stats)
+{
+  LOGI("Tile scheduling over %.3f ms, per parallelFor() slot:\n", stats.wallMs);
+  LOGI("  %-8s %12s %8s %8s\n", "Slot", "Utilization", "Tiles", "Steals");
+  for(size_t slot = 0; slot < stats.slots.size(); slot++)
+  {
+    const TileSlotStats& slotStats = stats.slots[slot];
+    LOGI("  %-8zu %11.1f%% %8u %8u\n", slot, 100.0 * slotStats.busyMs / std::max(stats.wallMs, 1e-9), slotStats.tiles,
+         slotStats.steals);
+  }
+}
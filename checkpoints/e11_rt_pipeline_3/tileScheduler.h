@@ -0,0 +1,71 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+// Spreads the tiles of an image over the thread pool by work stealing, for
+// the CPU renderer (see cpuRenderer.h). How long a pixel takes varies by
+// orders of magnitude: paths that leave through the sky end after one
+// segment, while paths inside the instanced boxes can bounce 32 times. So
+// instead of handing out fixed shares of the image, each slot (one per
+// thread, see TileSchedulerStats) starts with its own share of the tiles and
+// renders them in order, and when it runs out, it steals half of the
+// remaining tiles of the slot with the most left.
+//
+// The tiles are sorted along a Morton (Z-order) curve, so each slot's share
+// and each stolen half covers a compact region of the image, whose rays touch
+// similar parts of the scene. Each slot's tiles are a range [begin, end) of
+// this order, its deque: the owner takes tiles from the front, and thieves
+// split ranges off the back, both with a compare-and-swap on the range, so
+// no thread ever waits on a lock.
+#ifndef VK_MINI_PATH_TRACER_TILE_SCHEDULER_H
+#define VK_MINI_PATH_TRACER_TILE_SCHEDULER_H
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+class ThreadPool;
+
+// A rectangle of pixels.
+struct Tile
+{
+  uint32_t x;
+  uint32_t y;
+  uint32_t width;
+  uint32_t height;
+};
+
+// What one slot did in parallelForTiles().
+struct TileSlotStats
+{
+  uint32_t tiles  = 0;    // Tiles rendered
+  uint32_t steals = 0;    // Ranges of tiles stolen from other slots
+  double   busyMs = 0.0;  // Time spent rendering tiles
+};
+
+struct TileSchedulerStats
+{
+  double wallMs = 0.0;
+  // One entry per slot: one per worker of the thread pool, and one more for
+  // the calling thread. Slots are indices of ThreadPool::parallelFor(), so
+  // each one runs on one thread at a time, but one thread can run several
+  // slots (or none, e.g. while the pool is busy with other work), so these
+  // are only per-thread numbers if every thread took exactly one slot.
+  std::vector<TileSlotStats> slots;
+
+  // Adds the numbers of another run, e.g. to sum up several sample batches.
+  void add(const TileSchedulerStats& other);
+};
+
+// Splits a `width` x `height` image into tiles of at most `tileSize` x
+// `tileSize` pixels, and calls renderTile(tile) for each of them, spread over
+// the workers and the calling thread. Returns once all tiles are done.
+TileSchedulerStats parallelForTiles(uint32_t                                width,
+                                    uint32_t                                height,
+                                    uint32_t                                tileSize,
+                                    ThreadPool&                             threadPool,
+                                    const std::function<void(const Tile&)>& renderTile);
+
+// Logs how busy each slot was, and how many tiles it rendered and stole.
+void logTileSchedulerStats(const TileSchedulerStats& stats);
+
+#endif  // #ifndef VK_MINI_PATH_TRACER_TILE_SCHEDULER_H
@@ -0,0 +1,381 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+#include "triangleReorder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+#include <nvh/nvprint.hpp>
+
+#include "measurement.h"
+#include "sceneCache.h"
+#include "vertexWelder.h"
+
+namespace {
+
+// Number of triangles each task processes or sorts at once.
+const uint32_t k_blockSize = 1 << 16;
+
+// A range of triangles of one shape.
+struct TriangleBlock
+{
+  uint32_t shape;
+  uint32_t begin;  // Index of the first triangle, over all shapes
+  uint32_t end;
+};
+
+std::vector<TriangleBlock> makeTriangleBlocks(std::span<const SceneShape> shapes)
+{
+  std::vector<TriangleBlock> blocks;
+  for(uint32_t shapeIdx = 0; shapeIdx < shapes.size(); shapeIdx++)
+  {
+    const uint32_t first = shapes[shapeIdx].firstIndex / 3;
+    const uint32_t last  = first + shapes[shapeIdx].indexCount / 3;
+    for(uint32_t begin = first; begin < last; begin += k_blockSize)
+    {
+      blocks.push_back({.shape = shapeIdx, .begin = begin, .end = std::min(last, begin + k_blockSize)});
+    }
+  }
+  return blocks;
+}
+
+// Spreads the low 21 bits of `v` out so that there are two zero bits between each of them.
+uint64_t expandBits21(uint64_t v)
+{
+  v &= 0x1FFFFF;
+  v = (v | (v << 32)) & 0x1F00000000FFFFull;
+  v = (v | (v << 16)) & 0x1F0000FF0000FFull;
+  v = (v | (v << 8)) & 0x100F00F00F00F00Full;
+  v = (v | (v << 4)) & 0x10C30C30C30C30C3ull;
+  v = (v | (v << 2)) & 0x1249249249249249ull;
+  return v;
+}
+
+// Returns the 63-bit Morton code of a point, quantizing each coordinate to 21 bits within the given box.
+uint64_t mortonCode(const float point[3], const float boxMin[3], const float boxScale[3])
+{
+  uint64_t code = 0;
+  for(int c = 0; c < 3; c++)
+  {
+    const float    scaled    = std::clamp((point[c] - boxMin[c]) * boxScale[c], 0.0f, 2097151.0f);
+    const uint64_t quantized = std::isfinite(scaled) ? static_cast<uint64_t>(scaled) : 0;
+    code |= expandBits21(quantized) << c;
+  }
+  return code;
+}
+
+void triangleCentroid(const SceneGeometry& geometry, const SceneShape& shape, uint32_t localTriangle, float centroid[3])
+{
+  for(int c = 0; c < 3; c++)
+  {
+    centroid[c] = 0.0f;
+  }
+  for(uint32_t corner = 0; corner < 3; corner++)
+  {
+    const float* position = &geometry.positions[3 * static_cast<size_t>(geometry.vertexIndex(shape, 3 * localTriangle + corner))];
+    for(int c = 0; c < 3; c++)
+    {
+      centroid[c] += position[c] / 3.0f;
+    }
+  }
+}
+
+// Sorting by the first triangle of the shape first keeps every triangle
+// within its shape's range; the original index breaks ties, so that the
+// result doesn't depend on the sort's implementation.
+struct SortKey
+{
+  uint32_t shapeFirstTriangle;
+  uint32_t triangle;  // Index of the triangle in the input, over all shapes
+  uint64_t code;
+
+  bool operator<(const SortKey& other) const
+  {
+    if(shapeFirstTriangle != other.shapeFirstTriangle)
+    {
+      return shapeFirstTriangle < other.shapeFirstTriangle;
+    }
+    return (code != other.code) ? (code < other.code) : (triangle < other.triangle);
+  }
+};
+
+// Sorts blocks of keys on all threads, then merges pairs of sorted runs in
+// parallel until only one is left.
+void parallelSort(std::vector<SortKey>& keys, ThreadPool& pool)
+{
+  const size_t numKeys = keys.size();
+  pool.parallelFor((numKeys + k_blockSize - 1) / k_blockSize, [&](size_t block) {
+    std::sort(keys.begin() + block * k_blockSize, keys.begin() + std::min(numKeys, (block + 1) * k_blockSize));
+  });
+  for(size_t runLength = k_blockSize; runLength < numKeys; runLength *= 2)
+  {
+    pool.parallelFor((numKeys + 2 * runLength - 1) / (2 * runLength), [&](size_t pair) {
+      const size_t first = pair * 2 * runLength;
+      const size_t mid   = std::min(numKeys, first + runLength);
+      const size_t last  = std::min(numKeys, first + 2 * runLength);
+      std::inplace_merge(keys.begin() + first, keys.begin() + mid, keys.begin() + last);
+    });
+  }
+}
+
+}  // namespace
+
+void reorderSceneGeometry(const SceneGeometry& input, ThreadPool& pool, SceneGeometry& output)
+{
+  using Clock                       = std::chrono::steady_clock;
+  const Clock::time_point startTime = Clock::now();
+
+  // Compute each shape's bounding box of triangle centroids, which the
+  // Morton codes are relative to.
+  const std::span<const SceneShape> shapes = input.shapes;
+  std::vector<float>                shapeBoxes(6 * shapes.size());
+  pool.parallelFor(shapes.size(), [&](size_t shapeIdx) {
+    const SceneShape& shape  = shapes[shapeIdx];
+    float*            boxMin = &shapeBoxes[6 * shapeIdx];
+    float*            boxMax = boxMin + 3;
+    for(int c = 0; c < 3; c++)
+    {
+      boxMin[c] = std::numeric_limits<float>::infinity();
+      boxMax[c] = -std::numeric_limits<float>::infinity();
+    }
+    for(uint32_t triangle = 0; triangle < shape.indexCount / 3; triangle++)
+    {
+      float centroid[3];
+      triangleCentroid(input, shape, triangle, centroid);
+      for(int c = 0; c < 3; c++)
+      {
+        boxMin[c] = std::min(boxMin[c], centroid[c]);
+        boxMax[c] = std::max(boxMax[c], centroid[c]);
+      }
+    }
+    // From here on, the upper half holds the scale from box coordinates to 21-bit integers:
+    for(int c = 0; c < 3; c++)
+    {
+      const float extent = boxMax[c] - boxMin[c];
+      boxMax[c]          = (extent > 0.0f) ? 2097151.0f / extent : 0.0f;
+    }
+  });
+
+  // Sort the triangles of each shape by the Morton codes of their centroids.
+  const uint32_t             numTriangles = input.numTriangles();
+  const std::vector<TriangleBlock> blocks = makeTriangleBlocks(shapes);
+  std::vector<SortKey>       keys(numTriangles);
+  pool.parallelFor(blocks.size(), [&](size_t blockIdx) {
+    const TriangleBlock& block      = blocks[blockIdx];
+    const SceneShape&    shape      = shapes[block.shape];
+    const uint32_t       firstInShape = shape.firstIndex / 3;
+    for(uint32_t triangle = block.begin; triangle < block.end; triangle++)
+    {
+      float centroid[3];
+      triangleCentroid(input, shape, triangle - firstInShape, centroid);
+      keys[triangle] = {.shapeFirstTriangle = firstInShape,
+                        .triangle           = triangle,
+                        .code = mortonCode(centroid, &shapeBoxes[6 * block.shape], &shapeBoxes[6 * block.shape + 3])};
+    }
+  });
+  parallelSort(keys, pool);
+
+  // Gather the vertex indices, material IDs and source primitive IDs of the
+  // triangles in their new order. Each shape still covers the same range of
+  // triangles.
+  std::vector<uint32_t> cornerVertices(3 * static_cast<size_t>(numTriangles));
+  std::vector<int32_t>  materialIds(numTriangles);
+  std::vector<uint32_t> sourcePrimitives(numTriangles);
+  pool.parallelFor(blocks.size(), [&](size_t blockIdx) {
+    const TriangleBlock& block = blocks[blockIdx];
+    const SceneShape&    shape = shapes[block.shape];
+    for(uint32_t triangle = block.begin; triangle < block.end; triangle++)
+    {
+      const uint32_t source      = keys[triangle].triangle;
+      const uint32_t sourceLocal = source - shape.firstIndex / 3;
+      for(uint32_t corner = 0; corner < 3; corner++)
+      {
+        cornerVertices[3 * static_cast<size_t>(triangle) + corner] = input.vertexIndex(shape, 3 * sourceLocal + corner);
+      }
+      materialIds[triangle]      = input.materialIds[source];
+      sourcePrimitives[triangle] = input.sourcePrimitives.empty() ? sourceLocal : input.sourcePrimitives[source];
+    }
+  });
+
+  // Renumber vertices in order of first use, like weldSceneGeometry() does,
+  // so that each shape's vertices follow the new order of its triangles.
+  const uint32_t        unassigned = std::numeric_limits<uint32_t>::max();
+  std::vector<uint32_t> newIndex(input.numVertices(), unassigned);
+  std::vector<uint32_t> oldIndex;  // The inverse of newIndex
+  oldIndex.reserve(input.numVertices());
+  for(uint32_t& vertex : cornerVertices)
+  {
+    if(newIndex[vertex] == unassigned)
+    {
+      newIndex[vertex] = static_cast<uint32_t>(oldIndex.size());
+      oldIndex.push_back(vertex);
+    }
+    vertex = newIndex[vertex];
+  }
+  std::vector<float> positions(3 * oldIndex.size());
+  pool.parallelFor((oldIndex.size() + k_blockSize - 1) / k_blockSize, [&](size_t block) {
+    const size_t end = std::min(oldIndex.size(), (block + 1) * static_cast<size_t>(k_blockSize));
+    for(size_t v = block * k_blockSize; v < end; v++)
+    {
+      std::copy_n(&input.positions[3 * static_cast<size_t>(oldIndex[v])], 3, &positions[3 * v]);
+    }
+  });
+
+  std::vector<SceneShape> outputShapes(shapes.begin(), shapes.end());
+  std::vector<uint32_t>   indexWords;
+  packShapeIndices(cornerVertices, pool, outputShapes, indexWords);
+  output.setOwnedData(std::move(positions), std::move(indexWords), std::move(outputShapes), std::move(materialIds),
+                      std::move(sourcePrimitives));
+
+  LOGI("Reordered %u triangles of %zu shapes along Morton curves in %.3f ms.\n", numTriangles, shapes.size(),
+       millisecondsSince(startTime));
+}
+
+namespace {
+
+// The result of shading a list of hits.
+struct ShadingStats
+{
+  double milliseconds;
+  double cacheLinesPerGroup;  // Distinct 64-byte lines of index and vertex data per group of 32 hits
+  float  checksum;
+};
+
+// Does the loads and arithmetic of getObjectHitInfo() for each hit: reads 3
+// indices and 3 vertices, and computes a position and a normal.
+ShadingStats shadeHits(const SceneGeometry& geometry, std::span<const uint32_t> hitTriangles, std::span<const uint32_t> shapeOfTriangle)
+{
+  const auto shadeHit = [&](uint32_t triangle, auto&& onLoad) {
+    const SceneShape& shape = geometry.shapes[shapeOfTriangle[triangle]];
+    const uint32_t    local = triangle - shape.firstIndex / 3;
+    float             v[3][3];
+    for(uint32_t corner = 0; corner < 3; corner++)
+    {
+      const uint32_t indexCorner = 3 * local + corner;
+      onLoad(&geometry.indexWords[shape.firstIndexWord + ((shape.indexBits == 16) ? indexCorner / 2 : indexCorner)]);
+      const float* position = &geometry.positions[3 * static_cast<size_t>(geometry.vertexIndex(shape, indexCorner))];
+      onLoad(position);
+      std::copy_n(position, 3, v[corner]);
+    }
+    const float e1[3]  = {v[1][0] - v[0][0], v[1][1] - v[0][1], v[1][2] - v[0][2]};
+    const float e2[3]  = {v[2][0] - v[0][0], v[2][1] - v[0][1], v[2][2] - v[0][2]};
+    const float nz     = e1[0] * e2[1] - e1[1] * e2[0];
+    const float center = (v[0][0] + v[1][0] + v[2][0]) / 3.0f;
+    return nz + center;
+  };
+
+  ShadingStats stats{.milliseconds = std::numeric_limits<double>::max(), .cacheLinesPerGroup = 0.0, .checksum = 0.0f};
+  for(int rep = 0; rep < 3; rep++)
+  {
+    const auto startTime = std::chrono::steady_clock::now();
+    float      checksum  = 0.0f;
+    for(const uint32_t triangle : hitTriangles)
+    {
+      checksum += shadeHit(triangle, [](const void*) {});
+    }
+    stats.milliseconds = std::min(stats.milliseconds, millisecondsSince(startTime));
+    stats.checksum = checksum;
+  }
+
+  // Count the cache lines each group of 32 rays (one GPU warp) touches:
+  const size_t           groupSize = 32;
+  std::vector<uintptr_t> lines;
+  size_t                 totalLines = 0;
+  for(size_t groupStart = 0; groupStart < hitTriangles.size(); groupStart += groupSize)
+  {
+    lines.clear();
+    for(size_t hit = groupStart; hit < std::min(hitTriangles.size(), groupStart + groupSize); hit++)
+    {
+      shadeHit(hitTriangles[hit], [&lines](const void* address) { lines.push_back(reinterpret_cast<uintptr_t>(address) / 64); });
+    }
+    std::ranges::sort(lines);
+    totalLines += std::ranges::distance(lines.begin(), std::ranges::unique(lines).begin());
+  }
+  const size_t numGroups   = (hitTriangles.size() + groupSize - 1) / groupSize;
+  stats.cacheLinesPerGroup = (numGroups > 0) ? static_cast<double>(totalLines) / static_cast<double>(numGroups) : 0.0;
+  return stats;
+}
+
+}  // namespace
+
+void runReorderLocalityBenchmark(const std::string& objPath, bool weld, ThreadPool& pool)
+{
+  SceneGeometry original;
+  if(!loadSceneGeometry(objPath, false, weld, false, pool, original))
+  {
+    return;
+  }
+  SceneGeometry reordered;
+  reorderSceneGeometry(original, pool, reordered);
+
+  const uint32_t        numTriangles = original.numTriangles();
+  std::vector<uint32_t> shapeOfTriangle(numTriangles);
+  for(uint32_t shapeIdx = 0; shapeIdx < original.shapes.size(); shapeIdx++)
+  {
+    const SceneShape& shape = original.shapes[shapeIdx];
+    std::fill_n(shapeOfTriangle.begin() + shape.firstIndex / 3, shape.indexCount / 3, shapeIdx);
+  }
+
+  // Simulate coherent rays: an orthographic camera looks down the z axis at
+  // the whole scene through a 1024x1024 image, and each ray hits the
+  // triangles whose centroids fall into its pixel. Like GPUs do, rays are
+  // grouped into 8x4 tiles.
+  float boxMin[2] = {std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity()};
+  float boxMax[2] = {-std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity()};
+  std::vector<float> centroids(2 * static_cast<size_t>(numTriangles));
+  for(uint32_t triangle = 0; triangle < numTriangles; triangle++)
+  {
+    const SceneShape& shape = original.shapes[shapeOfTriangle[triangle]];
+    float             centroid[3];
+    triangleCentroid(original, shape, triangle - shape.firstIndex / 3, centroid);
+    for(int c = 0; c < 2; c++)
+    {
+      centroids[2 * static_cast<size_t>(triangle) + c] = centroid[c];
+      boxMin[c]                                         = std::min(boxMin[c], centroid[c]);
+      boxMax[c]                                         = std::max(boxMax[c], centroid[c]);
+    }
+  }
+  const uint32_t                          imageSize = 1024;
+  std::vector<std::pair<uint32_t, uint32_t>> rayOrder(numTriangles);  // (tile-major pixel index, triangle)
+  for(uint32_t triangle = 0; triangle < numTriangles; triangle++)
+  {
+    uint32_t pixel[2];
+    for(int c = 0; c < 2; c++)
+    {
+      const float extent = boxMax[c] - boxMin[c];
+      const float t      = (extent > 0.0f) ? (centroids[2 * static_cast<size_t>(triangle) + c] - boxMin[c]) / extent : 0.0f;
+      pixel[c]           = std::min(imageSize - 1, static_cast<uint32_t>(t * static_cast<float>(imageSize)));
+    }
+    const uint32_t tile      = (pixel[1] / 4) * (imageSize / 8) + pixel[0] / 8;
+    rayOrder[triangle] = {tile * 32 + (pixel[1] % 4) * 8 + pixel[0] % 8, triangle};
+  }
+  std::ranges::sort(rayOrder);
+
+  // The same hits, in terms of each geometry's triangle numbering:
+  std::vector<uint32_t> newTriangleOf(numTriangles);
+  for(uint32_t triangle = 0; triangle < numTriangles; triangle++)
+  {
+    const SceneShape& shape = reordered.shapes[shapeOfTriangle[triangle]];
+    newTriangleOf[shape.firstIndex / 3 + reordered.sourcePrimitives[triangle]] = triangle;
+  }
+  std::vector<uint32_t> originalHits(numTriangles), reorderedHits(numTriangles);
+  for(uint32_t hit = 0; hit < numTriangles; hit++)
+  {
+    originalHits[hit]  = rayOrder[hit].second;
+    reorderedHits[hit] = newTriangleOf[rayOrder[hit].second];
+  }
+
+  const ShadingStats before = shadeHits(original, originalHits, shapeOfTriangle);
+  const ShadingStats after  = shadeHits(reordered, reorderedHits, shapeOfTriangle);
+  LOGI("Triangle reordering locality proxy (simulated on the CPU): %s (%u triangles, %s)\n", objPath.c_str(), numTriangles, weld ? "welded" : "not welded");
+  LOGI("  Original order: %9.3f ms, %8.2f million hits/s, %6.2f cache lines per 32 hits\n", before.milliseconds,
+       numTriangles / (before.milliseconds * 1000.0), before.cacheLinesPerGroup);
+  LOGI("  Morton order:   %9.3f ms, %8.2f million hits/s, %6.2f cache lines per 32 hits\n", after.milliseconds,
+       numTriangles / (after.milliseconds * 1000.0), after.cacheLinesPerGroup);
+  if(std::abs(before.checksum - after.checksum) > 1e-3f * std::max(1.0f, std::abs(before.checksum)))
+  {
+    LOGW("  Checksums differ (%f vs. %f); the reordered geometry doesn't match the original.\n", before.checksum, after.checksum);
+  }
+}
@@ -0,0 +1,37 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+// Load-time reordering of triangles and vertices for memory locality. OBJ
+// exporters write triangles in whatever order they were modeled in, so
+// triangles that are close together in space are often far apart in the
+// index buffer. Neighboring rays usually hit neighboring triangles, so the
+// index and vertex loads in closest-hit shaders then touch many different
+// cache lines.
+//
+// This sorts the triangles of each shape along a Morton (Z-order) curve
+// through their centroids, then renumbers vertices in order of first use, so
+// that nearby triangles have nearby indices and vertices. Shaders see the new
+// primitive IDs; `SceneGeometry::sourcePrimitives` maps them back to the
+// original ones for shaders that depend on them (such as material7).
+#ifndef VK_MINI_PATH_TRACER_TRIANGLE_REORDER_H
+#define VK_MINI_PATH_TRACER_TRIANGLE_REORDER_H
+
+#include <string>
+
+#include "sceneGeometry.h"
+#include "threadPool.h"
+
+// Reorders the triangles of each shape of `input` and renumbers its vertices
+// into `output`. Shapes keep their order and triangle ranges, and each
+// triangle keeps its material ID.
+void reorderSceneGeometry(const SceneGeometry& input, ThreadPool& pool, SceneGeometry& output);
+
+// --bench-reorder-locality: simulates on the CPU the index and vertex loads
+// closest-hit shaders make for coherent rays on `objPath`, before and after
+// reordering, and logs how many cache lines each group of 32 rays touches
+// and how fast the CPU makes the loads. This is a proxy for memory locality,
+// not a measurement of GPU shading: for that, compare the paths/s of renders
+// with and without --no-reorder.
+void runReorderLocalityBenchmark(const std::string& objPath, bool weld, ThreadPool& pool);
+
+#endif  // #ifndef VK_MINI_PATH_TRACER_TRIANGLE_REORDER_H
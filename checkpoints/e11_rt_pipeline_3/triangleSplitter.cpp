@@ -0,0 +1,308 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+#include "triangleSplitter.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <unordered_map>
+
+#include <nvh/nvprint.hpp>
+
+#include "measurement.h"
+#include "vertexWelder.h"
+
+namespace {
+
+// Only split triangles whose box has at least this many times the surface
+// area of the triangle itself (counting both sides). The box of an
+// axis-aligned right triangle has 2 times its area, and splitting it wouldn't
+// make the boxes any tighter.
+const float k_minLooseness = 4.0f;
+// Each round splits every chosen triangle once. Halving a long, thin
+// triangle can leave one half just as loose, so it may take a few rounds
+// until the pieces are tight.
+const uint32_t k_maxRounds = 8;
+
+// The triangles of one shape while they're being split.
+struct ShapeTriangles
+{
+  std::vector<uint32_t> corners;    // 3 vertex indices per triangle, over all shapes
+  std::vector<uint32_t> sources;    // The primitive ID each triangle had in the OBJ file, within its shape
+  std::vector<int32_t>  materials;  // OBJ material ID of each triangle
+};
+
+// A triangle worth splitting at its longest edge.
+struct Candidate
+{
+  float    wastedArea;  // Surface area of its box minus that of the triangle
+  uint32_t shape;
+  uint32_t triangle;  // Within its shape
+  uint32_t edge;      // Edge i goes from corner i to corner (i + 1) % 3
+};
+
+float boxSurfaceArea(const float* a, const float* b, const float* c)
+{
+  float extent[3];
+  for(int i = 0; i < 3; i++)
+  {
+    extent[i] = std::max({a[i], b[i], c[i]}) - std::min({a[i], b[i], c[i]});
+  }
+  return 2.0f * (extent[0] * extent[1] + extent[1] * extent[2] + extent[2] * extent[0]);
+}
+
+float squaredDistance(const float* a, const float* b)
+{
+  const float d[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+  return d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+}
+
+uint64_t edgeKey(uint32_t a, uint32_t b)
+{
+  return (static_cast<uint64_t>(std::min(a, b)) << 32) | std::max(a, b);
+}
+
+// Returns the candidate for splitting `triangle` of a shape at its longest
+// edge, with no wasted area if its box is tight enough.
+Candidate makeCandidate(const std::vector<float>& positions, const uint32_t* corners, uint32_t shape, uint32_t triangle)
+{
+  const float* v[3] = {&positions[3 * static_cast<size_t>(corners[0])], &positions[3 * static_cast<size_t>(corners[1])],
+                       &positions[3 * static_cast<size_t>(corners[2])]};
+  uint32_t     edge = 0;
+  for(uint32_t i = 1; i < 3; i++)
+  {
+    if(squaredDistance(v[i], v[(i + 1) % 3]) > squaredDistance(v[edge], v[(edge + 1) % 3]))
+    {
+      edge = i;
+    }
+  }
+  const float e1[3]        = {v[1][0] - v[0][0], v[1][1] - v[0][1], v[1][2] - v[0][2]};
+  const float e2[3]        = {v[2][0] - v[0][0], v[2][1] - v[0][1], v[2][2] - v[0][2]};
+  const float normal[3]    = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+  const float twoSidedArea = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+  const float boxArea      = boxSurfaceArea(v[0], v[1], v[2]);
+  const bool  loose        = boxArea > k_minLooseness * twoSidedArea;
+  return {.wastedArea = loose ? boxArea - twoSidedArea : 0.0f, .shape = shape, .triangle = triangle, .edge = edge};
+}
+
+// Appends triangle (v0, v1, v2) to `out`, split at each of its edges that has
+// a midpoint. The new edges end at new vertices, so this splits at most 3 times.
+void appendSplit(const std::unordered_map<uint64_t, uint32_t>& midpoints,
+                 uint32_t                                      v0,
+                 uint32_t                                      v1,
+                 uint32_t                                      v2,
+                 uint32_t                                      source,
+                 int32_t                                       material,
+                 ShapeTriangles&                               out)
+{
+  const uint32_t v[3] = {v0, v1, v2};
+  for(uint32_t edge = 0; edge < 3; edge++)
+  {
+    const auto midpoint = midpoints.find(edgeKey(v[edge], v[(edge + 1) % 3]));
+    if(midpoint != midpoints.end())
+    {
+      // Both halves keep the triangle's winding order.
+      appendSplit(midpoints, v[edge], midpoint->second, v[(edge + 2) % 3], source, material, out);
+      appendSplit(midpoints, midpoint->second, v[(edge + 1) % 3], v[(edge + 2) % 3], source, material, out);
+      return;
+    }
+  }
+  out.corners.insert(out.corners.end(), {v0, v1, v2});
+  out.sources.push_back(source);
+  out.materials.push_back(material);
+}
+
+}  // namespace
+
+void splitSceneTriangles(const SceneGeometry& input, uint32_t maxExtraTriangles, ThreadPool& pool, SceneGeometry& output)
+{
+  using Clock                       = std::chrono::steady_clock;
+  const Clock::time_point startTime = Clock::now();
+
+  // Gather each shape's triangles, with global vertex indices, so that edges
+  // that shapes share get split the same way on both sides.
+  const std::span<const SceneShape> shapes = input.shapes;
+  std::vector<float>                positions(input.positions.begin(), input.positions.end());
+  std::vector<ShapeTriangles>       triangles(shapes.size());
+  pool.parallelFor(shapes.size(), [&](size_t shapeIdx) {
+    const SceneShape& shape = shapes[shapeIdx];
+    ShapeTriangles&   out   = triangles[shapeIdx];
+    for(uint32_t triangle = 0; triangle < shape.indexCount / 3; triangle++)
+    {
+      for(uint32_t corner = 0; corner < 3; corner++)
+      {
+        out.corners.push_back(input.vertexIndex(shape, 3 * triangle + corner));
+      }
+      const uint32_t global = shape.firstIndex / 3 + triangle;
+      out.sources.push_back(input.sourcePrimitives.empty() ? triangle : input.sourcePrimitives[global]);
+      out.materials.push_back(input.materialIds[global]);
+    }
+  });
+
+  // The sum of the triangles' box surface areas, which is what splitting reduces.
+  const auto totalBoxArea = [&]() {
+    std::vector<double> shapeAreas(shapes.size(), 0.0);
+    pool.parallelFor(shapes.size(), [&](size_t shapeIdx) {
+      const std::vector<uint32_t>& corners = triangles[shapeIdx].corners;
+      for(size_t corner = 0; corner < corners.size(); corner += 3)
+      {
+        shapeAreas[shapeIdx] += boxSurfaceArea(&positions[3 * static_cast<size_t>(corners[corner])],
+                                               &positions[3 * static_cast<size_t>(corners[corner + 1])],
+                                               &positions[3 * static_cast<size_t>(corners[corner + 2])]);
+      }
+    });
+    return std::accumulate(shapeAreas.begin(), shapeAreas.end(), 0.0);
+  };
+  const double areaBefore = totalBoxArea();
+
+  // Splitting an edge adds one triangle for each triangle that uses it: 2 for
+  // edges inside a manifold mesh, 1 on its boundary, and more for
+  // non-manifold edges. Rounds choose edges assuming 2, then count.
+  uint32_t remaining = maxExtraTriangles;
+  uint32_t numRounds = 0;
+  for(; numRounds < k_maxRounds && remaining >= 2; numRounds++)
+  {
+    std::vector<std::vector<Candidate>> shapeCandidates(shapes.size());
+    pool.parallelFor(shapes.size(), [&](size_t shapeIdx) {
+      const std::vector<uint32_t>& corners = triangles[shapeIdx].corners;
+      for(uint32_t triangle = 0; triangle < corners.size() / 3; triangle++)
+      {
+        const Candidate candidate = makeCandidate(positions, &corners[3 * static_cast<size_t>(triangle)],
+                                                  static_cast<uint32_t>(shapeIdx), triangle);
+        if(candidate.wastedArea > 0.0f)
+        {
+          shapeCandidates[shapeIdx].push_back(candidate);
+        }
+      }
+    });
+    std::vector<Candidate> candidates;
+    for(const std::vector<Candidate>& shapeList : shapeCandidates)
+    {
+      candidates.insert(candidates.end(), shapeList.begin(), shapeList.end());
+    }
+    // Most wasted area first; the stable sort keeps the result independent of the thread count.
+    std::stable_sort(candidates.begin(), candidates.end(),
+                     [](const Candidate& a, const Candidate& b) { return a.wastedArea > b.wastedArea; });
+
+    // Add a vertex at the midpoint of each chosen edge. Edge i gets vertex
+    // firstMidpoint + i.
+    const uint32_t                         firstMidpoint = static_cast<uint32_t>(positions.size() / 3);
+    std::vector<uint64_t>                  chosenEdges;
+    std::unordered_map<uint64_t, uint32_t> midpoints;
+    for(const Candidate& candidate : candidates)
+    {
+      if(2 * (chosenEdges.size() + 1) > remaining)
+      {
+        break;
+      }
+      const uint32_t* corners = &triangles[candidate.shape].corners[3 * static_cast<size_t>(candidate.triangle)];
+      const uint32_t  a       = corners[candidate.edge];
+      const uint32_t  b       = corners[(candidate.edge + 1) % 3];
+      if(midpoints.try_emplace(edgeKey(a, b), static_cast<uint32_t>(positions.size() / 3)).second)
+      {
+        for(int c = 0; c < 3; c++)
+        {
+          positions.push_back(0.5f * (positions[3 * static_cast<size_t>(a) + c] + positions[3 * static_cast<size_t>(b) + c]));
+        }
+        chosenEdges.push_back(edgeKey(a, b));
+      }
+    }
+
+    // Count the triangles that use each chosen edge, and keep the edges in
+    // order for as long as the budget covers what they really cost.
+    std::vector<std::vector<uint32_t>> shapeEdgeUses(shapes.size());
+    pool.parallelFor(shapes.size(), [&](size_t shapeIdx) {
+      const std::vector<uint32_t>& corners = triangles[shapeIdx].corners;
+      for(size_t corner = 0; corner < corners.size(); corner++)
+      {
+        const size_t next     = (corner % 3 == 2) ? corner - 2 : corner + 1;
+        const auto   midpoint = midpoints.find(edgeKey(corners[corner], corners[next]));
+        if(midpoint != midpoints.end())
+        {
+          shapeEdgeUses[shapeIdx].push_back(midpoint->second - firstMidpoint);
+        }
+      }
+    });
+    std::vector<uint32_t> edgeUses(chosenEdges.size(), 0);
+    for(const std::vector<uint32_t>& uses : shapeEdgeUses)
+    {
+      for(uint32_t edge : uses)
+      {
+        edgeUses[edge]++;
+      }
+    }
+    size_t numKept = 0;
+    for(; numKept < chosenEdges.size() && edgeUses[numKept] <= remaining; numKept++)
+    {
+      remaining -= edgeUses[numKept];
+    }
+    for(size_t edge = numKept; edge < chosenEdges.size(); edge++)
+    {
+      midpoints.erase(chosenEdges[edge]);
+    }
+    positions.resize(3 * (static_cast<size_t>(firstMidpoint) + numKept));
+    if(midpoints.empty())
+    {
+      break;
+    }
+
+    // Replace every triangle with an edge that has a midpoint by its pieces,
+    // in place, so that triangles stay in roughly the same order.
+    pool.parallelFor(shapes.size(), [&](size_t shapeIdx) {
+      const ShapeTriangles& in = triangles[shapeIdx];
+      ShapeTriangles        out;
+      for(size_t triangle = 0; triangle < in.sources.size(); triangle++)
+      {
+        appendSplit(midpoints, in.corners[3 * triangle], in.corners[3 * triangle + 1], in.corners[3 * triangle + 2],
+                    in.sources[triangle], in.materials[triangle], out);
+      }
+      triangles[shapeIdx] = std::move(out);
+    });
+  }
+  const double areaAfter = totalBoxArea();
+
+  // Lay the shapes' triangles out one after another.
+  std::vector<SceneShape> outputShapes(shapes.begin(), shapes.end());
+  std::vector<uint32_t>   cornerVertices;
+  std::vector<int32_t>    materialIds;
+  std::vector<uint32_t>   sourcePrimitives;
+  for(size_t shapeIdx = 0; shapeIdx < shapes.size(); shapeIdx++)
+  {
+    const ShapeTriangles& shapeTriangles = triangles[shapeIdx];
+    outputShapes[shapeIdx].firstIndex    = static_cast<uint32_t>(cornerVertices.size());
+    outputShapes[shapeIdx].indexCount    = static_cast<uint32_t>(shapeTriangles.corners.size());
+    cornerVertices.insert(cornerVertices.end(), shapeTriangles.corners.begin(), shapeTriangles.corners.end());
+    materialIds.insert(materialIds.end(), shapeTriangles.materials.begin(), shapeTriangles.materials.end());
+    sourcePrimitives.insert(sourcePrimitives.end(), shapeTriangles.sources.begin(), shapeTriangles.sources.end());
+  }
+
+  // New vertices were added after all others, so renumber vertices in order
+  // of first use, like reorderSceneGeometry() does, to keep each shape's
+  // range of vertices compact.
+  const uint32_t        unassigned = std::numeric_limits<uint32_t>::max();
+  std::vector<uint32_t> newIndex(positions.size() / 3, unassigned);
+  std::vector<float>    outputPositions;
+  outputPositions.reserve(positions.size());
+  for(uint32_t& vertex : cornerVertices)
+  {
+    if(newIndex[vertex] == unassigned)
+    {
+      newIndex[vertex] = static_cast<uint32_t>(outputPositions.size() / 3);
+      const auto position = positions.begin() + 3 * static_cast<size_t>(vertex);
+      outputPositions.insert(outputPositions.end(), position, position + 3);
+    }
+    vertex = newIndex[vertex];
+  }
+
+  std::vector<uint32_t> indexWords;
+  packShapeIndices(cornerVertices, pool, outputShapes, indexWords);
+  const uint32_t numTriangles = static_cast<uint32_t>(materialIds.size());
+  output.setOwnedData(std::move(outputPositions), std::move(indexWords), std::move(outputShapes), std::move(materialIds),
+                      std::move(sourcePrimitives));
+
+  LOGI("Split %u triangles into %u (%u round(s)) in %.3f ms; the total surface area of their boxes shrank by %.1f%%.\n",
+       input.numTriangles(), numTriangles, numRounds, millisecondsSince(startTime),
+       (areaBefore > 0.0) ? 100.0 * (areaBefore - areaAfter) / areaBefore : 0.0);
+}
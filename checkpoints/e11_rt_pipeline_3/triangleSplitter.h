@@ -0,0 +1,39 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+// Load-time pre-splitting of triangles with loose bounding boxes. The BLAS
+// builder bounds each triangle with an axis-aligned box, so long, thin
+// triangles that lie diagonally to the axes (floors and walls of
+// architectural scenes, for instance) get boxes that are mostly empty, and
+// rays traverse into them without hitting anything.
+//
+// This splits such triangles at the midpoint of their longest edge, over a
+// few rounds, until their boxes are tight compared to their area; the surface
+// area of the boxes is the surface area heuristic's estimate of how often
+// rays visit them. It picks the triangles whose boxes waste the most area
+// first, and stops at a budget of extra triangles. Neighboring triangles that
+// share a split edge are split too, so that the mesh stays watertight without
+// T-junctions.
+//
+// Triangles share an edge only if they share both of its vertex indices, so
+// this only keeps meshes watertight if their vertices are welded (see
+// vertexWelder.h); otherwise, splitting an edge on one side of a seam opens a
+// crack. Each split edge costs one extra triangle for every triangle that
+// uses it, which is 2 in a manifold mesh, but can be more for non-manifold
+// edges; the budget accounts for the actual count.
+//
+// Split triangles keep their material ID, and `SceneGeometry::sourcePrimitives`
+// maps every new triangle to the primitive it came from, so shaders that
+// depend on primitive IDs see the original ones (see triangleReorder.h).
+#ifndef VK_MINI_PATH_TRACER_TRIANGLE_SPLITTER_H
+#define VK_MINI_PATH_TRACER_TRIANGLE_SPLITTER_H
+
+#include "sceneGeometry.h"
+#include "threadPool.h"
+
+// Splits triangles of `input` into `output`, adding at most
+// `maxExtraTriangles` triangles, and logs how much this shrank the total
+// surface area of the triangles' bounding boxes. Shapes keep their order.
+void splitSceneTriangles(const SceneGeometry& input, uint32_t maxExtraTriangles, ThreadPool& pool, SceneGeometry& output);
+
+#endif  // #ifndef VK_MINI_PATH_TRACER_TRIANGLE_SPLITTER_H
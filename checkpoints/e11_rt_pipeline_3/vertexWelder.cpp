@@ -0,0 +1,226 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+#include "vertexWelder.h"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <unordered_map>
+
+#include <nvh/nvprint.hpp>
+
+#include "measurement.h"
+
+namespace {
+
+// Number of vertices each task hashes or scatters at once.
+const size_t k_vertexBlockSize = 1 << 16;
+
+// The bit patterns of a position, with -0 replaced by +0 so that both weld together.
+struct PositionKey
+{
+  uint32_t bits[3];
+
+  bool operator==(const PositionKey&) const = default;
+};
+
+PositionKey makePositionKey(const float* position)
+{
+  PositionKey key;
+  for(int c = 0; c < 3; c++)
+  {
+    const float value = (position[c] == 0.0f) ? 0.0f : position[c];
+    memcpy(&key.bits[c], &value, sizeof(float));
+  }
+  return key;
+}
+
+struct PositionKeyHash
+{
+  size_t operator()(const PositionKey& key) const
+  {
+    uint64_t hash = key.bits[0];
+    hash          = hash * 0x9E3779B97F4A7C15ull + key.bits[1];
+    hash          = hash * 0x9E3779B97F4A7C15ull + key.bits[2];
+    // Final mix (from MurmurHash3's fmix64), so that the top bits depend on all inputs:
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDull;
+    hash ^= hash >> 33;
+    return static_cast<size_t>(hash);
+  }
+};
+
+// Returns, for each vertex, the index of the first vertex with the same
+// position. Vertices are partitioned by hash so that each partition can be
+// deduplicated on its own thread.
+std::vector<uint32_t> findCanonicalVertices(std::span<const float> positions, ThreadPool& pool)
+{
+  const size_t numVertices   = positions.size() / 3;
+  const size_t numBlocks     = (numVertices + k_vertexBlockSize - 1) / k_vertexBlockSize;
+  const size_t numPartitions = std::min<size_t>(256, std::bit_ceil(4 * (static_cast<size_t>(pool.numThreads()) + 1)));
+  const int    partitionBits = std::countr_zero(numPartitions);
+  const auto   blockRange    = [numVertices](size_t block) {
+    return std::make_pair(block * k_vertexBlockSize, std::min(numVertices, (block + 1) * k_vertexBlockSize));
+  };
+
+  // Hash every vertex, and count how many vertices of each block go to each partition.
+  std::vector<uint8_t>  partitionOf(numVertices);
+  std::vector<uint32_t> blockCounts(numBlocks * numPartitions, 0);
+  pool.parallelFor(numBlocks, [&](size_t block) {
+    const auto [begin, end] = blockRange(block);
+    for(size_t v = begin; v < end; v++)
+    {
+      const uint64_t hash = PositionKeyHash()(makePositionKey(&positions[3 * v]));
+      partitionOf[v]      = static_cast<uint8_t>(partitionBits == 0 ? 0 : hash >> (64 - partitionBits));
+      blockCounts[block * numPartitions + partitionOf[v]]++;
+    }
+  });
+
+  // Prefix sums give each (partition, block) pair its place in `partitioned`.
+  // Within a partition, vertices stay in increasing order.
+  std::vector<size_t> partitionStarts(numPartitions + 1, 0);
+  std::vector<size_t> blockOffsets(numBlocks * numPartitions);
+  size_t              offset = 0;
+  for(size_t partition = 0; partition < numPartitions; partition++)
+  {
+    partitionStarts[partition] = offset;
+    for(size_t block = 0; block < numBlocks; block++)
+    {
+      blockOffsets[block * numPartitions + partition] = offset;
+      offset += blockCounts[block * numPartitions + partition];
+    }
+  }
+  partitionStarts[numPartitions] = offset;
+
+  std::vector<uint32_t> partitioned(numVertices);
+  pool.parallelFor(numBlocks, [&](size_t block) {
+    const auto [begin, end] = blockRange(block);
+    size_t* nextOffset      = &blockOffsets[block * numPartitions];
+    for(size_t v = begin; v < end; v++)
+    {
+      partitioned[nextOffset[partitionOf[v]]++] = static_cast<uint32_t>(v);
+    }
+  });
+
+  // Deduplicate each partition with its own hash table.
+  std::vector<uint32_t> canonical(numVertices);
+  pool.parallelFor(numPartitions, [&](size_t partition) {
+    const size_t begin = partitionStarts[partition], end = partitionStarts[partition + 1];
+    std::unordered_map<PositionKey, uint32_t, PositionKeyHash> firstWithPosition;
+    firstWithPosition.reserve(end - begin);
+    for(size_t i = begin; i < end; i++)
+    {
+      const uint32_t v  = partitioned[i];
+      const auto     it = firstWithPosition.try_emplace(makePositionKey(&positions[3 * v]), v).first;
+      canonical[v]      = it->second;
+    }
+  });
+  return canonical;
+}
+
+}  // namespace
+
+void packShapeIndices(std::span<const uint32_t> cornerVertices, ThreadPool& pool, std::vector<SceneShape>& shapes, std::vector<uint32_t>& indexWords)
+{
+  // Each shape's indices are relative to the lowest vertex it uses. If its
+  // range of vertices fits in 16 bits, we store two indices per word.
+  pool.parallelFor(shapes.size(), [&](size_t shapeIdx) {
+    SceneShape&                     shape   = shapes[shapeIdx];
+    const std::span<const uint32_t> corners = cornerVertices.subspan(shape.firstIndex, shape.indexCount);
+    const auto [minVertex, maxVertex]       = std::ranges::minmax(corners);
+    shape.firstVertex = corners.empty() ? 0 : minVertex;
+    shape.vertexCount = corners.empty() ? 0 : maxVertex - minVertex + 1;
+    shape.indexBits   = (shape.vertexCount <= 65536) ? 16 : 32;
+  });
+  uint32_t numIndexWords = 0;
+  for(SceneShape& shape : shapes)
+  {
+    shape.firstIndexWord = numIndexWords;
+    numIndexWords += (shape.indexBits == 16) ? (shape.indexCount + 1) / 2 : shape.indexCount;
+  }
+
+  indexWords.assign(numIndexWords, 0);
+  pool.parallelFor(shapes.size(), [&](size_t shapeIdx) {
+    const SceneShape& shape   = shapes[shapeIdx];
+    const uint32_t*   corners = &cornerVertices[shape.firstIndex];
+    uint32_t*         out     = &indexWords[shape.firstIndexWord];
+    if(shape.indexBits == 16)
+    {
+      // Two indices per word, low half first; an odd last index is padded with 0.
+      for(uint32_t corner = 0; corner < shape.indexCount; corner += 2)
+      {
+        const uint32_t low  = corners[corner] - shape.firstVertex;
+        const uint32_t high = (corner + 1 < shape.indexCount) ? corners[corner + 1] - shape.firstVertex : 0;
+        out[corner / 2]     = low | (high << 16);
+      }
+    }
+    else
+    {
+      for(uint32_t corner = 0; corner < shape.indexCount; corner++)
+      {
+        out[corner] = corners[corner] - shape.firstVertex;
+      }
+    }
+  });
+}
+
+void weldSceneGeometry(const SceneGeometry& input, ThreadPool& pool, SceneGeometry& output)
+{
+  using Clock                       = std::chrono::steady_clock;
+  const Clock::time_point startTime = Clock::now();
+
+  const std::vector<uint32_t> canonical = findCanonicalVertices(input.positions, pool);
+
+  // Renumber the welded vertices in order of first use, going through the
+  // shapes in order. Since OBJ files usually define each object's vertices
+  // right before its faces, this gives most shapes a small, contiguous range
+  // of vertices. Vertices shared between shapes aren't duplicated, and unused
+  // vertices are dropped.
+  const uint32_t        unassigned = std::numeric_limits<uint32_t>::max();
+  std::vector<uint32_t> newIndex(input.numVertices(), unassigned);
+  std::vector<uint32_t> oldIndex;  // The inverse of newIndex
+  std::vector<uint32_t> cornerVertices(3 * static_cast<size_t>(input.numTriangles()));
+  oldIndex.reserve(input.numVertices());
+  for(const SceneShape& shape : input.shapes)
+  {
+    for(uint32_t corner = 0; corner < shape.indexCount; corner++)
+    {
+      const uint32_t vertex = canonical[input.vertexIndex(shape, corner)];
+      if(newIndex[vertex] == unassigned)
+      {
+        newIndex[vertex] = static_cast<uint32_t>(oldIndex.size());
+        oldIndex.push_back(vertex);
+      }
+      cornerVertices[shape.firstIndex + corner] = newIndex[vertex];
+    }
+  }
+
+  std::vector<float> positions(3 * oldIndex.size());
+  pool.parallelFor((oldIndex.size() + k_vertexBlockSize - 1) / k_vertexBlockSize, [&](size_t block) {
+    const size_t end = std::min(oldIndex.size(), (block + 1) * k_vertexBlockSize);
+    for(size_t v = block * k_vertexBlockSize; v < end; v++)
+    {
+      std::copy_n(&input.positions[3 * static_cast<size_t>(oldIndex[v])], 3, &positions[3 * v]);
+    }
+  });
+
+  std::vector<SceneShape> shapes(input.shapes.begin(), input.shapes.end());
+  std::vector<uint32_t>   indexWords;
+  packShapeIndices(cornerVertices, pool, shapes, indexWords);
+  const uint32_t num16BitShapes = static_cast<uint32_t>(std::ranges::count(shapes, 16u, &SceneShape::indexBits));
+
+  const size_t inputVertexBytes = input.positions.size_bytes(), inputIndexBytes = input.indexWords.size_bytes();
+  const size_t outputVertexBytes = positions.size() * sizeof(float), outputIndexBytes = indexWords.size() * sizeof(uint32_t);
+  const uint32_t numShapes = static_cast<uint32_t>(shapes.size());
+  output.setOwnedData(std::move(positions), std::move(indexWords), std::move(shapes),
+                      std::vector<int32_t>(input.materialIds.begin(), input.materialIds.end()),
+                      std::vector<uint32_t>(input.sourcePrimitives.begin(), input.sourcePrimitives.end()));
+
+  LOGI("Welded %u vertices into %u in %.3f ms; %u of %u shapes use 16-bit indices.\n", input.numVertices(),
+       output.numVertices(), millisecondsSince(startTime), num16BitShapes, numShapes);
+  LOGI("  Vertex data: %.3f MB -> %.3f MB. Index data: %.3f MB -> %.3f MB. Saved %.3f MB in total.\n", toMB(inputVertexBytes),
+       toMB(outputVertexBytes), toMB(inputIndexBytes), toMB(outputIndexBytes),
+       toMB(inputVertexBytes + inputIndexBytes) - toMB(outputVertexBytes + outputIndexBytes));
+}
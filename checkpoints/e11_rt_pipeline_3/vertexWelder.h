@@ -0,0 +1,28 @@
+// Copyright 2020-2024 NVIDIA Corporation
+// SPDX-License-Identifier: Apache-2.0
+
+// Load-time vertex welding. OBJ exports often repeat the same position under
+// several vertex indices, and all shapes of an OBJ file index one shared
+// vertex array. Welding merges vertices with identical positions, makes each
+// shape's indices relative to the lowest vertex it uses, and stores them as
+// 16-bit values whenever the shape's range of vertices fits in 65536. This
+// halves the size of most index buffers, and lets BLAS builds use
+// VK_INDEX_TYPE_UINT16.
+#ifndef VK_MINI_PATH_TRACER_VERTEX_WELDER_H
+#define VK_MINI_PATH_TRACER_VERTEX_WELDER_H
+
+#include "sceneGeometry.h"
+#include "threadPool.h"
+
+// Welds the vertices of `input` into `output`, and logs how much vertex and
+// index memory this saved. Positions are merged if they're bitwise identical
+// (treating -0 and +0 as the same). Triangles and shapes keep their order, so
+// primitive IDs and material IDs don't change.
+void weldSceneGeometry(const SceneGeometry& input, ThreadPool& pool, SceneGeometry& output);
+
+// Given the vertex index of every triangle corner (over all shapes), sets the
+// vertex range and index size of each shape in `shapes`, and packs their
+// indices into `indexWords`. Other passes that renumber vertices use this too.
+void packShapeIndices(std::span<const uint32_t> cornerVertices, ThreadPool& pool, std::vector<SceneShape>& shapes, std::vector<uint32_t>& indexWords);
+
+#endif  // #ifndef VK_MINI_PATH_TRACER_VERTEX_WELDER_H